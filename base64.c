@@ -27,6 +27,13 @@
 /* Pair of functions to convert to/from base64.
  * Also can be used to build a standalone utility and a loopback test.
  * see http://www.faqs.org/rfcs/rfc3548.html
+ *
+ * The bulk of each conversion is done by a SIMD kernel when the CPU has one
+ * (SSE4.1 or AVX2 on x86, NEON on 64 bit ARM), picked at runtime on first
+ * use. Kernels only ever handle whole blocks of plain base64, the scalar code
+ * below does the rest: tails, padding and the newlines IDSetBLOB() puts
+ * every 72 chars. With setBase64Kernel("scalar") it does everything, which
+ * is the reference the kernels are tested against.
  */
 
 /** \file base64.c
@@ -36,10 +43,325 @@
 
 #include <ctype.h>
 #include <stdint.h>
+#include <string.h>
 #include "base64.h"
 #include "base64_luts.h"
 #include <stdio.h>
 
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define BASE64_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define BASE64_NEON
+#include <arm_neon.h>
+#endif
+
+/* one set of bulk conversion kernels.
+ * enc converts whole blocks of in to base64 at out, returns bytes of in used,
+ *   always a multiple of 3.
+ * dec converts whole blocks of base64 at in to out until it meets anything
+ *   else, returns chars of in used, always a multiple of 4. it may write up
+ *   to one block past what it converts, so it leaves at least one block
+ *   of in alone.
+ */
+typedef struct
+{
+    const char *name;
+    size_t (*enc)(unsigned char *out, const unsigned char *in, size_t inlen);
+    size_t (*dec)(char *out, const char *in, size_t inlen);
+} Base64Kernel;
+
+static size_t enc_scalar(unsigned char *out, const unsigned char *in, size_t inlen)
+{
+    (void)out;
+    (void)in;
+    (void)inlen;
+    return 0;
+}
+
+static size_t dec_scalar(char *out, const char *in, size_t inlen)
+{
+    (void)out;
+    (void)in;
+    (void)inlen;
+    return 0;
+}
+
+#ifdef BASE64_X86
+/* the x86 kernels follow Wojciech Mula and Daniel Lemire, "Faster Base64
+ * Encoding and Decoding using AVX2 Instructions", as done in aklomp/base64.
+ */
+
+/* 12 bytes -> 16 chars per block, reads 16 */
+__attribute__((target("sse4.1")))
+static size_t enc_sse41(unsigned char *out, const unsigned char *in, size_t inlen)
+{
+    const __m128i shuf   = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m128i lut    = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    size_t done          = 0;
+
+    for (; inlen - done >= 16; done += 12, out += 16)
+    {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + done)), shuf);
+        __m128i t0, t1, idx;
+
+        /* spread each 3 bytes into 4 6-bit indices */
+        t0 = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+        t1 = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+        v  = _mm_or_si128(t0, t1);
+
+        /* index -> ascii by adding an offset picked by range */
+        idx = _mm_subs_epu8(v, _mm_set1_epi8(51));
+        idx = _mm_sub_epi8(idx, _mm_cmpgt_epi8(v, _mm_set1_epi8(25)));
+        _mm_storeu_si128((__m128i *)out, _mm_add_epi8(v, _mm_shuffle_epi8(lut, idx)));
+    }
+
+    return done;
+}
+
+/* 16 chars -> 12 bytes per block, writes 16 */
+__attribute__((target("sse4.1")))
+static size_t dec_sse41(char *out, const char *in, size_t inlen)
+{
+    const __m128i lut_lo  = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B,
+                                          0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi  = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                          0x10, 0x10, 0x10);
+    const __m128i lut_rol = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i pack    = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m128i m2f     = _mm_set1_epi8(0x2F);
+    size_t done           = 0;
+
+    for (; inlen - done >= 32; done += 16, out += 12)
+    {
+        __m128i v  = _mm_loadu_si128((const __m128i *)(in + done));
+        __m128i hn = _mm_and_si128(_mm_srli_epi32(v, 4), m2f);
+        __m128i ln = _mm_and_si128(v, m2f);
+
+        /* stop at the first block with anything but base64 in it */
+        if (!_mm_test_all_zeros(_mm_shuffle_epi8(lut_lo, ln), _mm_shuffle_epi8(lut_hi, hn)))
+            break;
+
+        /* ascii -> 6-bit values, then pack 4 of those into 3 bytes */
+        v = _mm_add_epi8(v, _mm_shuffle_epi8(lut_rol, _mm_add_epi8(_mm_cmpeq_epi8(v, m2f), hn)));
+        v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+        v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(v, pack));
+    }
+
+    return done;
+}
+
+/* 24 bytes -> 32 chars per block, reads 28 */
+__attribute__((target("avx2")))
+static size_t enc_avx2(unsigned char *out, const unsigned char *in, size_t inlen)
+{
+    const __m256i shuf = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5, 4, 7,
+                                          6, 8, 7, 10, 9, 11, 10);
+    const __m256i lut  = _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0, 65, 71, -4,
+                                          -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    size_t done        = 0;
+
+    for (; inlen - done >= 28; done += 24, out += 32)
+    {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(in + done));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(in + done + 12));
+        __m256i v  = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), shuf);
+        __m256i t0, t1, idx;
+
+        t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040));
+        t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010));
+        v  = _mm256_or_si256(t0, t1);
+
+        idx = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+        idx = _mm256_sub_epi8(idx, _mm256_cmpgt_epi8(v, _mm256_set1_epi8(25)));
+        _mm256_storeu_si256((__m256i *)out, _mm256_add_epi8(v, _mm256_shuffle_epi8(lut, idx)));
+    }
+
+    return done;
+}
+
+/* 32 chars -> 24 bytes per block, writes 32 */
+__attribute__((target("avx2")))
+static size_t dec_avx2(char *out, const char *in, size_t inlen)
+{
+    const __m256i lut_lo  = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                             0x1B, 0x1B, 0x1B, 0x1A, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                             0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi  = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                             0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                             0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_rol = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16, 19, 4,
+                                             -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack    = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4,
+                                             10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i m2f     = _mm256_set1_epi8(0x2F);
+    size_t done           = 0;
+
+    for (; inlen - done >= 64; done += 32, out += 24)
+    {
+        __m256i v  = _mm256_loadu_si256((const __m256i *)(in + done));
+        __m256i hn = _mm256_and_si256(_mm256_srli_epi32(v, 4), m2f);
+        __m256i ln = _mm256_and_si256(v, m2f);
+
+        if (!_mm256_testz_si256(_mm256_shuffle_epi8(lut_lo, ln), _mm256_shuffle_epi8(lut_hi, hn)))
+            break;
+
+        v = _mm256_add_epi8(v, _mm256_shuffle_epi8(lut_rol, _mm256_add_epi8(_mm256_cmpeq_epi8(v, m2f), hn)));
+        v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+        v = _mm256_shuffle_epi8(v, pack);
+        v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256((__m256i *)out, v);
+    }
+
+    return done;
+}
+#endif
+
+#ifdef BASE64_NEON
+/* 48 bytes -> 64 chars per block */
+static size_t enc_neon(unsigned char *out, const unsigned char *in, size_t inlen)
+{
+    const uint8x16x4_t lut = { { vld1q_u8((const uint8_t *)base64digits), vld1q_u8((const uint8_t *)base64digits + 16),
+                                 vld1q_u8((const uint8_t *)base64digits + 32),
+                                 vld1q_u8((const uint8_t *)base64digits + 48) } };
+    const uint8x16_t m3f   = vdupq_n_u8(0x3F);
+    size_t done            = 0;
+
+    for (; inlen - done >= 48; done += 48, out += 64)
+    {
+        uint8x16x3_t v = vld3q_u8(in + done);
+        uint8x16x4_t c;
+
+        c.val[0] = vshrq_n_u8(v.val[0], 2);
+        c.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(v.val[0], 4), vshrq_n_u8(v.val[1], 4)), m3f);
+        c.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(v.val[1], 2), vshrq_n_u8(v.val[2], 6)), m3f);
+        c.val[3] = vandq_u8(v.val[2], m3f);
+        c.val[0] = vqtbl4q_u8(lut, c.val[0]);
+        c.val[1] = vqtbl4q_u8(lut, c.val[1]);
+        c.val[2] = vqtbl4q_u8(lut, c.val[2]);
+        c.val[3] = vqtbl4q_u8(lut, c.val[3]);
+        vst4q_u8(out, c);
+    }
+
+    return done;
+}
+
+/* ascii -> 6-bit value for the 128 ascii chars, 0xFF if not base64 */
+static const uint8_t neon_dlut[128] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 62,
+    255, 255, 255, 63,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  255, 255, 255, 255, 255, 255, 255, 0,
+    1,   2,   3,   4,   5,   6,   7,   8,   9,   10,  11,  12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  22,
+    23,  24,  25,  255, 255, 255, 255, 255, 255, 26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,
+    39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,  255, 255, 255, 255, 255
+};
+
+/* 64 chars -> 48 bytes per block, writes no more */
+static size_t dec_neon(char *out, const char *in, size_t inlen)
+{
+    const uint8x16x4_t lo = { { vld1q_u8(neon_dlut), vld1q_u8(neon_dlut + 16), vld1q_u8(neon_dlut + 32),
+                                vld1q_u8(neon_dlut + 48) } };
+    const uint8x16x4_t hi = { { vld1q_u8(neon_dlut + 64), vld1q_u8(neon_dlut + 80), vld1q_u8(neon_dlut + 96),
+                                vld1q_u8(neon_dlut + 112) } };
+    const uint8x16_t c64  = vdupq_n_u8(64);
+    size_t done           = 0;
+
+    for (; inlen - done >= 64; done += 64, out += 48)
+    {
+        uint8x16x4_t v = vld4q_u8((const uint8_t *)in + done);
+        uint8x16_t bad = vdupq_n_u8(0);
+        uint8x16x3_t b;
+        int i;
+
+        /* chars 0..63 from lo, 64..127 from hi, beyond both stay 0 so
+         * flag those separately.
+         */
+        for (i = 0; i < 4; i++)
+        {
+            uint8x16_t c = v.val[i];
+
+            v.val[i] = vqtbx4q_u8(vqtbl4q_u8(lo, c), hi, vsubq_u8(c, c64));
+            bad      = vorrq_u8(bad, vorrq_u8(v.val[i], vshrq_n_u8(c, 1)));
+        }
+        if (vmaxvq_u8(bad) > 63)
+            break;
+
+        b.val[0] = vorrq_u8(vshlq_n_u8(v.val[0], 2), vshrq_n_u8(v.val[1], 4));
+        b.val[1] = vorrq_u8(vshlq_n_u8(v.val[1], 4), vshrq_n_u8(v.val[2], 2));
+        b.val[2] = vorrq_u8(vshlq_n_u8(v.val[2], 6), v.val[3]);
+        vst3q_u8((uint8_t *)out, b);
+    }
+
+    return done;
+}
+#endif
+
+static const Base64Kernel kernels[] = {
+#ifdef BASE64_X86
+    { "avx2", enc_avx2, dec_avx2 },
+    { "sse4.1", enc_sse41, dec_sse41 },
+#endif
+#ifdef BASE64_NEON
+    { "neon", enc_neon, dec_neon },
+#endif
+    { "scalar", enc_scalar, dec_scalar },
+};
+#define NKERNELS ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+static const Base64Kernel *b64kernel;
+
+/* return 1 if this CPU can run kernel kp, else 0 */
+static int kernelRuns(const Base64Kernel *kp)
+{
+#ifdef BASE64_X86
+    __builtin_cpu_init();
+    if (!strcmp(kp->name, "avx2"))
+        return __builtin_cpu_supports("avx2");
+    if (!strcmp(kp->name, "sse4.1"))
+        return __builtin_cpu_supports("sse4.1");
+#endif
+    (void)kp;
+    return 1;
+}
+
+/* the kernel in use, the first in kernels[] this CPU runs unless set */
+static const Base64Kernel *getKernel(void)
+{
+    if (!b64kernel)
+        setBase64Kernel(NULL);
+    return b64kernel;
+}
+
+int setBase64Kernel(const char *name)
+{
+    int i;
+
+    for (i = 0; i < NKERNELS; i++)
+    {
+        if (name && strcmp(name, kernels[i].name))
+            continue;
+        if (!kernelRuns(&kernels[i]))
+        {
+            if (name)
+                return -1;
+            continue;
+        }
+        b64kernel = &kernels[i];
+        return 0;
+    }
+
+    return -1;
+}
+
+const char *base64KernelName(void)
+{
+    return getKernel()->name;
+}
+
 /* convert inlen raw bytes at in to base64 string (NUL-terminated) at out. 
  * out size should be at least 4*inlen/3 + 4.
  * return length of out (sans trailing NUL).
@@ -62,7 +384,15 @@ int to64frombits(unsigned char *out, const unsigned char *in, int inlen)
 {
     uint16_t *b64lut = (uint16_t *)base64lut;
     int dlen         = ((inlen + 2) / 3) * 4; /* 4/3, rounded up */
-    uint16_t *wbuf   = (uint16_t *)out;
+    uint16_t *wbuf;
+    size_t done;
+
+    /* bulk, then finish here */
+    done = inlen > 0 ? getKernel()->enc(out, in, inlen) : 0;
+    out += done / 3 * 4;
+    in += done;
+    inlen -= done;
+    wbuf = (uint16_t *)out;
 
     for (; inlen > 2; inlen -= 3)
     {
@@ -105,6 +435,7 @@ int from64tobits(char *out, const char *in)
 
 int from64tobits_fast(char *out, const char *in, int inlen)
 {
+    const Base64Kernel *kp = getKernel();
     int outlen = 0;
     uint8_t b1, b2, b3;
     uint16_t s1, s2;
@@ -115,8 +446,20 @@ int from64tobits_fast(char *out, const char *in, int inlen)
 
     for (j = 0; j < n; j++)
     {
+        size_t done;
+
         if (in[0] == '\n')
             in++;
+
+        /* bulk up to the next newline, if any */
+        done = kp->dec(out, in, (size_t)(n - j) * 4);
+        if (done > 0)
+        {
+            in += done;
+            out += done / 4 * 3;
+            j += done / 4 - 1;
+            continue;
+        }
         inp = (uint16_t *)in;
 
         s1 = rbase64lut[inp[0]];
@@ -58,6 +58,15 @@ extern int to64frombits(unsigned char *out, const unsigned char *in, int inlen);
 extern int from64tobits(char *out, const char *in);
 extern int from64tobits_fast(char *out, const char *in, int inlen);
 
+/** \brief Select the implementation used for the bulk of each conversion.
+    \param name one of "avx2", "sse4.1", "neon" or "scalar", NULL for the fastest one this CPU runs. The default is NULL.
+    \return 0 on success, -1 if name is unknown or this CPU can not run it.
+ */
+extern int setBase64Kernel(const char *name);
+
+/** \brief Name of the implementation in use, see setBase64Kernel(). */
+extern const char *base64KernelName(void);
+
 /*@}*/
 
 #ifdef __cplusplus
@@ -29,10 +29,20 @@
  * work procedures may be registered that are called when there is nothing
  *   else to do;
  *
+ * tasks may be posted from any thread that are called once from the loop;
+ *
+ * on linux the fds are watched with epoll(7) and a timerfd ends the wait for
+ *   the soonest timer, define INDI_IO_SELECT to use select(2) instead;
+ *
  #define MAIN_TEST for a stand-alone test program.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -41,6 +51,16 @@
 #include <sys/types.h>
 #include <sys/time.h>
 
+#if defined(__linux__) && !defined(INDI_IO_SELECT)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
 #include "eventloop.h"
 #include "indidevapi.h"
 
@@ -58,23 +78,63 @@ typedef struct
 static CB *cback;    /* malloced list of callbacks */
 static int ncback;   /* n entries in cback[] */
 static int ncbinuse; /* n entries in cback[] marked in_use */
-static int lastcb;   /* cback index of last cb called */
+
+/* how each fd is watched, indexed by fd.
+ * several callbacks may watch one fd, each time it is ready the last one
+ * added is called. the malloced array fdw is grown to the largest fd seen.
+ */
+typedef struct
+{
+    int cid;  /* cback index of the callback to call, -1 if none */
+    int refs; /* n callbacks watching this fd */
+    int how;  /* IO_* */
+} FDW;
+enum
+{
+    IO_NONE,  /* not in the epoll set */
+    IO_POLL,  /* in the epoll set */
+    IO_ALWAYS /* epoll refused it, eg a regular file: always ready as to select */
+};
+static FDW *fdw;        /* malloced list of fds */
+static int nfdw;        /* n entries in fdw[] */
+static unsigned iogen;  /* changes when the ready fds we hold may be stale */
+
+#ifdef USE_EPOLL
+#define MAXEVENTS 64     /* epoll events taken per loop */
+static int epfd = -2;    /* epoll instance, -1 if we use select, -2 until tried */
+static int tfd  = -1;    /* timerfd set to the soonest timer, -1 if none */
+static double tfdgo;     /* tgo tfd is set to, 0 if none */
+static int nalways;      /* n entries in fdw[] that are IO_ALWAYS */
+#endif
 
 /* info about one registered timer function.
- * the entries are kept sorted by decreasing time from epoch, ie,
- *   the next entry to fire is at the end of the array.
+ * the entries form a binary heap on their trigger time, ie, timef[0] runs
+ * soonest and each entry runs no later than those at 2i+1 and 2i+2. timers
+ * due at the same time run in the order they were added.
  */
 typedef struct
 {
-    double tgo; /* trigger time, ms from epoch */
+    double tgo; /* trigger time, ms on the monotonic clock */
     void *ud;   /* user's data handle */
     TCF *fp;    /* timer function */
     int tid;    /* unique id for this timer */
 } TF;
-static TF *timef;  /* malloced list of timer functions */
-static int ntimef; /* n entries in ntimef[] */
+static TF *timef;  /* malloced heap of timer functions */
+static int ntimef; /* n entries in timef[] */
+static int mtimef; /* n malloced in timef[] */
 static int tid;    /* source of unique timer ids */
-#define EPOCHDT(tp) /* ms from epoch to timeval *tp */ (((tp)->tv_usec) / 1000.0 + ((tp)->tv_sec) * 1000.0)
+
+/* where each timer is in timef[], found by its id with linear probing.
+ * ids are handed out in sequence so they spread evenly over the table,
+ * which is kept at most half full.
+ */
+typedef struct
+{
+    int tid; /* timer id, 0 if this slot is empty */
+    int at;  /* its index in timef[] */
+} TS;
+static TS *tslot;  /* malloced table of timer slots */
+static int ntslot; /* n entries in tslot[], a power of 2 */
 
 /* info about one registered work procedure.
  * the malloced array wproc is never shrunk, entries are reused. new id's are
@@ -91,11 +151,32 @@ static int nwproc;   /* n entries in wproc[] */
 static int nwpinuse; /* n entries in wproc[] marked in-use */
 static int lastwp;   /* wproc index of last workproc called*/
 
+/* info about one posted task.
+ * any thread pushes new ones onto ptasks with compare and swap, the loop
+ * takes them all at once and runs them in the order they were posted. the
+ * thread that finds ptasks empty wakes the loop through taskfd, so a burst
+ * of posts costs one wakeup.
+ */
+typedef struct PT
+{
+    struct PT *next; /* posted before this one */
+    TCF *fp;         /* task function */
+    void *ud;        /* user's data handle */
+} PT;
+static PT *ptasks;                             /* posted tasks, latest first */
+static int taskfd[2] = { -1, -1 };             /* read and write ends, one eventfd on linux */
+static pthread_once_t taskonce = PTHREAD_ONCE_INIT;
+static int taskcid = -1;                       /* callback id watching taskfd[0] */
+
 static void runWorkProc(void);
-static void callCallback(fd_set *rfdp);
+static void callCallback(int fd);
 static void checkTimer();
 static void oneLoop(void);
 static void deferTO(void *p);
+static void ioInit(void);
+static void ioWatch(int fd);
+static void ioUnwatch(int fd);
+static void taskStart(void);
 
 /* inf loop to dispatch callbacks, work procs and timers as necessary.
  * never returns.
@@ -177,6 +258,25 @@ int addCallback(int fd, CBF *fp, void *ud)
     cp->fd     = fd;
     ncbinuse++;
 
+    /* watch its fd */
+    if (fd >= 0)
+    {
+        if (fd >= nfdw)
+        {
+            fdw = (FDW *)realloc(fdw, (fd + 1) * sizeof(FDW));
+            for (; nfdw <= fd; nfdw++)
+            {
+                fdw[nfdw].cid  = -1;
+                fdw[nfdw].refs = 0;
+                fdw[nfdw].how  = IO_NONE;
+            }
+        }
+        fdw[fd].cid = cp - cback;
+        fdw[fd].refs++;
+        ioInit();
+        ioWatch(fd);
+    }
+
     /* id is index into array */
     return (cp - cback);
 }
@@ -187,6 +287,7 @@ int addCallback(int fd, CBF *fp, void *ud)
 void rmCallback(int cid)
 {
     CB *cp;
+    FDW *wp;
 
     /* validate id */
     if (cid < 0 || cid >= ncback)
@@ -198,68 +299,168 @@ void rmCallback(int cid)
     /* mark for reuse */
     cp->in_use = 0;
     ncbinuse--;
+    iogen++;
+
+    /* stop watching its fd, or hand it to another callback on it */
+    if (cp->fd < 0)
+        return;
+    wp = &fdw[cp->fd];
+    if (--wp->refs == 0)
+    {
+        ioUnwatch(cp->fd);
+        wp->cid = -1;
+    }
+    else if (wp->cid == cid)
+    {
+        CB *op;
+
+        for (op = cback; op < &cback[ncback]; op++)
+            if (op->in_use && op->fd == cp->fd)
+                wp->cid = op - cback;
+    }
 }
 
-/* register a new timer function, fp, to be called with ud as arg after ms
- * milliseconds. add to list in order of decreasing time from epoch, ie,
- * last entry runs soonest. return id for use with rmTimer().
- */
-int addTimer(int ms, TCF *fp, void *ud)
+/* return the time now in ms on the monotonic clock */
+static double nowMs(void)
 {
-    struct timeval t;
-    TF *tp;
+    struct timespec ts;
 
-    /* get time now */
-    gettimeofday(&t, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0);
+}
 
-    /* add one entry */
-    timef = (TF *)realloc(timef, (ntimef + 1) * sizeof(TF));
-    tp    = &timef[ntimef++];
+/* return 1 if timer a runs before b, else 0 */
+static int timerBefore(const TF *a, const TF *b)
+{
+    return (a->tgo < b->tgo || (a->tgo == b->tgo && a->tid < b->tid));
+}
 
-    /* init new entry */
-    tp->ud  = ud;
-    tp->fp  = fp;
-    tp->tgo = EPOCHDT(&t) + ms;
+/* return the slot of timer id, or NULL if there is none */
+static TS *findTimer(int id)
+{
+    unsigned mask = ntslot - 1;
+    unsigned i;
+
+    if (!ntslot)
+        return (NULL);
+    for (i = id & mask; tslot[i].tid; i = (i + 1) & mask)
+        if (tslot[i].tid == id)
+            return (&tslot[i]);
+    return (NULL);
+}
 
-    /* insert maintaining sort */
-    for (; tp > timef && tp[0].tgo > tp[-1].tgo; tp--)
+/* take a slot for timer id at timef[at], there must be room */
+static void slotTimer(int id, int at)
+{
+    unsigned mask = ntslot - 1;
+    unsigned i;
+
+    for (i = id & mask; tslot[i].tid; i = (i + 1) & mask)
+        continue;
+    tslot[i].tid = id;
+    tslot[i].at  = at;
+}
+
+/* empty slot sp, moving up those after it that would no longer be found */
+static void unslotTimer(TS *sp)
+{
+    unsigned mask = ntslot - 1;
+    unsigned i    = sp - tslot;
+    unsigned j, home;
+
+    for (j = (i + 1) & mask; tslot[j].tid; j = (j + 1) & mask)
     {
-        TF tmptf = tp[-1];
-        tp[-1]   = tp[0];
-        tp[0]    = tmptf;
+        /* leave j if its home slot is cyclically in (i, j] */
+        home = tslot[j].tid & mask;
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+        tslot[i] = tslot[j];
+        i        = j;
     }
+    tslot[i].tid = 0;
+}
 
-    /* store and return new unique id */
-    return (tp->tid = ++tid);
+/* put *tp in timef[i] */
+static void placeTimer(int i, const TF *tp)
+{
+    timef[i] = *tp;
+    findTimer(tp->tid)->at = i;
 }
 
-/* remove the timer with the given id, as returned from addTimer().
- * silently ignore if id not found.
- */
-void rmTimer(int timer_id)
+/* put *tp in the hole at timef[i], moving it up or down to keep the heap */
+static void siftTimer(int i, TF t)
 {
-    TF *tp;
+    int c;
+
+    for (; i > 0 && timerBefore(&t, &timef[(i - 1) / 2]); i = (i - 1) / 2)
+        placeTimer(i, &timef[(i - 1) / 2]);
 
-    /* find it */
-    for (tp = timef; tp < &timef[ntimef]; tp++)
-        if (tp->tid == timer_id)
+    for (; (c = 2 * i + 1) < ntimef; i = c)
+    {
+        if (c + 1 < ntimef && timerBefore(&timef[c + 1], &timef[c]))
+            c++;
+        if (!timerBefore(&timef[c], &t))
             break;
-    if (tp == &timef[ntimef])
-        return;
+        placeTimer(i, &timef[c]);
+    }
 
-    /* bubble it out */
-    for (++tp; tp < &timef[ntimef]; tp++)
-        tp[-1] = tp[0];
+    placeTimer(i, &t);
+}
+
+/* remove timef[i] */
+static void dropTimer(int i)
+{
+    unslotTimer(findTimer(timef[i].tid));
+    if (i < --ntimef)
+        siftTimer(i, timef[ntimef]);
+}
 
-    /* shrink list */
-    ntimef--;
-    if (ntimef == 0)
+/* register a new timer function, fp, to be called with ud as arg after ms
+ * milliseconds. return id for use with rmTimer().
+ */
+int addTimer(int ms, TCF *fp, void *ud)
+{
+    TF t;
+
+    /* room for one more */
+    if (ntimef == mtimef)
     {
-        free(timef);
-        timef = NULL;
-        return;
+        mtimef = mtimef ? 2 * mtimef : 16;
+        timef  = (TF *)realloc(timef, mtimef * sizeof(TF));
     }
-    timef = (TF *)realloc(timef, ntimef * sizeof(TF));
+    if (2 * (ntimef + 1) > ntslot)
+    {
+        int i;
+
+        ntslot = ntslot ? 2 * ntslot : 32;
+        free(tslot);
+        tslot = (TS *)calloc(ntslot, sizeof(TS));
+        for (i = 0; i < ntimef; i++)
+            slotTimer(timef[i].tid, i);
+    }
+
+    /* init new entry with a new unique id */
+    t.ud  = ud;
+    t.fp  = fp;
+    t.tgo = nowMs() + ms;
+    t.tid = tid = tid == INT_MAX ? 1 : tid + 1;
+
+    /* add at the bottom, then up to where it belongs */
+    slotTimer(t.tid, ntimef);
+    siftTimer(ntimef++, t);
+
+    return (t.tid);
+}
+
+/* remove the timer with the given id, as returned from addTimer().
+ * silently ignore if id not found.
+ */
+void rmTimer(int timer_id)
+{
+    TS *sp = findTimer(timer_id);
+
+    if (sp)
+        dropTimer(sp->at);
 }
 
 /* add a new work procedure, fp, to be called with ud when nothing else to do.
@@ -308,6 +509,114 @@ void rmWorkProc(int wid)
     nwpinuse--;
 }
 
+/* make taskfd, once, from whichever thread is first */
+static void taskInit(void)
+{
+#ifdef __linux__
+    taskfd[0] = taskfd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (taskfd[0] < 0)
+        perror("eventfd");
+#else
+    if (pipe(taskfd) < 0)
+    {
+        perror("pipe");
+        taskfd[0] = taskfd[1] = -1;
+        return;
+    }
+    fcntl(taskfd[0], F_SETFL, fcntl(taskfd[0], F_GETFL) | O_NONBLOCK);
+    fcntl(taskfd[1], F_SETFL, fcntl(taskfd[1], F_GETFL) | O_NONBLOCK);
+    fcntl(taskfd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(taskfd[1], F_SETFD, FD_CLOEXEC);
+#endif
+}
+
+/* callback when taskfd is ready: run all tasks posted so far.
+ * N.B. clear taskfd before taking ptasks, so a post that finds it empty
+ * after we took it wakes us again.
+ */
+static void taskCB(int fd, void *ud)
+{
+    PT *tp, *run = NULL;
+#ifdef __linux__
+    uint64_t n;
+
+    (void)!read(fd, &n, sizeof(n));
+#else
+    char buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+        continue;
+#endif
+    (void)ud;
+
+    /* take them all, then turn them to the order posted */
+    tp = __atomic_exchange_n(&ptasks, NULL, __ATOMIC_ACQUIRE);
+    while (tp)
+    {
+        PT *next = tp->next;
+
+        tp->next = run;
+        run      = tp;
+        tp       = next;
+    }
+
+    /* run */
+    while (run)
+    {
+        tp  = run;
+        run = tp->next;
+        (*tp->fp)(tp->ud);
+        free(tp);
+    }
+}
+
+/* watch taskfd from the loop, the first time it runs */
+static void taskStart(void)
+{
+    if (taskcid >= 0)
+        return;
+    pthread_once(&taskonce, taskInit);
+    if (taskfd[0] >= 0)
+        taskcid = addCallback(taskfd[0], taskCB, NULL);
+}
+
+/* post a task, fp, to be called once with ud by the thread running the loop.
+ * may be called from any thread, also from the loop itself.
+ * return 0 if posted, else -1.
+ */
+int postTask(TCF *fp, void *ud)
+{
+    PT *tp = (PT *)malloc(sizeof(PT));
+    PT *head;
+
+    pthread_once(&taskonce, taskInit);
+    if (!tp || taskfd[1] < 0)
+    {
+        free(tp);
+        return (-1);
+    }
+    tp->fp = fp;
+    tp->ud = ud;
+
+    /* push */
+    head = __atomic_load_n(&ptasks, __ATOMIC_RELAXED);
+    do
+        tp->next = head;
+    while (!__atomic_compare_exchange_n(&ptasks, &head, tp, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    /* wake the loop, unless an earlier post still has it to */
+    if (!head)
+    {
+#ifdef __linux__
+        uint64_t one = 1;
+#else
+        char one = 1;
+#endif
+        (void)!write(taskfd[1], &one, sizeof(one));
+    }
+    return (0);
+}
+
 /* run next work procedure */
 static void runWorkProc()
 {
@@ -328,50 +637,221 @@ static void runWorkProc()
     (*wp->fp)(wp->ud);
 }
 
-/* run next callback whose fd is listed as ready to go in rfdp */
-static void callCallback(fd_set *rfdp)
+/* run the callback for fd, which is ready */
+static void callCallback(int fd)
 {
     CB *cp;
 
-    /* skip if list is empty */
-    if (!ncbinuse)
+    if (fd >= nfdw || fdw[fd].cid < 0)
         return;
 
-    /* find next */
-    do
-    {
-        lastcb = (lastcb + 1) % ncback;
-        cp     = &cback[lastcb];
-    } while (!cp->in_use || !FD_ISSET(cp->fd, rfdp));
-
     /* run */
+    cp = &cback[fdw[fd].cid];
     (*cp->fp)(cp->fd, cp->ud);
 }
 
-/* run the next timer callback whose time has come, if any. all we have to do
- * is is check the last entry in timef[] because it is sorted in decreasing
- * order of time from epoch to run, ie, last entry runs soonest.
+/* run each timer callback whose time has come. timers added meanwhile wait
+ * for the next loop, even if they are due already.
  */
 static void checkTimer()
 {
-    struct timeval now;
     double tgonow;
-    TF *tp;
+    int lasttid = tid;
 
     /* skip if list is empty */
     if (!ntimef)
         return;
 
-    gettimeofday(&now, NULL);
-    tgonow = EPOCHDT(&now);
-    tp     = &timef[ntimef - 1];
-    if (tp->tgo <= tgonow)
+    tgonow = nowMs();
+    while (ntimef > 0 && timef[0].tgo <= tgonow && timef[0].tid <= lasttid)
     {
-        ntimef--; /* pop then call */
-        (*tp->fp)(tp->ud);
+        TF t = timef[0];
+
+        dropTimer(0); /* pop then call */
+        (*t.fp)(t.ud);
     }
 }
 
+/* start epoll if we can, with its timerfd, else we stay with select */
+static void ioInit(void)
+{
+#ifdef USE_EPOLL
+    struct epoll_event ev;
+    int fd;
+
+    if (epfd != -2)
+        return;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+    {
+        perror("epoll_create1, using select");
+        return;
+    }
+
+    /* without a timerfd epoll_wait times out to the ms */
+    tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd >= 0)
+    {
+        memset(&ev, 0, sizeof(ev));
+        ev.events  = EPOLLIN;
+        ev.data.fd = tfd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev) < 0)
+        {
+            close(tfd);
+            tfd = -1;
+        }
+    }
+
+    /* the fds watched so far */
+    for (fd = 0; fd < nfdw; fd++)
+        if (fdw[fd].refs > 0)
+            ioWatch(fd);
+#endif
+}
+
+/* add fd to the epoll set, if we use one.
+ * N.B. also when it should be there already: it may have been closed and
+ * opened anew since, which takes it out of the set without our knowing.
+ */
+static void ioWatch(int fd)
+{
+#ifdef USE_EPOLL
+    struct epoll_event ev;
+
+    if (epfd < 0 || fdw[fd].how == IO_ALWAYS)
+        return;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0 || errno == EEXIST)
+        fdw[fd].how = IO_POLL;
+    else if (errno == EPERM)
+    {
+        fdw[fd].how = IO_ALWAYS;
+        nalways++;
+    }
+    else
+        perror("epoll_ctl");
+#else
+    (void)fd;
+#endif
+}
+
+/* take fd out of the epoll set, if it is there */
+static void ioUnwatch(int fd)
+{
+#ifdef USE_EPOLL
+    /* it may have been closed already, so never mind if this fails */
+    if (fdw[fd].how == IO_POLL)
+        (void)epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    else if (fdw[fd].how == IO_ALWAYS)
+        nalways--;
+#endif
+    fdw[fd].how = IO_NONE;
+}
+
+#ifdef USE_EPOLL
+/* return ms until the soonest timer is due, rounded up, or -1 if none */
+static int timerWait(void)
+{
+    double late;
+
+    if (!ntimef)
+        return (-1);
+    late = ceil(timef[0].tgo - nowMs()); /* ms late */
+    if (late < 0)
+        late = 0;
+    return (late > INT_MAX ? INT_MAX : (int)late);
+}
+
+/* set tfd to go off when the soonest timer is due */
+static void setTimerFd(void)
+{
+    struct itimerspec its;
+    double tgo = ntimef ? timef[0].tgo : 0;
+
+    if (tgo == tfdgo)
+        return;
+
+    /* all 0 disarms it, so make a due time of 0 the smallest there is */
+    memset(&its, 0, sizeof(its));
+    if (ntimef)
+    {
+        double ns = ceil(tgo * 1000000.0);
+
+        if (ns < 1)
+            ns = 1;
+        its.it_value.tv_sec  = (time_t)(ns / 1e9);
+        its.it_value.tv_nsec = (long)(ns - its.it_value.tv_sec * 1e9);
+    }
+    if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) == 0)
+        tfdgo = tgo;
+}
+
+/* wait with epoll for a ready fd or the soonest timer, then dispatch */
+static void epollLoop(void)
+{
+    struct epoll_event ev[MAXEVENTS];
+    unsigned gen;
+    int i, n, ns, to;
+
+    /* determine timeout as select's below, 0 also if any fd is always ready.
+     * the timerfd ends the wait for timers, to better than the ms.
+     */
+    if (nwpinuse > 0 || nalways > 0)
+        to = 0;
+    else if (tfd >= 0)
+    {
+        setTimerFd();
+        to = -1;
+    }
+    else
+        to = timerWait();
+
+    n = epoll_wait(epfd, ev, MAXEVENTS, to);
+    if (n < 0)
+    {
+        perror("epoll_wait");
+        return;
+    }
+
+    /* count fds ready besides the timerfd */
+    ns = nalways;
+    for (i = 0; i < n; i++)
+    {
+        if (ev[i].data.fd == tfd)
+        {
+            uint64_t nexp;
+
+            if (read(tfd, &nexp, sizeof(nexp)) < 0 && errno != EAGAIN)
+                perror("timerfd");
+            tfdgo = 0; /* set it anew even if the same timer is still due */
+        }
+        else
+            ns++;
+    }
+
+    /* dispatch. callbacks run before might have made the rest stale, those
+     * that are still ready will be back next time.
+     */
+    gen = ++iogen;
+    checkTimer();
+    if (ns == 0)
+    {
+        runWorkProc();
+        return;
+    }
+    for (i = 0; i < n && gen == iogen; i++)
+        if (ev[i].data.fd != tfd)
+            callCallback(ev[i].data.fd);
+    for (i = 0; nalways > 0 && i < nfdw && gen == iogen; i++)
+        if (fdw[i].how == IO_ALWAYS)
+            callCallback(i);
+}
+#endif
+
 /* check fd's from each active callback.
  * if any ready, call their callbacks else call each registered work procedure.
  */
@@ -379,19 +859,29 @@ static void oneLoop()
 {
     struct timeval tv, *tvp;
     fd_set rfd;
-    CB *cp;
-    int maxfd, ns;
+    unsigned gen;
+    int fd, maxfd, ns;
+
+    taskStart();
+
+#ifdef USE_EPOLL
+    ioInit();
+    if (epfd >= 0)
+    {
+        epollLoop();
+        return;
+    }
+#endif
 
     /* build list of callback file descriptors to check */
     FD_ZERO(&rfd);
     maxfd = -1;
-    for (cp = cback; cp < &cback[ncback]; cp++)
+    for (fd = 0; fd < nfdw; fd++)
     {
-        if (cp->in_use)
+        if (fdw[fd].refs > 0)
         {
-            FD_SET(cp->fd, &rfd);
-            if (cp->fd > maxfd)
-                maxfd = cp->fd;
+            FD_SET(fd, &rfd);
+            maxfd = fd;
         }
     }
 
@@ -410,16 +900,18 @@ static void oneLoop()
     }
     else if (ntimef > 0)
     {
-        struct timeval now;
-        double late;
-        gettimeofday(&now, NULL);
-        late = timef[ntimef - 1].tgo - EPOCHDT(&now); /* ms late */
+        double late = timef[0].tgo - nowMs(); /* ms late */
         if (late < 0)
             late = 0;
         late /= 1000.0; /* secs late */
         tvp          = &tv;
         tvp->tv_sec  = (long)floor(late);
-        tvp->tv_usec = (long)floor((late - tvp->tv_sec) * 1000000.0);
+        tvp->tv_usec = (long)ceil((late - tvp->tv_sec) * 1000000.0);
+        if (tvp->tv_usec >= 1000000)
+        {
+            tvp->tv_sec++;
+            tvp->tv_usec -= 1000000;
+        }
     }
     else
         tvp = NULL;
@@ -432,12 +924,15 @@ static void oneLoop()
         return;
     }
 
-    /* dispatch */
+    /* dispatch, as for epoll */
+    gen = ++iogen;
     checkTimer();
     if (ns == 0)
         runWorkProc();
     else
-        callCallback(&rfd);
+        for (fd = 0; fd <= maxfd && gen == iogen; fd++)
+            if (FD_ISSET(fd, &rfd))
+                callCallback(fd);
 }
 
 /* timer callback used to implement deferLoop().
@@ -471,6 +966,11 @@ void IERmTimer(int timerid)
     rmTimer(timerid);
 }
 
+int IEPostTask(IE_TCF *fp, void *p)
+{
+    return (postTask((TCF *)fp, p));
+}
+
 int IEAddWorkProc(IE_WPF *fp, void *p)
 {
     return (addWorkProc((WPF *)fp, p));
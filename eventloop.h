@@ -84,7 +84,7 @@ extern int addWorkProc(WPF *fp, void *ud);
 */
 extern void rmWorkProc(int wid);
 
-/** Register a new timer function, \e fp, to be called with \e ud as argument after \e ms. Add to list in order of decreasing time from epoch, ie, last entry runs soonest. The timer will only invoke the callback function \b once. You need to call addTimer again if you want to repeat the process.
+/** Register a new timer function, \e fp, to be called with \e ud as argument after \e ms. Timers due at the same time run in the order they were added. The timer will only invoke the callback function \b once. You need to call addTimer again if you want to repeat the process.
 *
 * \param ms timer period in milliseconds.
 * \param fp a pointer to the callback function.
@@ -99,6 +99,14 @@ extern int addTimer(int ms, TCF *fp, void *ud);
 */
 extern void rmTimer(int tid);
 
+/** Post a task, \e fp, to be called once with \e ud as argument by the thread running the event loop. Unlike the other functions here it may be called from any thread. Tasks run in the order they were posted.
+*
+* \param fp a pointer to the task function.
+* \param ud a pointer to be passed to the task function when called.
+* \return 0 if posted, else -1.
+*/
+extern int postTask(TCF *fp, void *ud);
+
 /* utility functions */
 extern int deferLoop(int maxms, int *flagp);
 extern int deferLoop0(int maxms, int *flagp);
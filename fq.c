@@ -114,6 +114,22 @@ void *peekiFQ(FQ *q, int i)
     return (q->nq > 0 ? q->q[q->head - q->nq + i] : NULL);
 }
 
+/* replace the ith element from head of the given FQ with e.
+ * return the element replaced, or NULL if there is no such element.
+ */
+void *setiFQ(FQ *q, int i, void *e)
+{
+    void **ep;
+    void *old;
+
+    if (i < 0 || i >= q->nq)
+        return (NULL);
+    ep  = &q->q[q->head - q->nq + i];
+    old = *ep;
+    *ep = e;
+    return (old);
+}
+
 /* return the number of elements in the given FQ */
 int nFQ(FQ *q)
 {
@@ -327,7 +327,7 @@ extern void IERmCallback(int callbackid);
 
 /** \brief Register a new timer function, \e fp, to be called with \e ud as argument after \e ms.
 
- Add to list in order of decreasing time from epoch, ie, last entry runs soonest. The timer will only invoke the callback function \b once. You need to call addTimer again if you want to repeat the process.
+ Timers due at the same time run in the order they were added. The timer will only invoke the callback function \b once. You need to call addTimer again if you want to repeat the process.
 *
 * \param millisecs timer period in milliseconds.
 * \param fp a pointer to the callback function.
@@ -342,6 +342,16 @@ extern int IEAddTimer(int millisecs, IE_TCF *fp, void *userpointer);
 */
 extern void IERmTimer(int timerid);
 
+/** \brief Post a task, \e fp, to be called once with \e userpointer as argument by the thread running the event loop.
+
+ Unlike the other functions here it may be called from any thread, so a driver thread can hand work such as IDSet*() calls to the main thread without making a thread or waiting for a lock. Tasks run in the order they were posted.
+*
+* \param fp a pointer to the task function.
+* \param userpointer a pointer to be passed to the task function when called.
+* \return 0 if posted, else -1.
+*/
+extern int IEPostTask(IE_TCF *fp, void *userpointer);
+
 /** \brief Add a new work procedure, fp, to be called with ud when nothing else to do.
 *
 * \param fp a pointer to the work procedure callback function.
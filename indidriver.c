@@ -32,6 +32,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
 #include "locale_compat.h"
 
 #include <errno.h>
+#include <stdint.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -42,12 +43,44 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
 #include <sys/stat.h>
 #include <assert.h>
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#endif
+
 static pthread_mutex_t stdout_mutex = PTHREAD_MUTEX_INITIALIZER;
 int verbose;      /* chatty */
 char *me = NULL;  /* a.out name */
 
 #define MAXRBUF 2048
 
+/* set in our environment by an indiserver that takes BLOBs as raw bytes */
+#define BINBLOBENV "INDIBINARYBLOB"
+
+/* set in our environment by an indiserver that takes BLOBs in shared memory
+ * segments passed over our stdout, which is then a unix domain socket.
+ */
+#define SHMBLOBENV "INDISHMBLOB"
+#define SHMBLOBMIN (64 * 1024) /* smaller setBLOBVector are not worth a segment */
+#define MAXSHMFDS  16          /* most segments indiserver takes with one message */
+
+#if defined(__linux__) && defined(SYS_memfd_create)
+#define HAVE_SHMBLOB
+/* not all libcs that have the syscall name these */
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC       0x0001U
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS   (1024 + 9)
+#define F_SEAL_SEAL   0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW   0x0004
+#define F_SEAL_WRITE  0x0008
+#endif
+#endif
+
 /*! INDI property type */
 enum
 {
@@ -206,6 +239,367 @@ static char *escapeXML(const char *src, size_t size)
 }
 #endif
 
+/* IDSet*() and IDDef*() build each message in a buffer of the calling
+ * thread and send it with one write(2), so they hold stdout_mutex only for
+ * that write. The bytes are the same printf made in the C locale: numbers
+ * are formatted here as %g would, whatever the locale.
+ */
+typedef struct
+{
+    char *buf;    /* malloced message being built */
+    size_t len;   /* bytes in buf */
+    size_t max;   /* n malloced in buf */
+    time_t tst;   /* time of ts[] */
+    char ts[32];  /* timestamp() at tst */
+} MsgBuf;
+
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 FracBits;
+#else
+typedef uint64_t FracBits;
+#endif
+#define MAXFRACBITS (8 * (int)sizeof(FracBits) - 4) /* leaves room to multiply by 10 */
+
+static pthread_key_t msgkey;
+static pthread_once_t msgonce = PTHREAD_ONCE_INIT;
+
+static void freeMsgBuf(void *p)
+{
+    MsgBuf *mb = (MsgBuf *)p;
+
+    free(mb->buf);
+    free(mb);
+}
+
+static void makeMsgKey(void)
+{
+    pthread_key_create(&msgkey, freeMsgBuf);
+}
+
+/* return the empty buffer of the calling thread */
+static MsgBuf *startMsg(void)
+{
+    MsgBuf *mb;
+
+    pthread_once(&msgonce, makeMsgKey);
+    mb = (MsgBuf *)pthread_getspecific(msgkey);
+    if (!mb)
+    {
+        assert_mem(mb = (MsgBuf *)calloc(1, sizeof(MsgBuf)));
+        pthread_setspecific(msgkey, mb);
+    }
+    mb->len = 0;
+    return (mb);
+}
+
+/* make room for n more bytes in mb, return where they go */
+static char *roomMsg(MsgBuf *mb, size_t n)
+{
+    if (mb->len + n > mb->max)
+    {
+        mb->max = 2 * (mb->len + n) + 1024;
+        assert_mem(mb->buf = (char *)realloc(mb->buf, mb->max));
+    }
+    return (mb->buf + mb->len);
+}
+
+static void addBytes(MsgBuf *mb, const char *s, size_t n)
+{
+    memcpy(roomMsg(mb, n), s, n);
+    mb->len += n;
+}
+
+/* add a string literal, its length known at compile time */
+#define addLit(mb, lit) addBytes((mb), (lit), sizeof(lit) - 1)
+
+static void addStr(MsgBuf *mb, const char *s)
+{
+    addBytes(mb, s, strlen(s));
+}
+
+/* add s expanding special characters into xml escape sequences */
+static void addEscStr(MsgBuf *mb, const char *s)
+{
+    const char *run = s;
+
+    for (; *s; s++)
+    {
+        switch (*s)
+        {
+        case  '&': addBytes(mb, run, s - run); addLit(mb, "&amp;");  break;
+        case '\'': addBytes(mb, run, s - run); addLit(mb, "&apos;"); break;
+        case  '"': addBytes(mb, run, s - run); addLit(mb, "&quot;"); break;
+        case  '<': addBytes(mb, run, s - run); addLit(mb, "&lt;");   break;
+        case  '>': addBytes(mb, run, s - run); addLit(mb, "&gt;");   break;
+        default:   continue;
+        }
+        run = s + 1;
+    }
+    addBytes(mb, run, s - run);
+}
+
+/* add what timestamp() would return now, formatted once a second */
+static void addTimestamp(MsgBuf *mb)
+{
+    time_t t = time(NULL);
+
+    if (t != mb->tst || !mb->ts[0])
+    {
+        struct tm tm;
+
+        gmtime_r(&t, &tm);
+        strftime(mb->ts, sizeof(mb->ts), "%Y-%m-%dT%H:%M:%S", &tm);
+        mb->tst = t;
+    }
+    addStr(mb, mb->ts);
+}
+
+/* add v as snprintf "%.*g" with prec, then the locale's decimal point as '.' */
+static void addNumLibc(MsgBuf *mb, double v, int prec)
+{
+    const char *pt = localeconv()->decimal_point;
+    char tmp[64], *dp;
+
+    snprintf(tmp, sizeof(tmp), "%.*g", prec, v);
+    if (strcmp(pt, ".") && (dp = strstr(tmp, pt)) != NULL)
+    {
+        *dp = '.';
+        memmove(dp + 1, dp + strlen(pt), strlen(dp + strlen(pt)) + 1);
+    }
+    addStr(mb, tmp);
+}
+
+/* add v exactly as printf "%.*g" with 1 <= prec <= 20 in the C locale.
+ * finite values below 2^64 whose bits all fit in FracBits are expanded here
+ * with integer arithmetic, the rest are left to addNumLibc().
+ */
+static void addNum(MsgBuf *mb, double v, int prec)
+{
+    char d[48], *p;
+    uint64_t bits, mant, ip;
+    FracBits frac = 0, mask = 0;
+    int neg, e2, s = 0, nd = 0, x, sticky, i;
+
+    memcpy(&bits, &v, sizeof(bits));
+    neg  = bits >> 63;
+    e2   = (int)((bits >> 52) & 0x7ff);
+    mant = bits & ((1ULL << 52) - 1);
+
+    if (e2 == 0 && mant == 0)
+    {
+        if (neg)
+            addLit(mb, "-0");
+        else
+            addLit(mb, "0");
+        return;
+    }
+    /* not for subnormals, inf, nan nor from 2^64 up */
+    if (e2 == 0 || e2 > 1075 + 11)
+    {
+        addNumLibc(mb, v, prec);
+        return;
+    }
+
+    /* v = mant * 2^e2, drop the low zero bits to keep the fraction short */
+    mant |= 1ULL << 52;
+    e2 -= 1075;
+    while (e2 < 0 && !(mant & 1))
+    {
+        mant >>= 1;
+        e2++;
+    }
+    if (-e2 > MAXFRACBITS)
+    {
+        addNumLibc(mb, v, prec);
+        return;
+    }
+
+    if (e2 >= 0)
+        ip = mant << e2;
+    else
+    {
+        s    = -e2;
+        ip   = s < 64 ? mant >> s : 0;
+        mask = ((FracBits)1 << s) - 1;
+        frac = mant & mask;
+    }
+
+    /* all the digits of ip, or the first nonzero one of frac; x is the
+     * decimal exponent of the first
+     */
+    if (ip)
+    {
+        char t[20];
+        int n = 0;
+
+        while (ip)
+        {
+            t[n++] = '0' + ip % 10;
+            ip /= 10;
+        }
+        x = n - 1;
+        while (n > 0)
+            d[nd++] = t[--n];
+    }
+    else
+    {
+        for (x = -1;; x--)
+        {
+            frac *= 10;
+            d[nd] = '0' + (int)(frac >> s);
+            frac &= mask;
+            if (d[nd] != '0')
+                break;
+        }
+        nd++;
+    }
+
+    /* then of frac up to one past prec significant digits */
+    while (nd < prec + 1 && frac)
+    {
+        frac *= 10;
+        d[nd++] = '0' + (int)(frac >> s);
+        frac &= mask;
+    }
+    while (nd < prec + 1)
+        d[nd++] = '0';
+
+    /* round to nearest, ties to even, as glibc does with the exact value */
+    sticky = frac != 0;
+    for (i = prec + 1; i < nd; i++)
+        sticky |= d[i] != '0';
+    if (d[prec] > '5' || (d[prec] == '5' && (sticky || ((d[prec - 1] - '0') & 1))))
+    {
+        for (i = prec - 1; i >= 0 && d[i] == '9'; i--)
+            d[i] = '0';
+        if (i >= 0)
+            d[i]++;
+        else
+        {
+            d[0] = '1';
+            x++;
+        }
+    }
+    for (nd = prec; nd > 1 && d[nd - 1] == '0'; nd--)
+        ;
+
+    p = roomMsg(mb, prec + 16);
+    if (neg)
+        *p++ = '-';
+    if (x < -4 || x >= prec)
+    {
+        int ax = x < 0 ? -x : x;
+
+        *p++ = d[0];
+        if (nd > 1)
+        {
+            *p++ = '.';
+            memcpy(p, d + 1, nd - 1);
+            p += nd - 1;
+        }
+        *p++ = 'e';
+        *p++ = x < 0 ? '-' : '+';
+        if (ax >= 100)
+            *p++ = '0' + ax / 100;
+        *p++ = '0' + ax / 10 % 10;
+        *p++ = '0' + ax % 10;
+    }
+    else if (x >= 0)
+    {
+        for (i = 0; i <= x; i++)
+            *p++ = i < nd ? d[i] : '0';
+        if (nd > x + 1)
+        {
+            *p++ = '.';
+            memcpy(p, d + x + 1, nd - x - 1);
+            p += nd - x - 1;
+        }
+    }
+    else
+    {
+        *p++ = '0';
+        *p++ = '.';
+        for (i = -1; i > x; i--)
+            *p++ = '0';
+        memcpy(p, d, nd);
+        p += nd;
+    }
+    mb->len = p - mb->buf;
+}
+
+/* add "att='val'\n", att with its indentation */
+static void addAtt(MsgBuf *mb, const char *att, const char *val)
+{
+    addStr(mb, att);
+    addLit(mb, "='");
+    addStr(mb, val);
+    addLit(mb, "'\n");
+}
+
+static void addNumAtt(MsgBuf *mb, const char *att, double v, int prec)
+{
+    addStr(mb, att);
+    addLit(mb, "='");
+    addNum(mb, v, prec);
+    addLit(mb, "'\n");
+}
+
+/* add the timestamp attribute, the message one for fmt and ap if any, and
+ * close the start tag. the message is formatted in the C numeric locale if
+ * cnumeric, as our callers always have.
+ */
+static void addStamp(MsgBuf *mb, int cnumeric, const char *fmt, va_list ap)
+{
+    char message[MAXINDIMESSAGE];
+
+    addLit(mb, "  timestamp='");
+    addTimestamp(mb);
+    addLit(mb, "'\n");
+    if (!fmt)
+    {
+        addLit(mb, ">\n");
+        return;
+    }
+
+    if (cnumeric)
+    {
+        /* setlocale() is for the whole process */
+        pthread_mutex_lock(&stdout_mutex);
+        locale_char_t *orig = indi_locale_C_numeric_push();
+        vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
+        indi_locale_C_numeric_pop(orig);
+        pthread_mutex_unlock(&stdout_mutex);
+    }
+    else
+        vsnprintf(message, MAXINDIMESSAGE, fmt, ap);
+
+    addLit(mb, "  message='");
+    addEscStr(mb, message);
+    addLit(mb, "'\n>\n");
+}
+
+/* write mb to our stdout after whatever was printed there before.
+ * N.B. caller holds stdout_mutex
+ */
+static void writeMsg(MsgBuf *mb)
+{
+    const char *p = mb->buf;
+    size_t n      = mb->len;
+
+    fflush(stdout);
+    while (n > 0)
+    {
+        ssize_t nw = write(STDOUT_FILENO, p, n);
+
+        if (nw < 0 && errno == EINTR)
+            continue;
+        if (nw <= 0)
+            break;
+        p += nw;
+        n -= nw;
+    }
+}
+
 /* tell Client to delete the property with given name on given device, or
  * entire device if !name
  */
@@ -238,6 +632,28 @@ void IDDelete(const char *dev, const char *name, const char *fmt, ...)
     va_end(ap);
 }
 
+/* return 1 if our indiserver accepts oneBLOB content as rawlen bytes instead
+ * of base64, else 0. an indiserver that does sets BINBLOBENV for its drivers,
+ * other peers never see binary BLOBs from us.
+ */
+static int binaryBLOBs(void)
+{
+    static int binary = -1;
+
+    if (binary < 0)
+    {
+        const char *env = getenv(BINBLOBENV);
+        binary          = env && atoi(env) > 0;
+    }
+    return (binary);
+}
+
+/* the attribute that tells such an indiserver we accept binary BLOBs too */
+static const char *binaryBLOBAtt(void)
+{
+    return (binaryBLOBs() ? " binaryBLOB='1'" : "");
+}
+
 /* tell indiserver we want to snoop on the given device/property.
  * name ignored if NULL or empty.
  */
@@ -246,9 +662,10 @@ void IDSnoopDevice(const char *snooped_device, const char *snooped_property)
     pthread_mutex_lock(&stdout_mutex);
     xmlv1();
     if (snooped_property && snooped_property[0])
-        printf("<getProperties version='%g' device='%s' name='%s'/>\n", INDIV, snooped_device, snooped_property);
+        printf("<getProperties version='%g' device='%s' name='%s'%s/>\n", INDIV, snooped_device, snooped_property,
+               binaryBLOBAtt());
     else
-        printf("<getProperties version='%g' device='%s'/>\n", INDIV, snooped_device);
+        printf("<getProperties version='%g' device='%s'%s/>\n", INDIV, snooped_device, binaryBLOBAtt());
     fflush(stdout);
     pthread_mutex_unlock(&stdout_mutex);
 }
@@ -278,9 +695,10 @@ void IDSnoopBLOBs(const char *snooped_device, const char *snooped_property, BLOB
     pthread_mutex_lock(&stdout_mutex);
     xmlv1();
     if (snooped_property && snooped_property[0])
-        printf("<enableBLOB device='%s' name='%s'>%s</enableBLOB>\n", snooped_device, snooped_property, how);
+        printf("<enableBLOB device='%s' name='%s'%s>%s</enableBLOB>\n", snooped_device, snooped_property,
+               binaryBLOBAtt(), how);
     else
-        printf("<enableBLOB device='%s'>%s</enableBLOB>\n", snooped_device, how);
+        printf("<enableBLOB device='%s'%s>%s</enableBLOB>\n", snooped_device, binaryBLOBAtt(), how);
     fflush(stdout);
     pthread_mutex_unlock(&stdout_mutex);
 }
@@ -805,6 +1223,211 @@ int IUSnoopSwitch(XMLEle *root, ISwitchVectorProperty *svp)
     return (0);
 }
 
+/* the content of one oneBLOB, decoded as lilxml parsed it. see
+ * dispatchBLOBSink(): base64 is decoded straight into blob, which is then
+ * handed to ISNewBLOB() or copied by IUSnoopBLOB() instead of the element's
+ * pcdata. the entries of a root go once it has been dispatched.
+ */
+typedef struct
+{
+    XMLEle *ep;   /* oneBLOB whose content this is */
+    XMLEle *root; /* its outermost element */
+    char *blob;   /* malloced content so far, decoded */
+    int len;      /* bytes in blob */
+    int max;      /* n malloced in blob */
+    int raw;      /* 1 if the content is rawlen bytes as is, 0 if base64 */
+    int lost;     /* 1 if some of it went with a tree lilxml dropped */
+    int nq;       /* base64 chars in q[] */
+    char q[4];    /* base64 chars waiting for the rest of their quad */
+} SunkBLOB;
+static SunkBLOB *sunk; /* malloced list of oneBLOB contents, in order parsed */
+static int nsunk;      /* n entries in sunk[] */
+static int nsunklost;  /* n entries in sunk[] marked lost */
+#define MAXSUNKLOST 32 /* lost entries kept before all are forgotten */
+
+/* return the entry for ep, or NULL */
+static SunkBLOB *findSunk(XMLEle *ep)
+{
+    int i;
+
+    /* the one being parsed is last */
+    for (i = nsunk - 1; i >= 0; i--)
+        if (sunk[i].ep == ep)
+            return (&sunk[i]);
+    return (NULL);
+}
+
+/* remove sunk[i] */
+static void dropSunk(int i)
+{
+    nsunklost -= sunk[i].lost;
+    free(sunk[i].blob);
+    memmove(&sunk[i], &sunk[i + 1], (--nsunk - i) * sizeof(SunkBLOB));
+}
+
+/* return a new entry for the content of ep, which is about to begin */
+static SunkBLOB *newSunk(XMLEle *ep)
+{
+    SunkBLOB *sp = findSunk(ep);
+    const char *enclen, *rawlen;
+    XMLEle *root;
+    int i;
+
+    /* one for the same ep is left from a tree dropped before */
+    if (sp)
+        dropSunk(sp - sunk);
+
+    /* lost entries linger until their element would be found again, unless
+     * too many pile up.
+     */
+    if (nsunklost > MAXSUNKLOST)
+        for (i = nsunk - 1; i >= 0; i--)
+            if (sunk[i].lost)
+                dropSunk(i);
+
+    assert_mem(sunk = (SunkBLOB *)realloc(sunk, (nsunk + 1) * sizeof(SunkBLOB)));
+    sp = &sunk[nsunk++];
+    memset(sp, 0, sizeof(*sp));
+    for (root = ep; parentXMLEle(root); root = parentXMLEle(root))
+        ;
+    sp->ep   = ep;
+    sp->root = root;
+
+    /* the attributes tell how much is coming, most of the time */
+    rawlen = findXMLAttValu(ep, "rawlen");
+    enclen = findXMLAttValu(ep, "enclen");
+    sp->raw = rawlen[0] != '\0';
+    if (sp->raw)
+        sp->max = atoi(rawlen);
+    else if (enclen[0])
+        sp->max = atoi(enclen) / 4 * 3 + 3;
+    if (sp->max < 64)
+        sp->max = 64;
+    assert_mem(sp->blob = (char *)malloc(sp->max));
+    return (sp);
+}
+
+/* add base64 chars of sp's content, whole quads are decoded */
+static void decodeSunk(SunkBLOB *sp, const char *data, int len)
+{
+    const char *end = data + len;
+    int need        = sp->len + (sp->nq + len) / 4 * 3 + 3;
+
+    if (need > sp->max)
+    {
+        sp->max = need + need / 2;
+        assert_mem(sp->blob = (char *)realloc(sp->blob, sp->max));
+    }
+
+    while (data < end)
+    {
+        const char *eol;
+        int n;
+
+        /* newlines break the base64 into lines */
+        if (*data == '\n')
+        {
+            data++;
+            continue;
+        }
+
+        /* finish a quad begun before */
+        if (sp->nq > 0)
+        {
+            sp->q[sp->nq++] = *data++;
+            if (sp->nq == 4)
+            {
+                sp->len += from64tobits_fast(sp->blob + sp->len, sp->q, 4);
+                sp->nq = 0;
+            }
+            continue;
+        }
+
+        /* whole quads up to the end of the line at once, keep the rest */
+        eol = (const char *)memchr(data, '\n', end - data);
+        if (!eol)
+            eol = end;
+        n = (eol - data) / 4 * 4;
+        if (n > 0)
+        {
+            sp->len += from64tobits_fast(sp->blob + sp->len, data, n);
+            data += n;
+        }
+        while (data < eol)
+            sp->q[sp->nq++] = *data++;
+    }
+}
+
+/* lilxml sink for oneBLOB content, see dispatchBLOBSink() */
+static void sinkBLOB(XMLEle *ep, const char *data, int len, void *userdata)
+{
+    SunkBLOB *sp;
+
+    INDI_UNUSED(userdata);
+
+    /* new content */
+    if (len == 0)
+    {
+        (void)newSunk(ep);
+        return;
+    }
+
+    /* more of it. without an entry its start went with a dropped tree */
+    sp = findSunk(ep);
+    if (!sp)
+    {
+        sp       = newSunk(ep);
+        sp->lost = 1;
+        nsunklost++;
+    }
+    if (sp->lost)
+        return;
+
+    if (sp->raw)
+    {
+        if (sp->len + len > sp->max)
+        {
+            sp->max = sp->len + len;
+            assert_mem(sp->blob = (char *)realloc(sp->blob, sp->max));
+        }
+        memcpy(sp->blob + sp->len, data, len);
+        sp->len += len;
+    }
+    else
+        decodeSunk(sp, data, len);
+}
+
+/* have the oneBLOB content lp parses decoded as it arrives, instead of
+ * collected as pcdata and decoded by dispatch(). the trees lp returns must
+ * all be given to dispatch(), in order, and dispatchXMLError() called when lp
+ * reports an error.
+ */
+void dispatchBLOBSink(LilXML *lp)
+{
+    setXMLPCDataSink(lp, "oneBLOB", sinkBLOB, NULL);
+}
+
+/* lilxml reported an error, so the trees since the last dispatch() may have
+ * been dropped with content of ours. those BLOBs are reported lost when their
+ * tree is dispatched, if it was not dropped after all.
+ */
+void dispatchXMLError(void)
+{
+    int i;
+
+    for (i = 0; i < nsunk; i++)
+    {
+        if (!sunk[i].lost)
+        {
+            sunk[i].lost = 1;
+            nsunklost++;
+            free(sunk[i].blob);
+            sunk[i].blob = NULL;
+            sunk[i].len  = 0;
+        }
+    }
+}
+
 /* crack the snooped driver setBLOBVector message into the given
  * IBLOBVectorProperty. it is not necessary that all IBLOB names be found.
  * return 0 if type, device and name match, else return -1.
@@ -841,7 +1464,29 @@ int IUSnoopBLOB(XMLEle *root, IBLOBVectorProperty *bvp)
             XMLAtt *fa = findXMLAtt(ep, "format");
             XMLAtt *sa = findXMLAtt(ep, "size");
             XMLAtt *ec = findXMLAtt(ep, "enclen");
-            if (fa && sa && ec)
+            XMLAtt *rl = findXMLAtt(ep, "rawlen");
+            SunkBLOB *sp = findSunk(ep);
+            if (sp && sp->lost)
+                continue;
+            if (fa && sa && sp)
+            {
+                /* decoded as it was parsed */
+                bp->bloblen = sp->len;
+                assert_mem(bp->blob = realloc(bp->blob, bp->bloblen > 0 ? bp->bloblen : 1));
+                memcpy(bp->blob, sp->blob, bp->bloblen);
+                strncpy(bp->format, valuXMLAtt(fa), MAXINDIFORMAT);
+                bp->size = atoi(valuXMLAtt(sa));
+            }
+            else if (fa && sa && rl)
+            {
+                /* binary: pcdata is the blob itself */
+                bp->bloblen = pcdatalenXMLEle(ep);
+                assert_mem(bp->blob = realloc(bp->blob, bp->bloblen > 0 ? bp->bloblen : 1));
+                memcpy(bp->blob, pcdataXMLEle(ep), bp->bloblen);
+                strncpy(bp->format, valuXMLAtt(fa), MAXINDIFORMAT);
+                bp->size = atoi(valuXMLAtt(sa));
+            }
+            else if (fa && sa && ec)
             {
                 int enclen  = atoi(valuXMLAtt(ec));
                 assert_mem(bp->blob = realloc(bp->blob, 3 * enclen / 4));
@@ -857,12 +1502,8 @@ int IUSnoopBLOB(XMLEle *root, IBLOBVectorProperty *bvp)
 }
 
 
-/* crack the given INDI XML element and call driver's IS* entry points as they
- *   are recognized.
- * return 0 if ok else -1 with reason in msg[].
- * N.B. exit if getProperties does not proclaim a compatible version.
- */
-int dispatch(XMLEle *root, char msg[])
+/* dispatch() root, see there */
+static int dispatchRoot(XMLEle *root, char msg[])
 {
     char *rtag = tagXMLEle(root);
     XMLEle *ep;
@@ -1118,6 +1759,12 @@ int dispatch(XMLEle *root, char msg[])
                 XMLAtt *fa = findXMLAtt(ep, "format");
                 XMLAtt *sa = findXMLAtt(ep, "size");
                 XMLAtt *el = findXMLAtt(ep, "enclen");
+                SunkBLOB *sp = findSunk(ep);
+                if (sp && sp->lost)
+                {
+                    fprintf(stderr, "%s: %s.%s lost to an XML error\n", me, name, findXMLAttValu(ep, "name"));
+                    continue;
+                }
                 if (na && fa && sa)
                 {
                     if (n >= maxn)
@@ -1129,12 +1776,22 @@ int dispatch(XMLEle *root, char msg[])
                         assert_mem(sizes = (int *)realloc(sizes, maxn * sizeof *sizes));
                         assert_mem(blobsizes = (int *)realloc(blobsizes, maxn * sizeof *blobsizes));
                     }
-                    int bloblen = pcdatalenXMLEle(ep);
-                    // enclen is optional and not required by INDI protocol
-                    if (el)
-                        bloblen = atoi(valuXMLAtt(el));
-                    assert_mem(blobs[n] = (char*)malloc(3 * bloblen / 4));
-                    blobsizes[n] = from64tobits_fast(blobs[n], pcdataXMLEle(ep), bloblen);
+                    if (sp)
+                    {
+                        /* decoded as it was parsed, the driver gets it as is */
+                        blobs[n]     = sp->blob;
+                        blobsizes[n] = sp->len;
+                        sp->blob     = NULL;
+                    }
+                    else
+                    {
+                        int bloblen = pcdatalenXMLEle(ep);
+                        // enclen is optional and not required by INDI protocol
+                        if (el)
+                            bloblen = atoi(valuXMLAtt(el));
+                        assert_mem(blobs[n] = (char*)malloc(3 * bloblen / 4));
+                        blobsizes[n] = from64tobits_fast(blobs[n], pcdataXMLEle(ep), bloblen);
+                    }
                     names[n]     = valuXMLAtt(na);
                     formats[n]   = valuXMLAtt(fa);
                     sizes[n]     = atoi(valuXMLAtt(sa));
@@ -1159,6 +1816,24 @@ int dispatch(XMLEle *root, char msg[])
     return (1);
 }
 
+/* crack the given INDI XML element and call driver's IS* entry points as they
+ *   are recognized.
+ * return 0 if ok else -1 with reason in msg[].
+ * N.B. exit if getProperties does not proclaim a compatible version.
+ */
+int dispatch(XMLEle *root, char msg[])
+{
+    int ret = dispatchRoot(root, msg);
+    int i;
+
+    /* what dispatchBLOBSink() decoded for it is no longer needed */
+    for (i = nsunk - 1; i >= 0; i--)
+        if (sunk[i].root == root)
+            dropSunk(i);
+
+    return (ret);
+}
+
 int IUReadConfig(const char *filename, const char *dev, const char *property, int silent, char errmsg[])
 {
     char *rname, *rdev;
@@ -1776,44 +2451,38 @@ void IUSaveConfigBLOB(FILE *fp, const IBLOBVectorProperty *bvp)
 /* tell client to create a text vector property */
 void IDDefTextVA(const ITextVectorProperty *tvp, const char *fmt, va_list ap)
 {
-    pthread_mutex_lock(&stdout_mutex);
+    MsgBuf *mb = startMsg();
 
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<defTextVector\n");
-    printf("  device='%s'\n", tvp->device);
-    printf("  name='%s'\n", tvp->name);
-    printf("  label='%s'\n", tvp->label);
-    printf("  group='%s'\n", tvp->group);
-    printf("  state='%s'\n", pstateStr(tvp->s));
-    printf("  perm='%s'\n", permStr(tvp->p));
-    printf("  timeout='%g'\n", tvp->timeout);
-    printf("  timestamp='%s'\n", timestamp());
-    if (fmt)
-    {
-        printf("  message='");
-        escapeXML_vprintf(fmt, ap);
-        printf("'\n");
-    }
-    printf(">\n");
+    addLit(mb, "<?xml version='1.0'?>\n");
+    addLit(mb, "<defTextVector\n");
+    addAtt(mb, "  device", tvp->device);
+    addAtt(mb, "  name", tvp->name);
+    addAtt(mb, "  label", tvp->label);
+    addAtt(mb, "  group", tvp->group);
+    addAtt(mb, "  state", pstateStr(tvp->s));
+    addAtt(mb, "  perm", permStr(tvp->p));
+    addNumAtt(mb, "  timeout", tvp->timeout, 6);
+    addStamp(mb, 1, fmt, ap);
 
     for (int i = 0; i < tvp->ntp; i++)
     {
         IText *tp = &tvp->tp[i];
-        printf("  <defText\n");
-        printf("    name='%s'\n", tp->name);
-        printf("    label='%s'>\n", tp->label);
-        printf("      %s\n", tp->text ? tp->text : "");
-        printf("  </defText>\n");
+        addLit(mb, "  <defText\n");
+        addAtt(mb, "    name", tp->name);
+        addLit(mb, "    label='");
+        addStr(mb, tp->label);
+        addLit(mb, "'>\n      ");
+        addStr(mb, tp->text ? tp->text : "");
+        addLit(mb, "\n  </defText>\n");
     }
 
-    printf("</defTextVector>\n");
+    addLit(mb, "</defTextVector>\n");
+
+    pthread_mutex_lock(&stdout_mutex);
 
     /* Add this property to insure proper sanity check */
     rosc_add_unique(tvp->name, tvp->device, tvp->p, tvp, INDI_TEXT);
-
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
+    writeMsg(mb);
 
     pthread_mutex_unlock(&stdout_mutex);
 }
@@ -1829,50 +2498,45 @@ void IDDefText(const ITextVectorProperty *tvp, const char *fmt, ...)
 /* tell client to create a new numeric vector property */
 void IDDefNumberVA(const INumberVectorProperty *n, const char *fmt, va_list ap)
 {
-    pthread_mutex_lock(&stdout_mutex);
+    MsgBuf *mb = startMsg();
 
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<defNumberVector\n");
-    printf("  device='%s'\n", n->device);
-    printf("  name='%s'\n", n->name);
-    printf("  label='%s'\n", n->label);
-    printf("  group='%s'\n", n->group);
-    printf("  state='%s'\n", pstateStr(n->s));
-    printf("  perm='%s'\n", permStr(n->p));
-    printf("  timeout='%g'\n", n->timeout);
-    printf("  timestamp='%s'\n", timestamp());
-    if (fmt)
-    {
-        printf("  message='");
-        escapeXML_vprintf(fmt, ap);
-        printf("'\n");
-    }
-    printf(">\n");
+    addLit(mb, "<?xml version='1.0'?>\n");
+    addLit(mb, "<defNumberVector\n");
+    addAtt(mb, "  device", n->device);
+    addAtt(mb, "  name", n->name);
+    addAtt(mb, "  label", n->label);
+    addAtt(mb, "  group", n->group);
+    addAtt(mb, "  state", pstateStr(n->s));
+    addAtt(mb, "  perm", permStr(n->p));
+    addNumAtt(mb, "  timeout", n->timeout, 6);
+    addStamp(mb, 1, fmt, ap);
 
     for (int i = 0; i < n->nnp; i++)
     {
         INumber *np = &n->np[i];
 
-        printf("  <defNumber\n");
-        printf("    name='%s'\n", np->name);
-        printf("    label='%s'\n", np->label);
-        printf("    format='%s'\n", np->format);
-        printf("    min='%.20g'\n", np->min);
-        printf("    max='%.20g'\n", np->max);
-        printf("    step='%.20g'>\n", np->step);
-        printf("      %.20g\n", np->value);
+        addLit(mb, "  <defNumber\n");
+        addAtt(mb, "    name", np->name);
+        addAtt(mb, "    label", np->label);
+        addAtt(mb, "    format", np->format);
+        addNumAtt(mb, "    min", np->min, 20);
+        addNumAtt(mb, "    max", np->max, 20);
+        addLit(mb, "    step='");
+        addNum(mb, np->step, 20);
+        addLit(mb, "'>\n      ");
+        addNum(mb, np->value, 20);
+        addLit(mb, "\n");
 
-        printf("  </defNumber>\n");
+        addLit(mb, "  </defNumber>\n");
     }
 
-    printf("</defNumberVector>\n");
+    addLit(mb, "</defNumberVector>\n");
+
+    pthread_mutex_lock(&stdout_mutex);
 
     /* Add this property to insure proper sanity check */
     rosc_add_unique(n->name, n->device, n->p, n, INDI_NUMBER);
-
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
+    writeMsg(mb);
 
     pthread_mutex_unlock(&stdout_mutex);
 }
@@ -1888,45 +2552,39 @@ void IDDefNumber(const INumberVectorProperty *n, const char *fmt, ...)
 /* tell client to create a new switch vector property */
 void IDDefSwitchVA(const ISwitchVectorProperty *s, const char *fmt, va_list ap)
 {
-    pthread_mutex_lock(&stdout_mutex);
+    MsgBuf *mb = startMsg();
 
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<defSwitchVector\n");
-    printf("  device='%s'\n", s->device);
-    printf("  name='%s'\n", s->name);
-    printf("  label='%s'\n", s->label);
-    printf("  group='%s'\n", s->group);
-    printf("  state='%s'\n", pstateStr(s->s));
-    printf("  perm='%s'\n", permStr(s->p));
-    printf("  rule='%s'\n", ruleStr(s->r));
-    printf("  timeout='%g'\n", s->timeout);
-    printf("  timestamp='%s'\n", timestamp());
-    if (fmt)
-    {
-        printf("  message='");
-        escapeXML_vprintf(fmt, ap);
-        printf("'\n");
-    }
-    printf(">\n");
+    addLit(mb, "<?xml version='1.0'?>\n");
+    addLit(mb, "<defSwitchVector\n");
+    addAtt(mb, "  device", s->device);
+    addAtt(mb, "  name", s->name);
+    addAtt(mb, "  label", s->label);
+    addAtt(mb, "  group", s->group);
+    addAtt(mb, "  state", pstateStr(s->s));
+    addAtt(mb, "  perm", permStr(s->p));
+    addAtt(mb, "  rule", ruleStr(s->r));
+    addNumAtt(mb, "  timeout", s->timeout, 6);
+    addStamp(mb, 1, fmt, ap);
 
     for (int i = 0; i < s->nsp; i++)
     {
         ISwitch *sp = &s->sp[i];
-        printf("  <defSwitch\n");
-        printf("    name='%s'\n", sp->name);
-        printf("    label='%s'>\n", sp->label);
-        printf("      %s\n", sstateStr(sp->s));
-        printf("  </defSwitch>\n");
+        addLit(mb, "  <defSwitch\n");
+        addAtt(mb, "    name", sp->name);
+        addLit(mb, "    label='");
+        addStr(mb, sp->label);
+        addLit(mb, "'>\n      ");
+        addStr(mb, sstateStr(sp->s));
+        addLit(mb, "\n  </defSwitch>\n");
     }
 
-    printf("</defSwitchVector>\n");
+    addLit(mb, "</defSwitchVector>\n");
+
+    pthread_mutex_lock(&stdout_mutex);
 
     /* Add this property to insure proper sanity check */
     rosc_add_unique(s->name, s->device, s->p, s, INDI_SWITCH);
-
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
+    writeMsg(mb);
 
     pthread_mutex_unlock(&stdout_mutex);
 }
@@ -1942,37 +2600,33 @@ void IDDefSwitch(const ISwitchVectorProperty *s, const char *fmt, ...)
 /* tell client to create a new lights vector property */
 void IDDefLightVA(const ILightVectorProperty *lvp, const char *fmt, va_list ap)
 {
-    pthread_mutex_lock(&stdout_mutex);
+    MsgBuf *mb = startMsg();
 
-    xmlv1();
-    printf("<defLightVector\n");
-    printf("  device='%s'\n", lvp->device);
-    printf("  name='%s'\n", lvp->name);
-    printf("  label='%s'\n", lvp->label);
-    printf("  group='%s'\n", lvp->group);
-    printf("  state='%s'\n", pstateStr(lvp->s));
-    printf("  timestamp='%s'\n", timestamp());
-    if (fmt)
-    {
-        printf("  message='");
-        escapeXML_vprintf(fmt, ap);
-        printf("'\n");
-    }
-    printf(">\n");
+    addLit(mb, "<?xml version='1.0'?>\n");
+    addLit(mb, "<defLightVector\n");
+    addAtt(mb, "  device", lvp->device);
+    addAtt(mb, "  name", lvp->name);
+    addAtt(mb, "  label", lvp->label);
+    addAtt(mb, "  group", lvp->group);
+    addAtt(mb, "  state", pstateStr(lvp->s));
+    addStamp(mb, 0, fmt, ap);
 
     for (int i = 0; i < lvp->nlp; i++)
     {
         ILight *lp = &lvp->lp[i];
-        printf("  <defLight\n");
-        printf("    name='%s'\n", lp->name);
-        printf("    label='%s'>\n", lp->label);
-        printf("      %s\n", pstateStr(lp->s));
-        printf("  </defLight>\n");
+        addLit(mb, "  <defLight\n");
+        addAtt(mb, "    name", lp->name);
+        addLit(mb, "    label='");
+        addStr(mb, lp->label);
+        addLit(mb, "'>\n      ");
+        addStr(mb, pstateStr(lp->s));
+        addLit(mb, "\n  </defLight>\n");
     }
 
-    printf("</defLightVector>\n");
-    fflush(stdout);
+    addLit(mb, "</defLightVector>\n");
 
+    pthread_mutex_lock(&stdout_mutex);
+    writeMsg(mb);
     pthread_mutex_unlock(&stdout_mutex);
 }
 
@@ -1987,43 +2641,35 @@ void IDDefLight(const ILightVectorProperty *lvp, const char *fmt, ...)
 /* tell client to create a new BLOB vector property */
 void IDDefBLOBVA(const IBLOBVectorProperty *b, const char *fmt, va_list ap)
 {
-    pthread_mutex_lock(&stdout_mutex);
+    MsgBuf *mb = startMsg();
 
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<defBLOBVector\n");
-    printf("  device='%s'\n", b->device);
-    printf("  name='%s'\n", b->name);
-    printf("  label='%s'\n", b->label);
-    printf("  group='%s'\n", b->group);
-    printf("  state='%s'\n", pstateStr(b->s));
-    printf("  perm='%s'\n", permStr(b->p));
-    printf("  timeout='%g'\n", b->timeout);
-    printf("  timestamp='%s'\n", timestamp());
-    if (fmt)
-    {
-        printf("  message='");
-        escapeXML_vprintf(fmt, ap);
-        printf("'\n");
-    }
-    printf(">\n");
+    addLit(mb, "<?xml version='1.0'?>\n");
+    addLit(mb, "<defBLOBVector\n");
+    addAtt(mb, "  device", b->device);
+    addAtt(mb, "  name", b->name);
+    addAtt(mb, "  label", b->label);
+    addAtt(mb, "  group", b->group);
+    addAtt(mb, "  state", pstateStr(b->s));
+    addAtt(mb, "  perm", permStr(b->p));
+    addNumAtt(mb, "  timeout", b->timeout, 6);
+    addStamp(mb, 1, fmt, ap);
 
     for (int i = 0; i < b->nbp; i++)
     {
         IBLOB *bp = &b->bp[i];
-        printf("  <defBLOB\n");
-        printf("    name='%s'\n", bp->name);
-        printf("    label='%s'\n", bp->label);
-        printf("  />\n");
+        addLit(mb, "  <defBLOB\n");
+        addAtt(mb, "    name", bp->name);
+        addAtt(mb, "    label", bp->label);
+        addLit(mb, "  />\n");
     }
 
-    printf("</defBLOBVector>\n");
+    addLit(mb, "</defBLOBVector>\n");
+
+    pthread_mutex_lock(&stdout_mutex);
 
     /* Add this property to insure proper sanity check */
     rosc_add_unique(b->name, b->device, b->p, b, INDI_BLOB);
-
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
+    writeMsg(mb);
 
     pthread_mutex_unlock(&stdout_mutex);
 }
@@ -2038,36 +2684,31 @@ void IDDefBLOB(const IBLOBVectorProperty *b, const char *fmt, ...)
 /* tell client to update an existing text vector property */
 void IDSetTextVA(const ITextVectorProperty *tvp, const char *fmt, va_list ap)
 {
-    pthread_mutex_lock(&stdout_mutex);
+    MsgBuf *mb = startMsg();
 
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<setTextVector\n");
-    printf("  device='%s'\n", tvp->device);
-    printf("  name='%s'\n", tvp->name);
-    printf("  state='%s'\n", pstateStr(tvp->s));
-    printf("  timeout='%g'\n", tvp->timeout);
-    printf("  timestamp='%s'\n", timestamp());
-    if (fmt)
-    {
-        printf("  message='");
-        escapeXML_vprintf(fmt, ap);
-        printf("'\n");
-    }
-    printf(">\n");
+    addLit(mb, "<?xml version='1.0'?>\n");
+    addLit(mb, "<setTextVector\n");
+    addAtt(mb, "  device", tvp->device);
+    addAtt(mb, "  name", tvp->name);
+    addAtt(mb, "  state", pstateStr(tvp->s));
+    addNumAtt(mb, "  timeout", tvp->timeout, 6);
+    addStamp(mb, 1, fmt, ap);
 
     for (int i = 0; i < tvp->ntp; i++)
     {
         IText *tp = &tvp->tp[i];
-        printf("  <oneText name='%s'>\n", tp->name);
-        printf("      %s\n", tp->text ? entityXML(tp->text) : "");
-        printf("  </oneText>\n");
+        addLit(mb, "  <oneText name='");
+        addStr(mb, tp->name);
+        addLit(mb, "'>\n      ");
+        if (tp->text)
+            addEscStr(mb, tp->text);
+        addLit(mb, "\n  </oneText>\n");
     }
 
-    printf("</setTextVector>\n");
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
+    addLit(mb, "</setTextVector>\n");
 
+    pthread_mutex_lock(&stdout_mutex);
+    writeMsg(mb);
     pthread_mutex_unlock(&stdout_mutex);
 }
 void IDSetText(const ITextVectorProperty *tvp, const char *fmt, ...)
@@ -2081,36 +2722,30 @@ void IDSetText(const ITextVectorProperty *tvp, const char *fmt, ...)
 /* tell client to update an existing numeric vector property */
 void IDSetNumberVA(const INumberVectorProperty *nvp, const char *fmt, va_list ap)
 {
-    pthread_mutex_lock(&stdout_mutex);
+    MsgBuf *mb = startMsg();
 
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<setNumberVector\n");
-    printf("  device='%s'\n", nvp->device);
-    printf("  name='%s'\n", nvp->name);
-    printf("  state='%s'\n", pstateStr(nvp->s));
-    printf("  timeout='%g'\n", nvp->timeout);
-    printf("  timestamp='%s'\n", timestamp());
-    if (fmt)
-    {
-        printf("  message='");
-        escapeXML_vprintf(fmt, ap);
-        printf("'\n");
-    }
-    printf(">\n");
+    addLit(mb, "<?xml version='1.0'?>\n");
+    addLit(mb, "<setNumberVector\n");
+    addAtt(mb, "  device", nvp->device);
+    addAtt(mb, "  name", nvp->name);
+    addAtt(mb, "  state", pstateStr(nvp->s));
+    addNumAtt(mb, "  timeout", nvp->timeout, 6);
+    addStamp(mb, 1, fmt, ap);
 
     for (int i = 0; i < nvp->nnp; i++)
     {
         INumber *np = &nvp->np[i];
-        printf("  <oneNumber name='%s'>\n", np->name);
-        printf("      %.20g\n", np->value);
-        printf("  </oneNumber>\n");
+        addLit(mb, "  <oneNumber name='");
+        addStr(mb, np->name);
+        addLit(mb, "'>\n      ");
+        addNum(mb, np->value, 20);
+        addLit(mb, "\n  </oneNumber>\n");
     }
 
-    printf("</setNumberVector>\n");
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
+    addLit(mb, "</setNumberVector>\n");
 
+    pthread_mutex_lock(&stdout_mutex);
+    writeMsg(mb);
     pthread_mutex_unlock(&stdout_mutex);
 }
 void IDSetNumber(const INumberVectorProperty *nvp, const char *fmt, ...)
@@ -2124,36 +2759,30 @@ void IDSetNumber(const INumberVectorProperty *nvp, const char *fmt, ...)
 /* tell client to update an existing switch vector property */
 void IDSetSwitchVA(const ISwitchVectorProperty *svp, const char *fmt, va_list ap)
 {
-    pthread_mutex_lock(&stdout_mutex);
+    MsgBuf *mb = startMsg();
 
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<setSwitchVector\n");
-    printf("  device='%s'\n", svp->device);
-    printf("  name='%s'\n", svp->name);
-    printf("  state='%s'\n", pstateStr(svp->s));
-    printf("  timeout='%g'\n", svp->timeout);
-    printf("  timestamp='%s'\n", timestamp());
-    if (fmt)
-    {
-        printf("  message='");
-        escapeXML_vprintf(fmt, ap);
-        printf("'\n");
-    }
-    printf(">\n");
+    addLit(mb, "<?xml version='1.0'?>\n");
+    addLit(mb, "<setSwitchVector\n");
+    addAtt(mb, "  device", svp->device);
+    addAtt(mb, "  name", svp->name);
+    addAtt(mb, "  state", pstateStr(svp->s));
+    addNumAtt(mb, "  timeout", svp->timeout, 6);
+    addStamp(mb, 1, fmt, ap);
 
     for (int i = 0; i < svp->nsp; i++)
     {
         ISwitch *sp = &svp->sp[i];
-        printf("  <oneSwitch name='%s'>\n", sp->name);
-        printf("      %s\n", sstateStr(sp->s));
-        printf("  </oneSwitch>\n");
+        addLit(mb, "  <oneSwitch name='");
+        addStr(mb, sp->name);
+        addLit(mb, "'>\n      ");
+        addStr(mb, sstateStr(sp->s));
+        addLit(mb, "\n  </oneSwitch>\n");
     }
 
-    printf("</setSwitchVector>\n");
-    indi_locale_C_numeric_pop(orig);
-    fflush(stdout);
+    addLit(mb, "</setSwitchVector>\n");
 
+    pthread_mutex_lock(&stdout_mutex);
+    writeMsg(mb);
     pthread_mutex_unlock(&stdout_mutex);
 }
 void IDSetSwitch(const ISwitchVectorProperty *svp, const char *fmt, ...)
@@ -2167,33 +2796,29 @@ void IDSetSwitch(const ISwitchVectorProperty *svp, const char *fmt, ...)
 /* tell client to update an existing lights vector property */
 void IDSetLightVA(const ILightVectorProperty *lvp, const char *fmt, va_list ap)
 {
-    pthread_mutex_lock(&stdout_mutex);
+    MsgBuf *mb = startMsg();
 
-    xmlv1();
-    printf("<setLightVector\n");
-    printf("  device='%s'\n", lvp->device);
-    printf("  name='%s'\n", lvp->name);
-    printf("  state='%s'\n", pstateStr(lvp->s));
-    printf("  timestamp='%s'\n", timestamp());
-    if (fmt)
-    {
-        printf("  message='");
-        escapeXML_vprintf(fmt, ap);
-        printf("'\n");
-    }
-    printf(">\n");
+    addLit(mb, "<?xml version='1.0'?>\n");
+    addLit(mb, "<setLightVector\n");
+    addAtt(mb, "  device", lvp->device);
+    addAtt(mb, "  name", lvp->name);
+    addAtt(mb, "  state", pstateStr(lvp->s));
+    addStamp(mb, 0, fmt, ap);
 
     for (int i = 0; i < lvp->nlp; i++)
     {
         ILight *lp = &lvp->lp[i];
-        printf("  <oneLight name='%s'>\n", lp->name);
-        printf("      %s\n", pstateStr(lp->s));
-        printf("  </oneLight>\n");
+        addLit(mb, "  <oneLight name='");
+        addStr(mb, lp->name);
+        addLit(mb, "'>\n      ");
+        addStr(mb, pstateStr(lp->s));
+        addLit(mb, "\n  </oneLight>\n");
     }
 
-    printf("</setLightVector>\n");
-    fflush(stdout);
+    addLit(mb, "</setLightVector>\n");
 
+    pthread_mutex_lock(&stdout_mutex);
+    writeMsg(mb);
     pthread_mutex_unlock(&stdout_mutex);
 }
 void IDSetLight(const ILightVectorProperty *lvp, const char *fmt, ...)
@@ -2204,27 +2829,25 @@ void IDSetLight(const ILightVectorProperty *lvp, const char *fmt, ...)
     va_end(ap);
 }
 
-/* tell client to update an existing BLOB vector property */
-void IDSetBLOBVA(const IBLOBVectorProperty *bvp, const char *fmt, va_list ap)
-{
-    pthread_mutex_lock(&stdout_mutex);
-
-    xmlv1();
-    locale_char_t *orig = indi_locale_C_numeric_push();
-    printf("<setBLOBVector\n");
-    printf("  device='%s'\n", bvp->device);
-    printf("  name='%s'\n", bvp->name);
-    printf("  state='%s'\n", pstateStr(bvp->s));
-    printf("  timeout='%g'\n", bvp->timeout);
-    printf("  timestamp='%s'\n", timestamp());
+/* print the setBLOBVector for bvp to out. if fds is not NULL, each BLOB
+ * with fds[i] >= 0 is only described, its bytes are in that segment.
+ */
+static void writeBLOBVector(FILE *out, const IBLOBVectorProperty *bvp, const int *fds, const char *fmt, va_list ap)
+{
+    fprintf(out, "<setBLOBVector\n");
+    fprintf(out, "  device='%s'\n", bvp->device);
+    fprintf(out, "  name='%s'\n", bvp->name);
+    fprintf(out, "  state='%s'\n", pstateStr(bvp->s));
+    fprintf(out, "  timeout='%g'\n", bvp->timeout);
+    fprintf(out, "  timestamp='%s'\n", timestamp());
     if (fmt)
     {
-        printf("  message='");
+        fprintf(out, "  message='");
         // #PS: missing escapeXML_fputs ?
-        vprintf(fmt, ap);
-        printf("'\n");
+        vfprintf(out, fmt, ap);
+        fprintf(out, "'\n");
     }
-    printf(">\n");
+    fprintf(out, ">\n");
 
     for (int i = 0; i < bvp->nbp; i++)
     {
@@ -2232,15 +2855,32 @@ void IDSetBLOBVA(const IBLOBVectorProperty *bvp, const char *fmt, va_list ap)
         unsigned char *encblob;
         int l;
 
-        printf("  <oneBLOB\n");
-        printf("    name='%s'\n", bp->name);
-        printf("    size='%d'\n", bp->size);
+        fprintf(out, "  <oneBLOB\n");
+        fprintf(out, "    name='%s'\n", bp->name);
+        fprintf(out, "    size='%d'\n", bp->size);
 
         // If size is zero, we are only sending a state-change
         if (bp->size == 0)
         {
-            printf("    enclen='0'\n");
-            printf("    format='%s'>\n", bp->format);
+            fprintf(out, "    enclen='0'\n");
+            fprintf(out, "    format='%s'>\n", bp->format);
+        }
+        else if (fds && fds[i] >= 0)
+        {
+            /* the bytes are in the segment sent along with this message */
+            fprintf(out, "    shmlen='%d'\n", bp->bloblen);
+            fprintf(out, "    format='%s'>\n", bp->format);
+        }
+        else if (binaryBLOBs())
+        {
+            /* exactly rawlen bytes follow the '>' as is */
+            fprintf(out, "    rawlen='%d'\n", bp->bloblen);
+            fprintf(out, "    format='%s'>", bp->format);
+            if (fwrite(bp->blob, 1, bp->bloblen, out) != (size_t)bp->bloblen)
+            {
+                fprintf(stderr, "%s(%s): Failed to write BLOB.\n", me, __func__);
+                exit(1);
+            }
         }
         else
         {
@@ -2251,31 +2891,208 @@ void IDSetBLOBVA(const IBLOBVectorProperty *bvp, const char *fmt, va_list ap)
                 fprintf(stderr, "%s(%s): Not enough memory for decoding.\n", me, __func__);
                 exit(1);
             }
-            printf("    enclen='%d'\n", l);
-            printf("    format='%s'>\n", bp->format);
+            fprintf(out, "    enclen='%d'\n", l);
+            fprintf(out, "    format='%s'>\n", bp->format);
             size_t written = 0;
 
             while ((int)written < l)
             {
                 size_t towrite = ((l - written) > 72) ? 72 : l - written;
-                size_t wr      = fwrite(encblob + written, 1, towrite, stdout);
+                size_t wr      = fwrite(encblob + written, 1, towrite, out);
 
                 if (wr > 0)
                     written += wr;
                 if ((written % 72) == 0)
-                    fputc('\n', stdout);
+                    fputc('\n', out);
             }
 
             if ((written % 72) != 0)
-                fputc('\n', stdout);
+                fputc('\n', out);
 
             free(encblob);
         }
 
-        printf("  </oneBLOB>\n");
+        fprintf(out, "  </oneBLOB>\n");
     }
 
-    printf("</setBLOBVector>\n");
+    fprintf(out, "</setBLOBVector>\n");
+}
+
+#ifdef HAVE_SHMBLOB
+/* return 1 if our indiserver takes BLOBs in shm segments, else 0. it only
+ * ever says so along with BINBLOBENV.
+ */
+static int shmBLOBs(void)
+{
+    static int shm = -1;
+
+    if (shm < 0)
+    {
+        const char *env = getenv(SHMBLOBENV);
+        shm             = binaryBLOBs() && env && atoi(env) > 0;
+    }
+    return (shm);
+}
+
+/* copy each non-empty BLOB of bvp into a new sealed memfd in fds[], -1 for
+ * the others. return 0 if ok, else -1 with none left open.
+ */
+static int makeBLOBShm(const IBLOBVectorProperty *bvp, int fds[])
+{
+    int i;
+
+    for (i = 0; i < bvp->nbp; i++)
+        fds[i] = -1;
+
+    for (i = 0; i < bvp->nbp; i++)
+    {
+        IBLOB *bp        = &bvp->bp[i];
+        const char *data   = (const char *)bp->blob;
+        size_t left      = bp->bloblen;
+
+        if (bp->size == 0 || bp->bloblen <= 0)
+            continue;
+
+        fds[i] = syscall(SYS_memfd_create, "indiblob", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fds[i] < 0 || ftruncate(fds[i], bp->bloblen) < 0)
+            goto fail;
+        while (left > 0)
+        {
+            ssize_t nw = write(fds[i], data, left);
+
+            if (nw < 0 && errno == EINTR)
+                continue;
+            if (nw <= 0)
+                goto fail;
+            data += nw;
+            left -= nw;
+        }
+
+        /* readers may trust the size and content from now on */
+        if (fcntl(fds[i], F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0)
+            goto fail;
+    }
+
+    return (0);
+
+fail:
+    fprintf(stderr, "%s(%s): BLOB segment: %s, sending inline.\n", me, __func__, strerror(errno));
+    for (i = 0; i < bvp->nbp; i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+    return (-1);
+}
+
+/* write the n bytes of buf to our stdout with the segments in fds[] that are
+ * >= 0 attached to the first of them. return 0 if ok, else -1.
+ */
+static int sendBLOBShm(const char *buf, size_t n, const int fds[], int nfds)
+{
+    union
+    {
+        struct cmsghdr h;
+        char b[CMSG_SPACE(MAXSHMFDS * sizeof(int))];
+    } cbuf;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cm;
+    int i, nsend = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&cbuf, 0, sizeof(cbuf));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = cbuf.b;
+    msg.msg_controllen = sizeof(cbuf.b);
+    cm                 = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level     = SOL_SOCKET;
+    cm->cmsg_type      = SCM_RIGHTS;
+    for (i = 0; i < nfds; i++)
+        if (fds[i] >= 0)
+            memcpy(CMSG_DATA(cm) + nsend++ * sizeof(int), &fds[i], sizeof(int));
+    cm->cmsg_len       = CMSG_LEN(nsend * sizeof(int));
+    msg.msg_controllen = CMSG_SPACE(nsend * sizeof(int));
+
+    while (n > 0)
+    {
+        ssize_t nw;
+
+        iov.iov_base = (void *)buf;
+        iov.iov_len  = n;
+        nw           = sendmsg(STDOUT_FILENO, &msg, 0);
+        if (nw < 0 && errno == EINTR)
+            continue;
+        if (nw <= 0)
+            return (-1);
+
+        /* the segments went with the first byte */
+        msg.msg_control    = NULL;
+        msg.msg_controllen = 0;
+        buf += nw;
+        n -= nw;
+    }
+
+    return (0);
+}
+
+/* send bvp with its BLOBs in shm segments if our indiserver takes them and
+ * they are worth it. caller holds stdout_mutex.
+ * return 0 if sent, else -1 to send inline with nothing written.
+ */
+static int setBLOBVectorShm(const IBLOBVectorProperty *bvp, const char *fmt, va_list ap)
+{
+    int fds[MAXSHMFDS];
+    size_t total = 0, nbuf = 0;
+    char *buf    = NULL;
+    FILE *out;
+    int i;
+
+    if (!shmBLOBs() || bvp->nbp > MAXSHMFDS)
+        return (-1);
+    for (i = 0; i < bvp->nbp; i++)
+        if (bvp->bp[i].size != 0 && bvp->bp[i].bloblen > 0)
+            total += bvp->bp[i].bloblen;
+    if (total < SHMBLOBMIN || makeBLOBShm(bvp, fds) < 0)
+        return (-1);
+
+    /* the markup goes in one write with the segments so they arrive together */
+    out = open_memstream(&buf, &nbuf);
+    if (!out)
+    {
+        for (i = 0; i < bvp->nbp; i++)
+            if (fds[i] >= 0)
+                close(fds[i]);
+        return (-1);
+    }
+    writeBLOBVector(out, bvp, fds, fmt, ap);
+    fclose(out);
+
+    fflush(stdout);
+    if (sendBLOBShm(buf, nbuf, fds, bvp->nbp) < 0)
+    {
+        fprintf(stderr, "%s(%s): Failed to send BLOB: %s\n", me, __func__, strerror(errno));
+        exit(1);
+    }
+
+    free(buf);
+    for (i = 0; i < bvp->nbp; i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+    return (0);
+}
+#endif
+
+/* tell client to update an existing BLOB vector property */
+void IDSetBLOBVA(const IBLOBVectorProperty *bvp, const char *fmt, va_list ap)
+{
+    pthread_mutex_lock(&stdout_mutex);
+
+    xmlv1();
+    locale_char_t *orig = indi_locale_C_numeric_push();
+#ifdef HAVE_SHMBLOB
+    if (setBLOBVectorShm(bvp, fmt, ap) < 0)
+#endif
+        writeBLOBVector(stdout, bvp, NULL, fmt, ap);
     indi_locale_C_numeric_pop(orig);
     fflush(stdout);
 
@@ -40,6 +40,8 @@ extern char *me;       /* a.out name */
 //extern LilXML *clixml; /* XML parser context */
 
 extern int dispatch(XMLEle *root, char msg[]);
+extern void dispatchBLOBSink(LilXML *lp);
+extern void dispatchXMLError(void);
 //extern void clientMsgCB(int fd, void *arg);
 
 /**
@@ -47,23 +47,37 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
-#define MAXRBUF 2048
+#define MAXRBUF    2048      /* dispatch and XML error messages */
+#define MINREADBUF 65536     /* first size of the read buffer */
+#define MAXREADBUF 4194304   /* the read buffer grows no larger */
+
+/* what clientMsgCB() keeps from one call to the next */
+typedef struct
+{
+    LilXML *lp; /* parser for all that comes from the client */
+    char *buf;  /* malloced read buffer */
+    int size;   /* n malloced in buf */
+} ClientIn;
 
 static void usage(void);
 
 /* callback when INDI client message arrives on stdin.
- * collect and dispatch when see outter element closure.
+ * read all there is, up to a buffer full, parse it at once and dispatch
+ * each message completed. the buffer doubles each time a read fills it,
+ * so a BLOB arriving takes few reads. oneBLOB content is decoded as it is
+ * parsed, see dispatchBLOBSink().
  * exit if OS trouble or see incompatable INDI version.
- * arg is not used.
+ * arg is our ClientIn.
  */
 static void clientMsgCB(int fd, void *arg)
 {
-    LilXML *clixml = (LilXML*)arg;
-    char buf[MAXRBUF], msg[MAXRBUF], *bp;
-    int nr;
+    ClientIn *cip = (ClientIn *)arg;
+    char msg[MAXRBUF], err[MAXRBUF];
+    XMLEle **nodes;
+    int i, nr;
 
     /* one read */
-    nr = read(fd, buf, sizeof(buf));
+    nr = read(fd, cip->buf, cip->size);
     if (nr < 0)
     {
         fprintf(stderr, "%s: %s\n", me, strerror(errno));
@@ -75,18 +89,34 @@ static void clientMsgCB(int fd, void *arg)
         exit(1);
     }
 
-    /* crack and dispatch when complete */
-    for (bp = buf; nr-- > 0; bp++)
+    /* crack and dispatch those complete.
+     * N.B. a driver may run the event loop from dispatch, and so us again:
+     *   buf is all parsed by then.
+     */
+    nodes = parseXMLChunk(cip->lp, cip->buf, nr, err);
+    for (i = 0; nodes && nodes[i]; i++)
+    {
+        if (dispatch(nodes[i], msg) < 0)
+            fprintf(stderr, "%s dispatch error: %s\n", me, msg);
+        delXMLEle(nodes[i]);
+    }
+    free(nodes);
+    if (err[0])
     {
-        XMLEle *root = readXMLEle(clixml, *bp, msg);
-        if (root)
+        fprintf(stderr, "%s XML error: %s\n", me, err);
+        dispatchXMLError();
+    }
+
+    /* more may be waiting than fit */
+    if (nr == cip->size && cip->size < MAXREADBUF)
+    {
+        char *nb = (char *)realloc(cip->buf, 2 * cip->size);
+
+        if (nb)
         {
-            if (dispatch(root, msg) < 0)
-                fprintf(stderr, "%s dispatch error: %s\n", me, msg);
-            delXMLEle(root);
+            cip->buf = nb;
+            cip->size *= 2;
         }
-        else if (msg[0])
-            fprintf(stderr, "%s XML error: %s\n", me, msg);
     }
 }
 
@@ -124,8 +154,18 @@ int main(int ac, char *av[])
         usage();
 
     /* init */
-    LilXML *clixml = newLilXML();
-    addCallback(0, clientMsgCB, clixml);
+    static ClientIn clin;
+    clin.lp   = newLilXML();
+    setXMLRawTag(clin.lp, "oneBLOB");
+    clin.size = MINREADBUF;
+    clin.buf  = (char *)malloc(clin.size);
+    if (!clin.buf)
+    {
+        fprintf(stderr, "%s: no memory for read buffer\n", me);
+        exit(1);
+    }
+    dispatchBLOBSink(clin.lp);
+    addCallback(0, clientMsgCB, &clin);
 
     /* service client */
     eventLoop();
@@ -41,26 +41,102 @@
  * one client or device, they are queued and only removed after the last
  * consumer is finished. XMLEle are converted to linear strings before being
  * sent to optimize write system calls and avoid blocking to slow clients.
- * Clients that get more than maxqsiz bytes behind are shut down.
+ * Each time a client or driver can take more we write as many of its queued
+ * messages as fit in its socket send buffer (-w), or MAXWSIZ for pipes, with
+ * one writev. Client and chained server sockets are nonblocking so this never
+ * waits for a slow reader.
+ * The exception is setBLOBVector from drivers: their bytes are forwarded as
+ * received, only the markup around the base64 content is parsed to route them.
+ *
+ * BLOB content may also travel as raw bytes instead of base64: a oneBLOB with
+ * a rawlen attribute is followed by exactly that many bytes. We tell local
+ * drivers we accept this with BINBLOBENV in their environment, they and
+ * clients say they accept it with binaryBLOB='1'. Clients must say so in
+ * their first message, so a getProperties relayed by an older chained
+ * indiserver can not claim it for a peer that would choke on raw bytes.
+ * When a binary BLOB is also wanted by a legacy peer one base64 copy is made
+ * for all of them.
+ *
+ * Local drivers' stdout is a unix domain socket when possible, SHMBLOBENV then
+ * tells them they may also hand over BLOB content in sealed shared memory
+ * segments sent with the markup: such a oneBLOB has shmlen instead of rawlen
+ * and no content. Clients on our unix domain socket (-u) that also say
+ * shmBLOB='1' in their first message get the same markup and segments, all
+ * others get the content inline. We close a segment along with the last Msg
+ * that refers to it.
+ * Clients that get more than maxqsiz bytes behind are shut down. Clients more
+ * than maxstreamsiz bytes behind are sent fewer BLOBs, how is up to the slow
+ * consumer policy (-b): drop streaming BLOBs, drop a queued BLOB when a newer
+ * one of the same property is queued, or send no BLOBs until the queue has
+ * drained. Each client queue keeps a running count of its bytes for this.
+ * Clients that say conflate='1' in their first message, or all with -c, get
+ * property updates conflated: a setNumberVector, setSwitchVector or
+ * setLightVector takes the place of the one of the same property still queued
+ * for them, so a slow link gets the latest values instead of an ever longer
+ * backlog. Only if nothing is lost: the queued one must have no message and
+ * the newer one must carry all of its members, else both go.
+ *
+ * All fds are registered once with a small io engine that reports readiness.
+ * On Linux it is backed by epoll so the cost of a wakeup does not depend on
+ * the number of connected clients and drivers; elsewhere (or if epoll is not
+ * available at runtime) it falls back to select(). Write interest is only
+ * registered while a client or driver has something queued.
+ *
+ * Who wants what is kept in a routing table, see route.c, keyed by device and
+ * property name: the clients that asked for it, the drivers snooping on it and
+ * the drivers serving the device. It is updated as getProperties, enableBLOB
+ * and new devices are seen, so routing a message does not depend on how many
+ * properties each client or driver watches.
+ *
+ * Msgs, their content, queues and the parse trees of each message come from
+ * a pool, see pool.c, that keeps freed blocks for reuse, and each parse tree
+ * lives in one lilxml arena freed all at once. Once traffic settles routing
+ * no longer goes to the heap, -v logs how often it still does.
+ *
+ * With -z we ask chained servers for a compressed link in the getProperties
+ * that opens it. One that agrees, see startClientZL(), deflates all it sends
+ * from then on and inflates all it reads, and so do we: one stream each way
+ * for as long as the link lasts, see zlink.c, so the markup repeated in every
+ * message hardly costs anything. Queued Msgs count as sent once compressed.
+ * A server that says nothing for ZLWAITUS is taken not to know how.
+ *
+ * Each client and driver keeps counters of its traffic, queue, parsing time
+ * and, for Msgs read from drivers, how long they took to be written to each
+ * client. "metrics [path]" on the fifo (-f) writes them all to path, or to
+ * stderr, see writeMetrics(). It is only a snapshot taken when asked, so
+ * nothing waits for whoever collects them.
+ *
+ * With -L all that is read from drivers and clients also goes to a capture
+ * file, stamped with when and from whom, see captureIO(). The replay tool in
+ * test/benchmarks plays one back as synthetic drivers and clients against
+ * any indiserver, so real traffic can be benchmarked without the hardware.
  */
 
 #define _GNU_SOURCE // needed for siginfo_t and sigaction
 
 #include "config.h"
 
+#include "base64.h"
 #include "fq.h"
 #include "indiapi.h"
 #include "indidevapi.h"
 #include "lilxml.h"
+#include "pool.h"
+#include "route.h"
+#include "zlink.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
 #include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
@@ -71,6 +147,14 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#if defined(__linux__) && !defined(INDI_IO_SELECT)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 // added by Mike for stacktracing
 #include <stdio.h>
@@ -84,11 +168,37 @@
 #define REMOTEDVR     (-1234) /* invalid PID to flag remote drivers */
 #define MAXSBUF       512
 #define MAXRBUF       49152 /* max read buffering here */
-#define MAXWSIZ       49152 /* max bytes/write */
+#define MAXWSIZ       49152 /* min bytes/write, all there is for pipes */
+#define MAXWIOV       64    /* max Msgs/write */
 #define SHORTMSGSIZ   2048  /* buf size for most messages */
 #define DEFMAXQSIZ    128   /* default max q behind, MB */
 #define DEFMAXSSIZ    5     /* default max stream behind, MB */
 #define DEFMAXRESTART 10    /* default max restarts */
+#define MAXIOEVENTS   64    /* max ready fds handled per wakeup */
+#define UNIXSNDBUF    (4 * 1024 * 1024) /* SO_SNDBUF of unix domain clients unless -w, capped by the system */
+#define NLATBINS      26    /* fan-out latency bins: < 1 us, then < 2^k us, see writeMetrics() */
+
+/* drivers' setBLOBVector are forwarded as sent, these mark where one begins and ends */
+#define BLOBTAG    "<setBLOBVector"
+#define BLOBENDTAG "</setBLOBVector>"
+
+/* set for local drivers to tell them they may send raw BLOB content */
+#define BINBLOBENV "INDIBINARYBLOB"
+
+/* set for local drivers to tell them they may send BLOBs in shm segments */
+#define SHMBLOBENV "INDISHMBLOB"
+#define MAXSHMFDS  16 /* most segments taken with one message */
+
+/* a chained server asking for a compressed link, see startRemoteDvr(), and
+ * the answer that starts it: all that follows it either way is deflated.
+ */
+#define ZLMETHOD "deflate"
+#define ZLACK    "<compressLink method='" ZLMETHOD "'/>\n"
+#define ZLWAITUS 3000000ULL /* us to wait for the answer before going on plain */
+
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
 
 #ifdef OSX_EMBEDED_MODE
 #define LOGNAME  "/Users/%s/Library/Logs/indiserver.log"
@@ -96,14 +206,81 @@
 #endif
 
 /* associate a usage count with queuded client or device message */
-typedef struct
+typedef struct _Msg
 {
     int count;         /* number of consumers left */
     unsigned long cl;  /* content length */
     char *cp;          /* content: buf or malloced */
+    struct _Msg *b64;  /* while routing binary BLOBs: copy for legacy peers */
+    struct _Msg *inl;  /* while routing shm BLOBs: copy with their content inline */
+    int *fds;          /* malloced shm segments sent along, closed with us */
+    int nfds;          /* n entries in fds[] */
+    size_t shmlen;     /* bytes in those segments */
+    unsigned long long tread; /* monoUs() when read from a driver, else 0 */
+    int from;          /* index into dvrinfo[] of that driver */
     char buf[SHORTMSGSIZ];    /* local buf for most messages */
 } Msg;
 
+/* counters of one client or driver for the metrics report, see writeMetrics().
+ * N.B. only changed with srvlock held.
+ */
+typedef struct
+{
+    unsigned long long inbytes;  /* bytes read, after inflating */
+    unsigned long inmsgs;        /* messages read */
+    unsigned long long outbytes; /* bytes written, before deflating */
+    unsigned long outmsgs;       /* messages written */
+    int maxqmsgs;                /* most Msgs queued at once */
+    long maxqbytes;              /* most bytes queued at once, clients only */
+    unsigned long dropped;       /* BLOBs not sent to a slow client, see -b */
+    unsigned long conflated;     /* set*Vectors replaced by newer ones while queued */
+    unsigned long long parseus;  /* microseconds parsing what was read */
+    unsigned long lat[NLATBINS]; /* Msgs from drivers by microseconds from read to written */
+} Metrics;
+
+/* where the content of one oneBLOB is in a raw setBLOBVector */
+typedef struct
+{
+    size_t off; /* offset of first byte, or where it would go if in shm */
+    size_t len; /* rawlen, shmlen or n base64 chars */
+    int fd;     /* shm segment with the content, else -1 */
+    size_t att; /* offset of the shmlen attribute name */
+    int empty;  /* 1 if the shm oneBLOB start tag ends with /> */
+    int b64;    /* 1 if the content is base64 already, or there is none */
+    char *map;  /* segment mapped while making copies, else NULL */
+} BLOBSlice;
+
+/* what to do with BLOBs for clients more than maxstreamsiz bytes behind */
+typedef enum
+{
+    SC_STREAM,    /* drop those whose format says stream */
+    SC_SUPERSEDE, /* drop queued ones when a newer one of the same property comes */
+    SC_PAUSE      /* drop them all until the client queue drains */
+} SlowPolicy;
+
+/* how far a compressed link to a chained server has come, see startRemoteDvr() */
+typedef enum
+{
+    ZL_OFF,  /* plain */
+    ZL_ASK,  /* asking, the request is still queued */
+    ZL_WAIT, /* asked, nothing more goes until the server answers or ZLWAITUS */
+    ZL_ON    /* compressed both ways */
+} ZLState;
+
+/* the last set*Vector of one property queued for a client, kept so a newer
+ * one can take its place, see replaceClientMsg()
+ */
+typedef struct
+{
+    char dev[MAXINDIDEVICE];
+    char name[MAXINDINAME];
+    unsigned int hash; /* hashRoute() of dev and name */
+    unsigned long seq; /* nth Msg queued for the client, from 0 */
+    int used;          /* 1 when this slot is in use */
+    int hasmsg;        /* 1 if it has a message attribute, or we could not note its members */
+    char *members;     /* malloced names of its members, each nul terminated, then an empty one */
+} QProp;
+
 /* device + property name */
 typedef struct
 {
@@ -129,15 +306,35 @@ struct
 /* info for each connected client */
 typedef struct
 {
-    int active;         /* 1 when this record is in use */
-    Property *props;    /* malloced array of props we want */
-    int nprops;         /* n entries in props[] */
-    int allprops;       /* saw getProperties w/o device */
-    BLOBHandling blob;  /* when to send setBLOBs */
-    int s;              /* socket for this client */
-    LilXML *lp;         /* XML parsing context */
-    FQ *msgq;           /* Msg queue */
-    unsigned int nsent; /* bytes of current Msg sent so far */
+    int active;             /* 1 when this record is in use */
+    Property *props;        /* malloced array of props we want */
+    int nprops;             /* n entries in props[] */
+    int allprops;           /* saw getProperties w/o device */
+    BLOBHandling blob;      /* when to send setBLOBs */
+    int s;                  /* socket for this client */
+    LilXML *lp;             /* XML parsing context */
+    FQ *msgq;               /* Msg queue */
+    unsigned int nsent;     /* bytes of current Msg sent so far */
+    int greeted;            /* 1 once its first message has been seen */
+    int rawblobs;           /* 1 if it takes binary BLOBs */
+    int unixsock;           /* 1 if connected to usocket */
+    int shmblobs;           /* 1 if it takes shm BLOBs */
+    unsigned int routed;    /* routemark when last picked for a message */
+    long qbytes;            /* bytes in msgq, but for qlast */
+    Msg *qlast;             /* last Msg queued if not yet in qbytes, see clientQSize() */
+    unsigned long npushed;  /* Msgs queued so far */
+    unsigned long npopped;  /* Msgs sent so far */
+    QProp *qprops;          /* malloced hash table of set*Vectors queued, by property */
+    int nqprops;            /* n entries used in qprops[] */
+    int mqprops;            /* n entries malloced in qprops[], a power of 2 */
+    int blobspaused;        /* 1 while no BLOBs go to it, for SC_PAUSE */
+    int conflate;           /* 1 if newer set*Vectors replace queued ones */
+    size_t wbudget;         /* max bytes per write, see setupSocket() */
+    int nflight;            /* Msgs at the head of msgq its writer thread is writing */
+    int writing;            /* 1 while its writer thread writes to s without srvlock */
+    int closing;            /* 1 if its writer thread is to close s once done writing */
+    ZL *zl;                 /* compressed link if it asked for one, else NULL */
+    Metrics m;              /* counters, see writeMetrics() */
 } ClInfo;
 static ClInfo *clinfo; /*  malloced pool of clients */
 static int nclinfo;    /* n total (not active) */
@@ -166,19 +363,132 @@ typedef struct
     LilXML *lp;         /* XML parsing context */
     FQ *msgq;           /* Msg queue */
     unsigned int nsent; /* bytes of current Msg sent so far */
+    char *bbuf;         /* malloced raw setBLOBVector being collected, or NULL */
+    size_t nbbuf;       /* bytes in bbuf */
+    size_t mbbuf;       /* malloced size of bbuf */
+    size_t bfed;        /* bbuf[0..bfed) already given to lp or skipped */
+    size_t bscan;       /* where to look next for the tag we want in bbuf */
+    int binblob;        /* 1 while skipping oneBLOB content in bbuf */
+    char bpend[sizeof(BLOBTAG)]; /* possible start of BLOBTAG held back from lp */
+    int nbpend;                  /* n bytes in bpend */
+    BLOBSlice *rawb;    /* malloced oneBLOBs in bbuf, in order */
+    int nrawb;          /* n entries used in rawb[] */
+    int mrawb;          /* n entries malloced in rawb[] */
+    int rawblobs;       /* 1 if local driver takes binary snooped BLOBs */
+    int nshmb;          /* n entries in rawb[] that are shm segments */
+    int nb64b;          /* n entries in rawb[] that are base64 */
+    int fdpass;         /* 1 if rfd is a socket that may carry shm segments */
+    int *shmfds;        /* malloced shm segments received, not yet claimed */
+    int nshmfds;        /* n entries used in shmfds[] */
+    int mshmfds;        /* n entries malloced in shmfds[] */
+    size_t wbudget;     /* max bytes per write, see setupSocket() */
+    unsigned int gen;   /* dvrgen when last started */
+    int reading;        /* 1 while its reader thread reads it without srvlock */
+    ZL *zl;             /* compressed link once the chained server agreed, else NULL */
+    ZLState zstate;     /* how far asking for zl has come, for writing */
+    int zwant;          /* 1 while its answer is to be read */
+    int zhave;          /* n bytes of ZLACK read so far */
+    unsigned long long zasked; /* monoUs() when zstate became ZL_WAIT */
+    Metrics m;          /* counters over all restarts, see writeMetrics() */
+    unsigned long long tread;  /* monoUs() of the last read, reader's own */
+    unsigned long long nread;  /* bytes read not yet in m, reader's own */
+    unsigned long long nparse; /* microseconds parsing not yet in m, reader's own */
 } DvrInfo;
 static DvrInfo *dvrinfo; /* malloced array of drivers */
 static int ndvrinfo;     /* n total */
 
+/* what an fd registered with the io engine belongs to */
+typedef enum
+{
+    IO_NONE = 0, /* slot not in use */
+    IO_LISTEN,   /* lsocket or usocket */
+    IO_FIFO,     /* fifo.fd */
+    IO_CLIENT,   /* clinfo[idx].s */
+    IO_DRIVER,   /* dvrinfo[idx] rfd, wfd or efd */
+    IO_WAKE      /* mainwake.wake[0] */
+} IOKind;
+
+#define IO_READ  1 /* interested in fd being readable */
+#define IO_WRITE 2 /* interested in fd being writable */
+
+/* registration of one fd, ioslots[] is indexed by fd.
+ * N.B. we keep indices, not pointers, since clinfo and dvrinfo are realloced.
+ */
+typedef struct
+{
+    IOKind kind;  /* owner of fd */
+    int idx;      /* index into clinfo[] or dvrinfo[] */
+    int events;   /* IO_READ | IO_WRITE currently wanted */
+    int inkernel; /* 1 if currently registered with epoll */
+} IOSlot;
+static IOSlot *ioslots;  /* malloced, grown to the largest fd seen */
+static int nioslots;     /* n entries in ioslots[] */
+static int iomaxfd = -1; /* largest fd registered, for select() */
+#ifdef USE_EPOLL
+static int epfd = -1; /* epoll instance, -1 to use select() */
+#endif
+static unsigned int iogen; /* bumped each time an fd is forgotten, see ioWait() */
+
+/* clients that want all devices are kept on the route of device "" */
+static RT *routes;             /* who wants what */
+static unsigned int routemark; /* tells clients already picked for a message */
+static RouteSub *rcands;       /* malloced clients picked for a message */
+static int mrcands;            /* n entries malloced in rcands[] */
+
+/* one reader or writer thread, see -t */
+typedef struct
+{
+    pthread_t tid;
+    int wake[2];          /* pipe to wake it up while it waits in poll() */
+    int kicked;           /* 1 if a byte is waiting in wake[] */
+    struct pollfd *pfds;  /* malloced fds it waits on, pfds[0] is wake[0] */
+    int *idx;             /* malloced dvrinfo or clinfo index of each */
+    unsigned int *gen;    /* malloced DvrInfo.gen of each, for readers */
+    int mpfds;            /* n entries malloced in pfds[], idx[] and gen[] */
+} Worker;
+
+/* threaded mode: all but what a thread owns is guarded by srvlock, which the
+ * main thread holds but while waiting for io. readers read and parse driver
+ * traffic, then take srvlock to route it. writers write client queues with
+ * the Msgs being written held by an extra count.
+ */
+static int nthreads;                                        /* n readers and n writers, 0 for none */
+static pthread_t mainthread;                                /* the one running indiRun() */
+static pthread_mutex_t srvlock = PTHREAD_MUTEX_INITIALIZER; /* see above */
+static pthread_cond_t srvcond  = PTHREAD_COND_INITIALIZER;  /* a reader is done with its driver */
+static Worker *readers;                                     /* malloced, nthreads */
+static Worker *writers;                                     /* malloced, nthreads */
+static Worker mainwake;                                     /* just wake[] and kicked, for the main thread */
+static int nreading;                                        /* n drivers being read without srvlock */
+static int holdreaders;                                     /* > 0 while readers must not start reading */
+static unsigned int dvrgen;                                 /* DvrInfo.gen of the last driver started */
+
+/* one ready fd as reported by ioWait() */
+typedef struct
+{
+    int fd;
+    int readable;
+    int writable;
+} IOEvent;
+
 static char *me;                                       /* our name */
 static int port = INDIPORT;                            /* public INDI port */
 static int verbose;                                    /* chattiness */
 static int lsocket;                                    /* listen socket */
+static char *upath;                                    /* unix domain listen socket path */
+static int usocket = -1;                               /* unix domain listen socket */
 static char *ldir;                                     /* where to log driver messages */
+static char *cpath;                                    /* where to capture all traffic, see -L */
+static int capfd = -1;                                 /* cpath open for appending */
 static int maxqsiz       = (DEFMAXQSIZ * 1024 * 1024); /* kill if these bytes behind */
 static int maxstreamsiz  = (DEFMAXSSIZ * 1024 * 1024); /* drop blobs if these bytes behind while streaming*/
 static int maxrestarts   = DEFMAXRESTART;
 static int terminateddrv = 0;
+static SlowPolicy slowpolicy = SC_STREAM; /* BLOBs for clients maxstreamsiz behind, see -b */
+static int conflateall;                   /* conflate for all clients, see -c */
+static int sndbuf;                        /* SO_SNDBUF of our sockets, 0 for system default, see -w */
+static int zlinks;                        /* ask chained servers for compressed links, see -z */
+static unsigned long long tstart;         /* monoUs() when we started, for metrics */
 
 static void logStartup(int ac, char *av[]);
 static void usage(void);
@@ -187,12 +497,24 @@ static void reapZombies(void);
 static void noSIGPIPE(void);
 static void indiFIFO(void);
 static void indiRun(void);
+static void ioInit(void);
+static void ioWatch(int fd, IOKind kind, int idx, int events);
+static void ioWantWrite(int fd, int on);
+static void ioForget(int fd);
+static int ioWait(IOEvent *evs, int maxevs, int ms);
+static int ioDispatch(IOEvent *ev);
+static void pushClientMsg(ClInfo *cp, Msg *mp);
+static void pushDriverMsg(DvrInfo *dp, Msg *mp);
 static void indiListen(void);
+static void indiUnixListen(void);
 static void newFIFO(void);
-static void newClient(void);
-static int newClSocket(void);
+static void newClient(int lfd);
+static int newClSocket(int lfd);
 static void shutdownClient(ClInfo *cp);
 static int readFromClient(ClInfo *cp);
+static int readClientOnce(ClInfo *cp);
+static void startClientZL(ClInfo *cp);
+static int clientQueued(ClInfo *cp);
 static void startDvr(DvrInfo *dp);
 static void startLocalDvr(DvrInfo *dp);
 static void startRemoteDvr(DvrInfo *dp);
@@ -207,20 +529,77 @@ static void addSDevice(DvrInfo *dp, const char *dev, const char *name);
 static Property *findSDevice(DvrInfo *dp, const char *dev, const char *name);
 static void addClDevice(ClInfo *cp, const char *dev, const char *name, int isblob);
 static int findClDevice(ClInfo *cp, const char *dev, const char *name);
+static int routeClients(const char *dev, const char *name);
+static void addDvrDevice(DvrInfo *dp, const char *dev);
 static int readFromDriver(DvrInfo *dp);
+static int readDriverOnce(DvrInfo *dp);
+static ssize_t readDriver(DvrInfo *dp, char *buf, size_t n);
+static ssize_t readZLAnswer(DvrInfo *dp, char *buf, size_t n);
+static int zlTimeouts(void);
+static int driverQueued(DvrInfo *dp);
+static int parseDriverChunk(DvrInfo *dp, char *buf, int n, char *raw, int nraw, int *shutany);
+static int blobPass(DvrInfo *dp, char rest[], int *shutany);
+static char *findBLOBTok(DvrInfo *dp, size_t from, const char *tok, size_t len);
+static void growBLOBBuf(DvrInfo *dp, size_t n);
+static void addBLOBSlice(DvrInfo *dp, size_t off, size_t len, int fd);
+static void addB64Slice(DvrInfo *dp);
+static int addShmSlice(DvrInfo *dp, const char *ob, const char *gt, long shmlen);
+static void claimBLOBFds(DvrInfo *dp, Msg *mp);
+static void closeBLOBFds(DvrInfo *dp);
+static void resetBLOBPass(DvrInfo *dp);
+static const char *findTagAtt(const char *tag, size_t n, const char *att);
+static char *findTagEnd(char *tag, size_t n);
+static long findTagAttInt(const char *tag, size_t n, const char *att);
+static void dropBLOBData(XMLEle *e, const char *data, int len, void *userdata);
+static int wantsFlag(XMLEle *root, const char *how);
+static Msg *peerMsg(Msg *mp, int rawblobs, int shmblobs);
+static void mapBLOBSlices(BLOBSlice *rawb, int nrawb, int map);
+static void setMsgInline(Msg *mp, const char *raw, size_t nraw, const BLOBSlice *rawb, int nrawb);
+static void blobsToBase64(XMLEle *root, const char *raw, const BLOBSlice *rawb, int nrawb);
 static int stderrFromDriver(DvrInfo *dp);
-static int msgQSize(FQ *q);
+static long msgSize(Msg *mp);
+static long clientQSize(ClInfo *cp);
+static void popClientMsg(ClInfo *cp);
+static QProp *findQProp(ClInfo *cp, const char *dev, const char *name, int add);
+static int replaceClientMsg(ClInfo *cp, const char *dev, const char *name, Msg *mp, XMLEle *root);
+static void noteQProp(QProp *qp, XMLEle *root);
+static int supersedes(XMLEle *root, const QProp *qp);
+static int isStreamBLOB(XMLEle *root);
 static void setMsgXMLEle(Msg *mp, XMLEle *root);
 static void setMsgStr(Msg *mp, char *str);
 static void freeMsg(Msg *mp);
 static Msg *newMsg(void);
+static void stampMsg(Msg *mp, DvrInfo *dp);
 static int sendClientMsg(ClInfo *cp);
+static int sentClientMsg(ClInfo *cp, const struct iovec *iov, int niov, ssize_t nw);
+static size_t setupSocket(int s, int local);
+static int gatherMsgs(FQ *q, unsigned int nsent, size_t budget, int withfds, struct iovec *iov, Msg **fdmp);
+static ssize_t sendIov(int fd, struct iovec *iov, int niov, const int *fds, int nfds);
 static int sendDriverMsg(DvrInfo *cp);
+static void lockSrv(void);
+static void unlockSrv(void);
+static void startThreads(void);
+static void *readerThread(void *arg);
+static void *writerThread(void *arg);
+static void writeClient(int ci);
+static void growWorker(Worker *w, int n);
+static void kickWorker(Worker *w);
+static void drainWorker(Worker *w);
+static void wakeReader(DvrInfo *dp);
+static void holdReaders(int on);
 static void crackBLOB(const char *enableBLOB, BLOBHandling *bp);
 static void crackBLOBHandling(const char *dev, const char *name, const char *enableBLOB, ClInfo *cp);
 static void traceMsg(XMLEle *root);
 static char *indi_tstamp(char *s);
 static void logDMsg(XMLEle *root, const char *dev);
+static void startCapture(void);
+static void captureIO(int kind, int id, const char *buf, size_t n);
+static void logPool(void);
+static void logZL(ZL *zp, const char *who);
+static unsigned long long monoUs(void);
+static void addLatency(Metrics *mp, unsigned long long us);
+static void writeMetrics(const char *path);
+static void prMetrics(FILE *fp, const Metrics *mp);
 static void Bye(void);
 
 int main(int ac, char *av[])
@@ -260,6 +639,15 @@ int main(int ac, char *av[])
                     ldir = *++av;
                     ac--;
                     break;
+                case 'L':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-L requires capture file\n");
+                        usage();
+                    }
+                    cpath = *++av;
+                    ac--;
+                    break;
                 case 'm':
                     if (ac < 2)
                     {
@@ -287,6 +675,49 @@ int main(int ac, char *av[])
                     maxstreamsiz = 1024 * 1024 * atoi(*++av);
                     ac--;
                     break;
+                case 'b':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-b requires slow consumer policy\n");
+                        usage();
+                    }
+                    ++av;
+                    if (!strcmp(*av, "stream"))
+                        slowpolicy = SC_STREAM;
+                    else if (!strcmp(*av, "supersede"))
+                        slowpolicy = SC_SUPERSEDE;
+                    else if (!strcmp(*av, "pause"))
+                        slowpolicy = SC_PAUSE;
+                    else
+                    {
+                        fprintf(stderr, "-b policy must be stream, supersede or pause\n");
+                        usage();
+                    }
+                    ac--;
+                    break;
+                case 'c':
+                    conflateall = 1;
+                    break;
+                case 't':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-t requires number of threads\n");
+                        usage();
+                    }
+                    nthreads = atoi(*++av);
+                    if (nthreads < 0)
+                        nthreads = 0;
+                    ac--;
+                    break;
+                case 'w':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-w requires socket send buffer KB\n");
+                        usage();
+                    }
+                    sndbuf = 1024 * atoi(*++av);
+                    ac--;
+                    break;
                 case 'f':
                     if (ac < 2)
                     {
@@ -296,6 +727,15 @@ int main(int ac, char *av[])
                     fifo.name = *++av;
                     ac--;
                     break;
+                case 'u':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-u requires socket path\n");
+                        usage();
+                    }
+                    upath = *++av;
+                    ac--;
+                    break;
                 case 'r':
                     if (ac < 2)
                     {
@@ -310,6 +750,9 @@ int main(int ac, char *av[])
                 case 'v':
                     verbose++;
                     break;
+                case 'z':
+                    zlinks = 1;
+                    break;
                 default:
                     usage();
             }
@@ -325,6 +768,26 @@ int main(int ac, char *av[])
     reapZombies();
     noSIGPIPE();
 
+    /* pick an io backend before any fd gets registered */
+    ioInit();
+
+    /* Msgs, their queues and parse trees come and go with each message */
+    lilxmlMalloc(poolMalloc, poolRealloc, poolFree);
+    setMemFuncsFQ(poolMalloc, poolRealloc, poolFree);
+    poolThreads(nthreads > 0);
+
+    /* nobody wants anything yet */
+    routes = newRT();
+    tstart = monoUs();
+
+    /* capture from the start, see captureIO() */
+    if (cpath)
+        startCapture();
+
+    /* from now on we hold srvlock but while waiting for io */
+    mainthread = pthread_self();
+    lockSrv();
+
     /* realloc seed for client pool */
     clinfo  = (ClInfo *)malloc(1);
     nclinfo = 0;
@@ -342,10 +805,15 @@ int main(int ac, char *av[])
 
     /* announce we are online */
     indiListen();
+    if (upath)
+        indiUnixListen();
 
     /* Load up FIFO, if available */
     indiFIFO();
 
+    /* readers and writers, if wanted */
+    startThreads();
+
     /* handle new clients and all io */
     while (1)
         indiRun();
@@ -374,13 +842,25 @@ static void usage(void)
     fprintf(stderr, "INDI Library: %s\nCode %s. Protocol %g.\n", CMAKE_INDI_VERSION_STRING, GIT_TAG_STRING, INDIV);
     fprintf(stderr, "Options:\n");
     fprintf(stderr, " -l d     : log driver messages to <d>/YYYY-MM-DD.islog\n");
+    fprintf(stderr, " -L f     : capture all driver and client traffic to file f, for indiserver_replay\n");
     fprintf(stderr, " -m m     : kill client if gets more than this many MB behind, default %d\n", DEFMAXQSIZ);
     fprintf(stderr,
             " -d m     : drop streaming blobs if client gets more than this many MB behind, default %d. 0 to disable\n",
             DEFMAXSSIZ);
+    fprintf(stderr, " -b p     : what BLOBs clients that far behind still get, p is one of\n");
+    fprintf(stderr, "            stream    : all but streaming ones, default\n");
+    fprintf(stderr, "            supersede : all, but a queued one goes when a newer one of its property comes\n");
+    fprintf(stderr, "            pause     : none until they catch up\n");
+    fprintf(stderr, " -c       : conflate property updates queued for any client, not just those asking\n");
+    fprintf(stderr, " -t n     : n threads reading drivers and n writing to clients, default 0 for none\n");
+    fprintf(stderr, " -w k     : socket send buffer of clients and chained servers, KB, default set by system\n");
     fprintf(stderr, " -p p     : alternate IP port, default %d\n", INDIPORT);
     fprintf(stderr, " -r r     : maximum driver restarts on error, default %d\n", DEFMAXRESTART);
     fprintf(stderr, " -f path  : Path to fifo for dynamic startup and shutdown of drivers.\n");
+    fprintf(stderr, "            'metrics [file]' on it writes traffic counters to file or stderr\n");
+    fprintf(stderr, " -u path  : also listen for local clients on this unix domain socket,\n");
+    fprintf(stderr, "            @name for name in the abstract namespace (linux)\n");
+    fprintf(stderr, " -z       : compress links to chained servers that agree to it\n");
     fprintf(stderr, " -v       : show key events, no traffic\n");
     fprintf(stderr, " -vv      : -v + key message content\n");
     fprintf(stderr, " -vvv     : -vv + complete xml\n");
@@ -445,11 +925,12 @@ static DvrInfo *allocDvr()
 
     /* try to reuse a driver slot, else add one */
     for (dvi = 0; dvi < ndvrinfo; dvi++)
-        if (!(dp = &dvrinfo[dvi])->active)
+        if (!(dp = &dvrinfo[dvi])->active && !dp->reading)
             break;
     if (dvi == ndvrinfo)
     {
-        /* grow dvrinfo */
+        /* grow dvrinfo, not while any reader thread is using it */
+        holdReaders(1);
         dvrinfo = (DvrInfo *)realloc(dvrinfo, (ndvrinfo + 1) * sizeof(DvrInfo));
         if (!dvrinfo)
         {
@@ -457,6 +938,7 @@ static DvrInfo *allocDvr()
             Bye();
         }
         dp = &dvrinfo[ndvrinfo++];
+        holdReaders(0);
     }
 
     if (dp == NULL)
@@ -489,15 +971,19 @@ static void startLocalDvr(DvrInfo *dp)
     Msg *mp;
     char buf[32];
     int rp[2], wp[2], ep[2];
-    int pid;
+    int pid, fdpass = 0;
 
 #ifdef OSX_EMBEDED_MODE
     fprintf(stderr, "STARTING \"%s\"\n", dp->name);
     fflush(stderr);
 #endif
 
-    /* build three pipes: r, w and error*/
-    if (pipe(rp) < 0)
+    /* build three pipes: r, w and error. r is a socket if we can get one so
+     * the driver may pass us shm BLOB segments.
+     */
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, rp) == 0)
+        fdpass = 1;
+    else if (pipe(rp) < 0)
     {
         fprintf(stderr, "%s: read pipe: %s\n", indi_tstamp(NULL), strerror(errno));
         Bye();
@@ -545,6 +1031,11 @@ static void startLocalDvr(DvrInfo *dp)
             setenv("INDISKEL", dp->envSkel, 1);
         else if (fifo.fd > 0)
             unsetenv("INDISKEL");
+        setenv(BINBLOBENV, "1", 1);
+        if (fdpass)
+            setenv(SHMBLOBENV, "1", 1);
+        else
+            unsetenv(SHMBLOBENV);
         char executable[MAXSBUF];
         if (*dp->envPrefix)
         {
@@ -595,9 +1086,13 @@ static void startLocalDvr(DvrInfo *dp)
     dp->port    = -1;
     dp->rfd     = rp[0];
     dp->wfd     = wp[1];
+    dp->wbudget = MAXWSIZ;
     dp->efd     = ep[0];
+    dp->fdpass  = fdpass;
     dp->lp      = newLilXML();
     dp->msgq    = newFQ(1);
+    setXMLArena(dp->lp, 1);
+    setXMLRawTag(dp->lp, "oneBLOB");
     dp->sprops  = (Property *)malloc(1); /* seed for realloc */
     dp->nsprops = 0;
     dp->nsent   = 0;
@@ -605,14 +1100,23 @@ static void startLocalDvr(DvrInfo *dp)
     dp->ndev    = 0;
     dp->dev     = (char **)malloc(sizeof(char *));
 
+    /* watch driver stdout, unless its reader thread does, and stderr. stdin
+     * only while we have work for it.
+     */
+    captureIO('D', dp - dvrinfo, dp->name, strlen(dp->name));
+    dp->gen = ++dvrgen;
+    ioWatch(dp->rfd, IO_DRIVER, dp - dvrinfo, nthreads ? 0 : IO_READ);
+    ioWatch(dp->efd, IO_DRIVER, dp - dvrinfo, IO_READ);
+    ioWatch(dp->wfd, IO_DRIVER, dp - dvrinfo, 0);
+    wakeReader(dp);
+
     /* first message primes driver to report its properties -- dev known
      * if restarting
      */
     mp = newMsg();
-    pushFQ(dp->msgq, mp);
+    pushDriverMsg(dp, mp);
     snprintf(buf, sizeof(buf), "<getProperties version='%g'/>\n", INDIV);
     setMsgStr(mp, buf);
-    mp->count++;
 
     if (verbose > 0)
         fprintf(stderr, "%s: Driver %s: pid=%d rfd=%d wfd=%d efd=%d\n", indi_tstamp(NULL), dp->name, dp->pid, dp->rfd,
@@ -644,6 +1148,7 @@ static void startRemoteDvr(DvrInfo *dp)
 
     /* connect */
     sockfd = openINDIServer(host, indi_port);
+    captureIO('D', dp - dvrinfo, dp->name, strlen(dp->name));
 
     /* record flag pid, io channels, init lp and snoop list */
     dp->pid = REMOTEDVR;
@@ -651,36 +1156,55 @@ static void startRemoteDvr(DvrInfo *dp)
     dp->port    = indi_port;
     dp->rfd     = sockfd;
     dp->wfd     = sockfd;
+    dp->wbudget = setupSocket(sockfd, 0);
     dp->lp      = newLilXML();
     dp->msgq    = newFQ(1);
+    setXMLArena(dp->lp, 1);
+    setXMLRawTag(dp->lp, "oneBLOB");
     dp->sprops  = (Property *)malloc(1); /* seed for realloc */
     dp->nsprops = 0;
     dp->nsent   = 0;
     dp->active  = 1;
-    dp->ndev    = 1;
+    dp->ndev    = 0;
     dp->dev     = (char **)malloc(sizeof(char *));
+    dp->zl      = NULL;
+    dp->zstate  = zlinks ? ZL_ASK : ZL_OFF;
+    dp->zwant   = zlinks;
+    dp->zhave   = 0;
 
     /* N.B. storing name now is key to limiting outbound traffic to this
      * dev.
      */
-    dp->dev[0] = (char *)malloc(MAXINDIDEVICE * sizeof(char));
-    strncpy(dp->dev[0], dev, MAXINDIDEVICE - 1);
-    dp->dev[0][MAXINDIDEVICE - 1] = '\0';
+    addDvrDevice(dp, dev);
+
+    /* rfd and wfd are the same socket, read by its reader thread if any */
+    dp->gen = ++dvrgen;
+    ioWatch(sockfd, IO_DRIVER, dp - dvrinfo, nthreads ? 0 : IO_READ);
+    wakeReader(dp);
 
     /* Sending getProperties with device lets remote server limit its
      * outbound (and our inbound) traffic on this socket to this device.
+     * With -z it also asks for a compressed link: a server that agrees
+     * answers ZLACK and deflates all it sends after that, and so do we
+     * from then on. We send nothing more until we know, any other first
+     * bytes mean a server that does not know how and the link stays plain.
+     * So does no answer within ZLWAITUS, a server that does not know how
+     * need not say anything before it has something to send.
      */
     mp = newMsg();
-    pushFQ(dp->msgq, mp);
+    pushDriverMsg(dp, mp);
     if (dev[0])
-        sprintf(buf, "<getProperties device='%s' version='%g'/>\n", dp->dev[0], INDIV);
+        sprintf(buf, "<getProperties device='%s' version='%g' binaryBLOB='1'%s/>\n", dp->dev[0], INDIV,
+                zlinks ? " compress='" ZLMETHOD "'" : "");
     else
         // This informs downstream server that it is connecting to an upstream server
         // and not a regular client. The difference is in how it treats snooping properties
         // among properties.
-        sprintf(buf, "<getProperties device='*' version='%g'/>\n", INDIV);
+        sprintf(buf, "<getProperties device='*' version='%g' binaryBLOB='1'%s/>\n", INDIV,
+                zlinks ? " compress='" ZLMETHOD "'" : "");
+    if (zlinks)
+        buf[strlen(buf) - 1] = '\0'; /* the server inflates from right after the '>' */
     setMsgStr(mp, buf);
-    mp->count++;
 
     if (verbose > 0)
         fprintf(stderr, "%s: Driver %s: socket=%d\n", indi_tstamp(NULL), dp->name, sockfd);
@@ -770,6 +1294,7 @@ static void indiListen()
 
     /* ok */
     lsocket = sfd;
+    ioWatch(lsocket, IO_LISTEN, 0, IO_READ);
     if (verbose > 0)
         fprintf(stderr, "%s: listening to port %d on fd %d\n", indi_tstamp(NULL), port, sfd);
 }
@@ -777,6 +1302,7 @@ static void indiListen()
 /* Attempt to open up FIFO */
 static void indiFIFO(void)
 {
+    ioForget(fifo.fd);
     close(fifo.fd);
     fifo.fd = -1;
 
@@ -790,152 +1316,394 @@ static void indiFIFO(void)
             fprintf(stderr, "%s: open(%s): %s.\n", indi_tstamp(NULL), fifo.name, strerror(errno));
             Bye();
         }
+
+        ioWatch(fifo.fd, IO_FIFO, 0, IO_READ);
+    }
+}
+
+/* create the local INDI client endpoint usocket at upath.
+ * exit if trouble.
+ */
+static void indiUnixListen(void)
+{
+    struct sockaddr_un serv_socket;
+    socklen_t len = sizeof(serv_socket);
+    struct stat st;
+    int sfd;
+
+    if (strlen(upath) >= sizeof(serv_socket.sun_path))
+    {
+        fprintf(stderr, "%s: unix socket path too long: %s\n", indi_tstamp(NULL), upath);
+        Bye();
+    }
+
+    /* make socket endpoint */
+    if ((sfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        fprintf(stderr, "%s: unix socket: %s\n", indi_tstamp(NULL), strerror(errno));
+        Bye();
+    }
+
+    /* bind to path, replacing a socket left by an earlier run. on linux
+     * @name is name in the abstract namespace instead: nothing in the file
+     * system, and it goes away with us.
+     */
+    memset(&serv_socket, 0, sizeof(serv_socket));
+    serv_socket.sun_family = AF_UNIX;
+    strncpy(serv_socket.sun_path, upath, sizeof(serv_socket.sun_path) - 1);
+#ifdef __linux__
+    if (upath[0] == '@')
+    {
+        serv_socket.sun_path[0] = '\0';
+        len                     = offsetof(struct sockaddr_un, sun_path) + strlen(upath);
+    }
+#endif
+    if (serv_socket.sun_path[0] && lstat(upath, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(upath);
+    if (bind(sfd, (struct sockaddr *)&serv_socket, len) < 0)
+    {
+        fprintf(stderr, "%s: bind %s: %s\n", indi_tstamp(NULL), upath, strerror(errno));
+        Bye();
+    }
+
+    /* willing to accept connections with a backlog of 5 pending */
+    if (listen(sfd, 5) < 0)
+    {
+        fprintf(stderr, "%s: unix listen: %s\n", indi_tstamp(NULL), strerror(errno));
+        Bye();
     }
+
+    /* ok */
+    usocket = sfd;
+    ioWatch(usocket, IO_LISTEN, 0, IO_READ);
+    if (verbose > 0)
+        fprintf(stderr, "%s: listening to %s on fd %d\n", indi_tstamp(NULL), upath, sfd);
 }
 
 /* service traffic from clients and drivers */
 static void indiRun(void)
 {
-    fd_set rs, ws;
-    int maxfd = 0;
-    int i, s;
+    IOEvent evs[MAXIOEVENTS];
+    int i, n;
 
-    /* init with no writers or readers */
-    FD_ZERO(&ws);
-    FD_ZERO(&rs);
+    /* wait for action, or until a chained server took too long to answer */
+    n = ioWait(evs, MAXIOEVENTS, zlTimeouts());
+
+    /* handle each ready fd. once anything is shut down the fds reported in
+     * the rest of evs[] may have been closed or even reused, so just come
+     * back later: whatever is still ready will be reported again.
+     */
+    for (i = 0; i < n; i++)
+        if (ioDispatch(&evs[i]) < 0)
+            return; /* fds effected */
+}
+
+/* pick epoll if we can, else select */
+static void ioInit(void)
+{
+#ifdef USE_EPOLL
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+        fprintf(stderr, "%s: epoll_create1: %s, using select\n", indi_tstamp(NULL), strerror(errno));
+    else if (verbose > 0)
+        fprintf(stderr, "%s: using epoll\n", indi_tstamp(NULL));
+#endif
+}
+
+/* push the events wanted for fd in ioslots[] to the kernel, if using epoll.
+ * fds with nothing wanted are removed so a driver pipe whose reader is gone
+ * can not keep reporting EPOLLERR while we have nothing to send to it.
+ */
+static void ioSync(int fd)
+{
+#ifdef USE_EPOLL
+    IOSlot *sp = &ioslots[fd];
+    struct epoll_event ev;
+#endif
+
+    /* select() only sees changes made by other threads once woken */
+    if (nthreads && !pthread_equal(pthread_self(), mainthread))
+        kickWorker(&mainwake);
+
+#ifdef USE_EPOLL
+    if (epfd < 0)
+        return;
 
-    if (fifo.name && fifo.fd >= 0)
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = ((sp->events & IO_READ) ? EPOLLIN : 0) | ((sp->events & IO_WRITE) ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+
+    if (!sp->events)
+    {
+        if (sp->inkernel && epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev) < 0)
+            fprintf(stderr, "%s: epoll_ctl(DEL,%d): %s\n", indi_tstamp(NULL), fd, strerror(errno));
+        sp->inkernel = 0;
+    }
+    else if (epoll_ctl(epfd, sp->inkernel ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) < 0)
     {
-        FD_SET(fifo.fd, &rs);
-        maxfd = fifo.fd;
+        fprintf(stderr, "%s: epoll_ctl(%d): %s\n", indi_tstamp(NULL), fd, strerror(errno));
+        Bye();
     }
+    else
+        sp->inkernel = 1;
+#else
+    INDI_UNUSED(fd);
+#endif
+}
 
-    /* always listen for new clients */
-    FD_SET(lsocket, &rs);
-    if (lsocket > maxfd)
-        maxfd = lsocket;
+/* register fd as belonging to kind/idx with the given IO_READ/IO_WRITE wants */
+static void ioWatch(int fd, IOKind kind, int idx, int events)
+{
+    IOSlot *sp;
 
-    /* add all client readers and client writers with work to send */
-    for (i = 0; i < nclinfo; i++)
+    if (fd >= nioslots)
     {
-        ClInfo *cp = &clinfo[i];
-        if (cp->active)
+        int n   = fd + 16;
+        ioslots = (IOSlot *)realloc(ioslots, n * sizeof(IOSlot));
+        if (!ioslots)
         {
-            FD_SET(cp->s, &rs);
-            if (nFQ(cp->msgq) > 0)
-                FD_SET(cp->s, &ws);
-            if (cp->s > maxfd)
-                maxfd = cp->s;
+            fprintf(stderr, "no memory for io slots\n");
+            Bye();
         }
+        memset(&ioslots[nioslots], 0, (n - nioslots) * sizeof(IOSlot));
+        nioslots = n;
     }
 
-    /* add all driver readers and driver writers with work to send */
-    for (i = 0; i < ndvrinfo; i++)
+    sp         = &ioslots[fd];
+    sp->kind   = kind;
+    sp->idx    = idx;
+    sp->events = events;
+    if (fd > iomaxfd)
+        iomaxfd = fd;
+
+    ioSync(fd);
+}
+
+/* turn write interest in fd on or off, a no-op if unchanged */
+static void ioWantWrite(int fd, int on)
+{
+    IOSlot *sp;
+    int events;
+
+    if (fd < 0 || fd >= nioslots || ioslots[fd].kind == IO_NONE)
+        return;
+
+    sp     = &ioslots[fd];
+    events = on ? (sp->events | IO_WRITE) : (sp->events & ~IO_WRITE);
+    if (events == sp->events)
+        return;
+    sp->events = events;
+    ioSync(fd);
+}
+
+/* stop watching fd, silently ignore if not registered.
+ * N.B. call before closing fd.
+ */
+static void ioForget(int fd)
+{
+    if (fd < 0 || fd >= nioslots || ioslots[fd].kind == IO_NONE)
+        return;
+
+    ioslots[fd].events = 0;
+    ioSync(fd);
+    memset(&ioslots[fd], 0, sizeof(IOSlot));
+    iogen++;
+
+    while (iomaxfd >= 0 && ioslots[iomaxfd].kind == IO_NONE)
+        iomaxfd--;
+}
+
+/* block until at least one registered fd is ready, or for ms if >= 0.
+ * fill evs[] and return how many, 0 if interrupted, timed out or if another
+ * thread forgot any fd meanwhile: those reported might have been closed or
+ * reused.
+ */
+static int ioWait(IOEvent *evs, int maxevs, int ms)
+{
+    unsigned int gen = iogen;
+    struct timeval tv;
+    fd_set rs, ws;
+    int i, s, n = 0;
+
+#ifdef USE_EPOLL
+    if (epfd >= 0)
     {
-        DvrInfo *dp = &dvrinfo[i];
-        if (dp->active)
+        struct epoll_event eev[MAXIOEVENTS];
+
+        if (maxevs > MAXIOEVENTS)
+            maxevs = MAXIOEVENTS;
+
+        unlockSrv();
+        n = epoll_wait(epfd, eev, maxevs, ms);
+        lockSrv();
+        if (n < 0)
         {
-            FD_SET(dp->rfd, &rs);
-            if (dp->rfd > maxfd)
-                maxfd = dp->rfd;
-            if (dp->pid != REMOTEDVR)
-            {
-                FD_SET(dp->efd, &rs);
-                if (dp->efd > maxfd)
-                    maxfd = dp->efd;
-            }
-            if (nFQ(dp->msgq) > 0)
-            {
-                FD_SET(dp->wfd, &ws);
-                if (dp->wfd > maxfd)
-                    maxfd = dp->wfd;
-            }
+            if (errno == EINTR)
+                return (0);
+            fprintf(stderr, "%s: epoll_wait: %s\n", indi_tstamp(NULL), strerror(errno));
+            Bye();
+        }
+        if (iogen != gen)
+            return (0);
+
+        /* report errors and hangups as whatever we wanted so the following
+         * read or write notices and cleans up.
+         */
+        for (i = 0; i < n; i++)
+        {
+            int fd      = eev[i].data.fd;
+            int wanted  = ioslots[fd].events;
+            int trouble = (eev[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+
+            evs[i].fd       = fd;
+            evs[i].readable = (wanted & IO_READ) && ((eev[i].events & EPOLLIN) || trouble);
+            evs[i].writable = (wanted & IO_WRITE) && ((eev[i].events & EPOLLOUT) || trouble);
         }
+        return (n);
     }
+#endif
 
-    /* wait for action */
-    s = select(maxfd + 1, &rs, &ws, NULL, NULL);
-    if (s < 0)
+    /* select fallback: init with each registered reader and writer */
+    FD_ZERO(&rs);
+    FD_ZERO(&ws);
+    for (i = 0; i <= iomaxfd; i++)
     {
-        if(errno == EINTR)
-            return;
-        fprintf(stderr, "%s: select(%d): %s\n", indi_tstamp(NULL), maxfd + 1, strerror(errno));
-        Bye();
+        if (ioslots[i].events & IO_READ)
+            FD_SET(i, &rs);
+        if (ioslots[i].events & IO_WRITE)
+            FD_SET(i, &ws);
     }
 
-    /* new command from FIFO? */
-    if (s > 0 && fifo.fd >= 0 && FD_ISSET(fifo.fd, &rs))
+    tv.tv_sec  = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    unlockSrv();
+    s = select(iomaxfd + 1, &rs, &ws, NULL, ms >= 0 ? &tv : NULL);
+    lockSrv();
+    if (s < 0)
     {
-        newFIFO();
-        s--;
+        if (errno == EINTR)
+            return (0);
+        fprintf(stderr, "%s: select(%d): %s\n", indi_tstamp(NULL), iomaxfd + 1, strerror(errno));
+        Bye();
     }
+    if (iogen != gen)
+        return (0);
 
-    /* new client? */
-    if (s > 0 && FD_ISSET(lsocket, &rs))
+    for (i = 0; s > 0 && i <= iomaxfd && n < maxevs; i++)
     {
-        newClient();
-        s--;
+        int r = FD_ISSET(i, &rs) != 0;
+        int w = FD_ISSET(i, &ws) != 0;
+
+        if (!r && !w)
+            continue;
+        evs[n].fd       = i;
+        evs[n].readable = r;
+        evs[n].writable = w;
+        n++;
+        s -= r + w;
     }
 
-    /* message to/from client? */
-    for (i = 0; s > 0 && i < nclinfo; i++)
+    return (n);
+}
+
+/* handle one ready fd.
+ * return -1 if had to shut down or start anything, else 0.
+ */
+static int ioDispatch(IOEvent *ev)
+{
+    IOSlot *sp;
+
+    if (ev->fd < 0 || ev->fd >= nioslots)
+        return (0);
+    sp = &ioslots[ev->fd];
+
+    switch (sp->kind)
     {
-        ClInfo *cp = &clinfo[i];
-        if (cp->active)
-        {
-            if (FD_ISSET(cp->s, &rs))
-            {
-                if (readFromClient(cp) < 0)
-                    return; /* fds effected */
-                s--;
-            }
-            if (s > 0 && FD_ISSET(cp->s, &ws))
+        case IO_NONE:
+            break;
+
+        case IO_FIFO:
+            /* new command from FIFO? may start or stop drivers */
+            if (ev->readable)
             {
-                if (sendClientMsg(cp) < 0)
-                    return; /* fds effected */
-                s--;
+                newFIFO();
+                return (-1);
             }
+            break;
+
+        case IO_LISTEN:
+            /* new client? */
+            if (ev->readable)
+                newClient(ev->fd);
+            break;
+
+        case IO_WAKE:
+            /* another thread changed what we wait for */
+            if (ev->readable)
+                drainWorker(&mainwake);
+            break;
+
+        case IO_CLIENT:
+        {
+            /* message to/from client? */
+            ClInfo *cp = &clinfo[sp->idx];
+
+            if (!cp->active)
+                break;
+            if (ev->readable && readFromClient(cp) < 0)
+                return (-1);
+            if (ev->writable && clientQueued(cp) && sendClientMsg(cp) < 0)
+                return (-1);
+            break;
         }
-    }
 
-    /* message to/from driver? */
-    for (i = 0; s > 0 && i < ndvrinfo; i++)
-    {
-        DvrInfo *dp = &dvrinfo[i];
-        if (dp->active)
+        case IO_DRIVER:
         {
-            if (dp->pid != REMOTEDVR && FD_ISSET(dp->efd, &rs))
+            /* message to/from driver? */
+            DvrInfo *dp = &dvrinfo[sp->idx];
+
+            if (!dp->active)
+                break;
+            if (ev->readable && dp->pid != REMOTEDVR && ev->fd == dp->efd)
             {
                 if (stderrFromDriver(dp) < 0)
-                    return; /* fds effected */
-                s--;
+                    return (-1);
             }
-            if (s > 0 && FD_ISSET(dp->rfd, &rs))
+            else if (ev->readable && ev->fd == dp->rfd)
             {
                 if (readFromDriver(dp) < 0)
-                    return; /* fds effected */
-                s--;
+                    return (-1);
             }
-            if (s > 0 && FD_ISSET(dp->wfd, &ws) && nFQ(dp->msgq) > 0)
+            if (ev->writable && ev->fd == dp->wfd && driverQueued(dp))
             {
                 if (sendDriverMsg(dp) < 0)
-                    return; /* fds effected */
-                s--;
+                    return (-1);
             }
+            break;
         }
     }
+
+    return (0);
 }
 
 int isDeviceInDriver(const char *dev, DvrInfo *dp)
 {
-    int i = 0;
-    for (i = 0; i < dp->ndev; i++)
-    {
-        if (!strcmp(dev, dp->dev[i]))
-            return 1;
-    }
+    Route *rp = findRoute(routes, dev, "");
+
+    return (rp && findRouteSub(rp, RT_DRIVERS, dp - dvrinfo) >= 0);
+}
 
-    return 0;
+/* add dev to the devices served by dp */
+static void addDvrDevice(DvrInfo *dp, const char *dev)
+{
+    dp->dev           = (char **)realloc(dp->dev, (dp->ndev + 1) * sizeof(char *));
+    dp->dev[dp->ndev] = (char *)malloc(MAXINDIDEVICE * sizeof(char));
+
+    strncpy(dp->dev[dp->ndev], dev, MAXINDIDEVICE - 1);
+    dp->dev[dp->ndev][MAXINDIDEVICE - 1] = '\0';
+
+    addRouteSub(routes, dp->dev[dp->ndev], "", RT_DRIVERS, dp - dvrinfo, -1);
+    dp->ndev++;
 }
 
 /* Read commands from FIFO and process them. Start/stop drivers accordingly */
@@ -1047,6 +1815,13 @@ static void newFIFO(void)
             }
         }
 
+        /* metrics [file]: a snapshot of the counters, see writeMetrics() */
+        if (!strcmp(cmd, "metrics"))
+        {
+            writeMetrics(tDriver);
+            continue;
+        }
+
         if (!strcmp(cmd, "start"))
             startCmd = 1;
         else
@@ -1112,20 +1887,20 @@ static void newFIFO(void)
     }
 }
 
-/* prepare for new client arriving on lsocket.
+/* prepare for new client arriving on listen socket lfd.
  * exit if trouble.
  */
-static void newClient()
+static void newClient(int lfd)
 {
     ClInfo *cp = NULL;
     int s, cli;
 
     /* assign new socket */
-    s = newClSocket();
+    s = newClSocket(lfd);
 
     /* try to reuse a clinfo slot, else add one */
     for (cli = 0; cli < nclinfo; cli++)
-        if (!(cp = &clinfo[cli])->active)
+        if (!(cp = &clinfo[cli])->active && !cp->closing)
             break;
     if (cli == nclinfo)
     {
@@ -1144,14 +1919,23 @@ static void newClient()
 
     /* rig up new clinfo entry */
     memset(cp, 0, sizeof(*cp));
-    cp->active = 1;
-    cp->s      = s;
-    cp->lp     = newLilXML();
-    cp->msgq   = newFQ(1);
-    cp->props  = malloc(1);
-    cp->nsent  = 0;
-
-    if (verbose > 0)
+    cp->active   = 1;
+    cp->s        = s;
+    cp->lp       = newLilXML();
+    cp->msgq     = newFQ(1);
+    setXMLArena(cp->lp, 1);
+    setXMLRawTag(cp->lp, "oneBLOB");
+    cp->props    = malloc(1);
+    cp->nsent    = 0;
+    cp->unixsock = lfd == usocket;
+    cp->wbudget  = setupSocket(s, cp->unixsock);
+
+    ioWatch(s, IO_CLIENT, cp - clinfo, IO_READ);
+    captureIO('C', cp - clinfo, cp->unixsock ? "unix" : "tcp", cp->unixsock ? 4 : 3);
+
+    if (verbose > 0 && cp->unixsock)
+        fprintf(stderr, "%s: Client %d: new arrival on %s - welcome!\n", indi_tstamp(NULL), cp->s, upath);
+    else if (verbose > 0)
     {
         struct sockaddr_in addr;
         socklen_t len = sizeof(addr);
@@ -1174,13 +1958,37 @@ static void newClient()
  * return -1 if had to shut down anything, else 0.
  */
 static int readFromClient(ClInfo *cp)
+{
+    int shutany = 0;
+
+    /* one read of a compressed link may inflate to more than one buffer */
+    do
+    {
+        if (readClientOnce(cp) < 0)
+            shutany++;
+    } while (cp->active && cp->zl && moreZL(cp->zl));
+
+    return (shutany ? -1 : 0);
+}
+
+/* read and handle one buffer from the given client, see readFromClient().
+ * return -1 if had to shut down anything, else 0.
+ */
+static int readClientOnce(ClInfo *cp)
 {
     char buf[MAXRBUF];
     int shutany = 0;
+    int plain   = !cp->zl;
+    unsigned long long tmark;
     ssize_t i, nr;
 
     /* read client */
-    nr = read(cp->s, buf, sizeof(buf));
+    if (cp->zl)
+        nr = readZL(cp->zl, cp->s, buf, sizeof(buf));
+    else
+        nr = read(cp->s, buf, sizeof(buf));
+    if (nr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return (0);
     if (nr <= 0)
     {
         if (nr < 0)
@@ -1190,8 +1998,13 @@ static int readFromClient(ClInfo *cp)
         shutdownClient(cp);
         return (-1);
     }
+    cp->m.inbytes += nr;
+    captureIO('c', cp - clinfo, buf, nr);
 
-    /* process XML, sending when find closure */
+    /* process XML, sending when find closure. parsing is timed up to each
+     * message found and from when it has been handled.
+     */
+    tmark = monoUs();
     for (i = 0; i < nr; i++)
     {
         char err[1024];
@@ -1204,6 +2017,9 @@ static int readFromClient(ClInfo *cp)
             int isblob       = !strcmp(tagXMLEle(root), "setBLOBVector");
             Msg *mp;
 
+            cp->m.parseus += monoUs() - tmark;
+            cp->m.inmsgs++;
+
             if (verbose > 2)
             {
                 fprintf(stderr, "%s: Client %d: read ", indi_tstamp(NULL), cp->s);
@@ -1215,6 +2031,32 @@ static int readFromClient(ClInfo *cp)
                         tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
             }
 
+            /* only the first message may ask for binary or shm BLOBs, see top.
+             * shm implies binary, it only works on our unix domain socket.
+             */
+            if (!cp->greeted)
+            {
+                cp->rawblobs = wantsFlag(root, "binaryBLOB");
+                cp->shmblobs = wantsFlag(root, "shmBLOB") && cp->rawblobs && cp->unixsock;
+                cp->conflate = wantsFlag(root, "conflate") || conflateall;
+                if (!cp->unixsock && !strcmp(findXMLAttValu(root, "compress"), ZLMETHOD))
+                    startClientZL(cp);
+            }
+            else
+            {
+                rmXMLAtt(root, "binaryBLOB");
+                rmXMLAtt(root, "shmBLOB");
+                rmXMLAtt(root, "conflate");
+            }
+            cp->greeted = 1;
+
+            /* never passed on, it is about this link only */
+            rmXMLAtt(root, "compress");
+
+            /* drivers and other clients may not take binary BLOBs */
+            if (!strcmp(roottag, "newBLOBVector") || isblob)
+                blobsToBase64(root, NULL, NULL, 0);
+
             /* snag interested properties.
             * N.B. don't open to alldevs if seen specific dev already, else
             *   remote client connections start returning too much.
@@ -1224,12 +2066,18 @@ static int readFromClient(ClInfo *cp)
                 // Signature for CHAINED SERVER
                 // Not a regular client.
                 if (dev[0] == '*' && !cp->nprops)
+                {
                     cp->allprops = 2;
+                    addRouteSub(routes, "", "", RT_CLIENTS, cp - clinfo, -1);
+                }
                 else
                     addClDevice(cp, dev, name, isblob);
             }
             else if (!strcmp(roottag, "getProperties") && !cp->nprops && cp->allprops != 2)
+            {
                 cp->allprops = 1;
+                addRouteSub(routes, "", "", RT_CLIENTS, cp - clinfo, -1);
+            }
 
             /* snag enableBLOB -- send to remote drivers too */
             if (!strcmp(roottag, "enableBLOB"))
@@ -1261,6 +2109,14 @@ static int readFromClient(ClInfo *cp)
             else
                 freeMsg(mp);
             delXMLEle(root);
+            tmark = monoUs();
+
+            /* the rest is compressed if that asked for it */
+            if (plain && cp->zl)
+            {
+                feedZL(cp->zl, buf + i + 1, nr - i - 1);
+                break;
+            }
         }
         else if (err[0])
         {
@@ -1271,800 +2127,2633 @@ static int readFromClient(ClInfo *cp)
             return (-1);
         }
     }
+    cp->m.parseus += monoUs() - tmark;
 
     return (shutany ? -1 : 0);
 }
 
+/* answer a client, a chained server really, that asked for a compressed
+ * link in its first message: ZLACK goes as is ahead of all we send it from
+ * now on, which is deflated, and all it sends after that first message is
+ * inflated. it has nothing queued yet, so its writer is not using it.
+ */
+static void startClientZL(ClInfo *cp)
+{
+    cp->zl = newZL();
+    if (!cp->zl)
+    {
+        fprintf(stderr, "%s: Client %d: can not start compressed link\n", indi_tstamp(NULL), cp->s);
+        return;
+    }
+    putZL(cp->zl, ZLACK, sizeof(ZLACK) - 1);
+    if (writers)
+        kickWorker(&writers[(cp - clinfo) % nthreads]);
+    else
+        ioWantWrite(cp->s, 1);
+
+    if (verbose > 0)
+        fprintf(stderr, "%s: Client %d: compressed link\n", indi_tstamp(NULL), cp->s);
+}
+
+/* return 1 if there is anything to write to client cp, else 0 */
+static int clientQueued(ClInfo *cp)
+{
+    return (nFQ(cp->msgq) > 0 || (cp->zl && pendingZL(cp->zl)));
+}
+
 /* read more from the given driver, send to each interested client when see
  * xml closure. if driver dies, try restarting.
+ * N.B. in threaded mode called by its reader thread without srvlock.
+ * setBLOBVector messages are not rebuilt from their XMLEle: the raw bytes are
+ * collected as they arrive and that same buffer becomes the Msg content, only
+ * the surrounding markup is parsed for routing. see blobPass().
  * return 0 if ok else -1 if had to shut down anything.
  */
 static int readFromDriver(DvrInfo *dp)
 {
-    char buf[MAXRBUF];
+    unsigned int gen = dp->gen;
+    int shutany      = 0;
+
+    /* one read of a compressed link may inflate to more than one buffer */
+    do
+    {
+        if (readDriverOnce(dp) < 0)
+            shutany++;
+    } while (dp->active && dp->gen == gen && dp->zl && moreZL(dp->zl));
+
+    return (shutany ? -1 : 0);
+}
+
+/* read and handle one buffer from the given driver, see readFromDriver().
+ * return 0 if ok else -1 if had to shut down anything.
+ */
+static int readDriverOnce(DvrInfo *dp)
+{
+    char buf[MAXRBUF + sizeof(BLOBTAG)];
     int shutany = 0;
     ssize_t nr;
-    char err[1024];
-    XMLEle **nodes;
-    XMLEle *root;
-    int inode = 0;
+    int n;
 
-    /* read driver */
-    nr = read(dp->rfd, buf, sizeof(buf));
+    /* read driver, straight into the raw BLOB if collecting one.
+     * N.B. never more than MAXRBUF so whatever follows the BLOB fits in buf.
+     */
+    if (dp->bbuf)
+    {
+        growBLOBBuf(dp, MAXRBUF);
+        nr = readDriver(dp, dp->bbuf + dp->nbbuf, MAXRBUF);
+    }
+    else
+    {
+        memcpy(buf, dp->bpend, dp->nbpend);
+        nr = readDriver(dp, buf + dp->nbpend, MAXRBUF);
+    }
+    if (nr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return (0);
     if (nr <= 0)
     {
+        captureIO('d', dp - dvrinfo, NULL, 0);
+        lockSrv();
         if (nr < 0)
             fprintf(stderr, "%s: Driver %s: stdin %s\n", indi_tstamp(NULL), dp->name, strerror(errno));
         else
             fprintf(stderr, "%s: Driver %s: stdin EOF\n", indi_tstamp(NULL), dp->name);
 
         shutdownDvr(dp, 1);
+        unlockSrv();
         return (-1);
     }
+    dp->nread += nr;
+    dp->tread = monoUs();
+    captureIO('d', dp - dvrinfo, dp->bbuf ? dp->bbuf + dp->nbbuf : buf + dp->nbpend, nr);
 
-    /* process XML chunk */
-    nodes = parseXMLChunk(dp->lp, buf, nr, err);
-
-    if (!nodes)
+    if (dp->bbuf)
     {
-        if (err[0])
-        {
-            char *ts = indi_tstamp(NULL);
-            fprintf(stderr, "%s: Driver %s: XML error: %s\n", ts, dp->name, err);
-            fprintf(stderr, "%s: Driver %s: XML read: %.*s\n", ts, dp->name, (int)nr, buf);
-            shutdownDvr(dp, 1);
+        /* anything after the end of the BLOB comes back in buf */
+        dp->nbbuf += nr;
+        n = blobPass(dp, buf, &shutany);
+        if (n < 0)
             return (-1);
-        }
-        return -1;
+    }
+    else
+    {
+        n          = dp->nbpend + nr;
+        dp->nbpend = 0;
     }
 
-    root = nodes[inode];
-    while (root)
+    /* plain xml up to the next setBLOBVector, if any */
+    while (n > 0)
     {
-        char *roottag    = tagXMLEle(root);
-        const char *dev  = findXMLAttValu(root, "device");
-        const char *name = findXMLAttValu(root, "name");
-        int isblob       = !strcmp(tagXMLEle(root), "setBLOBVector");
-        Msg *mp;
+        char *tp = memmem(buf, n, BLOBTAG, sizeof(BLOBTAG) - 1);
+        int nxml;
 
-        if (verbose > 2)
-        {
-            fprintf(stderr, "%s: Driver %s: read ", indi_tstamp(0), dp->name);
-            traceMsg(root);
-        }
-        else if (verbose > 1)
+        if (tp)
+            nxml = tp - buf;
+        else
         {
-            fprintf(stderr, "%s: Driver %s: read <%s device='%s' name='%s'>\n", indi_tstamp(NULL), dp->name,
-                    tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
+            /* hold back a possible start of BLOBTAG until the next read */
+            int nhold = sizeof(BLOBTAG) - 2;
+
+            if (nhold > n)
+                nhold = n;
+            while (nhold > 0 && memcmp(buf + n - nhold, BLOBTAG, nhold))
+                nhold--;
+            memcpy(dp->bpend, buf + n - nhold, nhold);
+            dp->nbpend = nhold;
+            nxml       = n - nhold;
         }
 
-        /* that's all if driver is just registering a snoop */
-        /* JM 2016-05-18: Send getProperties to upstream chained servers as well.*/
-        if (!strcmp(roottag, "getProperties"))
-        {
-            addSDevice(dp, dev, name);
-            mp = newMsg();
-            /* send to interested chained servers upstream */
-            if (q2Servers(dp, mp, root) < 0)
-                shutany++;
-            /* Send to snooped drivers if they exist so that they can echo back the snooped propertly immediately */
-            q2RDrivers(dev, mp, root);
-
-            if (mp->count > 0)
-                setMsgXMLEle(mp, root);
-            else
-                freeMsg(mp);
-            delXMLEle(root);
-            inode++;
-            root = nodes[inode];
-            continue;
-        }
+        if (nxml > 0 && parseDriverChunk(dp, buf, nxml, NULL, 0, &shutany) < 0)
+            return (-1);
+        if (!tp)
+            break;
 
-        /* that's all if driver desires to snoop BLOBs from other drivers */
-        if (!strcmp(roottag, "enableBLOB"))
-        {
-            Property *sp = findSDevice(dp, dev, name);
-            if (sp)
-                crackBLOB(pcdataXMLEle(root), &sp->blob);
-            delXMLEle(root);
-            inode++;
-            root = nodes[inode];
-            continue;
-        }
+        /* start collecting a raw BLOB with the rest */
+        dp->nbbuf = 0;
+        dp->nrawb = 0;
+        dp->nshmb = 0;
+        dp->nb64b = 0;
+        growBLOBBuf(dp, n - nxml);
+        memcpy(dp->bbuf, tp, n - nxml);
+        dp->nbbuf = n - nxml;
+        n         = blobPass(dp, buf, &shutany);
+        if (n < 0)
+            return (-1);
+    }
 
-        /* Found a new device? Let's add it to driver info */
-        if (dev[0] && isDeviceInDriver(dev, dp) == 0)
-        {
-            dp->dev           = (char **)realloc(dp->dev, (dp->ndev + 1) * sizeof(char *));
-            dp->dev[dp->ndev] = (char *)malloc(MAXINDIDEVICE * sizeof(char));
+    return (shutany ? -1 : 0);
+}
 
-            strncpy(dp->dev[dp->ndev], dev, MAXINDIDEVICE - 1);
-            dp->dev[dp->ndev][MAXINDIDEVICE - 1] = '\0';
+/* read up to n bytes from driver dp into buf like read(2). shm segments that
+ * come along are queued in dp->shmfds[] for the oneBLOBs that refer to them,
+ * they never arrive after the first byte of their message. losing any is an
+ * EPROTO error, the caller restarts the driver.
+ */
+static ssize_t readDriver(DvrInfo *dp, char *buf, size_t n)
+{
+    union
+    {
+        struct cmsghdr h;
+        char b[CMSG_SPACE(MAXSHMFDS * sizeof(int))];
+    } cbuf;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cm;
+    ssize_t nr;
 
-#ifdef OSX_EMBEDED_MODE
-            if (!dp->ndev)
-                fprintf(stderr, "STARTED \"%s\"\n", dp->name);
-            fflush(stderr);
-#endif
+    if (dp->zwant)
+        return (readZLAnswer(dp, buf, n));
+    if (dp->zl)
+        return (readZL(dp->zl, dp->rfd, buf, n));
+    if (!dp->fdpass)
+        return (read(dp->rfd, buf, n));
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base       = buf;
+    iov.iov_len        = n;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = cbuf.b;
+    msg.msg_controllen = sizeof(cbuf.b);
+    nr                 = recvmsg(dp->rfd, &msg, MSG_CMSG_CLOEXEC);
+    if (nr < 0)
+        return (nr);
+
+    for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+    {
+        int i, nfds;
 
-            dp->ndev++;
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+            continue;
+        nfds = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (dp->nshmfds + nfds > dp->mshmfds)
+        {
+            dp->mshmfds = dp->nshmfds + nfds + MAXSHMFDS;
+            dp->shmfds  = (int *)realloc(dp->shmfds, dp->mshmfds * sizeof(int));
+            if (!dp->shmfds)
+            {
+                fprintf(stderr, "%s: Driver %s: no memory for shm segments\n", indi_tstamp(NULL), dp->name);
+                Bye();
+            }
         }
-
-        /* log messages if any and wanted */
-        if (ldir)
-            logDMsg(root, dev);
-
-        /* build a new message -- set content iff anyone cares */
-        mp = newMsg();
-
-        /* send to interested clients */
-        if (q2Clients(NULL, isblob, dev, name, mp, root) < 0)
-            shutany++;
-
-        /* send to snooping drivers */
-        q2SDrivers(dp, isblob, dev, name, mp, root);
-
-        /* set message content if anyone cares else forget it */
-        if (mp->count > 0)
-            setMsgXMLEle(mp, root);
-        else
-            freeMsg(mp);
-        delXMLEle(root);
-        inode++;
-        root = nodes[inode];
+        for (i = 0; i < nfds; i++)
+            memcpy(&dp->shmfds[dp->nshmfds++], CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+    }
+    if (msg.msg_flags & MSG_CTRUNC)
+    {
+        /* every later shm oneBLOB would get the wrong segment, start over */
+        lockSrv();
+        fprintf(stderr, "%s: Driver %s: too many shm segments at once, some lost\n", indi_tstamp(NULL), dp->name);
+        unlockSrv();
+        errno = EPROTO;
+        return (-1);
     }
 
-    free(nodes);
-
-    return (shutany ? -1 : 0);
+    return (nr);
 }
 
-/* read more from the given driver stderr, add prefix and send to our stderr.
- * return 0 if ok else -1 if had to restart.
+/* read the first bytes from a chained server we asked for a compressed link,
+ * see startRemoteDvr(), like readDriver(). if they are ZLACK the link is
+ * compressed from there on, else they are the first of a plain link and
+ * returned with any we held back. either way the writing held meanwhile
+ * resumes, unless zlTimeouts() already resumed it plain: then ZLACK is an
+ * error since the server inflates what we sent plain. buf must have room for
+ * n bytes but we read fewer, to be able to give back what we held.
  */
-static int stderrFromDriver(DvrInfo *dp)
+static ssize_t readZLAnswer(DvrInfo *dp, char *buf, size_t n)
 {
-    static char exbuf[MAXRBUF];
-    static int nexbuf;
-    ssize_t i, nr;
+    int nack = sizeof(ZLACK) - 1;
+    ssize_t nr;
+    int k;
 
-    /* read more */
-    nr = read(dp->efd, exbuf + nexbuf, sizeof(exbuf) - nexbuf);
+    nr = read(dp->rfd, buf + dp->zhave, n - nack);
     if (nr <= 0)
+        return (nr);
+    memcpy(buf, ZLACK, dp->zhave);
+    nr += dp->zhave;
+
+    for (k = 0; k < nr && k < nack && buf[k] == ZLACK[k]; k++)
+        ;
+    if (k == nr && k < nack)
     {
-        if (nr < 0)
-            fprintf(stderr, "%s: Driver %s: stderr %s\n", indi_tstamp(NULL), dp->name, strerror(errno));
-        else {
-            fprintf(stderr, "%s: Driver %s: stderr EOF\n", indi_tstamp(NULL), dp->name);
-        }
-        shutdownDvr(dp, 1);
+        /* so far so good */
+        dp->zhave = k;
+        errno     = EAGAIN;
         return (-1);
     }
-    nexbuf += nr;
 
-    /* prefix each whole line to our stderr, save extra for next time */
-    for (i = 0; i < nexbuf; i++)
+    dp->zwant = 0;
+    if (k == nack)
     {
-        if (exbuf[i] == '\n')
+        ZL *zl = newZL();
+
+        if (zl)
+            feedZL(zl, buf + nack, nr - nack);
+        lockSrv();
+        if (dp->zstate != ZL_WAIT)
         {
-            fprintf(stderr, "%s: Driver %s: %.*s\n", indi_tstamp(NULL), dp->name, (int)i, exbuf);
-            i++;                               /* count including nl */
-            nexbuf -= i;                       /* remove from nexbuf */
-            memmove(exbuf, exbuf + i, nexbuf); /* slide remaining to front */
-            i = -1;                            /* restart for loop scan */
+            /* we gave up waiting and went on plain, but it deflates now */
+            fprintf(stderr, "%s: Driver %s: compressed link agreed too late\n", indi_tstamp(NULL), dp->name);
+            unlockSrv();
+            if (zl)
+                delZL(zl);
+            errno = EPROTO;
+            return (-1);
+        }
+        if (!zl)
+        {
+            /* it will be deflating anyway */
+            fprintf(stderr, "%s: Driver %s: can not start compressed link\n", indi_tstamp(NULL), dp->name);
+            unlockSrv();
+            errno = ENOMEM;
+            return (-1);
         }
+        if (verbose > 0)
+            fprintf(stderr, "%s: Driver %s: compressed link\n", indi_tstamp(NULL), dp->name);
+        dp->zl     = zl;
+        dp->zstate = ZL_ON;
+        nr         = -1;
+        errno      = EAGAIN;
+    }
+    else
+    {
+        lockSrv();
+        if (verbose > 0)
+            fprintf(stderr, "%s: Driver %s: server does not compress\n", indi_tstamp(NULL), dp->name);
+        dp->zstate = ZL_OFF;
     }
+    if (nFQ(dp->msgq) > 0)
+        ioWantWrite(dp->wfd, 1);
+    unlockSrv();
 
-    return (0);
+    return (nr);
 }
 
-/* close down the given client */
-static void shutdownClient(ClInfo *cp)
+/* return 1 if there is anything to write to driver dp, else 0 */
+static int driverQueued(DvrInfo *dp)
 {
-    Msg *mp;
-
-    /* close connection */
-    shutdown(cp->s, SHUT_RDWR);
-    close(cp->s);
+    return (nFQ(dp->msgq) > 0 || (dp->zl && pendingZL(dp->zl)));
+}
 
-    /* free memory */
-    delLilXML(cp->lp);
-    free(cp->props);
+/* go on plain with each chained server that has not answered our asking for
+ * a compressed link within ZLWAITUS, see startRemoteDvr(). its answer is
+ * still checked for a late ZLACK, see readZLAnswer().
+ * return ms until the next one is due, else -1.
+ */
+static int zlTimeouts(void)
+{
+    unsigned long long now, next = 0;
+    DvrInfo *dp;
 
-    /* decrement and possibly free any unsent messages for this client */
-    while ((mp = (Msg *)popFQ(cp->msgq)) != NULL)
-        if (--mp->count == 0)
-            freeMsg(mp);
-    delFQ(cp->msgq);
+    if (!zlinks)
+        return (-1);
 
-    /* ok now to recycle */
-    cp->active = 0;
+    now = monoUs();
+    for (dp = dvrinfo; dp < &dvrinfo[ndvrinfo]; dp++)
+    {
+        if (!dp->active || dp->zstate != ZL_WAIT)
+            continue;
+        if (now - dp->zasked >= ZLWAITUS)
+        {
+            if (verbose > 0)
+                fprintf(stderr, "%s: Driver %s: no answer, server does not compress\n", indi_tstamp(NULL),
+                        dp->name);
+            dp->zstate = ZL_OFF;
+            if (driverQueued(dp))
+                ioWantWrite(dp->wfd, 1);
+        }
+        else if (next == 0 || dp->zasked + ZLWAITUS - now < next)
+            next = dp->zasked + ZLWAITUS - now;
+    }
 
-    if (verbose > 0)
-        fprintf(stderr, "%s: Client %d: shut down complete - bye!\n", indi_tstamp(NULL), cp->s);
-#ifdef OSX_EMBEDED_MODE
-    int active = 0;
-    for (int i = 0; i < nclinfo; i++)
-        if (clinfo[i].active)
-            active++;
-    fprintf(stderr, "CLIENTS %d\n", active);
-    fflush(stderr);
-#endif
+    return (next ? (int)((next + 999) / 1000) : -1);
 }
 
-/* close down the given driver and restart */
-static void shutdownDvr(DvrInfo *dp, int restart)
+/* make room for at least n more bytes in dp->bbuf, plus the nl and \0 added
+ * when it becomes a Msg.
+ */
+static void growBLOBBuf(DvrInfo *dp, size_t n)
 {
-    Msg *mp;
-    int i = 0;
+    size_t need = dp->nbbuf + n + 2;
 
-    // Tell client driver is dead.
-    for (i = 0; i < dp->ndev; i++)
+    if (dp->bbuf && need <= dp->mbbuf)
+        return;
+    if (need < 2 * dp->mbbuf)
+        need = 2 * dp->mbbuf;
+    dp->bbuf = (char *)poolRealloc(dp->bbuf, need);
+    if (!dp->bbuf)
     {
-        /* Inform clients that this driver is dead */
-        XMLEle *root = addXMLEle(NULL, "delProperty");
-        addXMLAtt(root, "device", dp->dev[i]);
-
-        prXMLEle(stderr, root, 0);
-        Msg *mp = newMsg();
-
-        q2Clients(NULL, 0, dp->dev[i], NULL, mp, root);
-        if (mp->count > 0)
-            setMsgXMLEle(mp, root);
-        else
-            freeMsg(mp);
-        delXMLEle(root);
-    }
-
-    /* make sure it's dead, reclaim resources */
-    if (dp->pid == REMOTEDVR)
-    {
-        /* socket connection */
-        shutdown(dp->wfd, SHUT_RDWR);
-        close(dp->wfd); /* same as rfd */
-    }
-    else
-    {
-        /* local pipe connection */
-        kill(dp->pid, SIGKILL); /* we've insured there are no zombies */
-        close(dp->wfd);
-        close(dp->rfd);
-        close(dp->efd);
+        fprintf(stderr, "%s: Driver %s: no memory for %lu byte BLOB\n", indi_tstamp(NULL), dp->name,
+                (unsigned long)need);
+        Bye();
     }
+    dp->mbbuf = need;
+}
 
-#ifdef OSX_EMBEDED_MODE
-    fprintf(stderr, "STOPPED \"%s\"\n", dp->name);
-    fflush(stderr);
-#endif
-
-    /* free memory */
-    free(dp->sprops);
-    free(dp->dev);
-    delLilXML(dp->lp);
-
-    /* ok now to recycle */
-    dp->active = 0;
-    dp->ndev   = 0;
-
-    /* decrement and possibly free any unsent messages for this client */
-    while ((mp = (Msg *)popFQ(dp->msgq)) != NULL)
-        if (--mp->count == 0)
-            freeMsg(mp);
-    delFQ(dp->msgq);
-
-    if (restart)
-    {
-        if (dp->restarts >= maxrestarts)
-        {
-            fprintf(stderr, "%s: Driver %s: Terminated after #%d restarts.\n", indi_tstamp(NULL), dp->name,
-                    dp->restarts);
-            // If we're not in FIFO mode and we do not have any more drivers, shutdown the server
-            terminateddrv++;
-            if ((ndvrinfo - terminateddrv) <= 0 && !fifo.name)
-                Bye();
-        }
-        else
-        {
-            fprintf(stderr, "%s: Driver %s: restart #%d\n", indi_tstamp(NULL), dp->name, ++dp->restarts);
-            startDvr(dp);
-        }
-    }
+/* forget any partially collected raw BLOB */
+static void resetBLOBPass(DvrInfo *dp)
+{
+    poolFree(dp->bbuf);
+    dp->bbuf    = NULL;
+    dp->nbbuf   = 0;
+    dp->mbbuf   = 0;
+    dp->bfed    = 0;
+    dp->bscan   = 0;
+    dp->binblob = 0;
+    dp->nbpend  = 0;
 }
 
-/* put Msg mp on queue of each driver responsible for dev, or all drivers
- * if dev not specified.
- */
-static void q2RDrivers(const char *dev, Msg *mp, XMLEle *root)
+/* find the first len bytes of tok in dp->bbuf at or after from, else NULL */
+static char *findBLOBTok(DvrInfo *dp, size_t from, const char *tok, size_t len)
 {
-    DvrInfo *dp;
-    char *roottag = tagXMLEle(root);
+    if (from >= dp->nbbuf)
+        return (NULL);
+    return ((char *)memmem(dp->bbuf + from, dp->nbbuf - from, tok, len));
+}
 
-    char lastRemoteHost[MAXSBUF];
-    int lastRemotePort = -1;
+/* return where the name of attribute att is in the n byte start tag, else NULL */
+static const char *findTagAtt(const char *tag, size_t n, const char *att)
+{
+    const char *end = tag + n;
+    size_t alen     = strlen(att);
+    const char *p;
 
-    /* queue message to each interested driver.
-     * N.B. don't send generic getProps to more than one remote driver,
-     *   otherwise they all fan out and we get multiple responses back.
-     */
-    for (dp = dvrinfo; dp < &dvrinfo[ndvrinfo]; dp++)
+    for (p = tag; (p = memmem(p, end - p, att, alen)) != NULL; p += alen)
     {
-        int isRemote = (dp->pid == REMOTEDVR);
+        const char *v = p + alen;
 
-        if (dp->active == 0)
+        /* must be the whole name: att = 'N' */
+        if (p == tag || !isspace((int)p[-1]))
             continue;
-
-        /* driver known to not support this dev */
-        if (dev[0] && dev[0] != '*' && isDeviceInDriver(dev, dp) == 0)
+        while (v < end && isspace((int)*v))
+            v++;
+        if (v == end || *v++ != '=')
             continue;
-
-        /* Only send message to each *unique* remote driver at a particular host:port
-         * Since it will be propogated to all other devices there */
-        if (!dev[0] && isRemote && !strcmp(lastRemoteHost, dp->host) && lastRemotePort == dp->port)
+        while (v < end && isspace((int)*v))
+            v++;
+        if (v == end || (*v != '\'' && *v != '"'))
             continue;
+        return (p);
+    }
 
-        /* JM 2016-10-30: Only send enableBLOB to remote drivers */
-        if (isRemote == 0 && !strcmp(roottag, "enableBLOB"))
-            continue;
+    return (NULL);
+}
 
-        /* Retain last remote driver data so that we do not send the same info again to a driver
-         * residing on the same host:port */
-        if (isRemote)
-        {
-            strncpy(lastRemoteHost, dp->host, MAXSBUF);
-            lastRemotePort = dp->port;
-        }
+/* return the value of integer attribute att in the n byte start tag, else -1 */
+/* return the '>' that ends the start tag at tag, n bytes long so far, or
+ * NULL if it is not there yet. a '>' in a quoted attribute value does not.
+ */
+static char *findTagEnd(char *tag, size_t n)
+{
+    char *end  = tag + n;
+    char quote = 0;
+    char *p;
 
-        /* ok: queue message to this driver */
-        mp->count++;
-        pushFQ(dp->msgq, mp);
-        if (verbose > 1)
+    for (p = tag; p < end; p++)
+    {
+        if (quote)
         {
-            fprintf(stderr, "%s: Driver %s: queuing responsible for <%s device='%s' name='%s'>\n", indi_tstamp(NULL),
-                    dp->name, tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
+            if (*p == quote)
+                quote = 0;
         }
+        else if (*p == '\'' || *p == '"')
+            quote = *p;
+        else if (*p == '>')
+            return (p);
     }
+
+    return (NULL);
 }
 
-/* put Msg mp on queue of each driver snooping dev/name.
- * if BLOB always honor current mode.
- */
-static void q2SDrivers(DvrInfo *me, int isblob, const char *dev, const char *name, Msg *mp, XMLEle *root)
+static long findTagAttInt(const char *tag, size_t n, const char *att)
 {
-    DvrInfo *dp = NULL;
-
-    for (dp = dvrinfo; dp < &dvrinfo[ndvrinfo]; dp++)
-    {
-        if (dp->active == 0)
-            continue;
+    const char *p = findTagAtt(tag, n, att);
 
-        Property *sp = findSDevice(dp, dev, name);
+    if (!p)
+        return (-1);
+    p = strpbrk(p, "'\"");
+    return (atol(p + 1));
+}
 
-        /* nothing for dp if not snooping for dev/name or wrong BLOB mode */
-        if (!sp)
-            continue;
-        if ((isblob && sp->blob == B_NEVER) || (!isblob && sp->blob == B_ONLY))
-            continue;
-        if (me && me->pid == REMOTEDVR && dp->pid == REMOTEDVR)
-        {
-            // Do not send snoop data to remote drivers at the same host
-            // since they will manage their own snoops remotely
-            if (!strcmp(me->host, dp->host) && me->port == dp->port)
-                continue;
-        }
+/* record one more oneBLOB of the setBLOBVector in dp->bbuf */
+static void addBLOBSlice(DvrInfo *dp, size_t off, size_t len, int fd)
+{
+    BLOBSlice *bs;
 
-        /* ok: queue message to this device */
-        mp->count++;
-        pushFQ(dp->msgq, mp);
-        if (verbose > 1)
+    if (dp->nrawb == dp->mrawb)
+    {
+        dp->mrawb = dp->mrawb ? 2 * dp->mrawb : 4;
+        dp->rawb  = (BLOBSlice *)realloc(dp->rawb, dp->mrawb * sizeof(BLOBSlice));
+        if (!dp->rawb)
         {
-            fprintf(stderr, "%s: Driver %s: queuing snooped <%s device='%s' name='%s'>\n", indi_tstamp(NULL), dp->name,
-                    tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
+            fprintf(stderr, "%s: Driver %s: no memory for BLOB slices\n", indi_tstamp(NULL), dp->name);
+            Bye();
         }
     }
+
+    bs = &dp->rawb[dp->nrawb++];
+    memset(bs, 0, sizeof(*bs));
+    bs->off = off;
+    bs->len = len;
+    bs->fd  = fd;
 }
 
-/* add dev/name to dp's snooping list.
- * init with blob mode set to B_NEVER.
+/* record one more base64 oneBLOB of the setBLOBVector in dp->bbuf, its
+ * content starting at dp->bscan. its length is known once its end tag is.
  */
-static void addSDevice(DvrInfo *dp, const char *dev, const char *name)
+static void addB64Slice(DvrInfo *dp)
 {
-    Property *sp;
-    char *ip;
-
-    /* no dups */
-    sp = findSDevice(dp, dev, name);
-    if (sp)
-        return;
+    addBLOBSlice(dp, dp->bscan, 0, -1);
+    dp->rawb[dp->nrawb - 1].b64 = 1;
+    dp->nb64b++;
+}
 
-    /* add dev to sdevs list */
-    dp->sprops = (Property *)realloc(dp->sprops, (dp->nsprops + 1) * sizeof(Property));
-    sp         = &dp->sprops[dp->nsprops++];
+/* give the shm oneBLOB whose start tag is ob..gt in dp->bbuf the next segment
+ * the driver sent. it must hold shmlen bytes and be sealed against shrinking
+ * so mapping it is safe.
+ * return 0 if ok, else -1 after shutting down the driver.
+ */
+static int addShmSlice(DvrInfo *dp, const char *ob, const char *gt, long shmlen)
+{
+    struct stat st;
+    BLOBSlice *bs;
+    int fd;
 
-    ip = sp->dev;
-    strncpy(ip, dev, MAXINDIDEVICE - 1);
-    ip[MAXINDIDEVICE - 1] = '\0';
+    if (dp->nshmfds == 0)
+    {
+        lockSrv();
+        fprintf(stderr, "%s: Driver %s: shm BLOB without segment\n", indi_tstamp(NULL), dp->name);
+        shutdownDvr(dp, 1);
+        unlockSrv();
+        return (-1);
+    }
+    fd = dp->shmfds[0];
+    memmove(dp->shmfds, dp->shmfds + 1, --dp->nshmfds * sizeof(int));
 
-    ip = sp->name;
-    strncpy(ip, name, MAXINDINAME - 1);
-    ip[MAXINDINAME - 1] = '\0';
+    if (fstat(fd, &st) < 0 || st.st_size < shmlen
+#ifdef F_GET_SEALS
+        || !(fcntl(fd, F_GET_SEALS) & F_SEAL_SHRINK)
+#endif
+    )
+    {
+        lockSrv();
+        fprintf(stderr, "%s: Driver %s: bad shm BLOB segment\n", indi_tstamp(NULL), dp->name);
+        close(fd);
+        shutdownDvr(dp, 1);
+        unlockSrv();
+        return (-1);
+    }
 
-    sp->blob = B_NEVER;
+    addBLOBSlice(dp, gt - dp->bbuf, shmlen, fd);
+    bs        = &dp->rawb[dp->nrawb - 1];
+    bs->att   = findTagAtt(ob, gt - ob, "shmlen") - dp->bbuf;
+    bs->empty = gt[-2] == '/';
+    dp->nshmb++;
 
-    if (verbose)
-        fprintf(stderr, "%s: Driver %s: snooping on %s.%s\n", indi_tstamp(NULL), dp->name, dev, name);
+    return (0);
 }
 
-/* return Property if dp is snooping dev/name, else NULL.
+/* hand the shm segments of the setBLOBVector just routed to mp, or close
+ * them if mp is NULL.
  */
-static Property *findSDevice(DvrInfo *dp, const char *dev, const char *name)
+static void claimBLOBFds(DvrInfo *dp, Msg *mp)
 {
     int i;
 
-    for (i = 0; i < dp->nsprops; i++)
+    for (i = 0; i < dp->nrawb; i++)
     {
-        Property *sp = &dp->sprops[i];
-        if (!strcmp(sp->dev, dev) && (!sp->name[0] || !strcmp(sp->name, name)))
-            return (sp);
+        BLOBSlice *bs = &dp->rawb[i];
+
+        if (bs->fd < 0)
+            continue;
+        if (mp)
+        {
+            mp->fds = (int *)realloc(mp->fds, (mp->nfds + 1) * sizeof(int));
+            if (!mp->fds)
+            {
+                fprintf(stderr, "%s: Driver %s: no memory for shm segments\n", indi_tstamp(NULL), dp->name);
+                Bye();
+            }
+            mp->fds[mp->nfds++] = bs->fd;
+            mp->shmlen += bs->len;
+        }
+        else
+            close(bs->fd);
+        bs->fd = -1;
     }
+}
 
-    return (NULL);
+/* close every shm segment dp holds */
+static void closeBLOBFds(DvrInfo *dp)
+{
+    int i;
+
+    claimBLOBFds(dp, NULL);
+    for (i = 0; i < dp->nshmfds; i++)
+        close(dp->shmfds[i]);
+    dp->nshmfds = 0;
 }
 
-/* put Msg mp on queue of each client interested in dev/name, except notme.
- * if BLOB always honor current mode.
- * return -1 if had to shut down any clients, else 0.
- */
-static int q2Clients(ClInfo *notme, int isblob, const char *dev, const char *name, Msg *mp, XMLEle *root)
+/* sink for oneBLOB content parsed while collecting a raw setBLOBVector */
+static void dropBLOBData(XMLEle *e, const char *data, int len, void *userdata)
 {
-    int shutany = 0;
-    ClInfo *cp;
-    int ql, i = 0;
+    INDI_UNUSED(e);
+    INDI_UNUSED(data);
+    INDI_UNUSED(len);
+    INDI_UNUSED(userdata);
+}
 
-    /* queue message to each interested client */
-    for (cp = clinfo; cp < &clinfo[nclinfo]; cp++)
+/* advance through the raw setBLOBVector in dp->bbuf. the markup outside each
+ * oneBLOB is given to dp->lp as usual so the resulting XMLEle can be routed,
+ * the base64 content is skipped. once the closing tag arrives the bytes seen
+ * so far become the Msg content and anything after it is copied to rest[].
+ * a setBLOBVector that is empty, <setBLOBVector ... />, has no closing tag:
+ * it is parsed and routed like any other message.
+ * return bytes copied to rest[], 0 if still collecting or -1 if driver was
+ * shut down.
+ */
+static int blobPass(DvrInfo *dp, char rest[], int *shutany)
+{
+    while (1)
     {
-        /* cp in use? notme? want this dev/name? blob? */
-        if (!cp->active || cp == notme)
-            continue;
-        if (findClDevice(cp, dev, name) < 0)
-            continue;
+        char *ob, *eb, *gt;
+        long rawlen;
 
-        //if ((isblob && cp->blob==B_NEVER) || (!isblob && cp->blob==B_ONLY))
-        if (!isblob && cp->blob == B_ONLY)
+        if (dp->bscan == 0)
+        {
+            /* first see the setBLOBVector start tag through */
+            gt = findTagEnd(dp->bbuf, dp->nbbuf);
+            if (!gt)
+                return (0);
+            gt++;
+            if (gt[-2] == '/')
+            {
+                size_t end = gt - dp->bbuf;
+                int nrest  = dp->nbbuf - end;
+                char *raw  = dp->bbuf;
+                int rc;
+
+                memcpy(rest, raw + end, nrest);
+                dp->bbuf = NULL;
+                resetBLOBPass(dp);
+
+                rc = parseDriverChunk(dp, raw, end, NULL, 0, shutany);
+                poolFree(raw);
+                return (rc < 0 ? -1 : nrest);
+            }
+            dp->bscan = gt - dp->bbuf;
             continue;
+        }
 
-        if (isblob)
+        if (dp->binblob)
         {
-            if (cp->nprops > 0)
+            /* skip base64 up to its end tag */
+            eb = findBLOBTok(dp, dp->bscan, "</oneBLOB", 9);
+            if (!eb)
             {
-                Property *pp   = NULL;
-                int blob_found = 0;
-                for (i = 0; i < cp->nprops; i++)
-                {
-                    pp = &cp->props[i];
-                    if (!strcmp(pp->dev, dev) && (!strcmp(pp->name, name)))
-                    {
-                        blob_found = 1;
-                        break;
-                    }
-                }
-
-                if ((blob_found && pp->blob == B_NEVER) || (blob_found == 0 && cp->blob == B_NEVER))
-                    continue;
+                if (dp->nbbuf > 8 && dp->bscan < dp->nbbuf - 8)
+                    dp->bscan = dp->nbbuf - 8;
+                return (0);
             }
-            else if (cp->blob == B_NEVER)
-                continue;
+            if (dp->nrawb > 0 && dp->rawb[dp->nrawb - 1].b64)
+                dp->rawb[dp->nrawb - 1].len = eb - dp->bbuf - dp->rawb[dp->nrawb - 1].off;
+            dp->bfed = dp->bscan = eb - dp->bbuf;
+            dp->binblob          = 0;
+            continue;
         }
 
-        /* shut down this client if its q is already too large */
-        ql = msgQSize(cp->msgq);
-        if (isblob && maxstreamsiz > 0 && ql > maxstreamsiz)
+        ob = findBLOBTok(dp, dp->bscan, "<oneBLOB", 8);
+        eb = findBLOBTok(dp, dp->bscan, BLOBENDTAG, sizeof(BLOBENDTAG) - 1);
+
+        if (eb && (!ob || eb < ob))
+        {
+            /* complete: split off what follows, parse the rest of the markup
+             * which yields the root that will carry bbuf as its content.
+             */
+            size_t end  = eb - dp->bbuf + sizeof(BLOBENDTAG) - 1;
+            int nrest   = dp->nbbuf - end;
+            size_t bfed = dp->bfed;
+            char *raw   = dp->bbuf;
+
+            memcpy(rest, raw + end, nrest);
+            raw[end]     = '\n';
+            raw[end + 1] = '\0';
+
+            dp->bbuf = NULL;
+            resetBLOBPass(dp);
+
+            if (parseDriverChunk(dp, raw + bfed, end - bfed, raw, end + 1, shutany) < 0)
+                return (-1);
+            if (dp->nrawb > dp->nb64b)
+                setXMLPCDataSink(dp->lp, NULL, NULL, NULL);
+            return (nrest);
+        }
+
+        if (ob)
         {
-            // Drop frames for streaming blobs
-            /* pull out each name/BLOB pair, decode */
-            XMLEle *ep      = NULL;
-            int streamFound = 0;
-            for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
+            gt = findTagEnd(ob, dp->nbbuf - (ob - dp->bbuf));
+            if (!gt)
             {
-                if (strcmp(tagXMLEle(ep), "oneBLOB") == 0)
-                {
-                    XMLAtt *fa = findXMLAtt(ep, "format");
+                /* wait for the rest of the start tag */
+                dp->bscan = ob - dp->bbuf;
+                return (0);
+            }
 
-                    if (fa && strstr(valuXMLAtt(fa), "stream"))
-                    {
-                        streamFound = 1;
-                        break;
-                    }
-                }
+            /* parse through the start tag, then skip its content */
+            gt++;
+            if (parseDriverChunk(dp, dp->bbuf + dp->bfed, gt - dp->bbuf - dp->bfed, NULL, 0, shutany) < 0)
+                return (-1);
+            dp->bfed = dp->bscan = gt - dp->bbuf;
+
+            /* shm: the content is in the next segment, any here is ignored */
+            rawlen = dp->fdpass ? findTagAttInt(ob, gt - ob, "shmlen") : -1;
+            if (rawlen > 0)
+            {
+                if (addShmSlice(dp, ob, gt, rawlen) < 0)
+                    return (-1);
+                if (gt[-2] != '/')
+                    dp->binblob = 1;
+                continue;
             }
-            if (streamFound)
+            if (gt[-2] == '/')
             {
-                if (verbose > 1)
-                    fprintf(stderr, "%s: Client %d: %d bytes behind. Dropping stream BLOB...\n", indi_tstamp(NULL),
-                            cp->s, ql);
+                /* empty element */
+                addB64Slice(dp);
                 continue;
             }
-        }
-        if (ql > maxqsiz)
-        {
-            if (verbose)
-                fprintf(stderr, "%s: Client %d: %d bytes behind, shutting down\n", indi_tstamp(NULL), cp->s, ql);
-            shutdownClient(cp);
-            shutany++;
-            continue;
-        }
 
-        /* ok: queue message to this client */
-        mp->count++;
-        pushFQ(cp->msgq, mp);
-        if (verbose > 1)
-            fprintf(stderr, "%s: Client %d: queuing <%s device='%s' name='%s'>\n", indi_tstamp(NULL), cp->s,
-                    tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
-    }
+            rawlen = findTagAttInt(ob, gt - ob, "rawlen");
+            if (rawlen > 0)
+            {
+                /* binary: exactly rawlen bytes that may look like anything.
+                 * lp counts them off itself as it gets them with the markup
+                 * that follows, its sink drops them since we have them here.
+                 */
+                setXMLPCDataSink(dp->lp, "oneBLOB", dropBLOBData, NULL);
+                addBLOBSlice(dp, dp->bscan, rawlen, -1);
+
+                dp->bscan += rawlen;
+                if (dp->bscan + MAXRBUF > dp->nbbuf)
+                    growBLOBBuf(dp, dp->bscan + MAXRBUF - dp->nbbuf);
+                continue;
+            }
+            addB64Slice(dp);
+            dp->binblob = 1;
 
-    return (shutany ? -1 : 0);
-}
+#ifdef WITH_ENCLEN
+            {
+                /* content is at least enclen chars, no need to scan those.
+                 * also size bbuf for all of it now so reads go right in.
+                 */
+                long blen = findTagAttInt(ob, gt - ob, "enclen");
 
-/* put Msg mp on queue of each chained server client, except notme.
+                if (blen > 0)
+                {
+                    size_t want = dp->bscan + blen + blen / 72 + MAXRBUF;
+
+                    dp->bscan += blen;
+                    if (want > dp->nbbuf)
+                        growBLOBBuf(dp, want - dp->nbbuf);
+                }
+            }
+#endif
+            continue;
+        }
+
+        /* neither yet, rescan only the tail next time in case it holds a
+         * partial tag.
+         */
+        if (dp->nbbuf > sizeof(BLOBENDTAG) && dp->bscan < dp->nbbuf - sizeof(BLOBENDTAG))
+            dp->bscan = dp->nbbuf - sizeof(BLOBENDTAG);
+        return (0);
+    }
+}
+
+/* give n bytes from buf to the driver's XML parser and route each complete
+ * message. if raw is not NULL it is the malloced serialization of the
+ * setBLOBVector expected to complete in this chunk, used as its content.
+ * set *shutany if any client was shut down.
+ * N.B. like readFromDriver() called without srvlock, taken just to route.
+ * return 0 if ok else -1 if the driver had to be shut down.
+ */
+static int parseDriverChunk(DvrInfo *dp, char *buf, int n, char *raw, int nraw, int *shutany)
+{
+    unsigned long long t0 = monoUs();
+    char err[1024];
+    XMLEle **nodes;
+    XMLEle *root;
+    int inode = 0;
+
+    /* process XML chunk */
+    nodes = parseXMLChunk(dp->lp, buf, n, err);
+    dp->nparse += monoUs() - t0;
+
+    if (!nodes)
+    {
+        poolFree(raw);
+        if (err[0])
+        {
+            char *ts;
+            lockSrv();
+            ts = indi_tstamp(NULL);
+            fprintf(stderr, "%s: Driver %s: XML error: %s\n", ts, dp->name, err);
+            fprintf(stderr, "%s: Driver %s: XML read: %.*s\n", ts, dp->name, n, buf);
+            shutdownDvr(dp, 1);
+            unlockSrv();
+            return (-1);
+        }
+        return (0);
+    }
+
+    lockSrv();
+
+    /* what was read and parsed so far counts now we may touch dp->m */
+    dp->m.inbytes += dp->nread;
+    dp->m.parseus += dp->nparse;
+    dp->nread  = 0;
+    dp->nparse = 0;
+
+    root = nodes[inode];
+    while (root)
+    {
+        char *roottag    = tagXMLEle(root);
+        const char *dev  = findXMLAttValu(root, "device");
+        const char *name = findXMLAttValu(root, "name");
+        int isblob       = !strcmp(tagXMLEle(root), "setBLOBVector");
+        int mapped;
+        Msg *mp;
+
+        dp->m.inmsgs++;
+
+        if (verbose > 2)
+        {
+            fprintf(stderr, "%s: Driver %s: read ", indi_tstamp(0), dp->name);
+            traceMsg(root);
+        }
+        else if (verbose > 1)
+        {
+            fprintf(stderr, "%s: Driver %s: read <%s device='%s' name='%s'>\n", indi_tstamp(NULL), dp->name,
+                    tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
+        }
+
+        /* that's all if driver is just registering a snoop */
+        /* JM 2016-05-18: Send getProperties to upstream chained servers as well.*/
+        if (!strcmp(roottag, "getProperties"))
+        {
+            addSDevice(dp, dev, name);
+            if (wantsFlag(root, "binaryBLOB") && dp->pid != REMOTEDVR)
+                dp->rawblobs = 1;
+            mp = newMsg();
+            stampMsg(mp, dp);
+            /* send to interested chained servers upstream */
+            if (q2Servers(dp, mp, root) < 0)
+                (*shutany)++;
+            /* Send to snooped drivers if they exist so that they can echo back the snooped propertly immediately */
+            q2RDrivers(dev, mp, root);
+
+            if (mp->count > 0)
+                setMsgXMLEle(mp, root);
+            else
+                freeMsg(mp);
+            delXMLEle(root);
+            inode++;
+            root = nodes[inode];
+            continue;
+        }
+
+        /* that's all if driver desires to snoop BLOBs from other drivers */
+        if (!strcmp(roottag, "enableBLOB"))
+        {
+            Property *sp = findSDevice(dp, dev, name);
+            if (wantsFlag(root, "binaryBLOB") && dp->pid != REMOTEDVR)
+                dp->rawblobs = 1;
+            if (sp)
+                crackBLOB(pcdataXMLEle(root), &sp->blob);
+            delXMLEle(root);
+            inode++;
+            root = nodes[inode];
+            continue;
+        }
+
+        /* Found a new device? Let's add it to driver info */
+        if (dev[0] && isDeviceInDriver(dev, dp) == 0)
+        {
+#ifdef OSX_EMBEDED_MODE
+            if (!dp->ndev)
+                fprintf(stderr, "STARTED \"%s\"\n", dp->name);
+            fflush(stderr);
+#endif
+
+            addDvrDevice(dp, dev);
+        }
+
+        /* log messages if any and wanted */
+        if (ldir)
+            logDMsg(root, dev);
+
+        /* build a new message -- set content iff anyone cares.
+         * binary BLOBs get a second one for peers that want base64, shm
+         * BLOBs one more for peers that want them inline.
+         */
+        mp = newMsg();
+        if (isblob && raw && dp->nrawb > dp->nb64b)
+            mp->b64 = newMsg();
+        if (isblob && raw && dp->nshmb > 0)
+            mp->inl = newMsg();
+        stampMsg(mp, dp);
+
+        /* send to interested clients */
+        if (q2Clients(NULL, isblob, dev, name, mp, root) < 0)
+            (*shutany)++;
+
+        /* send to snooping drivers */
+        q2SDrivers(dp, isblob, dev, name, mp, root);
+
+        mapped = mp->inl && (mp->inl->count > 0 || mp->b64->count > 0);
+        if (mapped)
+            mapBLOBSlices(dp->rawb, dp->nrawb, 1);
+        if (mp->inl && mp->inl->count > 0)
+            setMsgInline(mp->inl, raw, nraw, dp->rawb, dp->nrawb);
+        else if (mp->inl)
+            freeMsg(mp->inl);
+        mp->inl = NULL;
+        if (mp->b64 && mp->b64->count > 0)
+        {
+            blobsToBase64(root, raw, dp->rawb, dp->nrawb);
+            setMsgXMLEle(mp->b64, root);
+        }
+        else if (mp->b64)
+            freeMsg(mp->b64);
+        mp->b64 = NULL;
+        if (mapped)
+            mapBLOBSlices(dp->rawb, dp->nrawb, 0);
+
+        /* set message content if anyone cares else forget it.
+         * the raw BLOB can be used as is, its oneBLOB content was never
+         * parsed so root could not reproduce it anyway. shm segments stay
+         * open as long as it does.
+         */
+        if (isblob && raw)
+            claimBLOBFds(dp, mp->count > 0 ? mp : NULL);
+        if (mp->count > 0 && isblob && raw)
+        {
+            mp->cp = raw;
+            mp->cl = nraw;
+            raw    = NULL;
+        }
+        else if (mp->count > 0)
+            setMsgXMLEle(mp, root);
+        else
+            freeMsg(mp);
+        delXMLEle(root);
+        inode++;
+        root = nodes[inode];
+    }
+
+    unlockSrv();
+    poolFree(nodes);
+    poolFree(raw);
+
+    return (0);
+}
+
+/* read more from the given driver stderr, add prefix and send to our stderr.
+ * return 0 if ok else -1 if had to restart.
+ */
+static int stderrFromDriver(DvrInfo *dp)
+{
+    static char exbuf[MAXRBUF];
+    static int nexbuf;
+    ssize_t i, nr;
+
+    /* read more */
+    nr = read(dp->efd, exbuf + nexbuf, sizeof(exbuf) - nexbuf);
+    if (nr <= 0)
+    {
+        if (nr < 0)
+            fprintf(stderr, "%s: Driver %s: stderr %s\n", indi_tstamp(NULL), dp->name, strerror(errno));
+        else {
+            fprintf(stderr, "%s: Driver %s: stderr EOF\n", indi_tstamp(NULL), dp->name);
+        }
+        shutdownDvr(dp, 1);
+        return (-1);
+    }
+    nexbuf += nr;
+
+    /* prefix each whole line to our stderr, save extra for next time */
+    for (i = 0; i < nexbuf; i++)
+    {
+        if (exbuf[i] == '\n')
+        {
+            fprintf(stderr, "%s: Driver %s: %.*s\n", indi_tstamp(NULL), dp->name, (int)i, exbuf);
+            i++;                               /* count including nl */
+            nexbuf -= i;                       /* remove from nexbuf */
+            memmove(exbuf, exbuf + i, nexbuf); /* slide remaining to front */
+            i = -1;                            /* restart for loop scan */
+        }
+    }
+
+    return (0);
+}
+
+/* close down the given client */
+static void shutdownClient(ClInfo *cp)
+{
+    Msg *mp;
+    int i;
+
+    captureIO('c', cp - clinfo, NULL, 0);
+
+    /* close connection, its writer thread does once done writing to it */
+    ioForget(cp->s);
+    shutdown(cp->s, SHUT_RDWR);
+    if (cp->writing)
+        cp->closing = 1;
+    else
+        close(cp->s);
+
+    /* no longer routed to */
+    for (i = 0; i < cp->nprops; i++)
+        rmRouteSub(routes, cp->props[i].dev, cp->props[i].name, RT_CLIENTS, cp - clinfo);
+    if (cp->allprops)
+        rmRouteSub(routes, "", "", RT_CLIENTS, cp - clinfo);
+
+    /* free memory, its writer thread frees zl if still writing with it */
+    delLilXML(cp->lp);
+    free(cp->props);
+    if (!cp->closing)
+    {
+        if (verbose > 0 && cp->zl)
+        {
+            char who[32];
+
+            snprintf(who, sizeof(who), "Client %d", cp->s);
+            logZL(cp->zl, who);
+        }
+        delZL(cp->zl);
+        cp->zl = NULL;
+    }
+
+    /* decrement and possibly free any unsent messages for this client */
+    while ((mp = (Msg *)popFQ(cp->msgq)) != NULL)
+        if (--mp->count == 0)
+            freeMsg(mp);
+    delFQ(cp->msgq);
+    for (i = 0; i < cp->mqprops; i++)
+        free(cp->qprops[i].members);
+    free(cp->qprops);
+
+    /* ok now to recycle */
+    cp->active = 0;
+
+    if (verbose > 0)
+    {
+        fprintf(stderr, "%s: Client %d: shut down complete - bye!\n", indi_tstamp(NULL), cp->s);
+        logPool();
+    }
+#ifdef OSX_EMBEDED_MODE
+    int active = 0;
+    for (int i = 0; i < nclinfo; i++)
+        if (clinfo[i].active)
+            active++;
+    fprintf(stderr, "CLIENTS %d\n", active);
+    fflush(stderr);
+#endif
+}
+
+/* close down the given driver and restart */
+static void shutdownDvr(DvrInfo *dp, int restart)
+{
+    Msg *mp;
+    int i = 0;
+
+    /* wait for its reader thread, unless that is us, to be done with it.
+     * that's all if it shut the driver down itself meanwhile.
+     */
+    if (dp->reading && !pthread_equal(pthread_self(), readers[(dp - dvrinfo) % nthreads].tid))
+    {
+        unsigned int gen = dp->gen;
+
+        while (dp->reading)
+            pthread_cond_wait(&srvcond, &srvlock);
+        if (!dp->active || dp->gen != gen)
+            return;
+    }
+
+    // Tell client driver is dead.
+    for (i = 0; i < dp->ndev; i++)
+    {
+        /* Inform clients that this driver is dead */
+        XMLEle *root = addXMLEle(NULL, "delProperty");
+        addXMLAtt(root, "device", dp->dev[i]);
+
+        prXMLEle(stderr, root, 0);
+        Msg *mp = newMsg();
+
+        q2Clients(NULL, 0, dp->dev[i], NULL, mp, root);
+        if (mp->count > 0)
+            setMsgXMLEle(mp, root);
+        else
+            freeMsg(mp);
+        delXMLEle(root);
+    }
+
+    /* make sure it's dead, reclaim resources */
+    ioForget(dp->rfd);
+    ioForget(dp->wfd);
+    if (dp->pid == REMOTEDVR)
+    {
+        /* socket connection */
+        shutdown(dp->wfd, SHUT_RDWR);
+        close(dp->wfd); /* same as rfd */
+    }
+    else
+    {
+        /* local pipe connection */
+        ioForget(dp->efd);
+        kill(dp->pid, SIGKILL); /* we've insured there are no zombies */
+        close(dp->wfd);
+        close(dp->rfd);
+        close(dp->efd);
+    }
+
+#ifdef OSX_EMBEDED_MODE
+    fprintf(stderr, "STOPPED \"%s\"\n", dp->name);
+    fflush(stderr);
+#endif
+
+    /* no longer routed to */
+    for (i = 0; i < dp->nsprops; i++)
+        rmRouteSub(routes, dp->sprops[i].dev, dp->sprops[i].name, RT_SNOOPERS, dp - dvrinfo);
+    for (i = 0; i < dp->ndev; i++)
+    {
+        rmRouteSub(routes, dp->dev[i], "", RT_DRIVERS, dp - dvrinfo);
+        free(dp->dev[i]);
+    }
+
+    /* free memory */
+    free(dp->sprops);
+    free(dp->dev);
+    dp->sprops  = NULL;
+    dp->nsprops = 0;
+    delLilXML(dp->lp);
+    resetBLOBPass(dp);
+    closeBLOBFds(dp);
+    free(dp->rawb);
+    free(dp->shmfds);
+    dp->rawb     = NULL;
+    dp->nrawb    = 0;
+    dp->mrawb    = 0;
+    dp->rawblobs = 0;
+    dp->nshmb    = 0;
+    dp->nb64b    = 0;
+    dp->fdpass   = 0;
+    dp->shmfds   = NULL;
+    dp->mshmfds  = 0;
+    if (verbose > 0 && dp->zl)
+        logZL(dp->zl, dp->name);
+    delZL(dp->zl);
+    dp->zl     = NULL;
+    dp->zstate = ZL_OFF;
+    dp->zwant  = 0;
+
+    /* ok now to recycle */
+    dp->active = 0;
+    dp->ndev   = 0;
+    wakeReader(dp);
+
+    /* decrement and possibly free any unsent messages for this client */
+    while ((mp = (Msg *)popFQ(dp->msgq)) != NULL)
+        if (--mp->count == 0)
+            freeMsg(mp);
+    delFQ(dp->msgq);
+
+    if (restart)
+    {
+        if (dp->restarts >= maxrestarts)
+        {
+            fprintf(stderr, "%s: Driver %s: Terminated after #%d restarts.\n", indi_tstamp(NULL), dp->name,
+                    dp->restarts);
+            // If we're not in FIFO mode and we do not have any more drivers, shutdown the server
+            terminateddrv++;
+            if ((ndvrinfo - terminateddrv) <= 0 && !fifo.name)
+                Bye();
+        }
+        else
+        {
+            fprintf(stderr, "%s: Driver %s: restart #%d\n", indi_tstamp(NULL), dp->name, ++dp->restarts);
+            startDvr(dp);
+        }
+    }
+}
+
+/* put Msg mp on queue of each driver responsible for dev, or all drivers
+ * if dev not specified.
+ */
+static void q2RDrivers(const char *dev, Msg *mp, XMLEle *root)
+{
+    DvrInfo *dp;
+    char *roottag = tagXMLEle(root);
+    int anydev    = !dev[0] || dev[0] == '*';
+    Route *rp     = anydev ? NULL : findRoute(routes, dev, "");
+
+    char lastRemoteHost[MAXSBUF];
+    int lastRemotePort = -1;
+
+    /* queue message to each interested driver.
+     * N.B. don't send generic getProps to more than one remote driver,
+     *   otherwise they all fan out and we get multiple responses back.
+     */
+    for (dp = dvrinfo; dp < &dvrinfo[ndvrinfo]; dp++)
+    {
+        int isRemote = (dp->pid == REMOTEDVR);
+
+        if (dp->active == 0)
+            continue;
+
+        /* driver known to not support this dev */
+        if (!anydev && (!rp || findRouteSub(rp, RT_DRIVERS, dp - dvrinfo) < 0))
+            continue;
+
+        /* Only send message to each *unique* remote driver at a particular host:port
+         * Since it will be propogated to all other devices there */
+        if (!dev[0] && isRemote && !strcmp(lastRemoteHost, dp->host) && lastRemotePort == dp->port)
+            continue;
+
+        /* JM 2016-10-30: Only send enableBLOB to remote drivers */
+        if (isRemote == 0 && !strcmp(roottag, "enableBLOB"))
+            continue;
+
+        /* Retain last remote driver data so that we do not send the same info again to a driver
+         * residing on the same host:port */
+        if (isRemote)
+        {
+            strncpy(lastRemoteHost, dp->host, MAXSBUF);
+            lastRemotePort = dp->port;
+        }
+
+        /* ok: queue message to this driver */
+        pushDriverMsg(dp, mp);
+        if (verbose > 1)
+        {
+            fprintf(stderr, "%s: Driver %s: queuing responsible for <%s device='%s' name='%s'>\n", indi_tstamp(NULL),
+                    dp->name, tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
+        }
+    }
+}
+
+/* put Msg mp on queue of each driver snooping dev/name.
+ * if BLOB always honor current mode.
+ */
+static void q2SDrivers(DvrInfo *me, int isblob, const char *dev, const char *name, Msg *mp, XMLEle *root)
+{
+    Route *rps[2];
+    int i, j;
+
+    /* snoopers of the whole device, then those of just this property */
+    rps[0] = findRoute(routes, dev, "");
+    rps[1] = name[0] ? findRoute(routes, dev, name) : NULL;
+
+    for (j = 0; j < 2; j++)
+    {
+        RouteList *lp = rps[j] ? &rps[j]->lists[RT_SNOOPERS] : NULL;
+        for (i = 0; lp && i < lp->nsubs; i++)
+        {
+            DvrInfo *dp = &dvrinfo[lp->subs[i].who];
+
+            /* once each */
+            if (j == 1 && rps[0] && findRouteSub(rps[0], RT_SNOOPERS, dp - dvrinfo) >= 0)
+                continue;
+
+            Property *sp = findSDevice(dp, dev, name);
+
+            /* nothing for dp if wrong BLOB mode */
+            if (!sp)
+                continue;
+            if ((isblob && sp->blob == B_NEVER) || (!isblob && sp->blob == B_ONLY))
+                continue;
+            if (me && me->pid == REMOTEDVR && dp->pid == REMOTEDVR)
+            {
+                // Do not send snoop data to remote drivers at the same host
+                // since they will manage their own snoops remotely
+                if (!strcmp(me->host, dp->host) && me->port == dp->port)
+                    continue;
+            }
+
+            /* ok: queue message to this device, base64 BLOBs unless it takes binary */
+            pushDriverMsg(dp, peerMsg(mp, dp->rawblobs, 0));
+            if (verbose > 1)
+            {
+                fprintf(stderr, "%s: Driver %s: queuing snooped <%s device='%s' name='%s'>\n", indi_tstamp(NULL),
+                        dp->name, tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
+            }
+        }
+    }
+}
+
+/* add dev/name to dp's snooping list.
+ * init with blob mode set to B_NEVER.
+ */
+static void addSDevice(DvrInfo *dp, const char *dev, const char *name)
+{
+    Property *sp;
+    char *ip;
+
+    /* no dups */
+    sp = findSDevice(dp, dev, name);
+    if (sp)
+        return;
+
+    /* add dev to sdevs list */
+    dp->sprops = (Property *)realloc(dp->sprops, (dp->nsprops + 1) * sizeof(Property));
+    sp         = &dp->sprops[dp->nsprops];
+
+    ip = sp->dev;
+    strncpy(ip, dev, MAXINDIDEVICE - 1);
+    ip[MAXINDIDEVICE - 1] = '\0';
+
+    ip = sp->name;
+    strncpy(ip, name, MAXINDINAME - 1);
+    ip[MAXINDINAME - 1] = '\0';
+
+    sp->blob = B_NEVER;
+
+    addRouteSub(routes, sp->dev, sp->name, RT_SNOOPERS, dp - dvrinfo, dp->nsprops++);
+
+    if (verbose)
+        fprintf(stderr, "%s: Driver %s: snooping on %s.%s\n", indi_tstamp(NULL), dp->name, dev, name);
+}
+
+/* return Property if dp is snooping dev/name, else NULL.
+ * if snooping on both the whole dev and dev/name, the one asked for first.
+ */
+static Property *findSDevice(DvrInfo *dp, const char *dev, const char *name)
+{
+    Route *rps[2];
+    int first = -1;
+    int i, j;
+
+    rps[0] = findRoute(routes, dev, "");
+    rps[1] = name[0] ? findRoute(routes, dev, name) : NULL;
+
+    for (j = 0; j < 2; j++)
+    {
+        if (rps[j] && (i = findRouteSub(rps[j], RT_SNOOPERS, dp - dvrinfo)) >= 0)
+        {
+            int prop = rps[j]->lists[RT_SNOOPERS].subs[i].prop;
+            if (first < 0 || prop < first)
+                first = prop;
+        }
+    }
+
+    return (first < 0 ? NULL : &dp->sprops[first]);
+}
+
+/* put Msg mp on queue of each client interested in dev/name, except notme.
+ * if BLOB always honor current mode.
+ * return -1 if had to shut down any clients, else 0.
+ */
+static int q2Clients(ClInfo *notme, int isblob, const char *dev, const char *name, Msg *mp, XMLEle *root)
+{
+    int shutany     = 0;
+    int stream      = -1; /* whether mp is a streaming BLOB, once we need to know */
+    int isset       = !strncmp(tagXMLEle(root), "set", 3);
+    int conflatable = isset && !isblob && strcmp(tagXMLEle(root), "setTextVector");
+    ClInfo *cp;
+    Msg *qmp;
+    long ql;
+    int i, n, replace;
+
+    /* the clients that want this dev/name. N.B. shutting one down below
+     * changes the routes, hence the copy.
+     */
+    n = routeClients(dev, name ? name : "");
+
+    /* queue message to each interested client */
+    for (i = 0; i < n; i++)
+    {
+        cp = &clinfo[rcands[i].who];
+
+        /* cp in use? notme? blob? */
+        if (!cp->active || cp == notme)
+            continue;
+
+        //if ((isblob && cp->blob==B_NEVER) || (!isblob && cp->blob==B_ONLY))
+        if (!isblob && cp->blob == B_ONLY)
+            continue;
+
+        /* a BLOB enabled for this property overrides the client setting */
+        if (isblob && (rcands[i].prop >= 0 ? cp->props[rcands[i].prop].blob : cp->blob) == B_NEVER)
+            continue;
+
+        /* newer values take the place of queued ones if cp conflates, not
+         * texts. BLOBs only for clients falling behind, see -b.
+         */
+        replace = conflatable && cp->conflate;
+
+        /* go easy on BLOBs for clients falling behind */
+        ql = clientQSize(cp);
+        if (isblob && maxstreamsiz > 0 && ql > maxstreamsiz)
+        {
+            if (slowpolicy == SC_STREAM && stream < 0)
+                stream = isStreamBLOB(root);
+            if (slowpolicy == SC_PAUSE && !cp->blobspaused)
+            {
+                if (verbose > 1)
+                    fprintf(stderr, "%s: Client %d: %ld bytes behind. Pausing BLOBs...\n", indi_tstamp(NULL), cp->s,
+                            ql);
+                cp->blobspaused = 1;
+            }
+            if (slowpolicy == SC_STREAM && stream)
+            {
+                if (verbose > 1)
+                    fprintf(stderr, "%s: Client %d: %ld bytes behind. Dropping stream BLOB...\n", indi_tstamp(NULL),
+                            cp->s, ql);
+                cp->m.dropped++;
+                continue;
+            }
+            replace = slowpolicy == SC_SUPERSEDE;
+        }
+        if (isblob && cp->blobspaused)
+        {
+            cp->m.dropped++;
+            continue;
+        }
+
+        /* shut down this client if its q is already too large */
+        if (ql > maxqsiz)
+        {
+            if (verbose)
+                fprintf(stderr, "%s: Client %d: %ld bytes behind, shutting down\n", indi_tstamp(NULL), cp->s, ql);
+            shutdownClient(cp);
+            shutany++;
+            continue;
+        }
+
+        /* ok: queue message to this client, BLOBs in a form it takes */
+        qmp = peerMsg(mp, cp->rawblobs, cp->shmblobs);
+        if (replace && replaceClientMsg(cp, dev, name, qmp, root))
+        {
+            if (verbose > 1)
+                fprintf(stderr, "%s: Client %d: replacing queued <%s device='%s' name='%s'>\n", indi_tstamp(NULL),
+                        cp->s, tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
+            if (isblob)
+                cp->m.dropped++;
+            else
+                cp->m.conflated++;
+            continue;
+        }
+        pushClientMsg(cp, qmp);
+
+        /* note where it is in case a newer one comes */
+        if (isblob ? isset && slowpolicy == SC_SUPERSEDE : conflatable && cp->conflate)
+        {
+            QProp *qp = findQProp(cp, dev, name, 1);
+            if (qp)
+            {
+                qp->seq = cp->npushed - 1;
+                noteQProp(qp, root);
+            }
+        }
+        if (verbose > 1)
+            fprintf(stderr, "%s: Client %d: queuing <%s device='%s' name='%s'>\n", indi_tstamp(NULL), cp->s,
+                    tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
+    }
+
+    return (shutany ? -1 : 0);
+}
+
+/* put Msg mp on queue of each chained server client, except notme.
   * return -1 if had to shut down any clients, else 0.
  */
-static int q2Servers(DvrInfo *me, Msg *mp, XMLEle *root)
+static int q2Servers(DvrInfo *me, Msg *mp, XMLEle *root)
+{
+    int shutany = 0, i = 0, devFound = 0;
+    ClInfo *cp;
+    long ql = 0;
+
+    /* queue message to each interested client */
+    for (cp = clinfo; cp < &clinfo[nclinfo]; cp++)
+    {
+        /* cp in use? not chained server? */
+        if (!cp->active)
+            continue;
+
+        // Only send the message to the upstream server that is connected specfically to the device in driver dp
+        switch (cp->allprops)
+        {
+            // 0 --> not all props are requested. Check for specific combination
+            case 0:
+                for (i = 0; i < cp->nprops; i++)
+                {
+                    Property *pp = &cp->props[i];
+                    int j        = 0;
+                    for (j = 0; j < me->ndev; j++)
+                    {
+                        if (!strcmp(pp->dev, me->dev[j]))
+                            break;
+                    }
+
+                    if (j != me->ndev)
+                    {
+                        devFound = 1;
+                        break;
+                    }
+                }
+            break;
+
+            // All props are requested. This is client-only mode (not upstream server)
+            case 1:
+                break;
+            // Upstream server mode
+            case 2:
+                devFound = 1;
+                break;
+        }
+
+        // If no matching device found, continue
+        if (devFound == 0)
+            continue;
+
+        /* shut down this client if its q is already too large */
+        ql = clientQSize(cp);
+        if (ql > maxqsiz)
+        {
+            if (verbose)
+                fprintf(stderr, "%s: Client %d: %ld bytes behind, shutting down\n", indi_tstamp(NULL), cp->s, ql);
+            shutdownClient(cp);
+            shutany++;
+            continue;
+        }
+
+        /* ok: queue message to this client */
+        pushClientMsg(cp, mp);
+        if (verbose > 1)
+            fprintf(stderr, "%s: Client %d: queuing <%s device='%s' name='%s'>\n", indi_tstamp(NULL), cp->s,
+                    tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
+    }
+
+    return (shutany ? -1 : 0);
+}
+
+/* return the bytes mp holds */
+static long msgSize(Msg *mp)
+{
+    long l = sizeof(Msg) + mp->shmlen;
+
+    if (mp->cp != mp->buf)
+        l += mp->cl;
+    return (l);
+}
+
+/* return the bytes of all Msgs queued for cp.
+ * N.B. a Msg gets its content after being queued, but always before the
+ *   next one is, so the size of the last one is counted on the next call.
+ */
+static long clientQSize(ClInfo *cp)
+{
+    if (cp->qlast)
+    {
+        cp->qbytes += msgSize(cp->qlast);
+        cp->qlast = NULL;
+        if (cp->qbytes > cp->m.maxqbytes)
+            cp->m.maxqbytes = cp->qbytes;
+    }
+    return (cp->qbytes);
+}
+
+/* pop the Msg at the head of the queue of cp, free it if we are the last to
+ * use it.
+ */
+static void popClientMsg(ClInfo *cp)
+{
+    Msg *mp;
+
+    clientQSize(cp);
+    mp = (Msg *)popFQ(cp->msgq);
+    cp->qbytes -= msgSize(mp);
+    cp->npopped++;
+    if (--mp->count == 0)
+        freeMsg(mp);
+}
+
+/* return the entry of dev/name in the qprops[] of cp. if none, add one if add
+ * else return NULL. names too long to keep are never found.
+ */
+static QProp *findQProp(ClInfo *cp, const char *dev, const char *name, int add)
+{
+    unsigned int h = hashRoute(dev, name);
+    QProp *qp;
+    int i;
+
+    if (strlen(dev) >= MAXINDIDEVICE || strlen(name) >= MAXINDINAME)
+        return (NULL);
+
+    /* keep at least half the slots free */
+    if (add && 2 * (cp->nqprops + 1) > cp->mqprops)
+    {
+        QProp *old = cp->qprops;
+        int mold   = cp->mqprops;
+
+        cp->mqprops = mold ? 2 * mold : 16;
+        cp->qprops  = (QProp *)calloc(cp->mqprops, sizeof(QProp));
+        if (!cp->qprops)
+        {
+            fprintf(stderr, "no memory for queued properties\n");
+            Bye();
+        }
+        for (i = 0; i < mold; i++)
+        {
+            int j;
+            if (!old[i].used)
+                continue;
+            for (j = old[i].hash & (cp->mqprops - 1); cp->qprops[j].used; j = (j + 1) & (cp->mqprops - 1))
+                ;
+            cp->qprops[j] = old[i];
+        }
+        free(old);
+    }
+
+    for (i = h & (cp->mqprops - 1); cp->mqprops > 0 && cp->qprops[i].used; i = (i + 1) & (cp->mqprops - 1))
+    {
+        qp = &cp->qprops[i];
+        if (qp->hash == h && !strcmp(qp->dev, dev) && !strcmp(qp->name, name))
+            return (qp);
+    }
+    if (!add)
+        return (NULL);
+
+    qp = &cp->qprops[i];
+    strcpy(qp->dev, dev);
+    strcpy(qp->name, name);
+    qp->hash    = h;
+    qp->seq     = 0;
+    qp->used    = 1;
+    qp->hasmsg  = 1;
+    qp->members = NULL;
+    cp->nqprops++;
+    return (qp);
+}
+
+/* note in qp what the set*Vector root just queued carries */
+static void noteQProp(QProp *qp, XMLEle *root)
+{
+    size_t n = 1, len;
+    XMLEle *ep;
+    char *mp;
+
+    for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
+        n += strlen(findXMLAttValu(ep, "name")) + 1;
+    mp = (char *)realloc(qp->members, n);
+    if (!mp)
+    {
+        /* never replaced then */
+        qp->hasmsg = 1;
+        return;
+    }
+    qp->members = mp;
+    for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
+    {
+        len = strlen(findXMLAttValu(ep, "name")) + 1;
+        memcpy(mp, findXMLAttValu(ep, "name"), len);
+        mp += len;
+    }
+    *mp        = '\0';
+    qp->hasmsg = findXMLAtt(root, "message") != NULL;
+}
+
+/* return 1 if root may take the place of the set*Vector noted in qp without
+ * losing anything: that one has no message and root has all its members.
+ * else 0.
+ */
+static int supersedes(XMLEle *root, const QProp *qp)
+{
+    const char *np;
+    XMLEle *ep;
+
+    if (qp->hasmsg || !qp->members)
+        return (0);
+    for (np = qp->members; *np; np += strlen(np) + 1)
+    {
+        for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
+            if (!strcmp(findXMLAttValu(ep, "name"), np))
+                break;
+        if (!ep)
+            return (0);
+    }
+    return (1);
+}
+
+/* queue mp, made from root, for cp in place of the set*Vector of dev/name
+ * queued before, if that one has not started going out yet and root
+ * supersedes it. return 1 if so, else 0.
+ */
+static int replaceClientMsg(ClInfo *cp, const char *dev, const char *name, Msg *mp, XMLEle *root)
+{
+    QProp *qp = findQProp(cp, dev, name, 0);
+    Msg *old;
+
+    if (!qp || qp->seq < cp->npopped + cp->nflight || (qp->seq == cp->npopped && cp->nsent > 0))
+        return (0);
+    if (!supersedes(root, qp))
+        return (0);
+
+    clientQSize(cp);
+    mp->count++;
+    old = (Msg *)setiFQ(cp->msgq, (int)(qp->seq - cp->npopped), mp);
+    cp->qbytes -= msgSize(old);
+    cp->qlast = mp;
+    if (--old->count == 0)
+        freeMsg(old);
+    noteQProp(qp, root);
+    return (1);
+}
+
+/* return 1 if any BLOB in root has a streaming format, else 0 */
+static int isStreamBLOB(XMLEle *root)
+{
+    XMLEle *ep;
+
+    for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
+    {
+        XMLAtt *fa = findXMLAtt(ep, "format");
+
+        if (fa && !strcmp(tagXMLEle(ep), "oneBLOB") && strstr(valuXMLAtt(fa), "stream"))
+            return (1);
+    }
+    return (0);
+}
+
+/* return 1 if root says its sender wants what attribute how names, such as
+ * BLOBs in a given form, else 0. either way the attribute is removed so it
+ * goes no further.
+ */
+static int wantsFlag(XMLEle *root, const char *how)
+{
+    int yes = !strcmp(findXMLAttValu(root, how), "1");
+
+    rmXMLAtt(root, how);
+    return (yes);
+}
+
+/* return the copy of mp to queue for a peer that takes binary and/or shm
+ * BLOBs as given, see top.
+ */
+static Msg *peerMsg(Msg *mp, int rawblobs, int shmblobs)
+{
+    if (mp->b64 && !rawblobs)
+        return (mp->b64);
+    if (mp->inl && !shmblobs)
+        return (mp->inl);
+    return (mp);
+}
+
+/* map or unmap each shm segment in rawb[] */
+static void mapBLOBSlices(BLOBSlice *rawb, int nrawb, int map)
+{
+    int i;
+
+    for (i = 0; i < nrawb; i++)
+    {
+        BLOBSlice *bs = &rawb[i];
+
+        if (bs->fd < 0)
+            continue;
+        if (!map)
+        {
+            if (bs->map)
+                munmap(bs->map, bs->len);
+            bs->map = NULL;
+            continue;
+        }
+        bs->map = (char *)mmap(NULL, bs->len, PROT_READ, MAP_SHARED, bs->fd, 0);
+        if (bs->map == MAP_FAILED)
+        {
+            fprintf(stderr, "%s: mmap %lu byte BLOB: %s\n", indi_tstamp(NULL), (unsigned long)bs->len, strerror(errno));
+            Bye();
+        }
+    }
+}
+
+/* fill mp with the nraw bytes of raw, each mapped shm oneBLOB in rawb[] made
+ * a binary one: shmlen becomes rawlen and the content follows the start tag.
+ */
+static void setMsgInline(Msg *mp, const char *raw, size_t nraw, const BLOBSlice *rawb, int nrawb)
+{
+    static const char endtag[] = "</oneBLOB>";
+    size_t at = 0, cl = nraw;
+    char *cp;
+    int i;
+
+    for (i = 0; i < nrawb; i++)
+        if (rawb[i].map)
+            cl += rawb[i].len + (rawb[i].empty ? sizeof(endtag) - 2 : 0);
+
+    mp->cp = cp = (char *)poolMalloc(cl + 1);
+    if (!cp)
+    {
+        fprintf(stderr, "no memory for %lu byte BLOB\n", (unsigned long)cl);
+        Bye();
+    }
+
+    for (i = 0; i < nrawb; i++)
+    {
+        const BLOBSlice *bs = &rawb[i];
+        size_t tagend       = bs->empty ? bs->off - 2 : bs->off;
+
+        if (!bs->map)
+            continue;
+
+        /* "rawlen" is just as long as "shmlen" */
+        memcpy(cp, raw + at, bs->att - at);
+        cp += bs->att - at;
+        memcpy(cp, "rawlen", 6);
+        cp += 6;
+        memcpy(cp, raw + bs->att + 6, tagend - bs->att - 6);
+        cp += tagend - bs->att - 6;
+        if (bs->empty)
+            *cp++ = '>';
+        memcpy(cp, bs->map, bs->len);
+        cp += bs->len;
+        if (bs->empty)
+        {
+            memcpy(cp, endtag, sizeof(endtag) - 1);
+            cp += sizeof(endtag) - 1;
+        }
+        at = bs->off;
+    }
+    memcpy(cp, raw + at, nraw - at);
+    cp += nraw - at;
+    *cp = '\0';
+
+    mp->cl = cl;
+}
+
+/* change each binary oneBLOB in root to base64 for peers that want that.
+ * if raw is NULL the bytes are its pcdata, else rawb[] locates them in raw or
+ * their mapped shm segment. in the latter case root has no content for any
+ * oneBLOB, those already base64 get theirs back from raw.
+ */
+static void blobsToBase64(XMLEle *root, const char *raw, const BLOBSlice *rawb, int nrawb)
 {
-    int shutany = 0, i = 0, devFound = 0;
-    ClInfo *cp;
-    int ql = 0;
+    XMLEle *ep;
+    int i = 0;
 
-    /* queue message to each interested client */
-    for (cp = clinfo; cp < &clinfo[nclinfo]; cp++)
+    for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
     {
-        /* cp in use? not chained server? */
-        if (!cp->active)
+        const BLOBSlice *bs = NULL;
+        const unsigned char *data;
+        unsigned char *enc;
+        char enclen[32];
+        size_t len, sz;
+        int l;
+
+        if (strcmp(tagXMLEle(ep), "oneBLOB"))
             continue;
+        if (raw && i < nrawb)
+            bs = &rawb[i++];
 
-        // Only send the message to the upstream server that is connected specfically to the device in driver dp
-        switch (cp->allprops)
+        if (!findXMLAtt(ep, "rawlen") && !findXMLAtt(ep, "shmlen"))
         {
-            // 0 --> not all props are requested. Check for specific combination
-            case 0:
-                for (i = 0; i < cp->nprops; i++)
-                {
-                    Property *pp = &cp->props[i];
-                    int j        = 0;
-                    for (j = 0; j < me->ndev; j++)
-                    {
-                        if (!strcmp(pp->dev, me->dev[j]))
-                            break;
-                    }
+            if (bs && bs->b64 && bs->len > 0)
+                editXMLEleRaw(ep, raw + bs->off, bs->len);
+            continue;
+        }
 
-                    if (j != me->ndev)
-                    {
-                        devFound = 1;
-                        break;
-                    }
-                }
+        if (!raw)
+        {
+            data = (const unsigned char *)pcdataXMLEle(ep);
+            len  = pcdatalenXMLEle(ep);
+        }
+        else if (bs && !bs->b64)
+        {
+            data = (const unsigned char *)(bs->map ? bs->map : raw + bs->off);
+            len  = bs->len;
+        }
+        else
+        {
+            data = NULL;
+            len  = 0;
+        }
+
+        sz  = 4 * len / 3 + 4;
+        enc = (unsigned char *)malloc(sz + 1);
+        if (!enc)
+        {
+            fprintf(stderr, "no memory to encode %lu byte BLOB\n", (unsigned long)len);
+            Bye();
+        }
+        l      = len > 0 ? to64frombits_s(enc, data, len, sz) : 0;
+        enc[l] = '\0';
+        editXMLEle(ep, (char *)enc);
+        free(enc);
+
+        rmXMLAtt(ep, "rawlen");
+        rmXMLAtt(ep, "shmlen");
+        snprintf(enclen, sizeof(enclen), "%d", l);
+        addXMLAtt(ep, "enclen", enclen);
+    }
+}
+
+/* print root as content in Msg mp.
+ */
+static void setMsgXMLEle(Msg *mp, XMLEle *root)
+{
+    /* want cl to only count content, but need room for final \0 */
+    mp->cl = sprlXMLEle(root, 0);
+    if (mp->cl < sizeof(mp->buf))
+        mp->cp = mp->buf;
+    else
+        mp->cp = poolMalloc(mp->cl + 1);
+    sprXMLEle(mp->cp, root, 0);
+}
+
+/* save str as content in Msg mp.
+ */
+static void setMsgStr(Msg *mp, char *str)
+{
+    /* want cl to only count content, but need room for final \0 */
+    mp->cl = strlen(str);
+    if (mp->cl < sizeof(mp->buf))
+        mp->cp = mp->buf;
+    else
+        mp->cp = poolMalloc(mp->cl + 1);
+    strcpy(mp->cp, str);
+}
+
+/* add mp to the queue of client cp.
+ * start watching for cp to be writable if this is its first pending Msg, or
+ * tell its writer thread to.
+ */
+static void pushClientMsg(ClInfo *cp, Msg *mp)
+{
+    mp->count++;
+    if (nFQ(cp->msgq) == 0 && writers)
+        kickWorker(&writers[(cp - clinfo) % nthreads]);
+    else if (nFQ(cp->msgq) == 0)
+        ioWantWrite(cp->s, 1);
+    pushFQ(cp->msgq, mp);
+
+    /* count the previous one now that it has content */
+    clientQSize(cp);
+    cp->qlast = mp;
+    cp->npushed++;
+    if (nFQ(cp->msgq) > cp->m.maxqmsgs)
+        cp->m.maxqmsgs = nFQ(cp->msgq);
+}
+
+/* add mp to the queue of driver dp.
+ * start watching for dp to be writable if this is its first pending Msg.
+ */
+static void pushDriverMsg(DvrInfo *dp, Msg *mp)
+{
+    mp->count++;
+    if (nFQ(dp->msgq) == 0 && dp->zstate != ZL_WAIT)
+        ioWantWrite(dp->wfd, 1);
+    pushFQ(dp->msgq, mp);
+    if (nFQ(dp->msgq) > dp->m.maxqmsgs)
+        dp->m.maxqmsgs = nFQ(dp->msgq);
+}
+
+/* return pointer to one new nulled Msg
+ */
+static Msg *newMsg(void)
+{
+    Msg *mp = (Msg *)poolMalloc(sizeof(Msg));
+
+    memset(mp, 0, offsetof(Msg, buf));
+    return (mp);
+}
+
+/* note Msg mp, and its copies for other peers, as read from driver dp just
+ * now, for the fan-out latency.
+ */
+static void stampMsg(Msg *mp, DvrInfo *dp)
+{
+    Msg *all[3] = { mp, mp->b64, mp->inl };
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (!all[i])
+            continue;
+        all[i]->tread = dp->tread;
+        all[i]->from  = dp - dvrinfo;
+    }
+}
+
+/* free Msg mp and everything it contains */
+static void freeMsg(Msg *mp)
+{
+    int i;
+
+    if (mp->cp && mp->cp != mp->buf)
+        poolFree(mp->cp);
+    for (i = 0; i < mp->nfds; i++)
+        close(mp->fds[i]);
+    free(mp->fds);
+    poolFree(mp);
+}
+
+/* write as much as we may at once of the Msgs queued for the given client.
+ * pop each message from queue when complete and free it if we are the last
+ * one to use it. shut down this client if trouble.
+ * N.B. we assume we will never be called unless clientQueued(cp).
+ * return 0 if ok else -1 if had to shut down.
+ */
+static int sendClientMsg(ClInfo *cp)
+{
+    struct iovec iov[MAXWIOV];
+    Msg *fdmp;
+    ssize_t nw;
+    int niov;
+
+    /* gather the next chunk of as many messages as fit in one write */
+    niov = gatherMsgs(cp->msgq, cp->nsent, cp->wbudget, 1, iov, &fdmp);
+    if (cp->zl)
+        nw = sendZL(cp->zl, cp->s, iov, niov);
+    else
+        nw = sendIov(cp->s, iov, niov, fdmp ? fdmp->fds : NULL, fdmp ? fdmp->nfds : 0);
+
+    return (sentClientMsg(cp, iov, niov, nw));
+}
+
+/* account for nw bytes, or the errno if < 0, written to client cp of what
+ * gatherMsgs() put in iov[]. on a compressed link that is what sendZL()
+ * took, written or not. shut down this client if trouble.
+ * return 0 if ok else -1 if had to shut down.
+ */
+static int sentClientMsg(ClInfo *cp, const struct iovec *iov, int niov, ssize_t nw)
+{
+    unsigned long long now = 0;
+    size_t n;
+    Msg *mp;
+    int i;
+
+    /* shut down if trouble, try again later if no room after all */
+    if (nw < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return (0);
+    if (nw < 0 || (nw == 0 && niov > 0))
+    {
+        if (nw == 0)
+            fprintf(stderr, "%s: Client %d: write returned 0\n", indi_tstamp(NULL), cp->s);
+        else
+            fprintf(stderr, "%s: Client %d: write: %s\n", indi_tstamp(NULL), cp->s, strerror(errno));
+        shutdownClient(cp);
+        return (-1);
+    }
+    cp->m.outbytes += nw;
+
+    /* update amount sent of each message. when complete: free message if
+     * we are the last to use it and pop from our queue.
+     */
+    for (i = 0; i < niov; i++)
+    {
+        mp = (Msg *)peekFQ(cp->msgq);
+        n  = (size_t)nw < iov[i].iov_len ? (size_t)nw : iov[i].iov_len;
+
+        /* trace */
+        if (verbose > 2)
+        {
+            fprintf(stderr, "%s: Client %d: sending msg copy %d nq %d:\n%.*s\n", indi_tstamp(NULL), cp->s, mp->count,
+                    nFQ(cp->msgq), (int)n, &mp->cp[cp->nsent]);
+        }
+        else if (verbose > 1 && n > 0)
+        {
+            fprintf(stderr, "%s: Client %d: sending %.50s\n", indi_tstamp(NULL), cp->s, &mp->cp[cp->nsent]);
+        }
+
+        nw -= n;
+        cp->nsent += n;
+        if (cp->nsent < mp->cl)
+            break;
+
+        /* fan-out latency of what came from a driver */
+        if (mp->tread)
+        {
+            if (!now)
+                now = monoUs();
+            addLatency(&cp->m, now - mp->tread);
+            addLatency(&dvrinfo[mp->from].m, now - mp->tread);
+        }
+        cp->m.outmsgs++;
+        popClientMsg(cp);
+        cp->nsent = 0;
+    }
+
+    if (nFQ(cp->msgq) == 0)
+        cp->blobspaused = 0;
+    if (!clientQueued(cp))
+        ioWantWrite(cp->s, 0);
+
+    return (0);
+}
+
+/* make socket s nonblocking with the SO_SNDBUF asked for with -w and return
+ * the most bytes to write to it at once: its send buffer, but never less
+ * than MAXWSIZ. a local, unix domain, socket gets UNIXSNDBUF if -w is not
+ * given: its default is far less than TCP loopback grows to, so large BLOBs
+ * would take many more writes and wakeups than over TCP.
+ */
+static size_t setupSocket(int s, int local)
+{
+    socklen_t len = sizeof(int);
+    int want      = sndbuf > 0 || !local ? sndbuf : UNIXSNDBUF;
+    int n;
+
+    if (fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK) < 0)
+        fprintf(stderr, "%s: fcntl O_NONBLOCK: %s\n", indi_tstamp(NULL), strerror(errno));
+    if (want > 0 && setsockopt(s, SOL_SOCKET, SO_SNDBUF, &want, sizeof(want)) < 0)
+        fprintf(stderr, "%s: setsockopt SO_SNDBUF: %s\n", indi_tstamp(NULL), strerror(errno));
+    if (getsockopt(s, SOL_SOCKET, SO_SNDBUF, &n, &len) < 0 || n < MAXWSIZ)
+        return (MAXWSIZ);
+    return ((size_t)n);
+}
+
+/* fill iov[] with what is left to send of the Msgs in q, starting nsent bytes
+ * into the first, up to budget bytes and MAXWIOV Msgs. if withfds, shm
+ * segments must go along with the first byte of their Msg: so we stop before
+ * any but the first Msg with fds and set *fdmp to the first if its go now,
+ * else to NULL.
+ * return n entries used in iov[].
+ */
+static int gatherMsgs(FQ *q, unsigned int nsent, size_t budget, int withfds, struct iovec *iov, Msg **fdmp)
+{
+    int i, nq = nFQ(q);
+
+    *fdmp = NULL;
+    for (i = 0; i < nq && i < MAXWIOV && budget > 0; i++)
+    {
+        Msg *mp    = (Msg *)peekiFQ(q, i);
+        size_t off = i == 0 ? nsent : 0;
+        size_t len = mp->cl - off;
+
+        if (withfds && mp->nfds > 0)
+        {
+            if (i > 0)
+                break;
+            if (off == 0)
+                *fdmp = mp;
+        }
+        if (len > budget)
+            len = budget;
+        iov[i].iov_base = &mp->cp[off];
+        iov[i].iov_len  = len;
+        budget -= len;
+    }
+
+    return (i);
+}
+
+/* write the niov iov[] to fd like writev(2), with the nfds fds[] attached to
+ * the first byte if any. fd must be a socket then.
+ */
+static ssize_t sendIov(int fd, struct iovec *iov, int niov, const int *fds, int nfds)
+{
+    union
+    {
+        struct cmsghdr h;
+        char b[CMSG_SPACE(MAXSHMFDS * sizeof(int))];
+    } cbuf;
+    struct msghdr msg;
+    struct cmsghdr *cm;
+
+    if (nfds == 0)
+        return (writev(fd, iov, niov));
+    if (nfds > MAXSHMFDS)
+    {
+        errno = E2BIG;
+        return (-1);
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&cbuf, 0, sizeof(cbuf));
+    msg.msg_iov        = iov;
+    msg.msg_iovlen     = niov;
+    msg.msg_control    = cbuf.b;
+    msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+    cm                 = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level     = SOL_SOCKET;
+    cm->cmsg_type      = SCM_RIGHTS;
+    cm->cmsg_len       = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(cm), fds, nfds * sizeof(int));
+
+    return (sendmsg(fd, &msg, 0));
+}
+
+/* write as much as we may at once of the Msgs queued for the given driver.
+ * pop each message from queue when complete and free it if we are the last
+ * one to use it. restart this driver if touble.
+ * N.B. we assume we will never be called unless driverQueued(dp).
+ * return 0 if ok else -1 if had to shut down.
+ */
+static int sendDriverMsg(DvrInfo *dp)
+{
+    struct iovec iov[MAXWIOV];
+    Msg *mp, *fdmp;
+    ssize_t nw;
+    size_t n;
+    int i, niov;
+
+    /* nothing goes after asking for a compressed link until it is answered */
+    if (dp->zstate == ZL_WAIT)
+    {
+        ioWantWrite(dp->wfd, 0);
+        return (0);
+    }
+
+    /* gather the next chunk of as many messages as fit in one write */
+    niov = gatherMsgs(dp->msgq, dp->nsent, dp->wbudget, 0, iov, &fdmp);
+    if (dp->zstate == ZL_ASK)
+        niov = 1;
+    if (dp->zl)
+        nw = sendZL(dp->zl, dp->wfd, iov, niov);
+    else
+        nw = sendIov(dp->wfd, iov, niov, NULL, 0);
+
+    /* restart if trouble, try again later if no room after all */
+    if (nw < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return (0);
+    if (nw < 0 || (nw == 0 && niov > 0))
+    {
+        if (nw == 0)
+            fprintf(stderr, "%s: Driver %s: write returned 0\n", indi_tstamp(NULL), dp->name);
+        else
+            fprintf(stderr, "%s: Driver %s: write: %s\n", indi_tstamp(NULL), dp->name, strerror(errno));
+        shutdownDvr(dp, 1);
+        return (-1);
+    }
+    dp->m.outbytes += nw;
+
+    /* update amount sent of each message. when complete: free message if
+     * we are the last to use it and pop from our queue.
+     */
+    for (i = 0; i < niov; i++)
+    {
+        mp = (Msg *)peekFQ(dp->msgq);
+        n  = (size_t)nw < iov[i].iov_len ? (size_t)nw : iov[i].iov_len;
+
+        /* trace */
+        if (verbose > 2)
+        {
+            fprintf(stderr, "%s: Driver %s: sending msg copy %d nq %d:\n%.*s\n", indi_tstamp(NULL), dp->name,
+                    mp->count, nFQ(dp->msgq), (int)n, &mp->cp[dp->nsent]);
+        }
+        else if (verbose > 1 && n > 0)
+        {
+            fprintf(stderr, "%s: Driver %s: sending %.50s\n", indi_tstamp(NULL), dp->name, &mp->cp[dp->nsent]);
+        }
+
+        nw -= n;
+        dp->nsent += n;
+        if (dp->nsent < mp->cl)
             break;
+        if (--mp->count == 0)
+            freeMsg(mp);
+        popFQ(dp->msgq);
+        dp->nsent = 0;
+        dp->m.outmsgs++;
+        if (dp->zstate == ZL_ASK)
+        {
+            dp->zstate = ZL_WAIT;
+            dp->zasked = monoUs();
+        }
+    }
+
+    if (dp->zstate == ZL_WAIT || !driverQueued(dp))
+        ioWantWrite(dp->wfd, 0);
+
+    return (0);
+}
+
+/* take srvlock, if threaded */
+static void lockSrv(void)
+{
+    if (nthreads)
+        pthread_mutex_lock(&srvlock);
+}
+
+/* release srvlock, if threaded */
+static void unlockSrv(void)
+{
+    if (nthreads)
+        pthread_mutex_unlock(&srvlock);
+}
+
+/* start nthreads readers and writers, if any. drivers are shared out among
+ * the readers and clients among the writers by index, so the messages of a
+ * driver are routed and those to a client are written in order.
+ * N.B. call with srvlock held.
+ */
+static void startThreads(void)
+{
+    int i;
+
+    if (!nthreads)
+        return;
+
+    readers = (Worker *)calloc(nthreads, sizeof(Worker));
+    writers = (Worker *)calloc(nthreads, sizeof(Worker));
+    if (!readers || !writers)
+    {
+        fprintf(stderr, "no memory for threads\n");
+        Bye();
+    }
+
+    /* the main thread just needs waking */
+    if (pipe(mainwake.wake) < 0)
+    {
+        fprintf(stderr, "%s: wake pipe: %s\n", indi_tstamp(NULL), strerror(errno));
+        Bye();
+    }
+    fcntl(mainwake.wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(mainwake.wake[1], F_SETFL, O_NONBLOCK);
+    ioWatch(mainwake.wake[0], IO_WAKE, 0, IO_READ);
+
+    for (i = 0; i < 2 * nthreads; i++)
+    {
+        Worker *w = i < nthreads ? &readers[i] : &writers[i - nthreads];
+
+        if (pipe(w->wake) < 0)
+        {
+            fprintf(stderr, "%s: wake pipe: %s\n", indi_tstamp(NULL), strerror(errno));
+            Bye();
+        }
+        fcntl(w->wake[0], F_SETFL, O_NONBLOCK);
+        fcntl(w->wake[1], F_SETFL, O_NONBLOCK);
+        growWorker(w, 16);
+        if (pthread_create(&w->tid, NULL, i < nthreads ? readerThread : writerThread, w) != 0)
+        {
+            fprintf(stderr, "%s: pthread_create failed\n", indi_tstamp(NULL));
+            Bye();
+        }
+    }
+
+    if (verbose > 0)
+        fprintf(stderr, "%s: %d reader and %d writer threads\n", indi_tstamp(NULL), nthreads, nthreads);
+}
+
+/* read the drivers of one share as they become readable, forever */
+static void *readerThread(void *arg)
+{
+    Worker *w = (Worker *)arg;
+    int k     = w - readers;
+
+    lockSrv();
+    while (1)
+    {
+        int i, n = 1;
+
+        /* wait for our drivers, and for news of them */
+        growWorker(w, ndvrinfo / nthreads + 2);
+        w->pfds[0].fd     = w->wake[0];
+        w->pfds[0].events = POLLIN;
+        for (i = k; i < ndvrinfo; i += nthreads)
+        {
+            if (!dvrinfo[i].active)
+                continue;
+            w->pfds[n].fd     = dvrinfo[i].rfd;
+            w->pfds[n].events = POLLIN;
+            w->idx[n]         = i;
+            w->gen[n]         = dvrinfo[i].gen;
+            n++;
+        }
 
-            // All props are requested. This is client-only mode (not upstream server)
-            case 1:
-                break;
-            // Upstream server mode
-            case 2:
-                devFound = 1;
-                break;
+        unlockSrv();
+        if (poll(w->pfds, n, -1) < 0 && errno != EINTR)
+        {
+            lockSrv();
+            fprintf(stderr, "%s: poll: %s\n", indi_tstamp(NULL), strerror(errno));
+            Bye();
         }
+        lockSrv();
 
-        // If no matching device found, continue
-        if (devFound == 0)
-            continue;
+        if (w->pfds[0].revents)
+            drainWorker(w);
 
-        /* shut down this client if its q is already too large */
-        ql = msgQSize(cp->msgq);
-        if (ql > maxqsiz)
+        /* read each still the driver we polled. dvrinfo stays put while
+         * any is being read, see holdReaders().
+         */
+        for (i = 1; i < n; i++)
         {
-            if (verbose)
-                fprintf(stderr, "%s: Client %d: %d bytes behind, shutting down\n", indi_tstamp(NULL), cp->s, ql);
-            shutdownClient(cp);
-            shutany++;
-            continue;
-        }
+            DvrInfo *dp;
 
-        /* ok: queue message to this client */
-        mp->count++;
-        pushFQ(cp->msgq, mp);
-        if (verbose > 1)
-            fprintf(stderr, "%s: Client %d: queuing <%s device='%s' name='%s'>\n", indi_tstamp(NULL), cp->s,
-                    tagXMLEle(root), findXMLAttValu(root, "device"), findXMLAttValu(root, "name"));
+            if (!w->pfds[i].revents)
+                continue;
+            while (holdreaders)
+                pthread_cond_wait(&srvcond, &srvlock);
+            dp = &dvrinfo[w->idx[i]];
+            if (!dp->active || dp->gen != w->gen[i])
+                continue;
+
+            dp->reading = 1;
+            nreading++;
+            unlockSrv();
+            readFromDriver(dp);
+            lockSrv();
+            dp->reading = 0;
+            nreading--;
+            pthread_cond_broadcast(&srvcond);
+        }
     }
 
-    return (shutany ? -1 : 0);
+    return (NULL);
 }
 
-/* return size of all Msqs on the given q */
-static int msgQSize(FQ *q)
+/* write the clients of one share as they become writable, forever */
+static void *writerThread(void *arg)
 {
-    int i, l = 0;
+    Worker *w = (Worker *)arg;
+    int k     = w - writers;
 
-    for (i = 0; i < nFQ(q); i++)
+    lockSrv();
+    while (1)
     {
-        Msg *mp = (Msg *)peekiFQ(q, i);
-        l += sizeof(Msg);
-        if (mp->cp != mp->buf)
-            l += mp->cl;
+        int i, n = 1;
+
+        /* wait for those of our clients with anything queued, and for news */
+        growWorker(w, nclinfo / nthreads + 2);
+        w->pfds[0].fd     = w->wake[0];
+        w->pfds[0].events = POLLIN;
+        for (i = k; i < nclinfo; i += nthreads)
+        {
+            if (!clinfo[i].active || !clientQueued(&clinfo[i]))
+                continue;
+            w->pfds[n].fd     = clinfo[i].s;
+            w->pfds[n].events = POLLOUT;
+            w->idx[n]         = i;
+            n++;
+        }
+
+        unlockSrv();
+        if (poll(w->pfds, n, -1) < 0 && errno != EINTR)
+        {
+            lockSrv();
+            fprintf(stderr, "%s: poll: %s\n", indi_tstamp(NULL), strerror(errno));
+            Bye();
+        }
+        lockSrv();
+
+        if (w->pfds[0].revents)
+            drainWorker(w);
+
+        /* N.B. a client slot may have been reused meanwhile, but then the
+         * worst a write can do is find no room.
+         */
+        for (i = 1; i < n; i++)
+        {
+            ClInfo *cp = &clinfo[w->idx[i]];
+
+            if (w->pfds[i].revents && cp->active && cp->s == w->pfds[i].fd && clientQueued(cp))
+                writeClient(w->idx[i]);
+        }
     }
 
-    return (l);
+    return (NULL);
 }
 
-/* print root as content in Msg mp.
+/* write as much as we may at once of the Msgs queued for client clinfo[ci],
+ * as sendClientMsg() but without srvlock while writing. meanwhile those Msgs
+ * are held by an extra count and stay at the head of its queue.
+ * N.B. call with srvlock held.
  */
-static void setMsgXMLEle(Msg *mp, XMLEle *root)
+static void writeClient(int ci)
 {
-    /* want cl to only count content, but need room for final \0 */
-    mp->cl = sprlXMLEle(root, 0);
-    if (mp->cl < sizeof(mp->buf))
-        mp->cp = mp->buf;
+    struct iovec iov[MAXWIOV];
+    Msg *held[MAXWIOV];
+    ClInfo *cp = &clinfo[ci];
+    Msg *fdmp;
+    ZL *zl;
+    ssize_t nw;
+    int i, niov, s, err;
+
+    niov = gatherMsgs(cp->msgq, cp->nsent, cp->wbudget, 1, iov, &fdmp);
+    for (i = 0; i < niov; i++)
+    {
+        held[i] = (Msg *)peekiFQ(cp->msgq, i);
+        held[i]->count++;
+    }
+    cp->nflight = niov;
+    cp->writing = 1;
+    s           = cp->s;
+    zl          = cp->zl;
+
+    /* N.B. a compressed link is flushed with nothing in flight, but that is
+     * only up to this thread.
+     */
+    unlockSrv();
+    if (zl)
+        nw = sendZL(zl, s, iov, niov);
     else
-        mp->cp = malloc(mp->cl + 1);
-    sprXMLEle(mp->cp, root, 0);
+        nw = sendIov(s, iov, niov, fdmp ? fdmp->fds : NULL, fdmp ? fdmp->nfds : 0);
+    err = errno;
+    lockSrv();
+
+    /* clinfo may have moved, and the client may have been shut down */
+    cp          = &clinfo[ci];
+    cp->nflight = 0;
+    cp->writing = 0;
+    if (cp->closing)
+    {
+        close(s);
+        delZL(zl);
+        cp->zl      = NULL;
+        cp->closing = 0;
+    }
+    else
+    {
+        errno = err;
+        sentClientMsg(cp, iov, niov, nw);
+    }
+
+    for (i = 0; i < niov; i++)
+        if (--held[i]->count == 0)
+            freeMsg(held[i]);
 }
 
-/* save str as content in Msg mp.
+/* make room for n fds in the poll set of w */
+static void growWorker(Worker *w, int n)
+{
+    if (n <= w->mpfds)
+        return;
+
+    w->pfds = (struct pollfd *)realloc(w->pfds, n * sizeof(struct pollfd));
+    w->idx  = (int *)realloc(w->idx, n * sizeof(int));
+    w->gen  = (unsigned int *)realloc(w->gen, n * sizeof(unsigned int));
+    if (!w->pfds || !w->idx || !w->gen)
+    {
+        fprintf(stderr, "no memory for poll set\n");
+        Bye();
+    }
+    w->mpfds = n;
+}
+
+/* wake w if it is waiting in poll(), so it looks again at what to wait for.
+ * N.B. call with srvlock held.
  */
-static void setMsgStr(Msg *mp, char *str)
+static void kickWorker(Worker *w)
 {
-    /* want cl to only count content, but need room for final \0 */
-    mp->cl = strlen(str);
-    if (mp->cl < sizeof(mp->buf))
-        mp->cp = mp->buf;
-    else
-        mp->cp = malloc(mp->cl + 1);
-    strcpy(mp->cp, str);
+    if (w->kicked)
+        return;
+    w->kicked = 1;
+    if (write(w->wake[1], "", 1) < 0 && errno != EAGAIN)
+        fprintf(stderr, "%s: wake pipe: %s\n", indi_tstamp(NULL), strerror(errno));
 }
 
-/* return pointer to one new nulled Msg
+/* take note w has been woken.
+ * N.B. call with srvlock held.
  */
-static Msg *newMsg(void)
+static void drainWorker(Worker *w)
 {
-    return ((Msg *)calloc(1, sizeof(Msg)));
+    char buf[64];
+
+    while (read(w->wake[0], buf, sizeof(buf)) > 0)
+        ;
+    w->kicked = 0;
 }
 
-/* free Msg mp and everything it contains */
-static void freeMsg(Msg *mp)
+/* tell the reader thread of dp, if any, that dp has started or stopped */
+static void wakeReader(DvrInfo *dp)
 {
-    if (mp->cp && mp->cp != mp->buf)
-        free(mp->cp);
-    free(mp);
+    if (readers)
+        kickWorker(&readers[(dp - dvrinfo) % nthreads]);
 }
 
-/* write the next chunk of the current message in the queue to the given
- * client. pop message from queue when complete and free the message if we are
- * the last one to use it. shut down this client if trouble.
- * N.B. we assume we will never be called with cp->msgq empty.
- * return 0 if ok else -1 if had to shut down.
+/* on: wait until no reader thread uses dvrinfo and keep it that way.
+ * off: let them go again.
+ * N.B. call with srvlock held, from any but a reader thread.
  */
-static int sendClientMsg(ClInfo *cp)
+static void holdReaders(int on)
 {
-    ssize_t nsend, nw;
-    Msg *mp;
-
-    /* get current message */
-    mp = (Msg *)peekFQ(cp->msgq);
-
-    /* send next chunk, never more than MAXWSIZ to reduce blocking */
-    nsend = mp->cl - cp->nsent;
-    if (nsend > MAXWSIZ)
-        nsend = MAXWSIZ;
-    nw = write(cp->s, &mp->cp[cp->nsent], nsend);
-
-    /* shut down if trouble */
-    if (nw <= 0)
-    {
-        if (nw == 0)
-            fprintf(stderr, "%s: Client %d: write returned 0\n", indi_tstamp(NULL), cp->s);
-        else
-            fprintf(stderr, "%s: Client %d: write: %s\n", indi_tstamp(NULL), cp->s, strerror(errno));
-        shutdownClient(cp);
-        return (-1);
-    }
-
-    /* trace */
-    if (verbose > 2)
-    {
-        fprintf(stderr, "%s: Client %d: sending msg copy %d nq %d:\n%.*s\n", indi_tstamp(NULL), cp->s, mp->count,
-                nFQ(cp->msgq), (int)nw, &mp->cp[cp->nsent]);
-    }
-    else if (verbose > 1)
-    {
-        fprintf(stderr, "%s: Client %d: sending %.50s\n", indi_tstamp(NULL), cp->s, &mp->cp[cp->nsent]);
-    }
-
-    /* update amount sent. when complete: free message if we are the last
-     * to use it and pop from our queue.
-     */
-    cp->nsent += nw;
-    if (cp->nsent == mp->cl)
+    if (!on)
     {
-        if (--mp->count == 0)
-            freeMsg(mp);
-        popFQ(cp->msgq);
-        cp->nsent = 0;
+        holdreaders--;
+        pthread_cond_broadcast(&srvcond);
+        return;
     }
 
-    return (0);
+    holdreaders++;
+    while (nreading > 0)
+        pthread_cond_wait(&srvcond, &srvlock);
 }
 
-/* write the next chunk of the current message in the queue to the given
- * driver. pop message from queue when complete and free the message if we are
- * the last one to use it. restart this driver if touble.
- * N.B. we assume we will never be called with dp->msgq empty.
- * return 0 if ok else -1 if had to shut down.
+/* return 0 if cp may be interested in dev/name else -1
  */
-static int sendDriverMsg(DvrInfo *dp)
+static int findClDevice(ClInfo *cp, const char *dev, const char *name)
 {
-    ssize_t nsend, nw;
-    Msg *mp;
+    Route *rp;
 
-    /* get current message */
-    mp = (Msg *)peekFQ(dp->msgq);
+    if (cp->allprops >= 1 || !dev[0])
+        return (0);
+    if ((rp = findRoute(routes, dev, "")) && findRouteSub(rp, RT_CLIENTS, cp - clinfo) >= 0)
+        return (0);
+    if (name[0] && (rp = findRoute(routes, dev, name)) && findRouteSub(rp, RT_CLIENTS, cp - clinfo) >= 0)
+        return (0);
+    return (-1);
+}
 
-    /* send next chunk, never more than MAXWSIZ to reduce blocking */
-    nsend = mp->cl - dp->nsent;
-    if (nsend > MAXWSIZ)
-        nsend = MAXWSIZ;
-    nw = write(dp->wfd, &mp->cp[dp->nsent], nsend);
+/* collect in rcands[] each client interested in dev/name once, with the index
+ * of its Property for exactly dev/name if any, else -1. return how many.
+ */
+static int routeClients(const char *dev, const char *name)
+{
+    Route *rps[3];
+    ClInfo *cp;
+    int i, j, n = 0;
 
-    /* restart if trouble */
-    if (nw <= 0)
+    if (mrcands < nclinfo)
     {
-        if (nw == 0)
-            fprintf(stderr, "%s: Driver %s: write returned 0\n", indi_tstamp(NULL), dp->name);
-        else
-            fprintf(stderr, "%s: Driver %s: write: %s\n", indi_tstamp(NULL), dp->name, strerror(errno));
-        shutdownDvr(dp, 1);
-        return (-1);
+        mrcands = nclinfo;
+        rcands  = (RouteSub *)realloc(rcands, mrcands * sizeof(RouteSub));
+        if (!rcands)
+        {
+            fprintf(stderr, "no memory for routing\n");
+            Bye();
+        }
     }
 
-    /* trace */
-    if (verbose > 2)
-    {
-        fprintf(stderr, "%s: Driver %s: sending msg copy %d nq %d:\n%.*s\n", indi_tstamp(NULL), dp->name, mp->count,
-                nFQ(dp->msgq), (int)nw, &mp->cp[dp->nsent]);
-    }
-    else if (verbose > 1)
+    /* no device: everybody */
+    if (!dev[0])
     {
-        fprintf(stderr, "%s: Driver %s: sending %.50s\n", indi_tstamp(NULL), dp->name, &mp->cp[dp->nsent]);
+        for (cp = clinfo; cp < &clinfo[nclinfo]; cp++)
+        {
+            if (!cp->active)
+                continue;
+            rcands[n].who  = cp - clinfo;
+            rcands[n].prop = -1;
+            n++;
+        }
+        return (n);
     }
 
-    /* update amount sent. when complete: free message if we are the last
-     * to use it and pop from our queue.
-     */
-    dp->nsent += nw;
-    if (dp->nsent == mp->cl)
+    /* new mark, starting over if it wrapped */
+    if (++routemark == 0)
     {
-        if (--mp->count == 0)
-            freeMsg(mp);
-        popFQ(dp->msgq);
-        dp->nsent = 0;
+        for (cp = clinfo; cp < &clinfo[nclinfo]; cp++)
+            cp->routed = 0;
+        routemark = 1;
     }
 
-    return (0);
-}
-
-/* return 0 if cp may be interested in dev/name else -1
- */
-static int findClDevice(ClInfo *cp, const char *dev, const char *name)
-{
-    int i;
+    /* exact match first, it has the BLOB policy */
+    rps[0] = findRoute(routes, dev, name);
+    rps[1] = name[0] ? findRoute(routes, dev, "") : NULL;
+    rps[2] = findRoute(routes, "", "");
 
-    if (cp->allprops >= 1 || !dev[0])
-        return (0);
-    for (i = 0; i < cp->nprops; i++)
+    for (j = 0; j < 3; j++)
     {
-        Property *pp = &cp->props[i];
-        if (!strcmp(pp->dev, dev) && (!pp->name[0] || !strcmp(pp->name, name)))
-            return (0);
+        RouteList *lp = rps[j] ? &rps[j]->lists[RT_CLIENTS] : NULL;
+        for (i = 0; lp && i < lp->nsubs; i++)
+        {
+            cp = &clinfo[lp->subs[i].who];
+            if (cp->routed == routemark)
+                continue;
+            cp->routed     = routemark;
+            rcands[n].who  = lp->subs[i].who;
+            rcands[n].prop = j == 0 ? lp->subs[i].prop : -1;
+            n++;
+        }
     }
-    return (-1);
+
+    return (n);
 }
 
 /* add the given device and property to the devs[] list of client if new.
@@ -2073,13 +4762,9 @@ static void addClDevice(ClInfo *cp, const char *dev, const char *name, int isblo
 {
     if (isblob)
     {
-        int i = 0;
-        for (i = 0; i < cp->nprops; i++)
-        {
-            Property *pp = &cp->props[i];
-            if (!strcmp(pp->dev, dev) && (name == NULL || !strcmp(pp->name, name)))
-                return;
-        }
+        Route *rp = findRoute(routes, dev, name);
+        if (rp && findRouteSub(rp, RT_CLIENTS, cp - clinfo) >= 0)
+            return;
     }
     /* no dups */
     else if (!findClDevice(cp, dev, name))
@@ -2097,23 +4782,27 @@ static void addClDevice(ClInfo *cp, const char *dev, const char *name, int isblo
     strncpy (ip, name, MAXINDINAME-1);
         ip[MAXINDINAME-1] = '\0';*/
 
-    strncpy(pp->dev, dev, MAXINDIDEVICE);
-    strncpy(pp->name, name, MAXINDINAME);
+    strncpy(pp->dev, dev, MAXINDIDEVICE - 1);
+    pp->dev[MAXINDIDEVICE - 1] = '\0';
+    strncpy(pp->name, name, MAXINDINAME - 1);
+    pp->name[MAXINDINAME - 1] = '\0';
     pp->blob = B_NEVER;
+
+    addRouteSub(routes, pp->dev, pp->name, RT_CLIENTS, cp - clinfo, cp->nprops - 1);
 }
 
-/* block to accept a new client arriving on lsocket.
+/* block to accept a new client arriving on listen socket lfd.
  * return private nonblocking socket or exit.
  */
-static int newClSocket()
+static int newClSocket(int lfd)
 {
-    struct sockaddr_in cli_socket;
+    struct sockaddr_storage cli_socket;
     socklen_t cli_len;
     int cli_fd;
 
     /* get a private connection to new client */
     cli_len = sizeof(cli_socket);
-    cli_fd  = accept(lsocket, (struct sockaddr *)&cli_socket, &cli_len);
+    cli_fd  = accept(lfd, (struct sockaddr *)&cli_socket, &cli_len);
     if (cli_fd < 0)
     {
         fprintf(stderr, "accept: %s\n", strerror(errno));
@@ -2142,26 +4831,24 @@ static void crackBLOBHandling(const char *dev, const char *name, const char *ena
 {
     int i = 0;
 
-    /* If we have EnableBLOB with property name, we add it to Client device list */
+    /* If we have EnableBLOB with property name, we add it to Client device list
+       and apply the policy to it */
     if (name[0])
+    {
+        Route *rp;
+
         addClDevice(cp, dev, name, 1);
-    else
-        /* Otherwise, we set the whole client blob handling to what's passed (enableBLOB) */
-        crackBLOB(enableBLOB, &cp->blob);
+        rp = findRoute(routes, dev, name);
+        if (rp && (i = findRouteSub(rp, RT_CLIENTS, cp - clinfo)) >= 0)
+            crackBLOB(enableBLOB, &cp->props[rp->lists[RT_CLIENTS].subs[i].prop].blob);
+        return;
+    }
 
-    /* If whole client blob handling policy was updated, we need to pass that also to all children
-       and if the request was for a specific property, then we apply the policy to it */
+    /* Otherwise, we set the whole client blob handling to what's passed (enableBLOB)
+       and pass that also to all children */
+    crackBLOB(enableBLOB, &cp->blob);
     for (i = 0; i < cp->nprops; i++)
-    {
-        Property *pp = &cp->props[i];
-        if (!name[0])
-            crackBLOB(enableBLOB, &pp->blob);
-        else if (!strcmp(pp->dev, dev) && (!strcmp(pp->name, name)))
-        {
-            crackBLOB(enableBLOB, &pp->blob);
-            return;
-        }
-    }
+        crackBLOB(enableBLOB, &cp->props[i].blob);
 }
 
 /* print key attributes and values of the given xml to stderr.
@@ -2248,6 +4935,206 @@ static void logDMsg(XMLEle *root, const char *dev)
     fclose(fp);
 }
 
+/* open cpath for captureIO(), exit if trouble */
+static void startCapture(void)
+{
+    static const char head[] = "# indiserver capture 1\n";
+
+    capfd = open(cpath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (capfd < 0 || write(capfd, head, sizeof(head) - 1) < 0)
+    {
+        fprintf(stderr, "%s: capture %s: %s\n", indi_tstamp(NULL), cpath, strerror(errno));
+        Bye();
+    }
+}
+
+/* add a record of what was read from a driver or client to the -L capture.
+ * each record is a line "us kind id n" followed by n bytes and a newline, us
+ * since we started, id the index of the driver or client and kind one of
+ *   D  driver id started, the bytes are its name
+ *   d  the bytes were read from driver id, n is 0 when it closed
+ *   C  client id connected, the bytes are "tcp" or "unix"
+ *   c  the bytes were read from client id, n is 0 when it closed
+ * bytes read are after inflating a compressed link, shm BLOB segments are not
+ * kept. see test/benchmarks/indiserver_replay.c to play one back.
+ * N.B. also called by reader threads: one write per record keeps each whole.
+ */
+static void captureIO(int kind, int id, const char *buf, size_t n)
+{
+    struct iovec iov[3];
+    char head[64];
+
+    if (capfd < 0)
+        return;
+
+    iov[0].iov_base = head;
+    iov[0].iov_len  = snprintf(head, sizeof(head), "%llu %c %d %lu\n", monoUs() - tstart, kind, id, (unsigned long)n);
+    iov[1].iov_base = (char *)buf;
+    iov[1].iov_len  = n;
+    iov[2].iov_base = "\n";
+    iov[2].iov_len  = 1;
+    if (writev(capfd, iov, 3) < 0 && verbose > 0)
+        fprintf(stderr, "%s: capture %s: %s\n", indi_tstamp(NULL), cpath, strerror(errno));
+}
+
+/* log how much of the memory for messages had to come from the heap */
+static void logPool()
+{
+    PoolStats ps;
+
+    poolStats(&ps);
+    fprintf(stderr, "%s: pool: %lu allocs, %lu from heap, %lu back to heap, %lu KB in use, %lu KB idle\n",
+            indi_tstamp(NULL), ps.allocs, ps.heap, ps.frees, (unsigned long)(ps.inuse / 1024),
+            (unsigned long)(ps.idle / 1024));
+}
+
+/* log what went through compressed link zp, who says whose it is */
+static void logZL(ZL *zp, const char *who)
+{
+    ZLStats zs;
+
+    statsZL(zp, &zs);
+    fprintf(stderr, "%s: %s: compressed link: sent %llu bytes as %llu, read %llu bytes as %llu\n",
+            indi_tstamp(NULL), who, zs.sent, zs.written, zs.got, zs.read);
+}
+
+/* return microseconds on a clock that only goes forward */
+static unsigned long long monoUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/* count one Msg that took us microseconds from driver to client in mp.
+ * bin 0 is for under 1 us, bin k for 2^(k-1) up to 2^k us, the last one
+ * also for all slower.
+ */
+static void addLatency(Metrics *mp, unsigned long long us)
+{
+    int k = 0;
+
+    while (us > 0 && k < NLATBINS - 1)
+    {
+        us >>= 1;
+        k++;
+    }
+    mp->lat[k]++;
+}
+
+/* write the counters of each active driver and client to path, or to stderr
+ * if path is empty, for the fifo command "metrics [path]". the file is
+ * written as path.tmp then renamed, so a reader never sees part of one.
+ * one line each of name=value: how many messages and bytes went in and out,
+ * what is queued now and the most ever queued, the BLOBs dropped and updates
+ * conflated for slow clients, the time spent parsing what was read and how
+ * long Msgs from drivers took until written to a client, see prMetrics().
+ */
+static void writeMetrics(const char *path)
+{
+    char tmp[MAXSBUF + 8];
+    FILE *fp = stderr;
+    ZLStats zs;
+    int i, j;
+
+    if (path[0])
+    {
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+        fp = fopen(tmp, "w");
+        if (!fp)
+        {
+            fprintf(stderr, "%s: metrics: %s: %s\n", indi_tstamp(NULL), tmp, strerror(errno));
+            return;
+        }
+    }
+
+    fprintf(fp, "# indiserver metrics at %s, up %.3f s\n", indi_tstamp(NULL), (monoUs() - tstart) / 1e6);
+
+    for (i = 0; i < ndvrinfo; i++)
+    {
+        DvrInfo *dp = &dvrinfo[i];
+        long qbytes = 0;
+
+        if (!dp->active)
+            continue;
+        for (j = 0; j < nFQ(dp->msgq); j++)
+            qbytes += msgSize((Msg *)peekiFQ(dp->msgq, j));
+        fprintf(fp, "driver name=%s pid=%d restarts=%d qmsgs=%d qbytes=%ld", dp->name, dp->pid, dp->restarts,
+                nFQ(dp->msgq), qbytes);
+
+        /* its reader updates the input side of zl as it reads */
+        if (dp->zl && !dp->reading)
+        {
+            statsZL(dp->zl, &zs);
+            fprintf(fp, " zwritten=%llu zread=%llu", zs.written, zs.read);
+        }
+        prMetrics(fp, &dp->m);
+    }
+
+    for (i = 0; i < nclinfo; i++)
+    {
+        ClInfo *cp = &clinfo[i];
+
+        if (!cp->active)
+            continue;
+        fprintf(fp, "client fd=%d via=%s qmsgs=%d qbytes=%ld dropped=%lu conflated=%lu maxqbytes=%ld", cp->s,
+                cp->unixsock ? "unix" : "tcp", nFQ(cp->msgq), clientQSize(cp), cp->m.dropped, cp->m.conflated,
+                cp->m.maxqbytes);
+
+        /* its writer updates the output side of zl as it writes */
+        if (cp->zl && !cp->writing)
+        {
+            statsZL(cp->zl, &zs);
+            fprintf(fp, " zwritten=%llu zread=%llu", zs.written, zs.read);
+        }
+        prMetrics(fp, &cp->m);
+    }
+
+    if (fp == stderr)
+        return;
+    if (fclose(fp) != 0 || rename(tmp, path) < 0)
+        fprintf(stderr, "%s: metrics: %s: %s\n", indi_tstamp(NULL), path, strerror(errno));
+}
+
+/* finish a line of writeMetrics() with the counters in mp common to drivers
+ * and clients. the fan-out latency, in us, is given as the upper bounds of
+ * the bins holding the median and the 99th percentile, and as bound:count
+ * of each bin in use.
+ */
+static void prMetrics(FILE *fp, const Metrics *mp)
+{
+    unsigned long n = 0, k = 0;
+    int i, p50 = -1, p99 = -1;
+    char sep = '=';
+
+    for (i = 0; i < NLATBINS; i++)
+        n += mp->lat[i];
+    for (i = 0; i < NLATBINS && p99 < 0; i++)
+    {
+        k += mp->lat[i];
+        if (p50 < 0 && 2 * k >= n)
+            p50 = i;
+        if (100 * k >= 99 * n)
+            p99 = i;
+    }
+
+    fprintf(fp, " inmsgs=%lu inbytes=%llu outmsgs=%lu outbytes=%llu maxqmsgs=%d parseus=%llu latn=%lu", mp->inmsgs,
+            mp->inbytes, mp->outmsgs, mp->outbytes, mp->maxqmsgs, mp->parseus, n);
+    if (n > 0)
+    {
+        fprintf(fp, " latp50=%lu latp99=%lu lat", 1UL << p50, 1UL << p99);
+        for (i = 0; i < NLATBINS; i++)
+        {
+            if (!mp->lat[i])
+                continue;
+            fprintf(fp, "%c%lu:%lu", sep, 1UL << i, mp->lat[i]);
+            sep = ',';
+        }
+    }
+    fprintf(fp, "\n");
+}
+
 /* log when then exit */
 static void Bye()
 {
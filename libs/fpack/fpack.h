@@ -163,6 +163,8 @@ int fp_loop (int argc, char *argv[], int unpack, char *output_filename, fpstate
 int fp_pack (char *infits, char *outfits, fpstate fpvar, int *islossless);
 int fp_unpack (char *infits, char *outfits, fpstate fpvar);
 int fp_test (char *infits, char *outfits, char *outfits2, fpstate fpvar);
+int fp_pack_mem (const void *inbuf, size_t inlen, void **outbuf, size_t *outlen,
+    int nthreads, int *status);
 int fp_pack_hdu (fitsfile *infptr, fitsfile *outfptr, fpstate fpvar, 
     int *islossless, int *status);
 int fp_unpack_hdu (fitsfile *infptr, fitsfile *outfptr, fpstate fpvar, int *status);
@@ -0,0 +1,260 @@
+/* FPACK in memory
+ *
+ * Tile compress the primary image of a FITS file held in memory into a new
+ * FITS file in memory, laid out as fpack writes it: a null primary array
+ * followed by a RICE_1 compressed image extension with one tile per row.
+ *
+ * The tiles are independent so integer images are compressed by a pool of
+ * threads, each working on its own band of rows with fits_rcomp*(). Only the
+ * cheap part, appending the compressed tiles to the output table, runs in the
+ * calling thread through CFITSIO. Other images, i.e. floating point ones which
+ * need quantizing, go through fits_img_compress() on the same memfiles.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <fitsio.h>
+#include <fitsio2.h>
+#include "fpack.h"
+
+#define	FPM_BLOCKSIZE	32	/* CFITSIO's default Rice block size */
+#define	FPM_MINROWS	64	/* fewer rows than this per thread is not worth one */
+
+/* one band of rows compressed by one thread */
+typedef struct
+{
+    const unsigned char *pix;	/* first big-endian pixel of the band */
+    long	ntiles;			/* rows in this band */
+    long	nx;			/* pixels per row */
+    int	bytepix;		/* 1, 2 or 4 */
+    unsigned char *out;		/* compressed tiles, back to back */
+    size_t	outlen;			/* bytes used in out */
+    size_t	outsize;		/* bytes malloced for out */
+    size_t	*tilelen;		/* compressed length of each tile */
+    int	threaded;		/* whether run by its own thread */
+    int	status;			/* 0 or a CFITSIO status */
+} fpm_band;
+
+static void *fpm_compress_band (void *arg)
+{
+    fpm_band *bp = (fpm_band *) arg;
+    size_t	rowbytes = (size_t) bp->nx * bp->bytepix;
+    size_t	bound    = rowbytes + rowbytes / 8 + 64;	/* worst case Rice output */
+    void	*row     = NULL;
+    long	t, i;
+
+    bp->tilelen = (size_t *) malloc (bp->ntiles * sizeof(size_t));
+    if (bp->bytepix > 1)
+        row = malloc (rowbytes);
+    bp->outsize = bound * (bp->ntiles < 16 ? bp->ntiles : 16);
+    bp->out = (unsigned char *) malloc (bp->outsize);
+    if (!bp->tilelen || (bp->bytepix > 1 && !row) || !bp->out) {
+        bp->status = MEMORY_ALLOCATION;
+        free (row);
+        return (NULL);
+    }
+
+    for (t = 0; t < bp->ntiles; t++) {
+        const unsigned char *p = bp->pix + t * rowbytes;
+        int	clen;
+
+        if (bp->outlen + bound > bp->outsize) {
+            size_t	n = 2 * bp->outsize + bound;
+            unsigned char *newout = (unsigned char *) realloc (bp->out, n);
+            if (!newout) {
+                bp->status = MEMORY_ALLOCATION;
+                break;
+            }
+            bp->out = newout;
+            bp->outsize = n;
+        }
+
+        /* FITS pixels are big-endian, Rice wants native integers */
+        switch (bp->bytepix) {
+        case 1:
+            clen = fits_rcomp_byte ((signed char *) p, bp->nx,
+                bp->out + bp->outlen, bound, FPM_BLOCKSIZE);
+            break;
+        case 2:
+            for (i = 0; i < bp->nx; i++, p += 2)
+                ((short *) row)[i] = (short) ((p[0] << 8) | p[1]);
+            clen = fits_rcomp_short ((short *) row, bp->nx,
+                bp->out + bp->outlen, bound, FPM_BLOCKSIZE);
+            break;
+        default:
+            for (i = 0; i < bp->nx; i++, p += 4)
+                ((int *) row)[i] = (int) (((unsigned) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+            clen = fits_rcomp ((int *) row, bp->nx,
+                bp->out + bp->outlen, bound, FPM_BLOCKSIZE);
+            break;
+        }
+
+        if (clen < 0) {
+            bp->status = DATA_COMPRESSION_ERR;
+            break;
+        }
+        bp->tilelen[t] = clen;
+        bp->outlen += clen;
+    }
+
+    free (row);
+    return (NULL);
+}
+
+/* copy the user keywords of the current HDU of infptr to outfptr, leaving out
+ * the ones that describe the uncompressed layout or would be wrong after it.
+ */
+static int fpm_copy_keys (fitsfile *infptr, fitsfile *outfptr, int *status)
+{
+    char	card[FLEN_CARD];
+    int	nkeys, ii;
+
+    fits_get_hdrspace (infptr, &nkeys, NULL, status);
+    for (ii = 1; ii <= nkeys && *status <= 0; ii++) {
+        fits_read_record (infptr, ii, card, status);
+        switch (fits_get_keyclass (card)) {
+        case TYP_STRUC_KEY:
+        case TYP_CMPRS_KEY:
+        case TYP_CKSUM_KEY:
+            break;
+        default:
+            fits_write_record (outfptr, card, status);
+            break;
+        }
+    }
+    return (*status);
+}
+
+/* compress the integer image of infptr, whose nrows rows of nx pixels start
+ * at pix, into a new RICE_1 extension of outfptr using up to nthreads threads.
+ */
+static int fpm_pack_rice (fitsfile *infptr, fitsfile *outfptr, const unsigned char *pix,
+    int bitpix, int naxis, long *naxes, int nthreads, int *status)
+{
+    fpm_band	*bands;
+    pthread_t	*tids;
+    long	nx = naxes[0], nrows = 1, tiledim[3] = {1, 1, 1};
+    long	row, per;
+    int	bytepix = abs (bitpix) / 8, colnum, nbands, ii;
+
+    for (ii = 1; ii < naxis; ii++)
+        nrows *= naxes[ii];
+    tiledim[0] = nx;
+
+    if (nthreads > nrows / FPM_MINROWS)
+        nthreads = nrows / FPM_MINROWS;
+    if (nthreads < 1)
+        nthreads = 1;
+
+    bands = (fpm_band *) calloc (nthreads, sizeof(fpm_band));
+    tids = (pthread_t *) calloc (nthreads, sizeof(pthread_t));
+    if (!bands || !tids) {
+        free (bands);
+        free (tids);
+        return (*status = MEMORY_ALLOCATION);
+    }
+
+    /* compress the bands while CFITSIO builds the table header */
+    per = (nrows + nthreads - 1) / nthreads;
+    for (nbands = 0, row = 0; row < nrows; nbands++, row += per) {
+        fpm_band *bp = &bands[nbands];
+
+        bp->pix = pix + (size_t) row * nx * bytepix;
+        bp->ntiles = (nrows - row < per) ? nrows - row : per;
+        bp->nx = nx;
+        bp->bytepix = bytepix;
+        if (nbands > 0)
+            bp->threaded = !pthread_create (&tids[nbands], NULL, fpm_compress_band, bp);
+    }
+
+    fits_set_compression_type (outfptr, RICE_1, status);
+    fits_set_tile_dim (outfptr, naxis, tiledim, status);
+    fits_create_img (outfptr, bitpix, naxis, naxes, status);
+    fpm_copy_keys (infptr, outfptr, status);
+    fits_get_colnum (outfptr, CASEINSEN, "COMPRESSED_DATA", &colnum, status);
+
+    /* band 0, and any band no thread could be had for, run in this thread */
+    for (ii = 0; ii < nbands; ii++) {
+        if (bands[ii].threaded)
+            pthread_join (tids[ii], NULL);
+        else
+            fpm_compress_band (&bands[ii]);
+    }
+
+    /* append the tiles in order */
+    for (ii = 0, row = 1; ii < nbands; ii++) {
+        fpm_band *bp = &bands[ii];
+        size_t	off = 0;
+        long	t;
+
+        if (*status <= 0 && bp->status > 0)
+            *status = bp->status;
+        for (t = 0; t < bp->ntiles && *status <= 0; t++, row++) {
+            fits_write_col (outfptr, TBYTE, colnum, row, 1, bp->tilelen[t],
+                bp->out + off, status);
+            off += bp->tilelen[t];
+        }
+        free (bp->out);
+        free (bp->tilelen);
+    }
+
+    free (bands);
+    free (tids);
+    return (*status);
+}
+
+int fp_pack_mem (const void *inbuf, size_t inlen, void **outbuf, size_t *outlen,
+    int nthreads, int *status)
+{
+    fitsfile	*infptr = NULL, *outfptr = NULL;
+    void	*inptr = (void *) inbuf;
+    size_t	insize = inlen;
+    LONGLONG	headstart, datastart, dataend;
+    long	naxes[9] = {1, 1, 1, 1, 1, 1, 1, 1, 1};
+    int	bitpix = 0, naxis = 0, stat = 0, ii;
+    double	npix = 1;
+
+    if (*status > 0)
+        return (*status);
+
+    *outlen = 2880;
+    *outbuf = malloc (*outlen);
+    if (!*outbuf)
+        return (*status = MEMORY_ALLOCATION);
+
+    if (nthreads <= 0)
+        nthreads = sysconf (_SC_NPROCESSORS_ONLN);
+
+    fits_open_memfile (&infptr, "", READONLY, &inptr, &insize, 0, NULL, status);
+    fits_create_memfile (&outfptr, outbuf, outlen, 2880, realloc, status);
+    fits_get_img_param (infptr, 9, &bitpix, &naxis, naxes, status);
+    fits_get_hduaddrll (infptr, &headstart, &datastart, &dataend, status);
+    for (ii = 0; ii < naxis; ii++)
+        npix *= naxes[ii];
+
+    /* null primary array, as fpack writes it */
+    fits_create_img (outfptr, BYTE_IMG, 0, naxes, status);
+
+    if (*status > 0) {
+        ;
+    } else if (bitpix > 0 && naxis >= 1 && naxis <= 3 &&
+               datastart + npix * (bitpix / 8) <= (double) inlen) {
+        fpm_pack_rice (infptr, outfptr, (const unsigned char *) inbuf + datastart,
+            bitpix, naxis, naxes, nthreads, status);
+    } else {
+        fits_set_compression_type (outfptr, RICE_1, status);
+        fits_img_compress (infptr, outfptr, status);
+    }
+
+    if (infptr)
+        fits_close_file (infptr, &stat);
+    if (outfptr)
+        fits_close_file (outfptr, status);
+
+    if (*status > 0) {
+        free (*outbuf);
+        *outbuf = NULL;
+        *outlen = 0;
+    }
+    return (*status);
+}
@@ -24,6 +24,7 @@
 #include "locale_compat.h"
 
 #include <cerrno>
+#include <cstddef>
 #include <fcntl.h>
 #include <cstdlib>
 #include <stdarg.h>
@@ -44,7 +45,10 @@
 #include <netdb.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #define net_read read
 #define net_write write
@@ -56,6 +60,7 @@
 #endif
 
 #define MAXINDIBUF 49152
+#define MAXSHMFDS  16 /* most shm segments indiserver sends with one message */
 #define DISCONNECTION_DELAY_US 500000
 
 INDI::BaseClient::BaseClient() : cServer("localhost"), cPort(7624)
@@ -136,22 +141,56 @@ bool INDI::BaseClient::connectServer()
     ts.tv_usec = timeout_us;
 
     struct sockaddr_in serv_addr;
+    struct sockaddr *addr = (struct sockaddr *)&serv_addr;
+    socklen_t addrlen     = sizeof(serv_addr);
     struct hostent *hp;
     int ret = 0;
 
-    /* lookup host address */
-    hp = gethostbyname(cServer.c_str());
-    if (!hp)
+#ifndef _WINDOWS
+    /* a path is the unix domain socket of a local indiserver (-u), on linux
+     * @name is one in the abstract namespace. port does not matter then.
+     */
+    struct sockaddr_un unix_addr;
+    bool local = cServer[0] == '/';
+#ifdef __linux__
+    local = local || cServer[0] == '@';
+#endif
+    if (local)
     {
-        perror("gethostbyname");
-        return false;
+        if (cServer.size() >= sizeof(unix_addr.sun_path))
+        {
+            IDLog("unix socket path too long: %s\n", cServer.c_str());
+            return false;
+        }
+        (void)memset((char *)&unix_addr, 0, sizeof(unix_addr));
+        unix_addr.sun_family = AF_UNIX;
+        strncpy(unix_addr.sun_path, cServer.c_str(), sizeof(unix_addr.sun_path) - 1);
+        addr    = (struct sockaddr *)&unix_addr;
+        addrlen = sizeof(unix_addr);
+        if (cServer[0] == '@')
+        {
+            unix_addr.sun_path[0] = '\0';
+            addrlen               = offsetof(struct sockaddr_un, sun_path) + cServer.size();
+        }
+    }
+    else
+#endif
+    {
+        /* lookup host address */
+        hp = gethostbyname(cServer.c_str());
+        if (!hp)
+        {
+            perror("gethostbyname");
+            return false;
+        }
+
+        (void)memset((char *)&serv_addr, 0, sizeof(serv_addr));
+        serv_addr.sin_family      = AF_INET;
+        serv_addr.sin_addr.s_addr = ((struct in_addr *)(hp->h_addr_list[0]))->s_addr;
+        serv_addr.sin_port        = htons(cPort);
     }
 
     /* create a socket to the INDI server */
-    (void)memset((char *)&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family      = AF_INET;
-    serv_addr.sin_addr.s_addr = ((struct in_addr *)(hp->h_addr_list[0]))->s_addr;
-    serv_addr.sin_port        = htons(cPort);
 #ifdef _WINDOWS
     if ((sockfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == INVALID_SOCKET)
     {
@@ -160,7 +199,7 @@ bool INDI::BaseClient::connectServer()
         return false;
     }
 #else
-    if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    if ((sockfd = socket(addr->sa_family, SOCK_STREAM, 0)) < 0)
     {
         perror("socket");
         return false;
@@ -194,7 +233,7 @@ bool INDI::BaseClient::connectServer()
     wset = rset; //structure assignment okok
 
     /* connect */
-    if ((ret = ::connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr))) < 0)
+    if ((ret = ::connect(sockfd, addr, addrlen)) < 0)
     {
         if (errno != EINPROGRESS)
         {
@@ -409,10 +448,14 @@ void INDI::BaseClient::listenINDI()
 
     AutoCNumeric locale;
 
+    // shm BLOBs only come over the unix domain socket of a local server
+    bool local           = cServer[0] == '/' || cServer[0] == '@';
+    const char *blobAtts = shmBLOB && local ? "binaryBLOB='1' shmBLOB='1'" : "binaryBLOB='1'";
+
     if (cDeviceNames.empty())
     {
         char cmd[MAXRBUF] = {0};
-        snprintf(cmd, MAXRBUF, "<getProperties version='%g'/>\n", INDIV);
+        snprintf(cmd, MAXRBUF, "<getProperties version='%g' %s/>\n", INDIV, blobAtts);
         sendString(cmd);
         if (verbose)
             IDLog("%s\n", cmd);
@@ -425,7 +468,8 @@ void INDI::BaseClient::listenINDI()
             if (cWatchProperties.find(oneDevice) == cWatchProperties.end())
             {
                 char cmd[MAXRBUF] = {0};
-                snprintf(cmd, MAXRBUF, "<getProperties version='%g' device='%s'/>\n", INDIV, oneDevice.c_str());
+                snprintf(cmd, MAXRBUF, "<getProperties version='%g' device='%s' %s/>\n", INDIV,
+                         oneDevice.c_str(), blobAtts);
                 sendString(cmd);
                 if (verbose)
                     IDLog("%s\n", cmd);
@@ -435,8 +479,8 @@ void INDI::BaseClient::listenINDI()
                 for (auto oneProperty : cWatchProperties[oneDevice])
                 {
                     char cmd[MAXRBUF] = {0};
-                    snprintf(cmd, MAXRBUF, "<getProperties version='%g' device='%s' name='%s'/>\n",
-                             INDIV, oneDevice.c_str(), oneProperty.c_str());
+                    snprintf(cmd, MAXRBUF, "<getProperties version='%g' device='%s' name='%s' %s/>\n",
+                             INDIV, oneDevice.c_str(), oneProperty.c_str(), blobAtts);
                     sendString(cmd);
                     if (verbose)
                         IDLog("%s\n", cmd);
@@ -461,6 +505,7 @@ void INDI::BaseClient::listenINDI()
 
     clear();
     lillp = newLilXML();
+    setXMLRawTag(lillp, "oneBLOB");
 
     /* read from server, exit if find all requested properties */
     while (sConnected)
@@ -488,7 +533,7 @@ void INDI::BaseClient::listenINDI()
 #ifdef _WINDOWS
             n = recv(sockfd, buffer, MAXINDIBUF, 0);
 #else
-            n = recv(sockfd, buffer, MAXINDIBUF, MSG_DONTWAIT);
+            n = recvINDI(buffer, MAXINDIBUF);
 #endif
             if (n <= 0)
             {
@@ -498,6 +543,13 @@ void INDI::BaseClient::listenINDI()
                     net_close(sockfd);
                     break;
                 }
+#ifndef _WINDOWS
+                else if (errno == EPROTO)
+                {
+                    net_close(sockfd);
+                    break;
+                }
+#endif
                 else
                     continue;
             }
@@ -516,6 +568,11 @@ void INDI::BaseClient::listenINDI()
             root = nodes[inode];
             while (root)
             {
+#ifndef _WINDOWS
+                if (shmBLOB && !strcmp(tagXMLEle(root), "setBLOBVector"))
+                    inlineSHMBLOBs(root);
+#endif
+
                 if (verbose)
                     prXMLEle(stderr, root, 0);
 
@@ -540,6 +597,12 @@ void INDI::BaseClient::listenINDI()
 
     delLilXML(lillp);
 
+#ifndef _WINDOWS
+    for (int fd : shmFds)
+        close(fd);
+    shmFds.clear();
+#endif
+
     serverDisconnected((sConnected == false) ? 0 : -1);
     sConnected = false;
 
@@ -547,6 +610,106 @@ void INDI::BaseClient::listenINDI()
     //pthread_exit(0);
 }
 
+#ifndef _WINDOWS
+/* read up to len bytes from the server into buf like recv(2). shm segments
+ * that come along are queued in shmFds for the oneBLOBs that refer to them,
+ * indiserver sends them with the first byte of their setBLOBVector. losing
+ * any is an EPROTO error, the caller disconnects.
+ */
+int INDI::BaseClient::recvINDI(char *buf, int len)
+{
+    union
+    {
+        struct cmsghdr h;
+        char b[CMSG_SPACE(MAXSHMFDS * sizeof(int))];
+    } cbuf;
+    struct msghdr msg;
+    struct iovec iov;
+    int n;
+
+    if (!shmBLOB)
+        return recv(sockfd, buf, len, MSG_DONTWAIT);
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base       = buf;
+    iov.iov_len        = len;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = cbuf.b;
+    msg.msg_controllen = sizeof(cbuf.b);
+
+    n = recvmsg(sockfd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (n < 0)
+        return n;
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+    {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+            continue;
+        int nfds = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (int i = 0; i < nfds; i++)
+        {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+            shmFds.push_back(fd);
+        }
+    }
+    if (msg.msg_flags & MSG_CTRUNC)
+    {
+        // every later shm oneBLOB would get the wrong segment
+        IDLog("Too many shm segments at once from %s, some lost\n", cServer.c_str());
+        errno = EPROTO;
+        return -1;
+    }
+
+    return n;
+}
+
+/* make each shm oneBLOB of root a binary one: its segment, the next one
+ * queued, becomes its content and shmlen becomes rawlen. the segment is
+ * closed once copied.
+ */
+void INDI::BaseClient::inlineSHMBLOBs(XMLEle *root)
+{
+    for (XMLEle *ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
+    {
+        XMLAtt *ap = findXMLAtt(ep, "shmlen");
+        if (strcmp(tagXMLEle(ep), "oneBLOB") || !ap)
+            continue;
+
+        long shmlen = atol(valuXMLAtt(ap));
+        if (shmlen <= 0)
+            continue;
+        if (shmFds.empty())
+        {
+            IDLog("shm BLOB %s.%s without segment\n", findXMLAttValu(root, "name"), findXMLAttValu(ep, "name"));
+            continue;
+        }
+
+        int fd = shmFds.front();
+        shmFds.pop_front();
+
+        struct stat st;
+        void *map = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size >= shmlen)
+            map = mmap(nullptr, shmlen, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+            IDLog("Bad shm BLOB segment for %s.%s\n", findXMLAttValu(root, "name"), findXMLAttValu(ep, "name"));
+            continue;
+        }
+
+        editXMLEleRaw(ep, static_cast<const char *>(map), shmlen);
+        munmap(map, shmlen);
+
+        std::string len = valuXMLAtt(ap);
+        rmXMLAtt(ep, "shmlen");
+        addXMLAtt(ep, "rawlen", len.c_str());
+    }
+}
+#endif
+
 int INDI::BaseClient::dispatchCommand(XMLEle *root, char *errmsg)
 {
     const char *tag = tagXMLEle(root);
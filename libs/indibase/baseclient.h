@@ -21,6 +21,7 @@
 #include "indiapi.h"
 #include "indibase.h"
 
+#include <deque>
 #include <string>
 #include <vector>
 #include <map>
@@ -64,8 +65,10 @@ class INDI::BaseClient : public INDI::BaseMediator
         virtual ~BaseClient();
 
         /** \brief Set the server host name and port
-            \param hostname INDI server host name or IP address.
-            \param port INDI server port.
+            \param hostname INDI server host name or IP address. A path instead is the unix domain socket
+            of an INDI server on the same host (indiserver -u), which saves the TCP loopback overhead on
+            large BLOBs. On Linux \@name is a socket in the abstract namespace.
+            \param port INDI server port, not used for unix domain sockets.
         */
         void setServer(const char *hostname, unsigned int port);
 
@@ -223,6 +226,18 @@ class INDI::BaseClient : public INDI::BaseMediator
             return verbose;
         }
 
+        /**
+         * @brief setSHMBLOB Ask for BLOBs in shared memory. Only a local indiserver does this, when connected to
+         * its unix domain socket (-u) with setServer() given the socket path, or @name on linux. Each BLOB a local driver sends that
+         * way then arrives as a sealed shm segment passed along with the markup instead of over the socket.
+         * Received BLOBs are the same to the client either way. Must be set before connectServer().
+         * @param enable If true, ask for BLOBs in shared memory.
+         */
+        void setSHMBLOB(bool enable)
+        {
+            shmBLOB = enable;
+        }
+
         /**
          * @brief setConnectionTimeout Set connection timeout. By default it is 3 seconds.
          * @param seconds seconds
@@ -296,6 +311,14 @@ class INDI::BaseClient : public INDI::BaseMediator
         // Listen to INDI server and process incoming messages
         void listenINDI();
 
+#ifndef _WINDOWS
+        // Read from the server, queue any shm segments passed along in shmFds
+        int recvINDI(char *buf, int len);
+
+        // Give each shm oneBLOB of root its segment as content
+        void inlineSHMBLOBs(XMLEle *root);
+#endif
+
         void sendString(const char *fmt, ...);
 
         std::vector<INDI::BaseDevice *> cDevices;
@@ -307,6 +330,10 @@ class INDI::BaseClient : public INDI::BaseMediator
         uint32_t cPort;
         bool sConnected;
         bool verbose;
+        bool shmBLOB {false};
+
+        // shm segments received, not yet claimed by their oneBLOB
+        std::deque<int> shmFds;
 
         // Parse & FILE buffers for IO
 
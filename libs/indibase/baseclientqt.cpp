@@ -111,6 +111,7 @@ bool INDI::BaseClientQt::connectServer()
     clear();
 
     lillp = newLilXML();
+    setXMLRawTag(lillp, "oneBLOB");
 
     sConnected = true;
 
@@ -121,7 +122,7 @@ bool INDI::BaseClientQt::connectServer()
     QString getProp;
     if (cDeviceNames.empty())
     {
-        getProp = QString("<getProperties version='%1'/>\n").arg(QString::number(INDIV));
+        getProp = QString("<getProperties version='%1' binaryBLOB='1'/>\n").arg(QString::number(INDIV));
 
         client_socket.write(getProp.toLatin1());
 
@@ -132,8 +133,9 @@ bool INDI::BaseClientQt::connectServer()
     {
         for (auto &str : cDeviceNames)
         {
-            getProp =
-                QString("<getProperties version='%1' device='%2'/>\n").arg(QString::number(INDIV)).arg(str.c_str());
+            getProp = QString("<getProperties version='%1' device='%2' binaryBLOB='1'/>\n")
+                          .arg(QString::number(INDIV))
+                          .arg(str.c_str());
 
             client_socket.write(getProp.toLatin1());
             if (verbose)
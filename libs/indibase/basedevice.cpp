@@ -23,6 +23,7 @@
 #include "config.h"
 #include "indicom.h"
 #include "indistandardproperty.h"
+#include "indigzip.h"
 #include "locale_compat.h"
 
 #include <cerrno>
@@ -747,14 +748,47 @@ int BaseDevice::setBLOB(IBLOBVectorProperty *bvp, XMLEle *root, char *errmsg)
 
                 blobEL->size    = blobSize;
                 int bloblen     = pcdatalenXMLEle(ep);
-                int blobBufferSize = 3 * bloblen / 4;
-                if (blobBufferSize != blobEL->bloblen)
-                    blobEL->blob    = static_cast<unsigned char *>(realloc(blobEL->blob, blobBufferSize));
-                blobEL->bloblen = from64tobits_fast(static_cast<char *>(blobEL->blob), pcdataXMLEle(ep), bloblen);
+                if (findXMLAtt(ep, "rawlen"))
+                {
+                    // Binary BLOB: pcdata is the data itself
+                    if (bloblen != blobEL->bloblen)
+                        blobEL->blob = static_cast<unsigned char *>(realloc(blobEL->blob, bloblen));
+                    memcpy(blobEL->blob, pcdataXMLEle(ep), bloblen);
+                    blobEL->bloblen = bloblen;
+                }
+                else
+                {
+                    int blobBufferSize = 3 * bloblen / 4;
+                    if (blobBufferSize != blobEL->bloblen)
+                        blobEL->blob    = static_cast<unsigned char *>(realloc(blobEL->blob, blobBufferSize));
+                    blobEL->bloblen = from64tobits_fast(static_cast<char *>(blobEL->blob), pcdataXMLEle(ep), bloblen);
+                }
 
                 strncpy(blobEL->format, valuXMLAtt(fa), MAXINDIFORMAT);
 
-                if (strstr(blobEL->format, ".z"))
+                size_t formatLength = strlen(blobEL->format);
+                size_t suffixLength = strlen(INDI::GZip::FORMAT_SUFFIX);
+                if (formatLength > suffixLength &&
+                        !strcmp(blobEL->format + formatLength - suffixLength, INDI::GZip::FORMAT_SUFFIX))
+                {
+                    // Chunked gzip, inflated in parallel
+                    void *dataBuffer = nullptr;
+                    size_t dataSize  = 0;
+
+                    int r = INDI::GZip::uncompress(blobEL->blob, blobEL->bloblen, &dataBuffer, &dataSize, blobEL->size);
+                    if (r != Z_OK)
+                    {
+                        snprintf(errmsg, MAXRBUF, "INDI: %s.%s.%s compression error: %d", blobEL->bvp->device,
+                                 blobEL->bvp->name, blobEL->name, r);
+                        return -1;
+                    }
+                    blobEL->format[formatLength - suffixLength] = '\0';
+                    blobEL->size    = dataSize;
+                    blobEL->bloblen = dataSize;
+                    free(blobEL->blob);
+                    blobEL->blob = dataBuffer;
+                }
+                else if (strstr(blobEL->format, ".z"))
                 {
                     blobEL->format[strlen(blobEL->format) - 2] = '\0';
                     uLongf dataSize = blobEL->size * sizeof(uint8_t);
@@ -21,6 +21,7 @@
 #include "indistandardproperty.h"
 #include "connectionplugins/connectionserial.h"
 
+#include <cmath>
 #include <cstdlib>
 #include <cstring>
 #include <assert.h>
@@ -62,6 +63,15 @@ DefaultDevice::DefaultDevice()
     memset(&ConnectionModeSP, 0, sizeof(ConnectionModeSP));
 }
 
+DefaultDevice::~DefaultDevice()
+{
+    for (auto &it : updateRules)
+    {
+        if (it.second.timer >= 0)
+            IERmTimer(it.second.timer);
+    }
+}
+
 bool DefaultDevice::loadConfig(bool silent, const char *property)
 {
     char errmsg[MAXRBUF] = {0};
@@ -367,6 +377,11 @@ bool DefaultDevice::ISNewSwitch(const char *dev, const char *name, ISState *stat
                     // Disconnection is successful, set it IDLE and updateProperties.
                     if (rc)
                     {
+                        for (auto &it : updateRules)
+                            LOGF_DEBUG("%s: %llu updates, %llu sent, %llu unchanged.", it.first.c_str(),
+                                       static_cast<unsigned long long>(it.second.stats.requested),
+                                       static_cast<unsigned long long>(it.second.stats.sent),
+                                       static_cast<unsigned long long>(it.second.stats.unchanged));
                         setConnected(false, IPS_IDLE);
                         updateProperties();
                     }
@@ -839,6 +854,323 @@ void DefaultDevice::syncDriverInfo()
     IDSetText(&DriverInfoTP, nullptr);
 }
 
+/* what changed in a property given to update*() since it was last sent */
+enum
+{
+    UPDATE_SAME,   // nothing beyond epsilon
+    UPDATE_VALUES, // values only, may be held back
+    UPDATE_STATE   // state, permission or elements, or never sent: send now
+};
+
+void DefaultDevice::setUpdateRule(const char *propertyName, uint32_t minInterval, double epsilon)
+{
+    UpdateRule &rule = updateRules[propertyName];
+
+    rule.minInterval = minInterval;
+    rule.epsilon     = epsilon;
+    // the epsilons are taken when sent
+    rule.sent        = false;
+}
+
+bool DefaultDevice::setUpdateEpsilon(const char *propertyName, const char *elementName, double epsilon)
+{
+    auto it = updateRules.find(propertyName);
+    if (it == updateRules.end())
+        return false;
+
+    it->second.elementEpsilon[elementName] = epsilon;
+    it->second.sent = false;
+    return true;
+}
+
+void DefaultDevice::removeUpdateRule(const char *propertyName)
+{
+    auto it = updateRules.find(propertyName);
+    if (it == updateRules.end())
+        return;
+
+    if (it->second.timer >= 0)
+    {
+        IERmTimer(it->second.timer);
+        sendHeldUpdate(it->second);
+    }
+    updateRules.erase(it);
+}
+
+bool DefaultDevice::getUpdateStats(const char *propertyName, UpdateStats &stats) const
+{
+    auto it = updateRules.find(propertyName);
+    if (it == updateRules.end())
+        return false;
+
+    stats = it->second.stats;
+    return true;
+}
+
+void DefaultDevice::updateNumber(INumberVectorProperty *nvp, const char *fmt, ...)
+{
+    if (admitUpdate(nvp, INDI_NUMBER, nvp->name, fmt != nullptr))
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        IDSetNumberVA(nvp, fmt, ap);
+        va_end(ap);
+    }
+}
+
+void DefaultDevice::updateSwitch(ISwitchVectorProperty *svp, const char *fmt, ...)
+{
+    if (admitUpdate(svp, INDI_SWITCH, svp->name, fmt != nullptr))
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        IDSetSwitchVA(svp, fmt, ap);
+        va_end(ap);
+    }
+}
+
+void DefaultDevice::updateText(ITextVectorProperty *tvp, const char *fmt, ...)
+{
+    if (admitUpdate(tvp, INDI_TEXT, tvp->name, fmt != nullptr))
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        IDSetTextVA(tvp, fmt, ap);
+        va_end(ap);
+    }
+}
+
+void DefaultDevice::updateLight(ILightVectorProperty *lvp, const char *fmt, ...)
+{
+    if (admitUpdate(lvp, INDI_LIGHT, lvp->name, fmt != nullptr))
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        IDSetLightVA(lvp, fmt, ap);
+        va_end(ap);
+    }
+}
+
+/* return true if property is to be sent now. if it has a rule and it is not,
+ * it is either no change, or held back and sent by updateTimerHit().
+ */
+bool DefaultDevice::admitUpdate(void *property, INDI_PROPERTY_TYPE type, const char *name, bool message)
+{
+    auto it = updateRules.find(name);
+    if (it == updateRules.end())
+        return true;
+
+    UpdateRule &rule = it->second;
+    rule.property    = property;
+    rule.type        = type;
+    rule.stats.requested++;
+
+    int change = message ? UPDATE_STATE : updateChange(rule);
+
+    if (change == UPDATE_SAME)
+    {
+        // back to what the client has, so nothing held back is due any more
+        if (rule.timer >= 0)
+        {
+            IERmTimer(rule.timer);
+            rule.timer = -1;
+        }
+        rule.stats.unchanged++;
+        return false;
+    }
+
+    if (change == UPDATE_VALUES && rule.minInterval > 0)
+    {
+        auto since = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                     rule.lastTime).count();
+
+        if (since < static_cast<long long>(rule.minInterval))
+        {
+            if (rule.timer < 0)
+                rule.timer = IEAddTimer(static_cast<int>(rule.minInterval - since), updateTimerHit, &rule);
+            return false;
+        }
+    }
+
+    if (rule.timer >= 0)
+    {
+        IERmTimer(rule.timer);
+        rule.timer = -1;
+    }
+    updateSent(rule);
+    return true;
+}
+
+/* return what changed in rule.property since it was last sent */
+int DefaultDevice::updateChange(const UpdateRule &rule)
+{
+    switch (rule.type)
+    {
+        case INDI_NUMBER:
+        {
+            auto nvp = static_cast<const INumberVectorProperty *>(rule.property);
+
+            if (!rule.sent || nvp->s != rule.lastState || nvp->p != rule.lastPerm ||
+                    nvp->nnp != static_cast<int>(rule.lastValues.size()))
+                return UPDATE_STATE;
+            for (int i = 0; i < nvp->nnp; i++)
+            {
+                double change = std::fabs(nvp->np[i].value - rule.lastValues[i]);
+
+                // NaN counts as a change
+                if (change != 0 && !(change < rule.lastEpsilon[i]))
+                    return UPDATE_VALUES;
+            }
+            return UPDATE_SAME;
+        }
+
+        case INDI_SWITCH:
+        {
+            auto svp = static_cast<const ISwitchVectorProperty *>(rule.property);
+
+            if (!rule.sent || svp->s != rule.lastState || svp->p != rule.lastPerm ||
+                    svp->nsp != static_cast<int>(rule.lastValues.size()))
+                return UPDATE_STATE;
+            for (int i = 0; i < svp->nsp; i++)
+            {
+                if (svp->sp[i].s != rule.lastValues[i])
+                    return UPDATE_VALUES;
+            }
+            return UPDATE_SAME;
+        }
+
+        case INDI_TEXT:
+        {
+            auto tvp = static_cast<const ITextVectorProperty *>(rule.property);
+
+            if (!rule.sent || tvp->s != rule.lastState || tvp->p != rule.lastPerm ||
+                    tvp->ntp != static_cast<int>(rule.lastTexts.size()))
+                return UPDATE_STATE;
+            for (int i = 0; i < tvp->ntp; i++)
+            {
+                if (rule.lastTexts[i] != (tvp->tp[i].text ? tvp->tp[i].text : ""))
+                    return UPDATE_VALUES;
+            }
+            return UPDATE_SAME;
+        }
+
+        case INDI_LIGHT:
+        {
+            auto lvp = static_cast<const ILightVectorProperty *>(rule.property);
+
+            if (!rule.sent || lvp->s != rule.lastState || lvp->nlp != static_cast<int>(rule.lastValues.size()))
+                return UPDATE_STATE;
+            for (int i = 0; i < lvp->nlp; i++)
+            {
+                if (lvp->lp[i].s != rule.lastValues[i])
+                    return UPDATE_VALUES;
+            }
+            return UPDATE_SAME;
+        }
+
+        default:
+            return UPDATE_STATE;
+    }
+}
+
+/* remember rule.property as what the client has now */
+void DefaultDevice::updateSent(UpdateRule &rule)
+{
+    rule.lastValues.clear();
+    rule.lastTexts.clear();
+
+    switch (rule.type)
+    {
+        case INDI_NUMBER:
+        {
+            auto nvp = static_cast<const INumberVectorProperty *>(rule.property);
+
+            rule.lastState = nvp->s;
+            rule.lastPerm  = nvp->p;
+            rule.lastEpsilon.resize(nvp->nnp);
+            for (int i = 0; i < nvp->nnp; i++)
+            {
+                auto eps = rule.elementEpsilon.find(nvp->np[i].name);
+
+                rule.lastValues.push_back(nvp->np[i].value);
+                rule.lastEpsilon[i] = eps != rule.elementEpsilon.end() ? eps->second : rule.epsilon;
+            }
+            break;
+        }
+
+        case INDI_SWITCH:
+        {
+            auto svp = static_cast<const ISwitchVectorProperty *>(rule.property);
+
+            rule.lastState = svp->s;
+            rule.lastPerm  = svp->p;
+            for (int i = 0; i < svp->nsp; i++)
+                rule.lastValues.push_back(svp->sp[i].s);
+            break;
+        }
+
+        case INDI_TEXT:
+        {
+            auto tvp = static_cast<const ITextVectorProperty *>(rule.property);
+
+            rule.lastState = tvp->s;
+            rule.lastPerm  = tvp->p;
+            for (int i = 0; i < tvp->ntp; i++)
+                rule.lastTexts.push_back(tvp->tp[i].text ? tvp->tp[i].text : "");
+            break;
+        }
+
+        case INDI_LIGHT:
+        {
+            auto lvp = static_cast<const ILightVectorProperty *>(rule.property);
+
+            rule.lastState = lvp->s;
+            for (int i = 0; i < lvp->nlp; i++)
+                rule.lastValues.push_back(lvp->lp[i].s);
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    rule.sent     = true;
+    rule.lastTime = std::chrono::steady_clock::now();
+    rule.stats.sent++;
+}
+
+/* send the update of rule.property held back, unless it changed back since */
+void DefaultDevice::sendHeldUpdate(UpdateRule &rule)
+{
+    rule.timer = -1;
+    if (updateChange(rule) == UPDATE_SAME)
+        return;
+
+    updateSent(rule);
+    switch (rule.type)
+    {
+        case INDI_NUMBER:
+            IDSetNumber(static_cast<INumberVectorProperty *>(rule.property), nullptr);
+            break;
+        case INDI_SWITCH:
+            IDSetSwitch(static_cast<ISwitchVectorProperty *>(rule.property), nullptr);
+            break;
+        case INDI_TEXT:
+            IDSetText(static_cast<ITextVectorProperty *>(rule.property), nullptr);
+            break;
+        case INDI_LIGHT:
+            IDSetLight(static_cast<ILightVectorProperty *>(rule.property), nullptr);
+            break;
+        default:
+            break;
+    }
+}
+
+void DefaultDevice::updateTimerHit(void *p)
+{
+    sendHeldUpdate(*static_cast<UpdateRule *>(p));
+}
+
 bool DefaultDevice::initProperties()
 {
     char versionStr[16];
@@ -896,6 +1228,20 @@ bool DefaultDevice::deleteProperty(const char *propertyName)
 {
     char errmsg[MAXRBUF];
 
+    // what was held back or last sent says nothing of what is defined next
+    for (auto &it : updateRules)
+    {
+        if (propertyName != nullptr && it.first != propertyName)
+            continue;
+        if (it.second.timer >= 0)
+        {
+            IERmTimer(it.second.timer);
+            it.second.timer = -1;
+        }
+        it.second.sent     = false;
+        it.second.property = nullptr;
+    }
+
     if (propertyName == nullptr)
     {
         //while(!pAll.empty()) delete bar.back(), bar.pop_back();
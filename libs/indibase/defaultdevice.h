@@ -23,6 +23,8 @@
 #include "indilogger.h"
 
 #include <stdint.h>
+#include <chrono>
+#include <map>
 
 namespace Connection
 {
@@ -115,7 +117,7 @@ class INDI::DefaultDevice : public INDI::BaseDevice
 {
     public:
         DefaultDevice();
-        virtual ~DefaultDevice() override = default;
+        virtual ~DefaultDevice() override;
 
         /** \brief Add Debug, Simulation, and Configuration options to the driver */
         void addAuxControls();
@@ -510,6 +512,68 @@ class INDI::DefaultDevice : public INDI::BaseDevice
          */
         void syncDriverInfo();
 
+        /**
+         * @brief Counters of the updates of one property given to updateNumber(), updateSwitch(),
+         * updateText() or updateLight() under an update rule. requested - sent updates were saved.
+         */
+        struct UpdateStats
+        {
+            uint64_t requested { 0 }; /*!< updates given */
+            uint64_t sent { 0 };      /*!< messages sent to the client */
+            uint64_t unchanged { 0 }; /*!< updates dropped for changing nothing beyond epsilon */
+        };
+
+        /**
+         * @brief setUpdateRule Limit the updates of a property sent with updateNumber(), updateSwitch(),
+         * updateText() or updateLight(). Updates that change no element from what was last sent, numbers
+         * by more than their epsilon, are not sent. Updates that come less than minInterval after the last
+         * one sent are held back, and only the latest is sent once the interval is over. Changes of state
+         * or permission, and updates with a message, are always sent at once.
+         * @param propertyName name of the property.
+         * @param minInterval least time between two updates sent in milliseconds, 0 for no limit.
+         * @param epsilon number elements that change by less than this are unchanged, 0 for only exact
+         * repeats. See setUpdateEpsilon() for single elements.
+         * @note Rules are opt-in, properties without one are always sent as with IDSet*().
+         */
+        void setUpdateRule(const char *propertyName, uint32_t minInterval, double epsilon = 0);
+
+        /**
+         * @brief setUpdateEpsilon Set the epsilon of one element of a number property with an update rule.
+         * @return True if the property has a rule, false otherwise.
+         */
+        bool setUpdateEpsilon(const char *propertyName, const char *elementName, double epsilon);
+
+        /**
+         * @brief removeUpdateRule Send all updates of propertyName again, a held back update is sent now.
+         */
+        void removeUpdateRule(const char *propertyName);
+
+        /**
+         * @brief getUpdateStats Get the counters of propertyName since its rule was set.
+         * @return True if the property has a rule, false otherwise.
+         */
+        bool getUpdateStats(const char *propertyName, UpdateStats &stats) const;
+
+        /**
+         * @brief updateNumber Send nvp to the client as IDSetNumber() does, subject to its update rule if any.
+         */
+        void updateNumber(INumberVectorProperty *nvp, const char *fmt = nullptr, ...) ATTRIBUTE_FORMAT_PRINTF(3, 4);
+
+        /**
+         * @brief updateSwitch Send svp to the client as IDSetSwitch() does, subject to its update rule if any.
+         */
+        void updateSwitch(ISwitchVectorProperty *svp, const char *fmt = nullptr, ...) ATTRIBUTE_FORMAT_PRINTF(3, 4);
+
+        /**
+         * @brief updateText Send tvp to the client as IDSetText() does, subject to its update rule if any.
+         */
+        void updateText(ITextVectorProperty *tvp, const char *fmt = nullptr, ...) ATTRIBUTE_FORMAT_PRINTF(3, 4);
+
+        /**
+         * @brief updateLight Send lvp to the client as IDSetLight() does, subject to its update rule if any.
+         */
+        void updateLight(ILightVectorProperty *lvp, const char *fmt = nullptr, ...) ATTRIBUTE_FORMAT_PRINTF(3, 4);
+
 
         /** \return Default name of the device. */
         virtual const char *getDefaultName() = 0;
@@ -559,4 +623,33 @@ class INDI::DefaultDevice : public INDI::BaseDevice
 
         bool defineDynamicProperties {true};
         bool deleteDynamicProperties {true};
+
+        // Update rules
+        struct UpdateRule
+        {
+            uint32_t minInterval { 0 };
+            double epsilon { 0 };
+            std::map<std::string, double> elementEpsilon;
+
+            void *property { nullptr }; // last given, sent when the held back update is due
+            INDI_PROPERTY_TYPE type { INDI_UNKNOWN };
+            int timer { -1 };           // held back update due, or -1
+
+            bool sent { false };        // what was last sent is below
+            IPState lastState { IPS_IDLE };
+            IPerm lastPerm { IP_RO };
+            std::vector<double> lastValues;
+            std::vector<std::string> lastTexts;
+            std::vector<double> lastEpsilon;
+            std::chrono::steady_clock::time_point lastTime;
+
+            UpdateStats stats;
+        };
+        std::map<std::string, UpdateRule> updateRules;
+
+        bool admitUpdate(void *property, INDI_PROPERTY_TYPE type, const char *name, bool message);
+        static int updateChange(const UpdateRule &rule);
+        static void updateSent(UpdateRule &rule);
+        static void sendHeldUpdate(UpdateRule &rule);
+        static void updateTimerHit(void *p);
 };
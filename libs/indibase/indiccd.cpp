@@ -33,6 +33,7 @@
 #include "indicom.h"
 #include "locale_compat.h"
 #include "indiutility.h"
+#include "indigzip.h"
 
 #include <fitsio.h>
 
@@ -64,6 +65,75 @@ uint16_t INDIWSServer::m_global_port = 11623;
 namespace INDI
 {
 
+/////////////////////////////////////////////////////////////////////////////////////////
+/// Image Pipeline
+///
+/// A completed frame is copied out of the chip buffer into a pooled PipelineFrame, along
+/// with everything about it that could change with the next exposure: its layout, the
+/// FITS header and where to save it. Then it passes from thread to thread, one per stage:
+/// encode, compress, save and send. What the driver's properties should show once it is
+/// done is posted back to the loop thread as a FrameDone.
+/////////////////////////////////////////////////////////////////////////////////////////
+struct CCD::PipelineFrame
+{
+    ~PipelineFrame()
+    {
+        free(packed);
+    }
+
+    CCDChip * chip { nullptr };
+    uint32_t exposureStarts { 0 };
+    bool sendImage { false };
+    bool saveImage { false };
+    std::string uploadDir;
+    std::string uploadPrefix;
+    std::string savedTo;
+    bool compress { false };
+    int level { 6 };
+    std::string extension;
+
+    // Raw frame
+    FramePool::Buffer raw;
+    size_t rawSize { 0 };
+    int sizes[2] { 0, 0 };
+    int bpp { 0 };
+
+    // FITS layout and header records, captured at hand-off
+    int imgType { 0 };
+    int byteType { 0 };
+    int naxis { 2 };
+    long naxes[3] { 0, 0, 0 };
+    long nelements { 0 };
+    std::vector<std::string> cards;
+
+    // Encoded image, either fits or raw
+    FramePool::Buffer fits;
+    size_t fitsSize { 0 };
+    const void * encoded { nullptr };
+    size_t encodedSize { 0 };
+
+    // Image to send, either packed or encoded
+    void * packed { nullptr };
+    const void * output { nullptr };
+    size_t outputSize { 0 };
+    char format[MAXINDIBLOBFMT] {};
+
+    double wait { 0 };
+    double timing[PIPELINE_STAGES] {};
+};
+
+struct CCD::FrameDone
+{
+    std::shared_ptr<LoopHandle> handle;
+    CCDChip * chip { nullptr };
+    uint32_t exposureStarts { 0 };  // the chip's count when the frame was taken
+    IPState state { IPS_OK };       // for the exposure, unless a newer one started
+    std::string savedTo;            // file the frame was saved to, if any
+    std::string format;             // of the BLOB sent, if any
+    int size { 0 };
+    int bloblen { 0 };
+};
+
 CCD::CCD()
 {
     //ctor
@@ -75,6 +145,10 @@ CCD::CCD()
     //GuiderRapidGuideEnabled = false;
     m_ValidCCDRotation        = false;
 
+    framePool = std::make_shared<FramePool>();
+    PrimaryCCD.setFramePool(framePool);
+    GuideCCD.setFramePool(framePool);
+
     AutoLoop         = false;
     SendImage        = false;
     ShowMarker       = false;
@@ -104,10 +178,34 @@ CCD::CCD()
     primaryFocalLength = std::numeric_limits<double>::quiet_NaN();
     guiderAperture = std::numeric_limits<double>::quiet_NaN();
     guiderFocalLength = std::numeric_limits<double>::quiet_NaN();
+
+    loopHandle = std::make_shared<LoopHandle>();
+    loopHandle->ccd = this;
 }
 
 CCD::~CCD()
 {
+    // a FrameDone still posted must not find us
+    {
+        std::lock_guard<std::mutex> lock(loopHandle->lock);
+        loopHandle->ccd = nullptr;
+    }
+
+    std::unique_lock<std::mutex> guard(pipelineLock);
+    pipelineStop = true;
+    pipelineCond.notify_all();
+    guard.unlock();
+
+    for (auto &thread : pipelineThreads)
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+
+    for (auto &queue : pipelineQueue)
+        pipelinePool.insert(pipelinePool.end(), queue.begin(), queue.end());
+    for (auto frame : pipelinePool)
+        delete frame;
 }
 
 void CCD::SetCCDCapability(uint32_t cap)
@@ -189,6 +287,28 @@ bool CCD::initProperties()
     IUFillSwitchVector(&PrimaryCCD.CompressSP, PrimaryCCD.CompressS, 2, getDeviceName(), "CCD_COMPRESSION", "Image",
                        IMAGE_SETTINGS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
     PrimaryCCD.SendCompressed = false;
+    IUFillNumber(&PrimaryCCD.CompressLevelN[0], "LEVEL", "Level", "%.f", 1, 9, 1, 6);
+    IUFillNumberVector(&PrimaryCCD.CompressLevelNP, PrimaryCCD.CompressLevelN, 1, getDeviceName(),
+                       "CCD_COMPRESSION_LEVEL", "Compression", IMAGE_SETTINGS_TAB, IP_RW, 60, IPS_IDLE);
+
+    // Image Pipeline
+    IUFillNumber(&PipelineN[0], "DEPTH", "Frames", "%.f", 1, 16, 1, 2);
+    IUFillNumberVector(&PipelineNP, PipelineN, 1, getDeviceName(), "CCD_PIPELINE", "Pipeline", IMAGE_SETTINGS_TAB,
+                       IP_RW, 60, IPS_IDLE);
+
+    IUFillNumber(&PipelineTimingN[PIPELINE_QUEUED], "QUEUED", "Queued", "%.f", 0, 16, 0, 0);
+    IUFillNumber(&PipelineTimingN[PIPELINE_WAIT], "WAIT", "Wait (s)", "%.3f", 0, 3600, 0, 0);
+    IUFillNumber(&PipelineTimingN[PIPELINE_ENCODE_TIME], "ENCODE", "Encode (s)", "%.3f", 0, 3600, 0, 0);
+    IUFillNumber(&PipelineTimingN[PIPELINE_COMPRESS_TIME], "COMPRESS", "Compress (s)", "%.3f", 0, 3600, 0, 0);
+    IUFillNumber(&PipelineTimingN[PIPELINE_DELIVER_TIME], "DELIVER", "Save & Send (s)", "%.3f", 0, 3600, 0, 0);
+    IUFillNumberVector(&PipelineTimingNP, PipelineTimingN, 5, getDeviceName(), "CCD_PIPELINE_TIMING", "Pipeline",
+                       IMAGE_INFO_TAB, IP_RO, 60, IPS_IDLE);
+
+    IUFillNumber(&FramePoolN[FRAME_POOL_LEASES], "LEASES", "Leases", "%.f", 0, 1e15, 0, 0);
+    IUFillNumber(&FramePoolN[FRAME_POOL_ALLOCATIONS], "ALLOCATIONS", "Allocations", "%.f", 0, 1e15, 0, 0);
+    IUFillNumber(&FramePoolN[FRAME_POOL_SIZE], "SIZE", "Size (MB)", "%.1f", 0, 1e6, 0, 0);
+    IUFillNumberVector(&FramePoolNP, FramePoolN, 3, getDeviceName(), "CCD_FRAME_POOL", "Frame Buffers",
+                       IMAGE_INFO_TAB, IP_RO, 60, IPS_IDLE);
 
     // Primary CCD Chip Data Blob
     IUFillBLOB(&PrimaryCCD.FitsB, "CCD1", "Image", "");
@@ -278,6 +398,9 @@ bool CCD::initProperties()
     IUFillSwitchVector(&GuideCCD.CompressSP, GuideCCD.CompressS, 2, getDeviceName(), "GUIDER_COMPRESSION", "Image",
                        GUIDE_HEAD_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
     GuideCCD.SendCompressed = false;
+    IUFillNumber(&GuideCCD.CompressLevelN[0], "LEVEL", "Level", "%.f", 1, 9, 1, 6);
+    IUFillNumberVector(&GuideCCD.CompressLevelNP, GuideCCD.CompressLevelN, 1, getDeviceName(),
+                       "GUIDER_COMPRESSION_LEVEL", "Compression", GUIDE_HEAD_TAB, IP_RW, 60, IPS_IDLE);
 
     IUFillBLOB(&GuideCCD.FitsB, "CCD2", "Guider Image", "");
     IUFillBLOBVector(&GuideCCD.FitsBP, &GuideCCD.FitsB, 1, getDeviceName(), "CCD2", "Image Data", IMAGE_INFO_TAB, IP_RO,
@@ -494,10 +617,15 @@ bool CCD::updateProperties()
                 defineNumber(&GuideCCD.ImageBinNP);
         }
         defineSwitch(&PrimaryCCD.CompressSP);
+        defineNumber(&PrimaryCCD.CompressLevelNP);
+        defineNumber(&PipelineNP);
+        defineNumber(&PipelineTimingNP);
+        defineNumber(&FramePoolNP);
         defineBLOB(&PrimaryCCD.FitsBP);
         if (HasGuideHead())
         {
             defineSwitch(&GuideCCD.CompressSP);
+            defineNumber(&GuideCCD.CompressLevelNP);
             defineBLOB(&GuideCCD.FitsBP);
         }
         if (HasST4Port())
@@ -565,6 +693,10 @@ bool CCD::updateProperties()
             deleteProperty(PrimaryCCD.AbortExposureSP.name);
         deleteProperty(PrimaryCCD.FitsBP.name);
         deleteProperty(PrimaryCCD.CompressSP.name);
+        deleteProperty(PrimaryCCD.CompressLevelNP.name);
+        deleteProperty(PipelineNP.name);
+        deleteProperty(PipelineTimingNP.name);
+        deleteProperty(FramePoolNP.name);
 
 #if 0
         deleteProperty(PrimaryCCD.RapidGuideSP.name);
@@ -589,6 +721,7 @@ bool CCD::updateProperties()
             if (CanBin())
                 deleteProperty(GuideCCD.ImageBinNP.name);
             deleteProperty(GuideCCD.CompressSP.name);
+            deleteProperty(GuideCCD.CompressLevelNP.name);
             deleteProperty(GuideCCD.FrameTypeSP.name);
 
 #if 0
@@ -930,6 +1063,7 @@ bool CCD::ISNewNumber(const char * dev, const char * name, double values[], char
                     DEBUG(Logger::DBG_WARNING, "Warning: Aborting exposure failed.");
             }
 
+            PrimaryCCD.ExposureStarts++;
             if (StartExposure(ExposureTime))
             {
                 if (PrimaryCCD.getFrameType() == CCDChip::LIGHT_FRAME && !std::isnan(RA) && !std::isnan(Dec))
@@ -986,6 +1120,7 @@ bool CCD::ISNewNumber(const char * dev, const char * name, double values[], char
                 GuideCCD.ImageExposureN[0].value = GuiderExposureTime = values[0];
 
             GuideCCD.ImageExposureNP.s = IPS_BUSY;
+            GuideCCD.ExposureStarts++;
             if (StartGuideExposure(GuiderExposureTime))
                 GuideCCD.ImageExposureNP.s = IPS_BUSY;
             else
@@ -1147,6 +1282,32 @@ bool CCD::ISNewNumber(const char * dev, const char * name, double values[], char
             return true;
         }
 
+        // Primary Chip Compression Level
+        if (!strcmp(name, PrimaryCCD.CompressLevelNP.name))
+        {
+            PrimaryCCD.CompressLevelNP.s = IUUpdateNumber(&PrimaryCCD.CompressLevelNP, values, names, n) == 0 ? IPS_OK : IPS_ALERT;
+            IDSetNumber(&PrimaryCCD.CompressLevelNP, nullptr);
+            return true;
+        }
+
+        // Guide Chip Compression Level
+        if (!strcmp(name, GuideCCD.CompressLevelNP.name))
+        {
+            GuideCCD.CompressLevelNP.s = IUUpdateNumber(&GuideCCD.CompressLevelNP, values, names, n) == 0 ? IPS_OK : IPS_ALERT;
+            IDSetNumber(&GuideCCD.CompressLevelNP, nullptr);
+            return true;
+        }
+
+        // Image Pipeline Depth
+        if (!strcmp(name, PipelineNP.name))
+        {
+            std::unique_lock<std::mutex> guard(pipelineLock);
+            PipelineNP.s = IUUpdateNumber(&PipelineNP, values, names, n) == 0 ? IPS_OK : IPS_ALERT;
+            IDSetNumber(&PipelineNP, nullptr);
+            pipelineCond.notify_all();
+            return true;
+        }
+
 #ifdef WITH_EXPOSURE_LOOPING
         if (!strcmp(name, ExposureLoopCountNP.name))
         {
@@ -1970,22 +2131,24 @@ bool CCD::ExposureComplete(CCDChip * targetChip)
     // Reset POLLMS to default value
     POLLMS = getPollingPeriod();
 
-    // Run async
-    std::thread(&CCD::ExposureCompletePrivate, this, targetChip).detach();
+    // Run async. Any exposure started from now on is newer than this frame.
+    std::thread(&CCD::ExposureCompletePrivate, this, targetChip, targetChip->ExposureStarts.load()).detach();
 
     return true;
 }
 
-bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
+bool CCD::ExposureCompletePrivate(CCDChip * targetChip, uint32_t exposureStarts)
 {
-    if(HasDSP())
+    bool sendImage = (UploadS[0].s == ISS_ON || UploadS[2].s == ISS_ON);
+    bool saveImage = (UploadS[1].s == ISS_ON || UploadS[2].s == ISS_ON);
+
+    // Hand the frame over to the image pipeline first so the buffer is free for the next exposure
+    if ((sendImage || saveImage || HasDSP()) && submitFrame(targetChip, sendImage, saveImage, exposureStarts) == false)
     {
-        uint8_t* buf = static_cast<uint8_t*>(malloc(targetChip->getFrameBufferSize()));
-        memcpy(buf, targetChip->getFrameBuffer(), targetChip->getFrameBufferSize());
-        DSP->processBLOB(buf, 2, new int[2] { targetChip->getXRes() / targetChip->getBinX(), targetChip->getYRes() / targetChip->getBinY() },
-                         targetChip->getBPP());
-        free(buf);
+        targetChip->setExposureFailed();
+        return false;
     }
+
 #ifdef WITH_EXPOSURE_LOOPING
     // If looping is on, let's immediately take another capture
     if (ExposureLoopS[EXPOSURE_LOOP_ON].s == ISS_ON)
@@ -2014,6 +2177,7 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
 
             if (uploadTime < duration)
             {
+                PrimaryCCD.ExposureStarts++;
                 StartExposure(duration);
                 PrimaryCCD.ImageExposureNP.s = IPS_BUSY;
                 IDSetNumber(&PrimaryCCD.ImageExposureNP, nullptr);
@@ -2042,9 +2206,6 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
     }
 #endif
 
-    bool sendImage = (UploadS[0].s == ISS_ON || UploadS[2].s == ISS_ON);
-    bool saveImage = (UploadS[1].s == ISS_ON || UploadS[2].s == ISS_ON);
-
 #if 0
     bool showMarker = false;
     bool autoLoop   = false;
@@ -2485,142 +2646,13 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
     }
 #endif
 
-    if (sendImage || saveImage /* || useSolver*/)
+    // The pipeline reports the exposure done once the image is delivered
+    if (!sendImage && !saveImage)
     {
-        if (!strcmp(targetChip->getImageExtension(), "fits"))
-        {
-            void * memptr;
-            size_t memsize;
-            int img_type  = 0;
-            int byte_type = 0;
-            int status    = 0;
-            long naxis    = targetChip->getNAxis();
-            long naxes[3];
-            int nelements = 0;
-            std::string bit_depth;
-            char error_status[MAXRBUF];
-
-            fitsfile * fptr = nullptr;
-
-            naxes[0] = targetChip->getSubW() / targetChip->getBinX();
-            naxes[1] = targetChip->getSubH() / targetChip->getBinY();
-
-            switch (targetChip->getBPP())
-            {
-                case 8:
-                    byte_type = TBYTE;
-                    img_type  = BYTE_IMG;
-                    bit_depth = "8 bits per pixel";
-                    break;
-
-                case 16:
-                    byte_type = TUSHORT;
-                    img_type  = USHORT_IMG;
-                    bit_depth = "16 bits per pixel";
-                    break;
-
-                case 32:
-                    byte_type = TULONG;
-                    img_type  = ULONG_IMG;
-                    bit_depth = "32 bits per pixel";
-                    break;
-
-                default:
-                    LOGF_ERROR("Unsupported bits per pixel value %d", targetChip->getBPP());
-                    return false;
-            }
-
-            nelements = naxes[0] * naxes[1];
-            if (naxis == 3)
-            {
-                nelements *= 3;
-                naxes[2] = 3;
-            }
-
-            /*DEBUGF(Logger::DBG_DEBUG, "Exposure complete. Image Depth: %s. Width: %d Height: %d nelements: %d", bit_depth.c_str(), naxes[0],
-                    naxes[1], nelements);*/
-
-            std::unique_lock<std::mutex> guard(ccdBufferLock);
-
-            //  Now we have to send fits format data to the client
-            memsize = 5760;
-            memptr  = malloc(memsize);
-            if (!memptr)
-            {
-                LOGF_ERROR("Error: failed to allocate memory: %lu", memsize);
-                return false;
-            }
-
-            fits_create_memfile(&fptr, &memptr, &memsize, 2880, realloc, &status);
-
-            if (status)
-            {
-                fits_report_error(stderr, status); /* print out any error messages */
-                fits_get_errstatus(status, error_status);
-                fits_close_file(fptr, &status);
-                free(memptr);
-                LOGF_ERROR("FITS Error: %s", error_status);
-                return false;
-            }
-
-            fits_create_img(fptr, img_type, naxis, naxes, &status);
-
-            if (status)
-            {
-                fits_report_error(stderr, status); /* print out any error messages */
-                fits_get_errstatus(status, error_status);
-                fits_close_file(fptr, &status);
-                free(memptr);
-                LOGF_ERROR("FITS Error: %s", error_status);
-                return false;
-            }
-
-            addFITSKeywords(fptr, targetChip);
-
-            fits_write_img(fptr, byte_type, 1, nelements, targetChip->getFrameBuffer(), &status);
-
-            if (status)
-            {
-                fits_report_error(stderr, status); /* print out any error messages */
-                fits_get_errstatus(status, error_status);
-                fits_close_file(fptr, &status);
-                free(memptr);
-                LOGF_ERROR("FITS Error: %s", error_status);
-                return false;
-            }
-
-            fits_close_file(fptr, &status);
-
-            bool rc = uploadFile(targetChip, memptr, memsize, sendImage, saveImage /*, useSolver*/);
-
-            free(memptr);
-
-            guard.unlock();
-
-            if (rc == false)
-            {
-                targetChip->setExposureFailed();
-                return false;
-            }
-        }
-        else
-        {
-            std::unique_lock<std::mutex> guard(ccdBufferLock);
-            bool rc = uploadFile(targetChip, targetChip->getFrameBuffer(), targetChip->getFrameBufferSize(), sendImage,
-                                 saveImage);
-            guard.unlock();
-
-            if (rc == false)
-            {
-                targetChip->setExposureFailed();
-                return false;
-            }
-        }
+        targetChip->ImageExposureNP.s = IPS_OK;
+        IDSetNumber(&targetChip->ImageExposureNP, nullptr);
     }
 
-    targetChip->ImageExposureNP.s = IPS_OK;
-    IDSetNumber(&targetChip->ImageExposureNP, nullptr);
-
 #if 0
     if (autoLoop)
     {
@@ -2684,30 +2716,385 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
     return true;
 }
 
-bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBytes, bool sendImage,
-                     bool saveImage /*, bool useSolver*/)
+bool CCD::submitFrame(CCDChip * targetChip, bool sendImage, bool saveImage, uint32_t exposureStarts)
+{
+    // Keep the chip buffer locked until the frame is copied out. While the pipeline is full the
+    // driver waits here, and cannot read the next frame over this one.
+    std::unique_lock<std::mutex> bufferGuard(ccdBufferLock);
+    std::unique_lock<std::mutex> guard(pipelineLock);
+
+    if (!pipelineThreads[PIPELINE_ENCODE].joinable())
+    {
+        for (int stage = 0; stage < PIPELINE_STAGES; stage++)
+            pipelineThreads[stage] = std::thread(&CCD::pipelineEntry, this, stage);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    pipelineCond.wait(guard, [this]()
+    {
+        return pipelineInFlight < PipelineN[0].value;
+    });
+    std::chrono::duration<double> wait = std::chrono::high_resolution_clock::now() - start;
+
+    PipelineFrame * frame = nullptr;
+    if (pipelinePool.empty())
+        frame = new PipelineFrame();
+    else
+    {
+        frame = pipelinePool.back();
+        pipelinePool.pop_back();
+    }
+    pipelineInFlight++;
+    guard.unlock();
+
+    frame->chip      = targetChip;
+    frame->exposureStarts = exposureStarts;
+    frame->sendImage = sendImage;
+    frame->saveImage = saveImage;
+    frame->uploadDir    = UploadSettingsT[UPLOAD_DIR].text ? UploadSettingsT[UPLOAD_DIR].text : "";
+    frame->uploadPrefix = UploadSettingsT[UPLOAD_PREFIX].text ? UploadSettingsT[UPLOAD_PREFIX].text : "";
+    frame->savedTo.clear();
+    frame->compress  = targetChip->SendCompressed;
+    frame->level     = static_cast<int>(targetChip->CompressLevelN[0].value);
+    frame->extension = targetChip->getImageExtension();
+    frame->sizes[0]  = targetChip->getXRes() / targetChip->getBinX();
+    frame->sizes[1]  = targetChip->getYRes() / targetChip->getBinY();
+    frame->bpp       = targetChip->getBPP();
+    frame->wait      = wait.count();
+    frame->cards.clear();
+
+    frame->rawSize = targetChip->getFrameBufferSize();
+    frame->raw     = framePool->lease(frame->rawSize);
+
+    bool rc = true;
+    if (frame->raw.get() == nullptr)
+    {
+        LOGF_ERROR("Error: failed to allocate memory: %lu", frame->rawSize);
+        rc = false;
+    }
+    else
+        memcpy(frame->raw.get(), targetChip->getFrameBuffer(), frame->rawSize);
+
+    if (rc && frame->extension == "fits")
+    {
+        frame->naxis    = targetChip->getNAxis();
+        frame->naxes[0] = targetChip->getSubW() / targetChip->getBinX();
+        frame->naxes[1] = targetChip->getSubH() / targetChip->getBinY();
+        frame->naxes[2] = 3;
+        frame->nelements = frame->naxes[0] * frame->naxes[1] * (frame->naxis == 3 ? 3 : 1);
+
+        switch (frame->bpp)
+        {
+            case 8:
+                frame->byteType = TBYTE;
+                frame->imgType  = BYTE_IMG;
+                break;
+
+            case 16:
+                frame->byteType = TUSHORT;
+                frame->imgType  = USHORT_IMG;
+                break;
+
+            case 32:
+                frame->byteType = TULONG;
+                frame->imgType  = ULONG_IMG;
+                break;
+
+            default:
+                LOGF_ERROR("Unsupported bits per pixel value %d", frame->bpp);
+                rc = false;
+                break;
+        }
+
+        // Let addFITSKeywords() fill an empty header now, while the chip and the
+        // device still describe this frame, and keep its records for the encoder.
+        if (rc)
+        {
+            fitsfile * fptr = nullptr;
+            size_t memsize  = 2880;
+            void * memptr   = malloc(memsize);
+            int status      = 0;
+            int first = 0, nkeys = 0;
+            char card[FLEN_CARD];
+
+            fits_create_memfile(&fptr, &memptr, &memsize, 2880, realloc, &status);
+            fits_create_img(fptr, BYTE_IMG, 0, nullptr, &status);
+            fits_get_hdrspace(fptr, &first, nullptr, &status);
+            if (status == 0)
+                addFITSKeywords(fptr, targetChip);
+            fits_get_hdrspace(fptr, &nkeys, nullptr, &status);
+            for (int i = first + 1; i <= nkeys && status == 0; i++)
+            {
+                fits_read_record(fptr, i, card, &status);
+                frame->cards.push_back(card);
+            }
+
+            if (status)
+            {
+                char error_status[MAXRBUF];
+                fits_get_errstatus(status, error_status);
+                LOGF_ERROR("FITS Error: %s", error_status);
+                rc = false;
+            }
+            if (fptr)
+                fits_close_file(fptr, &status);
+            free(memptr);
+        }
+    }
+
+    bufferGuard.unlock();
+    guard.lock();
+
+    if (rc)
+        pipelineQueue[PIPELINE_ENCODE].push_back(frame);
+    else
+    {
+        pipelinePool.push_back(frame);
+        pipelineInFlight--;
+    }
+
+    PipelineTimingN[PIPELINE_QUEUED].value = pipelineInFlight;
+    PipelineTimingN[PIPELINE_WAIT].value   = frame->wait;
+    IDSetNumber(&PipelineTimingNP, nullptr);
+
+    pipelineCond.notify_all();
+    return rc;
+}
+
+void CCD::pipelineEntry(int stage)
+{
+    std::unique_lock<std::mutex> guard(pipelineLock);
+
+    while (true)
+    {
+        pipelineCond.wait(guard, [this, stage]()
+        {
+            return pipelineStop || !pipelineQueue[stage].empty();
+        });
+        if (pipelineStop)
+            return;
+
+        PipelineFrame * frame = pipelineQueue[stage].front();
+        pipelineQueue[stage].pop_front();
+        guard.unlock();
+
+        bool rc = false;
+        auto start = std::chrono::high_resolution_clock::now();
+        switch (stage)
+        {
+            case PIPELINE_ENCODE:
+                rc = encodeFrame(frame);
+                break;
+            case PIPELINE_COMPRESS:
+                rc = compressFrame(frame);
+                break;
+            case PIPELINE_DELIVER:
+                rc = deliverFrame(frame);
+                break;
+        }
+        std::chrono::duration<double> diff = std::chrono::high_resolution_clock::now() - start;
+        frame->timing[stage] = diff.count();
+
+        bool done = (rc == false || stage == PIPELINE_DELIVER);
+        if (done)
+        {
+            // The chip and file name are the loop thread's to update
+            if (rc == false || frame->sendImage || frame->saveImage)
+            {
+                FrameDone * fd      = new FrameDone();
+                fd->handle          = loopHandle;
+                fd->chip            = frame->chip;
+                fd->exposureStarts  = frame->exposureStarts;
+                fd->state           = rc ? IPS_OK : IPS_ALERT;
+                if (rc)
+                {
+                    fd->savedTo = frame->savedTo;
+                    fd->format  = frame->format;
+                    fd->bloblen = static_cast<int>(frame->outputSize);
+                    // .fz is a FITS file of its own, .gz the original compressed
+                    fd->size    = static_cast<int>((frame->compress && frame->extension == "fits") ? frame->outputSize :
+                                                   frame->encodedSize);
+                }
+                if (IEPostTask(frameDone, fd) < 0)
+                {
+                    LOG_ERROR("Failed to post the end of a frame to the main thread.");
+                    delete fd;
+                }
+            }
+
+            free(frame->packed);
+            frame->packed = nullptr;
+            frame->fits.reset();
+            frame->raw.reset();
+        }
+
+        guard.lock();
+        if (!done)
+            pipelineQueue[stage + 1].push_back(frame);
+        else
+        {
+            pipelinePool.push_back(frame);
+            pipelineInFlight--;
+
+            PipelineTimingN[PIPELINE_QUEUED].value = pipelineInFlight;
+            if (rc)
+            {
+                PipelineTimingN[PIPELINE_WAIT].value          = frame->wait;
+                PipelineTimingN[PIPELINE_ENCODE_TIME].value   = frame->timing[PIPELINE_ENCODE];
+                PipelineTimingN[PIPELINE_COMPRESS_TIME].value = frame->timing[PIPELINE_COMPRESS];
+                PipelineTimingN[PIPELINE_DELIVER_TIME].value  = frame->timing[PIPELINE_DELIVER];
+            }
+            PipelineTimingNP.s = rc ? IPS_OK : IPS_ALERT;
+            IDSetNumber(&PipelineTimingNP, nullptr);
+
+            FramePool::Stats stats = framePool->stats();
+            FramePoolN[FRAME_POOL_LEASES].value      = stats.leases;
+            FramePoolN[FRAME_POOL_ALLOCATIONS].value = stats.allocations;
+            FramePoolN[FRAME_POOL_SIZE].value        = stats.bytes / 1048576.0;
+            FramePoolNP.s = IPS_OK;
+            IDSetNumber(&FramePoolNP, nullptr);
+        }
+        pipelineCond.notify_all();
+    }
+}
+
+bool CCD::encodeFrame(PipelineFrame * frame)
+{
+    if (HasDSP())
+    {
+        FramePool::Buffer buf = framePool->lease(frame->rawSize);
+        if (buf.get() != nullptr)
+        {
+            memcpy(buf.get(), frame->raw.get(), frame->rawSize);
+            DSP->processBLOB(buf.get(), 2, new int[2] { frame->sizes[0], frame->sizes[1] }, frame->bpp);
+        }
+    }
+
+    if (!frame->sendImage && !frame->saveImage)
+        return true;
+
+    if (frame->extension != "fits")
+    {
+        frame->encoded     = frame->raw.get();
+        frame->encodedSize = frame->rawSize;
+        return true;
+    }
+
+    fitsfile * fptr = nullptr;
+    int status      = 0;
+    LONGLONG dataStart = 0;
+
+    // Lease the whole file up front: the header records we add, and those of
+    // fits_create_img(), then the data, each in whole 2880 byte blocks.
+    size_t headerSize = (frame->cards.size() + 36) * 80;
+    size_t dataSize   = frame->nelements * (frame->bpp / 8);
+    size_t memsize    = ((headerSize + 2879) / 2880 + (dataSize + 2879) / 2880) * 2880;
+
+    frame->fits = framePool->lease(memsize);
+    void * memptr = frame->fits.get();
+    if (memptr == nullptr)
+    {
+        LOGF_ERROR("Error: failed to allocate memory: %lu", memsize);
+        return false;
+    }
+
+    // No realloc, the file is made in the leased buffer or not at all
+    fits_create_memfile(&fptr, &memptr, &memsize, 0, nullptr, &status);
+    fits_create_img(fptr, frame->imgType, frame->naxis, frame->naxes, &status);
+    for (const auto &card : frame->cards)
+        fits_write_record(fptr, card.c_str(), &status);
+    fits_write_img(fptr, frame->byteType, 1, frame->nelements, frame->raw.get(), &status);
+    fits_get_hduaddrll(fptr, nullptr, &dataStart, nullptr, &status);
+
+    if (status)
+    {
+        char error_status[MAXRBUF];
+        fits_report_error(stderr, status); /* print out any error messages */
+        fits_get_errstatus(status, error_status);
+        if (fptr)
+            fits_close_file(fptr, &status);
+        LOGF_ERROR("FITS Error: %s", error_status);
+        return false;
+    }
+
+    fits_close_file(fptr, &status);
+
+    frame->fitsSize    = dataStart + (dataSize + 2879) / 2880 * 2880;
+    frame->encoded     = frame->fits.get();
+    frame->encodedSize = frame->fitsSize;
+    return true;
+}
+
+bool CCD::compressFrame(PipelineFrame * frame)
+{
+    if (!frame->sendImage && !frame->saveImage)
+        return true;
+
+    if (frame->compress && frame->extension == "fits")
+    {
+        char error_status[MAXRBUF];
+        int status = 0;
+
+        // Rice compress the tiles in memory across all cores, as fpack would
+        if (fp_pack_mem(frame->encoded, frame->encodedSize, &frame->packed, &frame->outputSize, 0, &status))
+        {
+            fits_report_error(stderr, status); /* print out any error messages */
+            fits_get_errstatus(status, error_status);
+            LOGF_ERROR("FITS compression error: %s", error_status);
+            return false;
+        }
+
+        frame->output = frame->packed;
+        snprintf(frame->format, MAXINDIBLOBFMT, ".%s.fz", frame->extension.c_str());
+    }
+    else if (frame->compress)
+    {
+        // Deflate independent chunks across all cores, see INDI::GZip
+        int r = INDI::GZip::compress(frame->encoded, frame->encodedSize, &frame->packed, &frame->outputSize,
+                                     frame->level);
+        if (r != Z_OK)
+        {
+            LOGF_ERROR("Error: Failed to compress image: %d", r);
+            return false;
+        }
+
+        frame->output = frame->packed;
+        snprintf(frame->format, MAXINDIBLOBFMT, ".%s%s", frame->extension.c_str(), INDI::GZip::FORMAT_SUFFIX);
+    }
+    else
+    {
+        frame->output     = frame->encoded;
+        frame->outputSize = frame->encodedSize;
+        snprintf(frame->format, MAXINDIBLOBFMT, ".%s", frame->extension.c_str());
+    }
+
+    return true;
+}
+
+bool CCD::deliverFrame(PipelineFrame * frame)
 {
-    uint8_t * compressedData = nullptr;
+    CCDChip * targetChip = frame->chip;
+
+    if (!frame->sendImage && !frame->saveImage)
+        return true;
 
-    DEBUGF(Logger::DBG_DEBUG, "Uploading file. Ext: %s, Size: %d, sendImage? %s, saveImage? %s",
-           targetChip->getImageExtension(), totalBytes, sendImage ? "Yes" : "No", saveImage ? "Yes" : "No");
+    DEBUGF(Logger::DBG_DEBUG, "Uploading file. Ext: %s, Size: %zu, sendImage? %s, saveImage? %s",
+           frame->extension.c_str(), frame->encodedSize, frame->sendImage ? "Yes" : "No", frame->saveImage ? "Yes" : "No");
 
-    if (saveImage)
+    if (frame->saveImage)
     {
-        targetChip->FitsB.blob    = const_cast<void *>(fitsData);
-        targetChip->FitsB.bloblen = totalBytes;
-        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", targetChip->getImageExtension());
+        char format[MAXINDIBLOBFMT];
+        snprintf(format, MAXINDIBLOBFMT, ".%s", frame->extension.c_str());
 
         FILE * fp = nullptr;
         char imageFileName[MAXRBUF];
 
-        std::string prefix = UploadSettingsT[UPLOAD_PREFIX].text;
-        int maxIndex       = getFileIndex(UploadSettingsT[UPLOAD_DIR].text, UploadSettingsT[UPLOAD_PREFIX].text,
-                                          targetChip->FitsB.format);
+        std::string prefix = frame->uploadPrefix;
+        int maxIndex       = getFileIndex(frame->uploadDir.c_str(), frame->uploadPrefix.c_str(), format);
 
         if (maxIndex < 0)
         {
-            LOGF_ERROR("Error iterating directory %s. %s", UploadSettingsT[0].text,
+            LOGF_ERROR("Error iterating directory %s. %s", frame->uploadDir.c_str(),
                        strerror(errno));
             return false;
         }
@@ -2730,7 +3117,7 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
             prefix = std::regex_replace(prefix, std::regex("XXX"), prefixIndex);
         }
 
-        snprintf(imageFileName, MAXRBUF, "%s/%s%s", UploadSettingsT[0].text, prefix.c_str(), targetChip->FitsB.format);
+        snprintf(imageFileName, MAXRBUF, "%s/%s%s", frame->uploadDir.c_str(), prefix.c_str(), format);
 
         fp = fopen(imageFileName, "w");
         if (fp == nullptr)
@@ -2739,142 +3126,44 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
             return false;
         }
 
-        int n = 0;
-        for (int nr = 0; nr < targetChip->FitsB.bloblen; nr += n)
-            n = fwrite((static_cast<char *>(targetChip->FitsB.blob) + nr), 1, targetChip->FitsB.bloblen - nr, fp);
+        size_t n = 0;
+        for (size_t nr = 0; nr < frame->encodedSize; nr += n)
+        {
+            n = fwrite(static_cast<const char *>(frame->encoded) + nr, 1, frame->encodedSize - nr, fp);
+            if (n == 0)
+                break;
+        }
 
         fclose(fp);
 
-        // Save image file path
-        IUSaveText(&FileNameT[0], imageFileName);
-
+        // The file name is sent once the frame is done, see frameDone()
+        frame->savedTo = imageFileName;
         DEBUGF(Logger::DBG_SESSION, "Image saved to %s", imageFileName);
-        FileNameTP.s = IPS_OK;
-        IDSetText(&FileNameTP, nullptr);
     }
 
-    if (targetChip->SendCompressed)
+    if (frame->sendImage)
     {
-        if (!strcmp(targetChip->getImageExtension(), "fits"))
-        {
-            int  compressedBytes = 0;
-            char filename[MAXRBUF] = {0};
-            strncpy(filename, "/tmp/compressedfits.fits", MAXRBUF);
-
-            FILE * fp = fopen(filename, "w");
-            if (fp == nullptr)
-            {
-                LOGF_ERROR("Unable to save temporary image file: %s", strerror(errno));
-                return false;
-            }
-
-            int n = 0;
-            for (int nr = 0; nr < static_cast<int>(totalBytes); nr += n)
-                n = fwrite(static_cast<const uint8_t *>(fitsData) + nr, 1, totalBytes - nr, fp);
-            fclose(fp);
-
-            fpstate	fpvar;
-            std::vector<std::string> arguments = {"fpack", filename};
-            std::vector<char *> arglist;
-            for (const auto &arg : arguments)
-                arglist.push_back(const_cast<char *>(arg.data()));
-            arglist.push_back(nullptr);
-
-            int argc = arglist.size() - 1;
-            char ** argv = arglist.data();
-
-            // TODO: Check for errors
-            fp_init (&fpvar);
-            fp_get_param (argc, argv, &fpvar);
-            fp_preflight (argc, argv, FPACK, &fpvar);
-            fp_loop (argc, argv, FPACK, filename, fpvar);
-
-            // Remove temporary file from disk
-            remove(filename);
-
-            // Add .fz
-            strncat(filename, ".fz", 4);
-
-            struct stat st;
-            stat(filename, &st);
-            compressedBytes = st.st_size;
-
-            compressedData = new uint8_t[compressedBytes];
-
-            if (compressedData == nullptr)
-            {
-                LOG_ERROR("Ran out of memory compressing image.");
-                return false;
-            }
-
-            fp = fopen(filename, "r");
-            if (fp == nullptr)
-            {
-                LOGF_ERROR("Unable to open temporary image file: %s", strerror(errno));
-                delete [] compressedData;
-                return false;
-            }
+        // Sent from a copy of the chip's BLOB property, which is the loop thread's
+        IBLOB blob                = targetChip->FitsB;
+        IBLOBVectorProperty blobv = targetChip->FitsBP;
+
+        blob.blob    = const_cast<void *>(frame->output);
+        blob.bloblen = frame->outputSize;
+        // .fz is a FITS file of its own, .gz the original compressed
+        blob.size    = (frame->compress && frame->extension == "fits") ? frame->outputSize : frame->encodedSize;
+        strncpy(blob.format, frame->format, MAXINDIBLOBFMT);
+        blob.bvp = &blobv;
+        blobv.bp = &blob;
+        blobv.s  = IPS_OK;
 
-            n = 0;
-            for (int nr = 0; nr < compressedBytes; nr += n)
-                n = fread(compressedData + nr, 1, compressedBytes - nr, fp);
-            fclose(fp);
-
-            // Remove compressed temporary file from disk
-            remove(filename);
-
-            targetChip->FitsB.blob    = compressedData;
-            targetChip->FitsB.bloblen = compressedBytes;
-            totalBytes = compressedBytes;
-            snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s.fz", targetChip->getImageExtension());
-        }
-        else
-        {
-            uLong compressedBytes = sizeof(char) * totalBytes + totalBytes / 64 + 16 + 3;
-            compressedData  = new uint8_t[compressedBytes];
-
-            if (fitsData == nullptr || compressedData == nullptr)
-            {
-                if (compressedData)
-                    delete [] compressedData;
-                LOG_ERROR("Error: Ran out of memory compressing image");
-                return false;
-            }
-
-            int r = compress2(compressedData, &compressedBytes, (const Bytef *)fitsData, totalBytes, 9);
-            if (r != Z_OK)
-            {
-                /* this should NEVER happen */
-                LOG_ERROR("Error: Failed to compress image");
-                delete [] compressedData;
-                return false;
-            }
-
-            targetChip->FitsB.blob    = compressedData;
-            targetChip->FitsB.bloblen = compressedBytes;
-            snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s.z", targetChip->getImageExtension());
-        }
-    }
-    else
-    {
-        targetChip->FitsB.blob    = const_cast<void *>(fitsData);
-        targetChip->FitsB.bloblen = totalBytes;
-        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", targetChip->getImageExtension());
-    }
-
-    targetChip->FitsB.size = totalBytes;
-    targetChip->FitsBP.s   = IPS_OK;
-
-    if (sendImage)
-    {
 #ifdef HAVE_WEBSOCKET
         if (HasWebSocket() && WebSocketS[WEBSOCKET_ENABLED].s == ISS_ON)
         {
             auto start = std::chrono::high_resolution_clock::now();
 
             // Send format/size/..etc first later
-            wsServer.send_text(std::string(targetChip->FitsB.format));
-            wsServer.send_binary(targetChip->FitsB.blob, targetChip->FitsB.bloblen);
+            wsServer.send_text(std::string(blob.format));
+            wsServer.send_binary(blob.blob, blob.bloblen);
 
             auto end = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> diff = end - start;
@@ -2884,21 +3173,51 @@ bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBy
 #endif
         {
             auto start = std::chrono::high_resolution_clock::now();
-            IDSetBLOB(&targetChip->FitsBP, nullptr);
+            IDSetBLOB(&blobv, nullptr);
             auto end = std::chrono::high_resolution_clock::now();
             std::chrono::duration<double> diff = end - start;
             LOGF_DEBUG("BLOB transfer took %g seconds", diff.count());
         }
     }
 
-    if (compressedData)
-        delete [] compressedData;
-
     DEBUG(Logger::DBG_DEBUG, "Upload complete");
 
     return true;
 }
 
+void CCD::frameDone(void * p)
+{
+    std::unique_ptr<FrameDone> fd(static_cast<FrameDone *>(p));
+    std::lock_guard<std::mutex> lock(fd->handle->lock);
+    CCD * ccd       = fd->handle->ccd;
+    CCDChip * chip  = fd->chip;
+
+    if (ccd == nullptr)
+        return;
+
+    if (!fd->savedTo.empty())
+    {
+        IUSaveText(&ccd->FileNameT[0], fd->savedTo.c_str());
+        ccd->FileNameTP.s = IPS_OK;
+        IDSetText(&ccd->FileNameTP, nullptr);
+    }
+
+    if (!fd->format.empty())
+    {
+        strncpy(chip->FitsB.format, fd->format.c_str(), MAXINDIBLOBFMT);
+        chip->FitsB.size    = fd->size;
+        chip->FitsB.bloblen = fd->bloblen;
+        chip->FitsBP.s      = IPS_OK;
+    }
+
+    // The client may already be waiting on the next exposure, which keeps its Busy
+    if (chip->ExposureStarts == fd->exposureStarts)
+    {
+        chip->ImageExposureNP.s = fd->state;
+        IDSetNumber(&chip->ImageExposureNP, nullptr);
+    }
+}
+
 void CCD::SetCCDParams(int x, int y, int bpp, float xf, float yf)
 {
     PrimaryCCD.setResolution(x, y);
@@ -2932,10 +3251,13 @@ bool CCD::saveConfigItems(FILE * fp)
 #endif
 
     IUSaveConfigSwitch(fp, &PrimaryCCD.CompressSP);
+    IUSaveConfigNumber(fp, &PrimaryCCD.CompressLevelNP);
+    IUSaveConfigNumber(fp, &PipelineNP);
 
     if (HasGuideHead())
     {
         IUSaveConfigSwitch(fp, &GuideCCD.CompressSP);
+        IUSaveConfigNumber(fp, &GuideCCD.CompressLevelNP);
         IUSaveConfigNumber(fp, &GuideCCD.ImageBinNP);
     }
 
@@ -44,6 +44,9 @@
 #include <stdint.h>
 #include <mutex>
 #include <thread>
+#include <condition_variable>
+#include <deque>
+#include <vector>
 
 //JM 2019-01-17: Disabled until further notice
 //#define WITH_EXPOSURE_LOOPING
@@ -103,6 +106,11 @@ class StreamManager;
  * Similiary, before calling Streamer->newFrame, the buffer needs to be protected in a similiar fashion using
  * the same ccdBufferLock mutex.
  *
+ * Once an exposure is complete, the frame is copied out of the chip buffer into the image pipeline, and the
+ * lock released, before it is encoded, compressed and saved or sent by background threads. At most
+ * CCD_PIPELINE frames are in the pipeline at once; when it is full, the copy waits, and so does the next
+ * readout into the buffer.
+ *
  * \example CCD Simulator
  * \version 1.1
  * \author Jasem Mutlaq
@@ -239,6 +247,7 @@ class CCD : public DefaultDevice, GuiderInterface
                 if(Streamer.get() == nullptr)
                 {
                     Streamer.reset(new StreamManager(this));
+                    Streamer->setFramePool(framePool);
                     Streamer->initProperties();
                 }
                 return true;
@@ -555,6 +564,9 @@ class CCD : public DefaultDevice, GuiderInterface
         std::vector<std::string> FilterNames;
         int CurrentFilterSlot;
 
+        // Frame buffers for the chips, the image pipeline and the streamer
+        std::shared_ptr<FramePool> framePool;
+
         std::unique_ptr<StreamManager> Streamer;
 
         std::unique_ptr<DSP::Manager> DSP;
@@ -687,6 +699,32 @@ class CCD : public DefaultDevice, GuiderInterface
             FITS_OBJECT
         };
 
+        // Image pipeline depth, frames in flight
+        INumber PipelineN[1];
+        INumberVectorProperty PipelineNP;
+
+        // Image pipeline timing of the last frame
+        INumber PipelineTimingN[5];
+        INumberVectorProperty PipelineTimingNP;
+        enum
+        {
+            PIPELINE_QUEUED,
+            PIPELINE_WAIT,
+            PIPELINE_ENCODE_TIME,
+            PIPELINE_COMPRESS_TIME,
+            PIPELINE_DELIVER_TIME
+        };
+
+        // Frame buffer pool counters
+        INumber FramePoolN[3];
+        INumberVectorProperty FramePoolNP;
+        enum
+        {
+            FRAME_POOL_LEASES,
+            FRAME_POOL_ALLOCATIONS,
+            FRAME_POOL_SIZE
+        };
+
     private:
         uint32_t capability;
 
@@ -695,10 +733,47 @@ class CCD : public DefaultDevice, GuiderInterface
         ///////////////////////////////////////////////////////////////////////////////
         /// Utility Functions
         ///////////////////////////////////////////////////////////////////////////////
-        bool uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBytes, bool sendImage, bool saveImage);
         void getMinMax(double * min, double * max, CCDChip * targetChip);
         int getFileIndex(const char * dir, const char * prefix, const char * ext);
-        bool ExposureCompletePrivate(CCDChip * targetChip);
+        bool ExposureCompletePrivate(CCDChip * targetChip, uint32_t exposureStarts);
+
+        ///////////////////////////////////////////////////////////////////////////////
+        /// Image Pipeline
+        ///////////////////////////////////////////////////////////////////////////////
+        struct PipelineFrame;
+        enum
+        {
+            PIPELINE_ENCODE,
+            PIPELINE_COMPRESS,
+            PIPELINE_DELIVER,
+            PIPELINE_STAGES
+        };
+
+        bool submitFrame(CCDChip * targetChip, bool sendImage, bool saveImage, uint32_t exposureStarts);
+        void pipelineEntry(int stage);
+        bool encodeFrame(PipelineFrame * frame);
+        bool compressFrame(PipelineFrame * frame);
+        bool deliverFrame(PipelineFrame * frame);
+
+        // What a pipeline thread leaves for the loop thread to update once a frame is done
+        struct FrameDone;
+        static void frameDone(void * p);
+
+        // Posted FrameDone find the CCD through this, cleared when it goes
+        struct LoopHandle
+        {
+            std::mutex lock;
+            CCD * ccd { nullptr };
+        };
+        std::shared_ptr<LoopHandle> loopHandle;
+
+        std::mutex pipelineLock;
+        std::condition_variable pipelineCond;
+        std::deque<PipelineFrame *> pipelineQueue[PIPELINE_STAGES];
+        std::vector<PipelineFrame *> pipelinePool;
+        std::thread pipelineThreads[PIPELINE_STAGES];
+        int pipelineInFlight { 0 };
+        bool pipelineStop { false };
 
         // Threading for Websocket
 #ifdef HAVE_WEBSOCKET
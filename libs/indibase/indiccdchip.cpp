@@ -32,8 +32,17 @@ CCDChip::CCDChip()
 
 CCDChip::~CCDChip()
 {
-    delete [] RawFrame;
-    delete[] BinFrame;
+    if (RawFrame != RawLease.get())
+        delete [] RawFrame;
+    if (BinFrame != BinLease.get())
+        delete [] BinFrame;
+}
+
+const std::shared_ptr<FramePool> &CCDChip::getFramePool()
+{
+    if (Pool.get() == nullptr)
+        Pool = std::make_shared<FramePool>();
+    return Pool;
 }
 
 void CCDChip::setFrameType(CCD_FRAME type)
@@ -150,13 +159,17 @@ void CCDChip::setFrameBufferSize(uint32_t nbuf, bool allocMem)
     if (allocMem == false)
         return;
 
-    delete [] RawFrame;
-    RawFrame = new uint8_t[nbuf];
+    if (RawFrame != RawLease.get())
+        delete [] RawFrame;
+    RawLease = getFramePool()->lease(nbuf);
+    RawFrame = RawLease.get();
 
     if (BinFrame)
     {
-        delete [] BinFrame;
-        BinFrame = new uint8_t[nbuf];
+        if (BinFrame != BinLease.get())
+            delete [] BinFrame;
+        BinLease = getFramePool()->lease(nbuf);
+        BinFrame = BinLease.get();
     }
 }
 
@@ -234,7 +247,12 @@ void CCDChip::binFrame()
 
     // Jasem: Keep full frame shadow in memory to enhance performance and just swap frame pointers after operation is complete
     if (BinFrame == nullptr)
-        BinFrame = new uint8_t[RawFrameSize];
+    {
+        BinLease = getFramePool()->lease(RawFrameSize);
+        BinFrame = BinLease.get();
+        if (BinFrame == nullptr)
+            return;
+    }
 
     memset(BinFrame, 0, RawFrameSize);
 
@@ -302,6 +320,7 @@ void CCDChip::binFrame()
     RawFrame                 = BinFrame;
     // We just memset it next time we use it
     BinFrame = rawFramePointer;
+    RawLease.swap(BinLease);
 }
 
 }
@@ -19,9 +19,12 @@
 #pragma once
 
 #include "indiapi.h"
+#include "indiframepool.h"
 
 #include <sys/time.h>
 #include <stdint.h>
+#include <atomic>
+#include <memory>
 
 namespace INDI
 {
@@ -309,6 +312,22 @@ class CCDChip
          */
         void setFrameBufferSize(uint32_t nbuf, bool allocMem = true);
 
+        /**
+         * @brief setFramePool Set the pool the frame buffers are leased from.
+         * @param pool frame buffer pool, shared with the CCD and its streamer.
+         * @note Buffers already allocated stay leased from the previous pool until reallocated.
+         */
+        void setFramePool(const std::shared_ptr<FramePool> &pool)
+        {
+            Pool = pool;
+        }
+
+        /**
+         * @brief getFramePool Get the pool the frame buffers are leased from, made on first use.
+         * @return frame buffer pool.
+         */
+        const std::shared_ptr<FramePool> &getFramePool();
+
         /**
          * @brief setBPP Set depth of CCD chip.
          * @param bpp bits per pixel
@@ -416,8 +435,15 @@ class CCDChip
         uint32_t RawFrameSize {0};
         // BINNED Frame when software binning is used.
         uint8_t *BinFrame {nullptr};
+        // Pool the frames above are leased from, and their leases. A frame that is
+        // not its lease was set by the driver.
+        std::shared_ptr<FramePool> Pool;
+        FramePool::Buffer RawLease;
+        FramePool::Buffer BinLease;
         // Should we compress frame before transmission?
         bool SendCompressed {false};
+        // Exposures started by CCD, so a frame delivered late can tell a newer one is on
+        std::atomic<uint32_t> ExposureStarts {0};
         // Frame Type
         CCD_FRAME FrameType {LIGHT_FRAME};
         // Exposure duration in seconds.
@@ -473,6 +499,12 @@ class CCDChip
         ISwitchVectorProperty CompressSP;
         ISwitch CompressS[2];
 
+        /////////////////////////////////////////////////////////////////////////////////////////
+        /// Compression Level of non-FITS images
+        /////////////////////////////////////////////////////////////////////////////////////////
+        INumberVectorProperty CompressLevelNP;
+        INumber CompressLevelN[1];
+
         /////////////////////////////////////////////////////////////////////////////////////////
         /// FITS Binary Data
         /////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,160 @@
+/*
+    Frame buffer pool
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "indiframepool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sys/mman.h>
+
+namespace INDI
+{
+
+namespace
+{
+
+const size_t SMALL_SIZE  = 64 * 1024;
+const size_t SMALL_ALIGN = 64;
+
+uint8_t *allocate(size_t capacity)
+{
+    size_t alignment = capacity >= FramePool::HUGE_PAGE_SIZE ? FramePool::HUGE_PAGE_SIZE : SMALL_ALIGN;
+    void *buffer     = nullptr;
+
+    if (posix_memalign(&buffer, alignment, capacity) != 0)
+        return nullptr;
+
+#ifdef MADV_HUGEPAGE
+    if (alignment == FramePool::HUGE_PAGE_SIZE)
+        madvise(buffer, capacity, MADV_HUGEPAGE);
+#endif
+
+    return static_cast<uint8_t *>(buffer);
+}
+
+}
+
+void FramePool::Release::operator()(uint8_t *buffer) const
+{
+    if (buffer != nullptr)
+        pool->release(buffer, capacity);
+}
+
+FramePool::~FramePool()
+{
+    // Leases hold the pool, so none are left by now
+    trim();
+}
+
+size_t FramePool::sizeClass(size_t size)
+{
+    if (size <= SMALL_SIZE)
+        return (std::max<size_t>(size, 1) + SMALL_ALIGN - 1) / SMALL_ALIGN * SMALL_ALIGN;
+
+    // a quarter of the largest power of two below size
+    size_t step = SMALL_SIZE / 4;
+    while (step * 8 <= size)
+        step *= 2;
+
+    size_t capacity = (size + step - 1) / step * step;
+    if (capacity >= HUGE_PAGE_SIZE)
+        capacity = (capacity + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    return capacity;
+}
+
+FramePool::Buffer FramePool::lease(size_t size)
+{
+    size_t capacity = sizeClass(size);
+    uint8_t *buffer = nullptr;
+    std::vector<uint8_t *> unused;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        uint64_t now = ++counters.leases;
+
+        SizeClass &sc = classes[capacity];
+        sc.lastLease  = now;
+        if (!sc.idle.empty())
+        {
+            buffer = sc.idle.back();
+            sc.idle.pop_back();
+            counters.idleBytes -= capacity;
+        }
+
+        // Let go of the sizes no longer in use, i.e. after a change of frame or binning
+        for (auto it = classes.begin(); it != classes.end();)
+        {
+            if (now - it->second.lastLease > IDLE_LEASES && !it->second.idle.empty())
+            {
+                counters.frees     += it->second.idle.size();
+                counters.bytes     -= it->first * it->second.idle.size();
+                counters.idleBytes -= it->first * it->second.idle.size();
+                unused.insert(unused.end(), it->second.idle.begin(), it->second.idle.end());
+                it = classes.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    for (auto unusedBuffer : unused)
+        free(unusedBuffer);
+
+    if (buffer == nullptr)
+    {
+        buffer = allocate(capacity);
+        if (buffer == nullptr)
+            return Buffer(nullptr, Release(shared_from_this(), 0));
+
+        std::lock_guard<std::mutex> guard(lock);
+        counters.allocations++;
+        counters.bytes += capacity;
+    }
+
+    return Buffer(buffer, Release(shared_from_this(), capacity));
+}
+
+void FramePool::release(uint8_t *buffer, size_t capacity)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    classes[capacity].idle.push_back(buffer);
+    counters.idleBytes += capacity;
+}
+
+FramePool::Stats FramePool::stats() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return counters;
+}
+
+void FramePool::trim()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &sc : classes)
+    {
+        for (auto buffer : sc.second.idle)
+            free(buffer);
+        counters.frees     += sc.second.idle.size();
+        counters.bytes     -= sc.first * sc.second.idle.size();
+        counters.idleBytes -= sc.first * sc.second.idle.size();
+        sc.second.idle.clear();
+    }
+}
+
+}
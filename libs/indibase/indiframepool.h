@@ -0,0 +1,120 @@
+/*
+    Frame buffer pool
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace INDI
+{
+
+/**
+ * @brief Pool of reusable frame sized buffers.
+ *
+ * Buffers are leased by size and go back to the pool, not the heap, when the
+ * lease is dropped. Sizes are rounded up to a size class, a quarter of a power
+ * of two apart, so frames of about the same size share buffers. Buffers of
+ * HUGE_PAGE_SIZE or more are aligned to it so the kernel can back them with
+ * huge pages.
+ *
+ * Buffers of a size class that has not been leased for a while are freed.
+ *
+ * A pool is shared: each lease holds a reference to it, so leases may outlive
+ * the owner that handed them out. Make pools with std::make_shared(). All
+ * methods are thread safe.
+ */
+class FramePool : public std::enable_shared_from_this<FramePool>
+{
+    public:
+        /** @brief Alignment, and rounding, of large buffers */
+        static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+        /** @brief Size classes not leased in this many leases have their idle buffers freed */
+        static constexpr uint64_t IDLE_LEASES = 64;
+
+        /** @brief Gives a leased buffer back to its pool */
+        struct Release
+        {
+            Release() = default;
+            Release(const std::shared_ptr<FramePool> &owner, size_t size) : pool(owner), capacity(size) {}
+
+            std::shared_ptr<FramePool> pool;
+            size_t capacity {0};
+            void operator()(uint8_t *buffer) const;
+        };
+
+        /** @brief A leased buffer, returned to the pool when reset or destroyed */
+        typedef std::unique_ptr<uint8_t[], Release> Buffer;
+
+        struct Stats
+        {
+            /// Buffers leased
+            uint64_t leases {0};
+            /// Leases that had to allocate a new buffer
+            uint64_t allocations {0};
+            /// Buffers freed back to the heap
+            uint64_t frees {0};
+            /// Bytes held, leased or idle
+            size_t bytes {0};
+            /// Bytes idle in the pool
+            size_t idleBytes {0};
+        };
+
+        FramePool() = default;
+        ~FramePool();
+
+        FramePool(const FramePool &) = delete;
+        FramePool &operator=(const FramePool &) = delete;
+
+        /**
+         * @brief Lease a buffer.
+         * @param size bytes needed. The buffer may be larger, see Buffer::get_deleter().capacity.
+         * @return the buffer, or an empty one if there is no memory for it. Its contents are undefined.
+         */
+        Buffer lease(size_t size);
+
+        /** @return counters since the pool was made */
+        Stats stats() const;
+
+        /** @brief Free all idle buffers */
+        void trim();
+
+        /** @return bytes a lease of size bytes takes */
+        static size_t sizeClass(size_t size);
+
+    private:
+        void release(uint8_t *buffer, size_t capacity);
+
+        struct SizeClass
+        {
+            std::vector<uint8_t *> idle;
+            uint64_t lastLease {0};
+        };
+
+        mutable std::mutex lock;
+        std::map<size_t, SizeClass> classes;
+        Stats counters;
+};
+
+}
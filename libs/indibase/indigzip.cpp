@@ -0,0 +1,354 @@
+/*
+    Chunked gzip for BLOBs
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#include "indigzip.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace INDI
+{
+namespace GZip
+{
+
+namespace
+{
+
+// Member header: gzip magic, deflate, FEXTRA, no mtime, unknown OS, XLEN 8,
+// then subfield 'IC' of 4 bytes holding the member length, little endian.
+const uint8_t HEADER[16] = { 0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 255, 8, 0, 'I', 'C', 4, 0 };
+const size_t HEADER_SIZE  = sizeof(HEADER) + 4;
+const size_t TRAILER_SIZE = 8; // CRC32 and ISIZE
+
+struct Chunk
+{
+    const uint8_t *in {nullptr};
+    size_t inSize {0};
+    uint8_t *out {nullptr};
+    size_t outSize {0};
+    uint32_t crc {0};
+    int status {Z_OK};
+};
+
+void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// run job(i) for each i in [0, n) on up to threads threads, this one included
+template <typename Job>
+void runParallel(size_t n, int threads, Job job)
+{
+    std::atomic<size_t> next {0};
+    std::vector<std::thread> pool;
+
+    auto worker = [&]()
+    {
+        for (size_t i; (i = next++) < n;)
+            job(i);
+    };
+
+    if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (size_t t = 1; t < std::min<size_t>(threads, n); t++)
+    {
+        try
+        {
+            pool.emplace_back(worker);
+        }
+        catch (const std::system_error &)
+        {
+            // make do with the threads we have
+            break;
+        }
+    }
+
+    worker();
+    for (auto &thread : pool)
+        thread.join();
+}
+
+// deflate c.in into a new complete member at c.out
+int deflateChunk(Chunk &c, int level)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+
+    int r = deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    if (r != Z_OK)
+        return r;
+
+    size_t bound = HEADER_SIZE + deflateBound(&zs, c.inSize) + TRAILER_SIZE;
+    c.out = static_cast<uint8_t *>(malloc(bound));
+    if (c.out == nullptr)
+    {
+        deflateEnd(&zs);
+        return Z_MEM_ERROR;
+    }
+
+    zs.next_in   = const_cast<Bytef *>(c.in);
+    zs.avail_in  = c.inSize;
+    zs.next_out  = c.out + HEADER_SIZE;
+    zs.avail_out = bound - HEADER_SIZE - TRAILER_SIZE;
+
+    r = deflate(&zs, Z_FINISH);
+    size_t deflated = zs.total_out;
+    deflateEnd(&zs);
+    if (r != Z_STREAM_END)
+        return r == Z_OK ? Z_BUF_ERROR : r;
+
+    c.outSize = HEADER_SIZE + deflated + TRAILER_SIZE;
+    memcpy(c.out, HEADER, sizeof(HEADER));
+    put32(c.out + sizeof(HEADER), c.outSize);
+    put32(c.out + HEADER_SIZE + deflated, crc32(0L, c.in, c.inSize));
+    put32(c.out + HEADER_SIZE + deflated + 4, c.inSize);
+    return Z_OK;
+}
+
+// inflate c.in into exactly c.outSize bytes at c.out
+int inflateChunk(Chunk &c)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+
+    int r = inflateInit2(&zs, -MAX_WBITS);
+    if (r != Z_OK)
+        return r;
+
+    zs.next_in   = const_cast<Bytef *>(c.in);
+    zs.avail_in  = c.inSize;
+    zs.next_out  = c.out;
+    zs.avail_out = c.outSize;
+
+    r = inflate(&zs, Z_FINISH);
+    bool complete = zs.avail_in == 0 && zs.avail_out == 0;
+    inflateEnd(&zs);
+    if (r != Z_STREAM_END || !complete || crc32(0L, c.out, c.outSize) != c.crc)
+        return Z_DATA_ERROR;
+    return Z_OK;
+}
+
+// split data into the members written by compress().
+// false if it is anything else, or would uncompress to more than maxSize.
+bool findChunks(const uint8_t *data, size_t size, size_t maxSize, std::vector<Chunk> &chunks, size_t *total)
+{
+    size_t off = 0;
+
+    *total = 0;
+    while (off < size)
+    {
+        const uint8_t *p = data + off;
+
+        if (size - off < HEADER_SIZE + TRAILER_SIZE || memcmp(p, HEADER, sizeof(HEADER)))
+            return false;
+
+        size_t len = get32(p + sizeof(HEADER));
+        if (len < HEADER_SIZE + TRAILER_SIZE || len > size - off)
+            return false;
+
+        Chunk c;
+        c.in      = p + HEADER_SIZE;
+        c.inSize  = len - HEADER_SIZE - TRAILER_SIZE;
+        c.crc     = get32(p + len - 8);
+        c.outSize = get32(p + len - 4);
+        if (c.outSize > CHUNK_SIZE || (*total += c.outSize) > maxSize)
+            return false;
+
+        chunks.push_back(c);
+        off += len;
+    }
+
+    return !chunks.empty();
+}
+
+// inflate any gzip data, one member after another
+int inflateAll(const uint8_t *data, size_t size, void **out, size_t *outSize, size_t maxSize)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+
+    int r = inflateInit2(&zs, MAX_WBITS + 16);
+    if (r != Z_OK)
+        return r;
+
+    size_t capacity = std::min(maxSize, std::max<size_t>(4 * size, 65536));
+    uint8_t *buffer = static_cast<uint8_t *>(malloc(std::max<size_t>(capacity, 1)));
+    size_t used     = 0;
+    bool nomem      = buffer == nullptr;
+
+    zs.next_in  = const_cast<Bytef *>(data);
+    zs.avail_in = size;
+
+    while (!nomem)
+    {
+        if (used == capacity)
+        {
+            if (capacity == maxSize)
+            {
+                r = Z_BUF_ERROR;
+                break;
+            }
+            capacity        = std::min(maxSize, 2 * capacity);
+            uint8_t *larger = static_cast<uint8_t *>(realloc(buffer, capacity));
+            if (larger == nullptr)
+            {
+                nomem = true;
+                break;
+            }
+            buffer = larger;
+        }
+
+        zs.next_out  = buffer + used;
+        zs.avail_out = capacity - used;
+        r = inflate(&zs, Z_NO_FLUSH);
+        used = capacity - zs.avail_out;
+
+        if (r == Z_STREAM_END)
+        {
+            // next member, if any
+            if (zs.avail_in == 0)
+                break;
+            r = inflateReset(&zs);
+        }
+        else if (r == Z_BUF_ERROR && zs.avail_in == 0)
+            r = Z_DATA_ERROR; // truncated
+        else if (r == Z_BUF_ERROR)
+            r = Z_OK; // just out of room
+
+        if (r != Z_OK)
+            break;
+    }
+
+    inflateEnd(&zs);
+
+    if (nomem)
+        r = Z_MEM_ERROR;
+    if (r != Z_STREAM_END)
+    {
+        free(buffer);
+        return r;
+    }
+
+    *out     = buffer;
+    *outSize = used;
+    return Z_OK;
+}
+
+}
+
+int compress(const void *data, size_t size, void **out, size_t *outSize, int level, int threads)
+{
+    const uint8_t *in = static_cast<const uint8_t *>(data);
+    std::vector<Chunk> chunks(std::max<size_t>(1, (size + CHUNK_SIZE - 1) / CHUNK_SIZE));
+
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        chunks[i].in     = in + i * CHUNK_SIZE;
+        chunks[i].inSize = std::min(CHUNK_SIZE, size - i * CHUNK_SIZE);
+    }
+
+    runParallel(chunks.size(), threads, [&](size_t i)
+    {
+        chunks[i].status = deflateChunk(chunks[i], level);
+    });
+
+    int status   = Z_OK;
+    size_t total = 0;
+    for (auto &c : chunks)
+    {
+        if (status == Z_OK)
+            status = c.status;
+        total += c.outSize;
+    }
+
+    uint8_t *buffer = nullptr;
+    if (status == Z_OK && (buffer = static_cast<uint8_t *>(malloc(total))) == nullptr)
+        status = Z_MEM_ERROR;
+
+    size_t used = 0;
+    for (auto &c : chunks)
+    {
+        if (buffer)
+            memcpy(buffer + used, c.out, c.outSize);
+        used += c.outSize;
+        free(c.out);
+    }
+
+    if (status != Z_OK)
+        return status;
+
+    *out     = buffer;
+    *outSize = total;
+    return Z_OK;
+}
+
+int uncompress(const void *data, size_t size, void **out, size_t *outSize, size_t maxSize, int threads)
+{
+    const uint8_t *in = static_cast<const uint8_t *>(data);
+    std::vector<Chunk> chunks;
+    size_t total;
+
+    if (!findChunks(in, size, maxSize, chunks, &total))
+        return inflateAll(in, size, out, outSize, maxSize);
+
+    uint8_t *buffer = static_cast<uint8_t *>(malloc(std::max<size_t>(total, 1)));
+    if (buffer == nullptr)
+        return Z_MEM_ERROR;
+
+    for (size_t i = 0, used = 0; i < chunks.size(); used += chunks[i++].outSize)
+        chunks[i].out = buffer + used;
+
+    runParallel(chunks.size(), threads, [&](size_t i)
+    {
+        chunks[i].status = inflateChunk(chunks[i]);
+    });
+
+    for (auto &c : chunks)
+    {
+        if (c.status != Z_OK)
+        {
+            free(buffer);
+            return c.status;
+        }
+    }
+
+    *out     = buffer;
+    *outSize = total;
+    return Z_OK;
+}
+
+}
+}
@@ -0,0 +1,74 @@
+/*
+    Chunked gzip for BLOBs
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#pragma once
+
+#include <cstddef>
+
+namespace INDI
+{
+
+/**
+ * @brief Parallel gzip of BLOB data.
+ *
+ * The data is cut into chunks that are deflated independently, pigz style, each
+ * into a gzip member of its own. Every member carries its total length in an
+ * 'IC' extra subfield so a reader can find them all without inflating, and
+ * inflate them in parallel too. The concatenation is still a plain gzip file,
+ * so anything that reads .gz, including gunzip and CFITSIO, can read it.
+ *
+ * BLOBs compressed this way have FORMAT_SUFFIX appended to their format. It is
+ * deliberately not ".z", which older clients zlib uncompress in one go.
+ */
+namespace GZip
+{
+
+/** @brief Suffix appended to the format of a BLOB compressed by compress() */
+static constexpr const char *FORMAT_SUFFIX = ".gz";
+
+/** @brief Uncompressed bytes per gzip member */
+static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+
+/**
+ * @brief Compress data into a new buffer.
+ * @param data the data to compress.
+ * @param size bytes of data.
+ * @param out set to a malloc()ed buffer of the gzip data, to be free()d by the caller.
+ * @param outSize set to the bytes in out.
+ * @param level zlib compression level, 1 to 9.
+ * @param threads threads to use, 0 for one per core.
+ * @return Z_OK or a zlib error code.
+ */
+int compress(const void *data, size_t size, void **out, size_t *outSize, int level, int threads = 0);
+
+/**
+ * @brief Uncompress gzip data into a new buffer.
+ * Data from compress() is inflated in parallel, any other gzip data one member after another.
+ * @param data the gzip data.
+ * @param size bytes of data.
+ * @param out set to a malloc()ed buffer of the uncompressed data, to be free()d by the caller.
+ * @param outSize set to the bytes in out.
+ * @param maxSize fail with Z_BUF_ERROR rather than uncompress more than this.
+ * @param threads threads to use, 0 for one per core.
+ * @return Z_OK or a zlib error code.
+ */
+int uncompress(const void *data, size_t size, void **out, size_t *outSize, size_t maxSize, int threads = 0);
+
+}
+}
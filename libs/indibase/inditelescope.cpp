@@ -695,7 +695,7 @@ void Telescope::NewRaDec(double ra, double dec)
         EqN[AXIS_RA].value = ra;
         EqN[AXIS_DE].value = dec;
         lastEqState        = EqNP.s;
-        IDSetNumber(&EqNP, nullptr);
+        updateNumber(&EqNP);
     }
 }
 
@@ -45,29 +45,64 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "lilxml.h"
 
+typedef struct XMLArena_ XMLArena;
+
 /* used to efficiently manage growing malloced string space */
 typedef struct
 {
-    char *s; /* malloced memory for string */
-    int sl;  /* string length, sans trailing \0 */
-    int sm;  /* total malloced bytes */
+    char *s;     /* malloced memory for string */
+    int sl;      /* string length, sans trailing \0 */
+    int sm;      /* total malloced bytes */
+    XMLArena *a; /* arena s comes from, else NULL */
 } String;
 #define MINMEM 64 /* starting string length */
 
+/* one block of arena memory, the space it gives out follows */
+typedef struct XMLChunk_
+{
+    struct XMLChunk_ *next; /* older chunk */
+    size_t size;            /* bytes after this header */
+    size_t used;            /* bytes given out */
+    size_t last;            /* where the last one given out starts, it may grow in place */
+} XMLChunk;
+
+/* all the memory of one tree parsed with setXMLArena() on, freed at once */
+struct XMLArena_
+{
+    XMLChunk *chunks; /* newest first, space is taken from the first one */
+    XMLChunk *big;    /* one chunk for each block of ARENABIG or more */
+    XMLEle *root;     /* tree whose deletion frees us */
+};
+#define ARENACHUNK  4096  /* first chunk, with header */
+#define ARENAMAXCHK 65536 /* chunks double up to this, with header */
+#define ARENABIG    8192  /* blocks this large get their own chunk */
+#define ARENAALIGN  16    /* all blocks are aligned to this */
+
 static int oneXMLchar(LilXML *lp, int c, char ynot[]);
 static void initParser(LilXML *lp);
 static void pushXMLEle(LilXML *lp);
 static void popXMLEle(LilXML *lp);
 static void resetEndTag(LilXML *lp);
 static XMLAtt *growAtt(XMLEle *e);
-static XMLEle *growEle(XMLEle *pe);
+static XMLEle *growEle(XMLEle *pe, int arena);
 static void freeAtt(XMLAtt *a);
 static int isTokenChar(int start, int c);
+static int bulkXMLchars(LilXML *lp, const char *buf, int size);
+static void addPCData(LilXML *lp, const char *data, int len);
+static void startContent(LilXML *lp);
+static int addRawData(LilXML *lp, const char *data, int len);
 static void growString(String *sp, int c);
 static void appendString(String *sp, const char *str);
+static void appendStringN(String *sp, const char *str, int len);
 static void freeString(String *sp);
 static void newString(String *sp);
 static void *moremem(void *old, int n);
+static void *strmem(String *sp, int n);
+static void *elemem(XMLEle *ep, void *old, int oldn, int n);
+static XMLArena *newArena(void);
+static void *arenaMore(XMLArena *ap, void *old, size_t oldn, size_t n);
+static void freeArena(XMLArena *ap);
+static void freeForeign(XMLEle *ep);
 
 typedef enum {
     LOOK4START = 0, /* looking for first element start */
@@ -84,7 +119,8 @@ typedef enum {
     ENTINCON,       /* in entity in pcdata */
     SAWLTINCON,     /* saw < in content */
     LOOK4CLOSETAG,  /* looking for closing tag after < */
-    INCLOSETAG      /* reading closing tag */
+    INCLOSETAG,     /* reading closing tag */
+    INRAW           /* taking rawlen bytes of content as is */
 } State;            /* parsing states */
 
 /* maintain state while parsing */
@@ -98,7 +134,15 @@ struct LilXML_
     int delim;     /* attribute value delimiter */
     int lastc;     /* last char (just used wiht skipping)*/
     int skipping;  /* in comment or declaration */
-    int inblob;    /* in oneBLOB element */
+    int rawleft;   /* bytes of content still to take as is in INRAW */
+
+    /* survive initParser() */
+    int arena;              /* 1 to parse each tree into its own arena */
+    char *rawtag;           /* malloced tag whose rawlen is honored, if any */
+    char *sinktag;          /* malloced tag whose pcdata goes to sink, if any */
+    XMLPCDataSink *sink;    /* called with pcdata of sinktag elements */
+    void *sinkud;           /* passed to sink */
+    String sinkws;          /* trailing whitespace held back from sink */
 };
 
 /* internal representation of a (possibly nested) XML element */
@@ -114,6 +158,7 @@ struct xml_ele_
     int eit;           /* used to iterate over el[] */
     String pcdata;     /* character data in this element */
     int pcdata_hasent; /* 1 if pcdata contains an entity char*/
+    XMLArena *arena;   /* arena of the tree we are in, else NULL */
 };
 
 /* internal representation of an attribute */
@@ -156,11 +201,67 @@ LilXML *newLilXML()
 /* discard */
 void delLilXML(LilXML *lp)
 {
+    /* any tree still being built, from its root */
+    while (lp->ce && lp->ce->pe)
+        lp->ce = lp->ce->pe;
     delXMLEle(lp->ce);
     freeString(&lp->endtag);
+    freeString(&lp->sinkws);
+    if (lp->sinktag)
+        (*myfree)(lp->sinktag);
+    if (lp->rawtag)
+        (*myfree)(lp->rawtag);
     (*myfree)(lp);
 }
 
+/* take the content of each element with the given tag and a rawlen attribute
+ * as exactly that many bytes as is. no other element is, nor any at all until
+ * this is called. pass NULL to stop.
+ */
+void setXMLRawTag(LilXML *lp, const char *tag)
+{
+    if (lp->rawtag)
+        (*myfree)(lp->rawtag);
+    lp->rawtag = NULL;
+
+    if (tag)
+    {
+        lp->rawtag = (char *)moremem(NULL, strlen(tag) + 1);
+        strcpy(lp->rawtag, tag);
+    }
+}
+
+/* arrange for the pcdata of each element with the given tag to be passed to
+ * sink as it is parsed instead of being collected in the element, which is
+ * then left with empty pcdata. sink sees the same bytes pcdataXMLEle() would
+ * have returned, possibly in many calls, after one with len 0 as the start
+ * tag ends. pass NULL sink to stop.
+ */
+void setXMLPCDataSink(LilXML *lp, const char *tag, XMLPCDataSink *sink, void *userdata)
+{
+    if (lp->sinktag)
+        (*myfree)(lp->sinktag);
+    lp->sinktag = NULL;
+    lp->sink    = NULL;
+    lp->sinkud  = NULL;
+
+    if (sink && tag)
+    {
+        lp->sinktag = (char *)moremem(NULL, strlen(tag) + 1);
+        strcpy(lp->sinktag, tag);
+        lp->sink   = sink;
+        lp->sinkud = userdata;
+    }
+}
+
+/* parse each tree into its own arena if on: all its memory comes from a few
+ * chunks, freed at once when the root is deleted.
+ */
+void setXMLArena(LilXML *lp, int on)
+{
+    lp->arena = on;
+}
+
 /* delete ep and all its children and remove from parent's list if known */
 void delXMLEle(XMLEle *ep)
 {
@@ -170,6 +271,29 @@ void delXMLEle(XMLEle *ep)
     if (!ep)
         return;
 
+    /* arena parts are freed with the root, all at once */
+    if (ep->arena)
+    {
+        XMLArena *ap = ep->arena;
+
+        freeForeign(ep);
+        if (ep->pe)
+        {
+            XMLEle *pe = ep->pe;
+            for (i = 0; i < pe->nel; i++)
+            {
+                if (pe->el[i] == ep)
+                {
+                    memmove(&pe->el[i], &pe->el[i + 1], (--pe->nel - i) * sizeof(XMLEle *));
+                    break;
+                }
+            }
+        }
+        if (ap->root == ep)
+            freeArena(ap);
+        return;
+    }
+
     /* delete all parts of ep */
     freeString(&ep->tag);
     freeString(&ep->pcdata);
@@ -209,91 +333,37 @@ void delXMLEle(XMLEle *ep)
     (*myfree)(ep);
 }
 
-//#define WITH_MEMCHR
 XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
 {
     unsigned int nnodes     = 1;
-    XMLEle **nodes = (XMLEle **)malloc(nnodes * sizeof *nodes);
+    XMLEle **nodes = (XMLEle **)moremem(NULL, nnodes * sizeof *nodes);
     *nodes         = NULL;
     char *curr     = buf;
     int s;
     ynot[0] = '\0';
 
-    if (lp->inblob)
+    while (curr - buf < size)
     {
-#ifdef WITH_ENCLEN
-        if (size < lp->ce->pcdata.sm - lp->ce->pcdata.sl)
-        {
-            memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
-            lp->ce->pcdata.sl += size;
-            return nodes;
-        }
-        else
-            lp->inblob = 0;
-#endif
-#ifdef WITH_MEMCHR
-        char *ltpos = memchr(buf, '<', size);
-        if (!ltpos)
+        char newc = *curr;
+
+        /* raw content is just counted off, it may hold anything */
+        if (lp->cs == INRAW)
         {
-            lp->ce->pcdata.s = (char *)moremem(lp->ce->pcdata.s, lp->ce->pcdata.sm + size);
-            lp->ce->pcdata.sm += size;
-            memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
-            lp->ce->pcdata.sl += size;
-            return nodes;
+            curr += addRawData(lp, curr, size - (curr - buf));
+            continue;
         }
-        else
-            lp->inblob = 0;
-#endif
-    }
-    else
-    {
-        if (lp->ce)
+
+        /* take runs of plain content or attribute value all at once */
+        if (!lp->skipping && lp->lastc != '<' && (lp->cs == INCON || lp->cs == INATTRV))
         {
-            char *ctag = tagXMLEle(lp->ce);
-            if (ctag && !(strcmp(ctag, "oneBLOB")) && (lp->cs == INCON))
+            int n = bulkXMLchars(lp, curr, size - (curr - buf));
+            if (n > 0)
             {
-#ifdef WITH_ENCLEN
-                XMLAtt *blenatt = findXMLAtt(lp->ce, "enclen");
-                if (blenatt)
-                {
-                    int blen;
-                    sscanf(valuXMLAtt(blenatt), "%d", &blen);
-
-                    // Add room for those '\n' on every 72 character line + extra half-full line.
-                    blen += (blen / 72) + 1;
-
-                    lp->ce->pcdata.s  = (char *)moremem(lp->ce->pcdata.s, blen);
-                    lp->ce->pcdata.sm = blen; // always set sm
-
-                    if (size <= blen - lp->ce->pcdata.sl)
-                    {
-                        memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
-                        lp->ce->pcdata.sl += size;
-                        lp->inblob = 1;
-                        return nodes;
-                    }
-                }
-#endif
-#ifdef WITH_MEMCHR
-                char *ltpos = memchr(buf, '<', size);
-                if (!ltpos)
-                {
-                    lp->ce->pcdata.s = (char *)moremem(lp->ce->pcdata.s, lp->ce->pcdata.sm + size);
-                    lp->ce->pcdata.sm += size;
-                    memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
-                    lp->ce->pcdata.sl += size;
-                    lp->inblob = 1;
-                    return nodes;
-                }
-                else
-                    lp->inblob = 0;
-#endif
+                curr += n;
+                continue;
             }
         }
-    }
-    while (curr - buf < size)
-    {
-        char newc = *curr;
+
         /* EOF? */
         if (newc == 0)
         {
@@ -361,7 +431,7 @@ XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
          * N.B. up to caller to call delXMLEle with what we return.
          */
         nodes[nnodes - 1] = lp->ce;
-        nodes             = (XMLEle **)realloc(nodes, (nnodes + 1) * sizeof *nodes);
+        nodes             = (XMLEle **)moremem(nodes, (nnodes + 1) * sizeof *nodes);
         nodes[nnodes]     = NULL;
         nnodes += 1;
         lp->ce = NULL;
@@ -388,6 +458,14 @@ XMLEle *readXMLEle(LilXML *lp, int newc, char ynot[])
     /* start optimistic */
     ynot[0] = '\0';
 
+    /* raw content is just counted off, it may hold anything */
+    if (lp->cs == INRAW)
+    {
+        char c = (char)newc;
+        addRawData(lp, &c, 1);
+        return (NULL);
+    }
+
     /* EOF? */
     if (newc == 0)
     {
@@ -638,7 +716,7 @@ XMLEle *readXMLFile(FILE *fp, LilXML *lp, char ynot[])
  */
 XMLEle *addXMLEle(XMLEle *parent, const char *tag)
 {
-    XMLEle *ep = growEle(parent);
+    XMLEle *ep = growEle(parent, 0);
     appendString(&ep->tag, tag);
     return (ep);
 }
@@ -648,7 +726,7 @@ XMLEle *addXMLEle(XMLEle *parent, const char *tag)
  */
 void appXMLEle(XMLEle *ep, XMLEle *newep)
 {
-    ep->el            = (XMLEle **)moremem(ep->el, (ep->nel + 1) * sizeof(XMLEle *));
+    ep->el = (XMLEle **)elemem(ep, ep->el, ep->nel * sizeof(XMLEle *), (ep->nel + 1) * sizeof(XMLEle *));
     ep->el[ep->nel++] = newep;
 }
 
@@ -660,6 +738,14 @@ void editXMLEle(XMLEle *ep, const char *pcdata)
     ep->pcdata_hasent = (strpbrk(pcdata, entities) != NULL);
 }
 
+/* set the pcdata of the given element to len bytes as is, like raw content */
+void editXMLEleRaw(XMLEle *ep, const char *pcdata, int len)
+{
+    freeString(&ep->pcdata);
+    appendStringN(&ep->pcdata, pcdata, len);
+    ep->pcdata_hasent = 0;
+}
+
 /* add an attribute to the given XML element */
 XMLAtt *addXMLAtt(XMLEle *ep, const char *name, const char *valu)
 {
@@ -855,7 +941,7 @@ char *entityXML(char *s)
         /* using s, so free any alloced memory from last time */
         if (malbuf)
         {
-            free(malbuf);
+            (*myfree)(malbuf);
             malbuf = NULL;
         }
         return s;
@@ -930,7 +1016,7 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
             if (isTokenChar(0, c))
                 growString(&lp->ce->tag, c);
             else if (c == '>')
-                lp->cs = LOOK4CON;
+                startContent(lp);
             else if (c == '/')
                 lp->cs = SAWSLASH;
             else
@@ -939,7 +1025,7 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
 
         case LOOK4ATTRN: /* looking for attr name, > or / */
             if (c == '>')
-                lp->cs = LOOK4CON;
+                startContent(lp);
             else if (c == '/')
                 lp->cs = SAWSLASH;
             else if (isTokenChar(1, c))
@@ -1029,7 +1115,8 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
                 lp->cs = SAWLTINCON;
             else if (!isspace(c))
             {
-                growString(&lp->ce->pcdata, c);
+                char cc = (char)c;
+                addPCData(lp, &cc, 1);
                 lp->cs = INCON;
             }
             break;
@@ -1046,11 +1133,13 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
                 /* chomp trailing whitespace */
                 while (lp->ce->pcdata.sl > 0 && isspace(lp->ce->pcdata.s[lp->ce->pcdata.sl - 1]))
                     lp->ce->pcdata.s[--(lp->ce->pcdata.sl)] = '\0';
+                freeString(&lp->sinkws);
                 lp->cs = SAWLTINCON;
             }
             else
             {
-                growString(&lp->ce->pcdata, c);
+                char cc = (char)c;
+                addPCData(lp, &cc, 1);
             }
             break;
 
@@ -1060,10 +1149,13 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
                 /* if find a recognized esc seq, add equiv char else raw seq */
                 growString(&lp->entity, c);
                 if (decodeEntity(lp->entity.s, &c))
-                    growString(&lp->ce->pcdata, c);
+                {
+                    char cc = (char)c;
+                    addPCData(lp, &cc, 1);
+                }
                 else
                 {
-                    appendString(&lp->ce->pcdata, lp->entity.s);
+                    addPCData(lp, lp->entity.s, lp->entity.sl);
                     //lp->ce->pcdata_hasent = 1;
                 }
                 // JM 2018-09-26: Even if decoded, we always set
@@ -1133,20 +1225,157 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
                 return (-1);
             }
             break;
+
+        case INRAW: /* raw content, normally taken before we get here */
+        {
+            char cc = (char)c;
+            addRawData(lp, &cc, 1);
+            break;
+        }
     }
 
     return (0);
 }
 
-/* set up for a fresh start again */
+/* set up for a fresh start again, keeping any sink and raw tag */
 static void initParser(LilXML *lp)
 {
+    char *rawtag        = lp->rawtag;
+    char *sinktag       = lp->sinktag;
+    XMLPCDataSink *sink = lp->sink;
+    void *sinkud        = lp->sinkud;
+    int arena           = lp->arena;
+
+    /* any tree still being built, from its root */
+    while (lp->ce && lp->ce->pe)
+        lp->ce = lp->ce->pe;
     delXMLEle(lp->ce);
     freeString(&lp->endtag);
+    freeString(&lp->sinkws);
     memset(lp, 0, sizeof(*lp));
     newString(&lp->endtag);
-    lp->cs = LOOK4START;
-    lp->ln = 1;
+    lp->cs      = LOOK4START;
+    lp->ln      = 1;
+    lp->rawtag  = rawtag;
+    lp->sinktag = sinktag;
+    lp->sink    = sink;
+    lp->sinkud  = sinkud;
+    lp->arena   = arena;
+}
+
+/* handle as many chars at the front of buf as possible without going through
+ * oneXMLchar() one at a time: in content that is everything up to the next
+ * '<', '&' or \0; in an attribute value up to its delimiter, '&', '<' or a
+ * control char. the states and lines are left just as if each had been.
+ * return number of chars used, 0 if buf[0] needs the full treatment.
+ */
+static int bulkXMLchars(LilXML *lp, const char *buf, int size)
+{
+    const char *end = buf + size;
+    const char *p;
+
+    if (lp->cs == INCON)
+    {
+        /* memchr is much faster than looking at each char ourselves */
+        if ((p = memchr(buf, '<', end - buf)) != NULL)
+            end = p;
+        if ((p = memchr(buf, '&', end - buf)) != NULL)
+            end = p;
+        if ((p = memchr(buf, '\0', end - buf)) != NULL)
+            end = p;
+        if (end == buf)
+            return (0);
+
+        for (p = buf; (p = memchr(p, '\n', end - p)) != NULL; p++)
+            lp->ln++;
+        addPCData(lp, buf, end - buf);
+    }
+    else
+    {
+        XMLAtt *ap = lp->ce->at[lp->ce->nat - 1];
+
+        for (p = buf; p < end && *p != lp->delim && *p != '&' && *p != '<' && !iscntrl((int)*p); p++)
+            ;
+        if (p == buf)
+            return (0);
+        end = p;
+        appendStringN(&ap->valu, buf, end - buf);
+    }
+
+    lp->lastc = end[-1];
+    return (end - buf);
+}
+
+/* add len bytes of data to the pcdata of ce, or pass them to the sink if ce
+ * is one of its elements. trailing whitespace is held back from the sink
+ * until more content follows so it is chomped just like in pcdata.
+ */
+static void addPCData(LilXML *lp, const char *data, int len)
+{
+    int nkeep;
+
+    if (!lp->sink || strcmp(lp->ce->tag.s, lp->sinktag))
+    {
+        if (len == 1)
+            growString(&lp->ce->pcdata, *data);
+        else
+            appendStringN(&lp->ce->pcdata, data, len);
+        return;
+    }
+
+    for (nkeep = len; nkeep > 0 && isspace((int)data[nkeep - 1]); nkeep--)
+        ;
+    if (nkeep > 0)
+    {
+        if (lp->sinkws.sl > 0)
+        {
+            (*lp->sink)(lp->ce, lp->sinkws.s, lp->sinkws.sl, lp->sinkud);
+            lp->sinkws.sl = 0;
+        }
+        (*lp->sink)(lp->ce, data, nkeep, lp->sinkud);
+    }
+    if (nkeep < len)
+        appendStringN(&lp->sinkws, data + nkeep, len - nkeep);
+}
+
+/* the start tag of ce just ended. if it is a rawtag element with a rawlen
+ * attribute its content is exactly that many bytes, taken as is, else look
+ * for content as usual. the sink, if ce is one of its elements, is told its
+ * content begins.
+ */
+static void startContent(LilXML *lp)
+{
+    int raw = lp->rawtag && lp->ce->nat > 0 && !strcmp(lp->ce->tag.s, lp->rawtag);
+
+    lp->rawleft = raw ? atoi(findXMLAttValu(lp->ce, "rawlen")) : 0;
+    lp->cs      = lp->rawleft > 0 ? INRAW : LOOK4CON;
+
+    if (lp->sink && !strcmp(lp->ce->tag.s, lp->sinktag))
+        (*lp->sink)(lp->ce, "", 0, lp->sinkud);
+}
+
+/* add up to len bytes of raw content to ce, or pass them to the sink if ce
+ * is one of its elements. nothing is decoded, counted or chomped.
+ * back to looking for content, which should be the end tag, once all rawlen
+ * bytes are in. return number of bytes used.
+ */
+static int addRawData(LilXML *lp, const char *data, int len)
+{
+    if (len > lp->rawleft)
+        len = lp->rawleft;
+
+    if (lp->sink && !strcmp(lp->ce->tag.s, lp->sinktag))
+        (*lp->sink)(lp->ce, data, len, lp->sinkud);
+    else
+        appendStringN(&lp->ce->pcdata, data, len);
+
+    lp->rawleft -= len;
+    if (lp->rawleft == 0)
+    {
+        lp->cs    = LOOK4CON;
+        lp->lastc = 0; /* whatever the last byte was, it was not markup */
+    }
+    return (len);
 }
 
 /* start a new XMLEle.
@@ -1156,7 +1385,7 @@ static void initParser(LilXML *lp)
  */
 static void pushXMLEle(LilXML *lp)
 {
-    lp->ce = growEle(lp->ce);
+    lp->ce = growEle(lp->ce, lp->arena);
     resetEndTag(lp);
 }
 
@@ -1169,21 +1398,29 @@ static void popXMLEle(LilXML *lp)
     resetEndTag(lp);
 }
 
-/* return one new XMLEle, added to the given element if given */
-static XMLEle *growEle(XMLEle *pe)
+/* return one new XMLEle, added to the given element if given.
+ * it is in the arena of pe, or a new one if it is a root and arena is set.
+ */
+static XMLEle *growEle(XMLEle *pe, int arena)
 {
-    XMLEle *newe = (XMLEle *)moremem(NULL, sizeof(XMLEle));
+    XMLArena *ap = pe ? pe->arena : (arena ? newArena() : NULL);
+    XMLEle *newe = (XMLEle *)(ap ? arenaMore(ap, NULL, 0, sizeof(XMLEle)) : moremem(NULL, sizeof(XMLEle)));
 
     memset(newe, 0, sizeof(XMLEle));
+    newe->arena    = ap;
+    newe->tag.a    = ap;
+    newe->pcdata.a = ap;
     newString(&newe->tag);
     newString(&newe->pcdata);
     newe->pe = pe;
 
     if (pe)
     {
-        pe->el            = (XMLEle **)moremem(pe->el, (pe->nel + 1) * sizeof(XMLEle *));
+        pe->el = (XMLEle **)elemem(pe, pe->el, pe->nel * sizeof(XMLEle *), (pe->nel + 1) * sizeof(XMLEle *));
         pe->el[pe->nel++] = newe;
     }
+    else if (ap)
+        ap->root = newe;
 
     return (newe);
 }
@@ -1191,14 +1428,16 @@ static XMLEle *growEle(XMLEle *pe)
 /* add room for and return one new XMLAtt to the given element */
 static XMLAtt *growAtt(XMLEle *ep)
 {
-    XMLAtt *newa = (XMLAtt *)moremem(NULL, sizeof *newa);
+    XMLAtt *newa = (XMLAtt *)elemem(ep, NULL, 0, sizeof *newa);
 
     memset(newa, 0, sizeof(*newa));
+    newa->name.a = ep->arena;
+    newa->valu.a = ep->arena;
     newString(&newa->name);
     newString(&newa->valu);
     newa->ce = ep;
 
-    ep->at            = (XMLAtt **)moremem(ep->at, (ep->nat + 1) * sizeof(XMLAtt *));
+    ep->at = (XMLAtt **)elemem(ep, ep->at, ep->nat * sizeof(XMLAtt *), (ep->nat + 1) * sizeof(XMLAtt *));
     ep->at[ep->nat++] = newa;
 
     return (newa);
@@ -1207,7 +1446,7 @@ static XMLAtt *growAtt(XMLEle *ep)
 /* free a and all it holds */
 static void freeAtt(XMLAtt *a)
 {
-    if (!a)
+    if (!a || a->ce->arena)
         return;
     freeString(&a->name);
     freeString(&a->valu);
@@ -1239,7 +1478,8 @@ static void growString(String *sp, int c)
         if (!sp->s)
             newString(sp);
         else {
-            sp->s = (char *)moremem(sp->s, sp->sm *= 2);
+            sp->s = (char *)strmem(sp, sp->sm * 2);
+            sp->sm *= 2;
         }
     }
     sp->s[--l] = '\0';
@@ -1261,7 +1501,8 @@ static void appendString(String *sp, const char *str)
         if (!sp->s)
             newString(sp);
         if (l > sp->sm) {
-            sp->s = (char *)moremem(sp->s, (sp->sm = l));
+            sp->s  = (char *)strmem(sp, l);
+            sp->sm = l;
         }
     }
     if (sp->s)
@@ -1271,13 +1512,34 @@ static void appendString(String *sp, const char *str)
     }
 }
 
+/* append len bytes of str to the String storage at *sp, at least doubling
+ * when it must grow so long content costs only a few reallocs.
+ */
+static void appendStringN(String *sp, const char *str, int len)
+{
+    int l = sp->sl + len + 1; /* need room for '\0' */
+
+    if (l > sp->sm)
+    {
+        int m = sp->sm < MINMEM ? MINMEM : sp->sm;
+
+        while (m < l)
+            m *= 2;
+        sp->s  = (char *)strmem(sp, m);
+        sp->sm = m;
+    }
+    memcpy(&sp->s[sp->sl], str, len);
+    sp->sl += len;
+    sp->s[sp->sl] = '\0';
+}
+
 /* init a String with a malloced string containing just \0 */
 static void newString(String *sp)
 {
     if (!sp)
         return;
 
-    sp->s  = (char *)moremem(NULL, MINMEM);
+    sp->s  = (char *)(sp->a ? arenaMore(sp->a, NULL, 0, MINMEM) : moremem(NULL, MINMEM));
     sp->sm = MINMEM;
     *sp->s = '\0';
     sp->sl = 0;
@@ -1286,7 +1548,7 @@ static void newString(String *sp)
 /* free memory used by the given String */
 static void freeString(String *sp)
 {
-    if (sp->s)
+    if (sp->s && !sp->a)
         (*myfree)(sp->s);
     sp->s  = NULL;
     sp->sl = 0;
@@ -1304,6 +1566,145 @@ static void *moremem(void *old, int n)
     return p;
 }
 
+/* moremem for the String at sp, from its arena if any */
+static void *strmem(String *sp, int n)
+{
+    return (sp->a ? arenaMore(sp->a, sp->s, sp->sm, n) : moremem(sp->s, n));
+}
+
+/* moremem for part of ep, from its arena if any. oldn is the size of old */
+static void *elemem(XMLEle *ep, void *old, int oldn, int n)
+{
+    return (ep->arena ? arenaMore(ep->arena, old, oldn, n) : moremem(old, n));
+}
+
+/* return a new empty arena, it lives in its own first chunk */
+static XMLArena *newArena(void)
+{
+    XMLChunk *cp = (XMLChunk *)moremem(NULL, ARENACHUNK);
+    XMLArena *ap = (XMLArena *)(cp + 1);
+
+    cp->next    = NULL;
+    cp->size    = ARENACHUNK - sizeof(XMLChunk);
+    cp->last    = 0;
+    cp->used    = (sizeof(XMLArena) + ARENAALIGN - 1) & ~(size_t)(ARENAALIGN - 1);
+    ap->chunks  = cp;
+    ap->big     = NULL;
+    ap->root    = NULL;
+    return (ap);
+}
+
+/* like moremem but from arena ap. oldn is the size of old, which can only
+ * grow in place if it was the last one given out. what is left behind is
+ * freed with the arena.
+ */
+static void *arenaMore(XMLArena *ap, void *old, size_t oldn, size_t n)
+{
+    XMLChunk *cp = ap->chunks;
+    size_t rn    = (n + ARENAALIGN - 1) & ~(size_t)(ARENAALIGN - 1);
+    char *p;
+
+    /* large blocks get their own chunk so they can be realloced as such */
+    if (n >= ARENABIG)
+    {
+        XMLChunk **cpp = &ap->big;
+
+        /* old is a large block too if it has a chunk of its own */
+        if (old && oldn >= ARENABIG)
+            for (; *cpp && (char *)(*cpp + 1) != (char *)old; cpp = &(*cpp)->next)
+                ;
+
+        cp = (XMLChunk *)(*cpp ? (*myrealloc)(*cpp, sizeof(XMLChunk) + n) : (*mymalloc)(sizeof(XMLChunk) + n));
+        if (!cp)
+            return (NULL);
+        if (*cpp)
+            *cpp = cp;
+        else
+        {
+            if (old)
+                memcpy(cp + 1, old, oldn);
+            cp->next = ap->big;
+            ap->big  = cp;
+        }
+        cp->size = cp->used = n;
+        return (cp + 1);
+    }
+
+    /* grow the last one in place if it fits */
+    p = (char *)(cp + 1);
+    if (old && (char *)old == p + cp->last && cp->last + rn <= cp->size)
+    {
+        cp->used = cp->last + rn;
+        return (old);
+    }
+
+    if (cp->used + rn > cp->size)
+    {
+        size_t size = 2 * (cp->size + sizeof(XMLChunk));
+
+        if (size > ARENAMAXCHK)
+            size = ARENAMAXCHK;
+        /* blocks just under ARENABIG do not fit a doubled first chunk */
+        if (size < sizeof(XMLChunk) + rn)
+            size = sizeof(XMLChunk) + rn;
+        cp = (XMLChunk *)(*mymalloc)(size);
+        if (!cp)
+            return (NULL);
+        cp->next   = ap->chunks;
+        cp->size   = size - sizeof(XMLChunk);
+        cp->used   = 0;
+        ap->chunks = cp;
+        p          = (char *)(cp + 1);
+    }
+
+    cp->last = cp->used;
+    cp->used += rn;
+    p += cp->last;
+    if (old)
+        memcpy(p, old, oldn < n ? oldn : n);
+    return (p);
+}
+
+/* free arena ap and all it gave out */
+static void freeArena(XMLArena *ap)
+{
+    XMLChunk *big = ap->big;
+    XMLChunk *cp  = ap->chunks;
+
+    /* ap itself is in the oldest chunk */
+    while (big)
+    {
+        XMLChunk *next = big->next;
+        (*myfree)(big);
+        big = next;
+    }
+    while (cp)
+    {
+        XMLChunk *next = cp->next;
+        (*myfree)(cp);
+        cp = next;
+    }
+}
+
+/* delete the elements below arena element ep that are not in its arena, as
+ * put there by appXMLEle(), they would not be freed with it.
+ */
+static void freeForeign(XMLEle *ep)
+{
+    int i;
+
+    for (i = 0; i < ep->nel; i++)
+    {
+        if (ep->el[i]->arena == ep->arena)
+            freeForeign(ep->el[i]);
+        else
+        {
+            ep->el[i]->pe = NULL;
+            delXMLEle(ep->el[i]);
+        }
+    }
+}
+
 #if defined(MAIN_TST)
 int main(int ac, char *av[])
 {
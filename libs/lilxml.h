@@ -27,6 +27,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
 
     It only handles elements, attributes and pcdata content. <! ... > and <? ... > are silently ignored. pcdata is collected into one string, sans leading whitespace first line. \n
 
+    With setXMLRawTag(), an element of the given tag with a rawlen attribute is taken to be followed by exactly that many bytes of content right after its start tag. These are collected as is, without entity decoding or chomping, so its pcdata may hold any bytes and pcdatalenXMLEle() must be used to get its length. This is how INDI sends binary BLOBs; prXMLEle() and sprXMLEle() do not reproduce such content. \n
+
     The following is an example of a cannonical usage for the lilxml library. Initialize a lil xml context and read an XML file in a root element.
 
     \code
@@ -102,10 +104,56 @@ extern void delXMLEle(XMLEle *e);
     \param buf buffer to process.
     \param size size of buf
     \param errmsg a buffer to store error messages if an error in parsing is encountered.
-    \return return a pointer to a NULL terminated array of parsed XML elements. An array of size 1 with on a NULL element means there is nothing to parse or a parsing is still in progress. A NULL pointer may be returned if a parsing error occurs. Check errmsg for errors if NULL is returned.
+    \note Runs of pcdata and attribute values are copied in bulk, so this is much faster than calling readXMLEle() for each char.
+    \return return a pointer to a NULL terminated array of parsed XML elements. An array of size 1 with on a NULL element means there is nothing to parse or a parsing is still in progress. A NULL pointer may be returned if a parsing error occurs. Check errmsg for errors if NULL is returned. Free the array with free(), or the free function given to lilxmlMalloc().
  */
 extern XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char errmsg[]);
 
+/** \brief Callback that receives pcdata for setXMLPCDataSink().
+    \param e the element whose content is being parsed. Its attributes are complete.
+    \param data next bytes of content, entities already decoded. Not nul terminated.
+    \param len number of bytes in data.
+    \param userdata as given to setXMLPCDataSink().
+*/
+typedef void(XMLPCDataSink)(XMLEle *e, const char *data, int len, void *userdata);
+
+/** \brief Pass the pcdata of each element with the given tag to a callback as it is parsed.
+    Useful for large content such as oneBLOB which then need not be collected in memory first.
+    The element is then delivered with empty pcdata. The callback sees exactly the bytes pcdataXMLEle()
+    would have returned, in as many calls as it takes. These follow one call with len 0 when the start tag
+    of the element ends, so the callback knows where new content begins. An element closed in its start tag,
+    as <tag/>, gets no calls.
+    \param lp a pointer to a lilxml parser.
+    \param tag element tag to match.
+    \param sink the callback, or NULL to collect pcdata as usual again.
+    \param userdata passed to each call of sink.
+*/
+extern void setXMLPCDataSink(LilXML *lp, const char *tag, XMLPCDataSink *sink, void *userdata);
+
+/** \brief Take the content of elements with the given tag and a rawlen attribute as that many bytes as is.
+    The content is collected without entity decoding or chomping, so it may hold any bytes. Off by default, so
+    parsers of files and other XML are not led astray by a stray rawlen. Only set it for the INDI protocol
+    streams that may carry binary BLOBs, with tag "oneBLOB".
+    \param lp a pointer to a lilxml parser.
+    \param tag element tag to match, or NULL to take no content raw.
+*/
+extern void setXMLRawTag(LilXML *lp, const char *tag);
+
+/** \brief Parse each tree into an arena of its own.
+    All the memory of a tree parsed by lp then comes from a few large chunks, freed all at once when its root
+    is deleted with delXMLEle(), instead of a malloc for each element, attribute and string. Deleting a child
+    only unlinks it, its memory goes with the root. Useful for trees that are parsed, used and deleted soon.
+    \param lp a pointer to a lilxml parser.
+    \param on 1 to parse into arenas, 0 for the usual malloc per part. Trees already parsed are not affected.
+*/
+extern void setXMLArena(LilXML *lp, int on);
+
+/** \brief Use other memory managers than malloc, realloc and free for all lilxml memory.
+    \note Call before any other lilxml function.
+*/
+extern void lilxmlMalloc(void *(*newmalloc)(size_t size), void *(*newrealloc)(void *ptr, size_t size),
+                         void (*newfree)(void *ptr));
+
 /** \brief Process an XML one char at a time.
   \param lp a pointer to a lilxml parser.
   \param c one character to process.
@@ -210,6 +258,13 @@ extern XMLEle *addXMLEle(XMLEle *parent, const char *tag);
 */
 extern void editXMLEle(XMLEle *ep, const char *pcdata);
 
+/** \brief set the pcdata of the given element to len bytes taken as is, like the content of a raw tag, see setXMLRawTag().
+    \param ep pointer to an XML element.
+    \param pcdata bytes to set, may hold any values.
+    \param len number of bytes.
+*/
+extern void editXMLEleRaw(XMLEle *ep, const char *pcdata, int len);
+
 /** \brief Add an XML attribute to an existing XML element.
     \param ep pointer to an XML element
     \param name the name of the XML attribute to add.
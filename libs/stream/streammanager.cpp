@@ -62,6 +62,10 @@ StreamManager::StreamManager(DefaultDevice *mainDevice)
 
     LOGF_DEBUG("Using default encoder (%s)", encoder->getName());
 
+    m_FramePool = std::make_shared<INDI::FramePool>();
+    m_fastFPSPost = std::make_shared<FastFPSPost>();
+    m_fastFPSPost->sm = this;
+
     m_framesThreadTerminate = false;
     m_framesThread = std::thread(&StreamManager::asyncStreamThread, this);
 
@@ -69,6 +73,12 @@ StreamManager::StreamManager(DefaultDevice *mainDevice)
 
 StreamManager::~StreamManager()
 {
+    // a sendFastFPS() still posted must not find us
+    {
+        std::lock_guard<std::mutex> lock(m_fastFPSPost->lock);
+        m_fastFPSPost->sm = nullptr;
+    }
+
     if (m_framesThread.joinable())
     {
         m_framesThreadTerminate = true;
@@ -80,6 +90,11 @@ StreamManager::~StreamManager()
     delete (encoderManager);
 }
 
+void StreamManager::setFramePool(const std::shared_ptr<INDI::FramePool> &pool)
+{
+    m_FramePool = pool;
+}
+
 const char * StreamManager::getDeviceName()
 {
     return currentDevice->getDeviceName();
@@ -272,8 +287,16 @@ void StreamManager::newFrame(const uint8_t * buffer, uint32_t nbytes)
     if (m_FPSFast.newFrame())
     {
         FpsN[0].value = m_FPSFast.framesPerSecond();
-        if (m_fastFPSUpdate.try_lock()) // don't block stream thread / record thread
-            std::thread([&](){ IDSetNumber(&FpsNP, nullptr); m_fastFPSUpdate.unlock(); }).detach();
+        // don't block stream thread / record thread, nor post again while one is on its way
+        if (!m_fastFPSUpdate.exchange(true))
+        {
+            auto post = new std::shared_ptr<FastFPSPost>(m_fastFPSPost);
+            if (IEPostTask(sendFastFPS, post) < 0)
+            {
+                delete post;
+                m_fastFPSUpdate = false;
+            }
+        }
     }
 
     if (isStreaming() || isRecording())
@@ -285,9 +308,15 @@ void StreamManager::newFrame(const uint8_t * buffer, uint32_t nbytes)
             return;
         }
 
-        std::vector<uint8_t> copyBuffer(buffer, buffer + nbytes); // copy the frame
+        INDI::FramePool::Buffer copyBuffer = m_FramePool->lease(nbytes);
+        if (copyBuffer.get() == nullptr)
+        {
+            LOG_WARN("Out of memory for frame buffer, skipping frame...");
+            return;
+        }
+        memcpy(copyBuffer.get(), buffer, nbytes); // copy the frame
 
-        m_framesIncoming.push(TimeFrame{m_FPSFast.deltaTime(), std::move(copyBuffer)}); // push it into the queue
+        m_framesIncoming.push(TimeFrame{m_FPSFast.deltaTime(), std::move(copyBuffer), nbytes}); // push it into the queue
     }
 
     if (isRecording())
@@ -340,8 +369,8 @@ void StreamManager::asyncStreamThread()
             continue;
 
 
-        const uint8_t *sourceBufferData = sourceTimeFrame.frame.data();
-        uint32_t nbytes                 = sourceTimeFrame.frame.size();
+        const uint8_t *sourceBufferData = sourceTimeFrame.frame.get();
+        uint32_t nbytes                 = sourceTimeFrame.size;
 
 #if 1 // TODO move above the loop
         int subX = 0, subY = 0, subW = 0, subH = 0;
@@ -519,6 +548,23 @@ bool StreamManager::recordStream(const uint8_t * buffer, uint32_t nbytes, double
     return recorder->writeFrame(buffer, nbytes);
 }
 
+void StreamManager::sendFastFPS(void *p)
+{
+    auto post = static_cast<std::shared_ptr<FastFPSPost> *>(p);
+
+    {
+        std::lock_guard<std::mutex> lock((*post)->lock);
+        StreamManager *sm = (*post)->sm;
+
+        if (sm)
+        {
+            IDSetNumber(&sm->FpsNP, nullptr);
+            sm->m_fastFPSUpdate = false;
+        }
+    }
+    delete post;
+}
+
 std::string StreamManager::expand(const std::string &fname, const std::map<std::string, std::string> &patterns)
 {
     std::string result = fname;
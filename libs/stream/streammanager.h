@@ -24,6 +24,7 @@
 #pragma once
 
 #include "indidevapi.h"
+#include "indiframepool.h"
 #include "fpsmeter.h"
 #include "recorder/recordermanager.h"
 #include "encoder/encodermanager.h"
@@ -32,6 +33,7 @@
 #include <map>
 #include <functional>
 #include <list>
+#include <memory>
 #include <thread>
 #include <atomic>
 #include <condition_variable>
@@ -137,6 +139,12 @@ public:
      */
     void newFrame(const uint8_t *buffer, uint32_t nbytes);
 
+    /**
+     * @brief setFramePool Set the pool incoming frames are copied into.
+     * @param pool frame buffer pool, by default the streamer makes its own.
+     */
+    void setFramePool(const std::shared_ptr<INDI::FramePool> &pool);
+
     /**
      * @brief setStream Enables (starts) or disables (stops) streaming.
      * @param enable True to enable, false to disable
@@ -185,6 +193,12 @@ protected:
 private: // helpers
     static std::string expand(const std::string &fname, const std::map<std::string, std::string> &patterns);
 
+    /**
+     * @brief Send the fast FPS, posted to the main thread by newFrame()
+     * @param p a new std::shared_ptr<FastFPSPost>, deleted here
+     */
+    static void sendFastFPS(void *p);
+
 private: // Utility for record file
     bool startRecording();
 
@@ -288,14 +302,25 @@ private: // Utility for record file
     // Processing for streaming
     typedef struct {
         double time;
-        std::vector<uint8_t> frame;
+        INDI::FramePool::Buffer frame;
+        uint32_t size;
     } TimeFrame;
 
+    std::shared_ptr<INDI::FramePool> m_FramePool;
+
     std::thread              m_framesThread;   // async incoming frames processing
     std::atomic<bool>        m_framesThreadTerminate;
     UniqueQueue<TimeFrame>   m_framesIncoming;
 
-    std::mutex               m_fastFPSUpdate;
+    // what a posted sendFastFPS() finds, sm is cleared when we go
+    struct FastFPSPost
+    {
+        std::mutex lock;
+        StreamManager *sm;
+    };
+
+    std::atomic<bool>        m_fastFPSUpdate { false }; // an update is posted and not sent yet
+    std::shared_ptr<FastFPSPost> m_fastFPSPost;
     std::mutex               m_recordMutex;
 
     GammaLut16               m_gammaLut16;
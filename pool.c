@@ -0,0 +1,247 @@
+/* indiserver memory pool: reuses freed blocks instead of going to the heap.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/** \file pool.c
+    \brief indiserver memory pool.
+
+   Drop-in malloc, realloc and free for the Msgs, their content, the FQs and
+   the lilxml parse trees indiserver makes and frees for every message it
+   routes. Sizes up to POOLMAXSIZ are rounded up to a size class, a quarter of
+   a power of two apart, and freed blocks are kept on a list for their class
+   to be handed out again, so once the lists hold what the traffic needs the
+   heap is no longer used. Larger blocks, BLOBs mostly, go to and from the
+   heap as usual.
+
+   Each block is preceded by a small header with its class, so any block can
+   be freed without knowing its size. At most POOLMAXIDLE bytes are kept idle
+   in each class, the rest goes back to the heap.
+
+   All calls are serialized with a mutex once poolThreads(1) is called.
+*/
+
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOLMINSIZ  32        /* smallest class */
+#define POOLMAXSIZ  65536     /* largest class */
+#define POOLNCLASS  45        /* classes from POOLMINSIZ to POOLMAXSIZ */
+#define POOLMAXIDLE (4 << 20) /* most idle bytes kept in each class */
+#define POOLBIG     (-1)      /* class of blocks larger than POOLMAXSIZ */
+
+/* in front of each block, also keeps it aligned as malloc would */
+typedef union
+{
+    struct
+    {
+        int cls;     /* class, or POOLBIG */
+        size_t size; /* bytes usable */
+    } h;
+    long double align;
+} Hdr;
+
+/* idle blocks of one class, linked through their first bytes */
+typedef struct
+{
+    void *idle;   /* first idle block */
+    size_t nidle; /* bytes in idle blocks */
+} Class;
+
+static Class classes[POOLNCLASS];
+static PoolStats stats;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int locking;
+
+/* return the class of a block of size bytes, its usable size in *csize */
+static int sizeClass(size_t size, size_t *csize)
+{
+    size_t base = POOLMINSIZ, step;
+    int cls = 0, j;
+
+    if (size <= POOLMINSIZ)
+    {
+        *csize = POOLMINSIZ;
+        return (0);
+    }
+
+    while (2 * base < size)
+    {
+        base *= 2;
+        cls += 4;
+    }
+    step   = base / 4;
+    j      = (size - base + step - 1) / step;
+    *csize = base + j * step;
+    return (cls + j);
+}
+
+/* return a block of at least size bytes, NULL if no memory.
+ * N.B. caller holds lock if locking
+ */
+static void *takeBlock(size_t size)
+{
+    size_t csize;
+    Hdr *hp;
+    int cls;
+
+    stats.allocs++;
+
+    if (size > POOLMAXSIZ)
+    {
+        hp = (Hdr *)malloc(sizeof(Hdr) + size);
+        if (!hp)
+            return (NULL);
+        stats.heap++;
+        hp->h.cls  = POOLBIG;
+        hp->h.size = size;
+        stats.inuse += size;
+        return (hp + 1);
+    }
+
+    cls = sizeClass(size, &csize);
+    if (classes[cls].idle)
+    {
+        void *p           = classes[cls].idle;
+        classes[cls].idle = *(void **)p;
+        classes[cls].nidle -= csize;
+        stats.idle -= csize;
+        stats.inuse += csize;
+        return (p);
+    }
+
+    hp = (Hdr *)malloc(sizeof(Hdr) + csize);
+    if (!hp)
+        return (NULL);
+    stats.heap++;
+    hp->h.cls  = cls;
+    hp->h.size = csize;
+    stats.inuse += csize;
+    return (hp + 1);
+}
+
+/* put ptr back on its list, or give it back to the heap.
+ * N.B. caller holds lock if locking
+ */
+static void giveBlock(void *ptr)
+{
+    Hdr *hp = (Hdr *)ptr - 1;
+    Class *cp;
+
+    stats.inuse -= hp->h.size;
+
+    if (hp->h.cls == POOLBIG || classes[hp->h.cls].nidle + hp->h.size > POOLMAXIDLE)
+    {
+        stats.frees++;
+        free(hp);
+        return;
+    }
+
+    cp            = &classes[hp->h.cls];
+    *(void **)ptr = cp->idle;
+    cp->idle      = ptr;
+    cp->nidle += hp->h.size;
+    stats.idle += hp->h.size;
+}
+
+/* like malloc(3) */
+void *poolMalloc(size_t size)
+{
+    void *p;
+
+    if (locking)
+        pthread_mutex_lock(&lock);
+    p = takeBlock(size);
+    if (locking)
+        pthread_mutex_unlock(&lock);
+    return (p);
+}
+
+/* like realloc(3). blocks that still fit stay where they are */
+void *poolRealloc(void *ptr, size_t size)
+{
+    Hdr *hp;
+    void *p;
+
+    if (!ptr)
+        return (poolMalloc(size));
+
+    hp = (Hdr *)ptr - 1;
+    if (hp->h.cls != POOLBIG && size <= hp->h.size)
+        return (ptr);
+
+    if (locking)
+        pthread_mutex_lock(&lock);
+
+    /* large to large is left to the heap, it may not even have to copy */
+    if (hp->h.cls == POOLBIG && size > POOLMAXSIZ)
+    {
+        size_t was = hp->h.size;
+
+        hp = (Hdr *)realloc(hp, sizeof(Hdr) + size);
+        if (hp)
+        {
+            stats.allocs++;
+            stats.heap++;
+            stats.inuse += size - was;
+            hp->h.size = size;
+        }
+        if (locking)
+            pthread_mutex_unlock(&lock);
+        return (hp ? hp + 1 : NULL);
+    }
+
+    p = takeBlock(size);
+    if (p)
+    {
+        memcpy(p, ptr, size < hp->h.size ? size : hp->h.size);
+        giveBlock(ptr);
+    }
+    if (locking)
+        pthread_mutex_unlock(&lock);
+    return (p);
+}
+
+/* like free(3) */
+void poolFree(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    if (locking)
+        pthread_mutex_lock(&lock);
+    giveBlock(ptr);
+    if (locking)
+        pthread_mutex_unlock(&lock);
+}
+
+/* serialize all calls if on, must be set before there is more than one thread */
+void poolThreads(int on)
+{
+    locking = on;
+}
+
+/* fill *sp with the counters since start */
+void poolStats(PoolStats *sp)
+{
+    if (locking)
+        pthread_mutex_lock(&lock);
+    *sp = stats;
+    if (locking)
+        pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,36 @@
+/* indiserver memory pool: reuses freed blocks instead of going to the heap.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+/* counters since start */
+typedef struct
+{
+    unsigned long allocs; /* blocks given out */
+    unsigned long heap;   /* of those, the ones that had to come from the heap */
+    unsigned long frees;  /* blocks given back to the heap */
+    size_t inuse;         /* bytes given out and not yet freed */
+    size_t idle;          /* bytes kept for reuse */
+} PoolStats;
+
+extern void *poolMalloc(size_t size);
+extern void *poolRealloc(void *ptr, size_t size);
+extern void poolFree(void *ptr);
+extern void poolThreads(int on);
+extern void poolStats(PoolStats *sp);
@@ -0,0 +1,234 @@
+/* indiserver routing table: who wants messages about each device and property.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/** \file route.c
+    \brief indiserver routing table.
+
+   An RT maps device.property to the lists of clients and drivers that want
+   messages about it, so routing a message costs two hash lookups however many
+   properties each peer watches. Name "" is the whole device: a message about
+   dev.name goes to the subscribers of both dev.name and dev.
+
+   Routes are made by the first subscriber and freed with the last one. The
+   table doubles its buckets when it holds more routes than buckets.
+*/
+
+#include "route.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RTBUCKETS 64 /* initial n buckets, a power of 2 */
+
+struct _RT
+{
+    Route **buckets; /* malloced hash chains */
+    int nbuckets;    /* n entries in buckets[] */
+    int nroutes;     /* n routes in all chains */
+};
+
+static void *rtAlloc(size_t n)
+{
+    void *p = malloc(n);
+
+    if (!p)
+    {
+        fprintf(stderr, "no memory for routing table\n");
+        exit(1);
+    }
+    return (p);
+}
+
+/* return FNV-1a hash of dev and name */
+unsigned int hashRoute(const char *dev, const char *name)
+{
+    unsigned int h = 2166136261u;
+
+    while (*dev)
+        h = (h ^ (unsigned char)*dev++) * 16777619u;
+    h = (h ^ '.') * 16777619u;
+    while (*name)
+        h = (h ^ (unsigned char)*name++) * 16777619u;
+    return (h);
+}
+
+/* return address of the link to dev.name, or of the NULL ending its chain */
+static Route **rtLink(RT *rt, unsigned int h, const char *dev, const char *name)
+{
+    Route **rpp = &rt->buckets[h & (rt->nbuckets - 1)];
+
+    for (; *rpp; rpp = &(*rpp)->next)
+        if ((*rpp)->hash == h && !strcmp((*rpp)->dev, dev) && !strcmp((*rpp)->name, name))
+            break;
+    return (rpp);
+}
+
+static void rtGrow(RT *rt)
+{
+    int n      = rt->nbuckets * 2;
+    Route **nb = (Route **)rtAlloc(n * sizeof(Route *));
+    int i;
+
+    memset(nb, 0, n * sizeof(Route *));
+    for (i = 0; i < rt->nbuckets; i++)
+    {
+        Route *rp, *next;
+        for (rp = rt->buckets[i]; rp; rp = next)
+        {
+            next                   = rp->next;
+            rp->next               = nb[rp->hash & (n - 1)];
+            nb[rp->hash & (n - 1)] = rp;
+        }
+    }
+    free(rt->buckets);
+    rt->buckets  = nb;
+    rt->nbuckets = n;
+}
+
+/* return a new empty routing table */
+RT *newRT(void)
+{
+    RT *rt = (RT *)rtAlloc(sizeof(RT));
+
+    rt->nbuckets = RTBUCKETS;
+    rt->nroutes  = 0;
+    rt->buckets  = (Route **)rtAlloc(RTBUCKETS * sizeof(Route *));
+    memset(rt->buckets, 0, RTBUCKETS * sizeof(Route *));
+    return (rt);
+}
+
+/* free rt and all its routes */
+void delRT(RT *rt)
+{
+    int i, k;
+
+    for (i = 0; i < rt->nbuckets; i++)
+    {
+        Route *rp, *next;
+        for (rp = rt->buckets[i]; rp; rp = next)
+        {
+            next = rp->next;
+            for (k = 0; k < RT_NLISTS; k++)
+                free(rp->lists[k].subs);
+            free(rp);
+        }
+    }
+    free(rt->buckets);
+    free(rt);
+}
+
+/* return the route of dev.name, or NULL if nobody wants it */
+Route *findRoute(RT *rt, const char *dev, const char *name)
+{
+    return (*rtLink(rt, hashRoute(dev, name), dev, name));
+}
+
+/* add who, with its Property index prop, to the kind list of dev.name.
+ * no dups, an existing entry just gets the new prop.
+ */
+void addRouteSub(RT *rt, const char *dev, const char *name, RouteKind kind, int who, int prop)
+{
+    unsigned int h = hashRoute(dev, name);
+    Route **rpp    = rtLink(rt, h, dev, name);
+    Route *rp      = *rpp;
+    RouteList *lp;
+    int i;
+
+    if (!rp)
+    {
+        size_t ldev = strlen(dev) + 1, lname = strlen(name) + 1;
+        char *keys;
+
+        rp   = (Route *)rtAlloc(sizeof(Route) + ldev + lname);
+        keys = (char *)(rp + 1);
+        memset(rp, 0, sizeof(Route));
+        memcpy(keys, dev, ldev);
+        memcpy(keys + ldev, name, lname);
+        rp->dev  = keys;
+        rp->name = keys + ldev;
+        rp->hash = h;
+        *rpp     = rp;
+        if (++rt->nroutes > rt->nbuckets)
+            rtGrow(rt);
+    }
+
+    lp = &rp->lists[kind];
+    i  = findRouteSub(rp, kind, who);
+    if (i < 0)
+    {
+        if (lp->nsubs == lp->msubs)
+        {
+            lp->msubs = lp->msubs ? 2 * lp->msubs : 4;
+            lp->subs  = (RouteSub *)realloc(lp->subs, lp->msubs * sizeof(RouteSub));
+            if (!lp->subs)
+            {
+                fprintf(stderr, "no memory for routing table\n");
+                exit(1);
+            }
+        }
+        i = lp->nsubs++;
+    }
+    lp->subs[i].who  = who;
+    lp->subs[i].prop = prop;
+}
+
+/* remove who from the kind list of dev.name, if there.
+ * the route goes once all its lists are empty.
+ */
+void rmRouteSub(RT *rt, const char *dev, const char *name, RouteKind kind, int who)
+{
+    Route **rpp = rtLink(rt, hashRoute(dev, name), dev, name);
+    Route *rp   = *rpp;
+    RouteList *lp;
+    int i, k;
+
+    if (!rp || (i = findRouteSub(rp, kind, who)) < 0)
+        return;
+
+    /* order does not matter, fill the hole with the last one */
+    lp          = &rp->lists[kind];
+    lp->subs[i] = lp->subs[--lp->nsubs];
+
+    for (k = 0; k < RT_NLISTS; k++)
+        if (rp->lists[k].nsubs > 0)
+            return;
+
+    *rpp = rp->next;
+    for (k = 0; k < RT_NLISTS; k++)
+        free(rp->lists[k].subs);
+    free(rp);
+    rt->nroutes--;
+}
+
+/* return index of who in the kind list of rp, else -1 */
+int findRouteSub(const Route *rp, RouteKind kind, int who)
+{
+    const RouteList *lp = &rp->lists[kind];
+    int i;
+
+    for (i = 0; i < lp->nsubs; i++)
+        if (lp->subs[i].who == who)
+            return (i);
+    return (-1);
+}
+
+/* return n routes in rt */
+int nRoutes(RT *rt)
+{
+    return (rt->nroutes);
+}
@@ -0,0 +1,62 @@
+/* indiserver routing table: who wants messages about each device and property.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#pragma once
+
+/* the lists kept for each device.property */
+typedef enum
+{
+    RT_CLIENTS,  /* clients that asked for it */
+    RT_SNOOPERS, /* drivers snooping on it */
+    RT_DRIVERS,  /* drivers serving the device, whole device routes only */
+    RT_NLISTS
+} RouteKind;
+
+/* one subscriber */
+typedef struct
+{
+    int who;  /* index of the client or driver */
+    int prop; /* index of its matching Property, if any */
+} RouteSub;
+
+typedef struct
+{
+    RouteSub *subs; /* malloced */
+    int nsubs;      /* n entries in use */
+    int msubs;      /* n entries malloced */
+} RouteList;
+
+/* one device.property, name "" for the whole device */
+typedef struct _Route
+{
+    struct _Route *next; /* next in same hash bucket */
+    unsigned int hash;
+    const char *dev;
+    const char *name;
+    RouteList lists[RT_NLISTS];
+} Route;
+
+typedef struct _RT RT;
+
+extern RT *newRT(void);
+extern void delRT(RT *rt);
+extern Route *findRoute(RT *rt, const char *dev, const char *name);
+extern void addRouteSub(RT *rt, const char *dev, const char *name, RouteKind kind, int who, int prop);
+extern void rmRouteSub(RT *rt, const char *dev, const char *name, RouteKind kind, int who);
+extern int findRouteSub(const Route *rp, RouteKind kind, int who);
+extern int nRoutes(RT *rt);
+extern unsigned int hashRoute(const char *dev, const char *name);
@@ -0,0 +1,155 @@
+/*
+    base64 kernel benchmark
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/* Measure base64 throughput of each kernel this CPU runs on one large frame.
+ *
+ * For each kernel:
+ *   encode         to64frombits_s() of the whole frame
+ *   decode         from64tobits_fast() of that, as one line
+ *   decode lines   same but in 72 char lines, as IDSetBLOB() sends it
+ * GB/s are of raw frame bytes.
+ *
+ * Example:
+ *   base64_bench -m 100 -n 3
+ */
+
+#include "base64.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int mbytes = 100; /* raw frame MB */
+static int nruns  = 3;   /* best of */
+
+static void usage(const char *me)
+{
+    fprintf(stderr, "Usage: %s [options]\n", me);
+    fprintf(stderr, "Purpose: measure base64 throughput of each kernel\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, " -m MB    : raw frame size, default %d\n", mbytes);
+    fprintf(stderr, " -n n     : runs of each, best is reported, default %d\n", nruns);
+    exit(2);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+static void *xmalloc(size_t n)
+{
+    void *p = malloc(n);
+
+    if (!p)
+    {
+        fprintf(stderr, "no memory for %lu bytes\n", (unsigned long)n);
+        exit(1);
+    }
+    return (p);
+}
+
+int main(int ac, char *av[])
+{
+    static const char *kernels[] = { "scalar", "sse4.1", "avx2", "neon" };
+    static const char *names[]   = { "encode", "decode", "decode lines" };
+    int rawlen, enclen, nlines, k, c;
+    unsigned char *raw, *enc;
+    char *lines, *back;
+    unsigned int seed = 1;
+
+    while ((c = getopt(ac, av, "m:n:")) != -1)
+    {
+        switch (c)
+        {
+            case 'm':
+                mbytes = atoi(optarg);
+                break;
+            case 'n':
+                nruns = atoi(optarg);
+                break;
+            default:
+                usage(av[0]);
+        }
+    }
+    if (mbytes <= 0 || nruns <= 0)
+        usage(av[0]);
+
+    /* noise-like frame, base64 of it plain and in lines */
+    rawlen = mbytes * 1024 * 1024;
+    raw    = xmalloc(rawlen);
+    for (k = 0; k < rawlen; k++)
+        raw[k] = (seed = seed * 1103515245 + 12345) >> 16;
+    enc    = xmalloc(4 * rawlen / 3 + 4);
+    enclen = to64frombits_s(enc, raw, rawlen, 4 * rawlen / 3 + 4);
+    lines  = xmalloc(enclen + enclen / 72 + 2);
+    for (k = nlines = 0; k < enclen; k += 72)
+    {
+        int n = enclen - k < 72 ? enclen - k : 72;
+
+        lines[k + nlines++] = '\n';
+        memcpy(lines + k + nlines, enc + k, n);
+    }
+    back = xmalloc(3 * enclen / 4);
+
+    printf("%-8s %-14s %10s %10s\n", "kernel", "op", "secs", "GB/s");
+    for (k = 0; k < (int)(sizeof(kernels) / sizeof(kernels[0])); k++)
+    {
+        int op;
+
+        if (setBase64Kernel(kernels[k]) < 0)
+            continue;
+
+        for (op = 0; op < 3; op++)
+        {
+            double best = 0;
+            int r, n = 0;
+
+            for (r = 0; r < nruns; r++)
+            {
+                double t = now();
+
+                if (op == 0)
+                    n = to64frombits_s(enc, raw, rawlen, 4 * rawlen / 3 + 4);
+                else
+                    n = from64tobits_fast(back, op == 1 ? (char *)enc : lines, enclen);
+                t = now() - t;
+                if (r == 0 || t < best)
+                    best = t;
+            }
+
+            if ((op == 0 && n != enclen) || (op > 0 && (n != rawlen || memcmp(back, raw, rawlen))))
+            {
+                fprintf(stderr, "%s %s: wrong result\n", kernels[k], names[op]);
+                return (1);
+            }
+            printf("%-8s %-14s %10.3f %10.2f\n", kernels[k], names[op], best, rawlen / 1e9 / best);
+        }
+    }
+
+    free(raw);
+    free(enc);
+    free(lines);
+    free(back);
+    return (0);
+}
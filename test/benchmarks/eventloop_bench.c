@@ -0,0 +1,268 @@
+/*
+    eventloop benchmark
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/* Measure how late the eventloop runs timers and callbacks, as a driver
+ * with many of each would see it.
+ *
+ * -t timers each run every 1 to -p ms, at random, and add themselves again.
+ * Each time one runs it also pushes back one of -w watchdog timers, which
+ * thus never run but are removed and added all the time, as drivers do
+ * with their timeouts. -f pipes are watched that are never written. A thread
+ * writes the time to another pipe every ms, whose callback reads it.
+ *
+ * Reported is how late, in us, timers ran after they were due and the
+ * callback ran after the thread wrote.
+ *
+ * Example:
+ *   eventloop_bench -t 1000 -w 10000 -f 200 -d 10
+ */
+
+#include "eventloop.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int ntimers = 100;  /* periodic timers */
+static int maxper  = 50;   /* longest period, ms */
+static int nwdogs  = 1000; /* watchdog timers */
+static int nidle   = 100;  /* idle pipes */
+static int secs    = 5;    /* how long to run */
+
+/* one periodic timer */
+typedef struct
+{
+    double due; /* when it should run, s */
+} Tick;
+
+/* lateness samples, us */
+typedef struct
+{
+    double *v;
+    size_t n, max;
+} Samples;
+
+static Samples timerlate, pinglate;
+static int *wdogs;      /* watchdog timer ids */
+static int pingfd[2];   /* pipe the ping thread writes */
+static volatile int done;
+
+static void usage(const char *me)
+{
+    fprintf(stderr, "Usage: %s [options]\n", me);
+    fprintf(stderr, "Purpose: measure how late eventloop timers and callbacks run\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, " -d n     : seconds to run, default %d\n", secs);
+    fprintf(stderr, " -f n     : idle pipes watched, default %d\n", nidle);
+    fprintf(stderr, " -p n     : longest timer period, ms, default %d\n", maxper);
+    fprintf(stderr, " -t n     : periodic timers, default %d\n", ntimers);
+    fprintf(stderr, " -w n     : watchdog timers, default %d\n", nwdogs);
+    exit(2);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+static void *xrealloc(void *p, size_t n)
+{
+    p = realloc(p, n);
+    if (!p)
+    {
+        fprintf(stderr, "no memory for %lu bytes\n", (unsigned long)n);
+        exit(1);
+    }
+    return (p);
+}
+
+static void addSample(Samples *sp, double us)
+{
+    if (sp->n == sp->max)
+    {
+        sp->max = sp->max ? 2 * sp->max : 65536;
+        sp->v   = (double *)xrealloc(sp->v, sp->max * sizeof(double));
+    }
+    sp->v[sp->n++] = us;
+}
+
+static int cmpDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x < y ? -1 : x > y);
+}
+
+static void report(const char *what, Samples *sp)
+{
+    double sum = 0;
+    size_t i;
+
+    if (!sp->n)
+    {
+        printf("%-6s %10s\n", what, "none");
+        return;
+    }
+    qsort(sp->v, sp->n, sizeof(double), cmpDouble);
+    for (i = 0; i < sp->n; i++)
+        sum += sp->v[i];
+    printf("%-6s %10lu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", what, (unsigned long)sp->n, sum / sp->n,
+           sp->v[sp->n / 2], sp->v[sp->n * 9 / 10], sp->v[sp->n * 99 / 100], sp->v[sp->n * 999 / 1000],
+           sp->v[sp->n - 1]);
+}
+
+static void wdogTO(void *ud)
+{
+    (void)ud;
+    fprintf(stderr, "a watchdog ran\n");
+}
+
+static void tickTO(void *ud)
+{
+    Tick *tp = (Tick *)ud;
+    double t = now();
+    int w    = rand() % (nwdogs ? nwdogs : 1);
+    int ms   = 1 + rand() % maxper;
+
+    addSample(&timerlate, (t - tp->due) * 1e6);
+
+    if (nwdogs)
+    {
+        rmTimer(wdogs[w]);
+        wdogs[w] = addTimer(600000 + rand() % 60000, wdogTO, NULL);
+    }
+
+    tp->due = now() + ms / 1000.0;
+    addTimer(ms, tickTO, tp);
+}
+
+static void pingCB(int fd, void *ud)
+{
+    double sent[64];
+    ssize_t nr = read(fd, sent, sizeof(sent));
+    double t   = now();
+    int i;
+
+    (void)ud;
+    for (i = 0; i < (int)(nr / sizeof(double)); i++)
+        addSample(&pinglate, (t - sent[i]) * 1e6);
+}
+
+static void idleCB(int fd, void *ud)
+{
+    (void)fd, (void)ud;
+    fprintf(stderr, "an idle pipe was ready\n");
+}
+
+/* write the time to the ping pipe every ms */
+static void *pingThread(void *arg)
+{
+    struct timespec ms = { 0, 1000000 };
+
+    (void)arg;
+    while (!done)
+    {
+        double t = now();
+
+        if (write(pingfd[1], &t, sizeof(t)) != sizeof(t))
+            break;
+        nanosleep(&ms, NULL);
+    }
+    return (NULL);
+}
+
+int main(int ac, char *av[])
+{
+    pthread_t pinger;
+    Tick *ticks;
+    int i, c, never = 0;
+
+    while ((c = getopt(ac, av, "d:f:p:t:w:")) != -1)
+    {
+        switch (c)
+        {
+            case 'd':
+                secs = atoi(optarg);
+                break;
+            case 'f':
+                nidle = atoi(optarg);
+                break;
+            case 'p':
+                maxper = atoi(optarg);
+                break;
+            case 't':
+                ntimers = atoi(optarg);
+                break;
+            case 'w':
+                nwdogs = atoi(optarg);
+                break;
+            default:
+                usage(av[0]);
+        }
+    }
+    if (secs <= 0 || nidle < 0 || maxper <= 0 || ntimers < 0 || nwdogs < 0)
+        usage(av[0]);
+
+    srand(1);
+    for (i = 0; i < nidle; i++)
+    {
+        int p[2];
+
+        if (pipe(p) < 0)
+        {
+            perror("pipe");
+            return (1);
+        }
+        addCallback(p[0], idleCB, NULL);
+    }
+    wdogs = (int *)xrealloc(NULL, (nwdogs + 1) * sizeof(int));
+    for (i = 0; i < nwdogs; i++)
+        wdogs[i] = addTimer(600000 + rand() % 60000, wdogTO, NULL);
+    ticks = (Tick *)xrealloc(NULL, (ntimers + 1) * sizeof(Tick));
+    for (i = 0; i < ntimers; i++)
+    {
+        int ms = 1 + rand() % maxper;
+
+        ticks[i].due = now() + ms / 1000.0;
+        addTimer(ms, tickTO, &ticks[i]);
+    }
+
+    if (pipe(pingfd) < 0)
+    {
+        perror("pipe");
+        return (1);
+    }
+    addCallback(pingfd[0], pingCB, NULL);
+    pthread_create(&pinger, NULL, pingThread, NULL);
+
+    deferLoop(secs * 1000, &never);
+    done = 1;
+    pthread_join(pinger, NULL);
+
+    printf("%d timers every 1-%d ms, %d watchdogs, %d idle pipes, %d s\n", ntimers, maxper, nwdogs, nidle, secs);
+    printf("%-6s %10s %9s %9s %9s %9s %9s %9s\n", "us", "n", "mean", "p50", "p90", "p99", "p99.9", "max");
+    report("timer", &timerlate);
+    report("ping", &pinglate);
+    return (0);
+}
@@ -0,0 +1,261 @@
+/*
+    fpack benchmark
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/* Measure the latency of compressing one 16 bit FITS frame for SendCompressed
+ * at several sizes, from the in-memory FITS file to the compressed one.
+ *
+ * For each size:
+ *   file           what CCD::uploadFile() used to do: write the frame to a
+ *                  temporary file, fp_loop() it and read back the .fz
+ *   mem 1          fp_pack_mem() on one thread
+ *   mem N          fp_pack_mem() on -t threads, default one per core
+ * Each result is unpacked again and checked against the frame.
+ *
+ * Example:
+ *   fpack_bench -m 20,60,120 -n 3
+ */
+
+#include <fitsio.h>
+#include "fpack/fpack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *sizes = "20,40,60,80,100,120"; /* frame megapixels */
+static int nruns         = 3;                     /* best of */
+static int nthreads      = 0;                     /* 0 is one per core */
+
+static void usage(const char *me)
+{
+    fprintf(stderr, "Usage: %s [options]\n", me);
+    fprintf(stderr, "Purpose: measure FITS frame compression latency\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, " -m list  : comma separated frame megapixels, default %s\n", sizes);
+    fprintf(stderr, " -n n     : runs of each, best is reported, default %d\n", nruns);
+    fprintf(stderr, " -t n     : threads for mem N, default one per core\n");
+    exit(2);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+static void bail(const char *what, int status)
+{
+    char msg[FLEN_STATUS];
+
+    fits_get_errstatus(status, msg);
+    fprintf(stderr, "%s: %s\n", what, msg);
+    exit(1);
+}
+
+/* build a w x h 16 bit unsigned FITS frame in memory: sky, a few stars, noise */
+static void makeFrame(long w, long h, void **buf, size_t *len)
+{
+    unsigned short *pix = malloc(w * h * sizeof(unsigned short));
+    long naxes[2]       = { w, h };
+    fitsfile *fptr      = NULL;
+    unsigned int seed   = 1;
+    int status          = 0;
+    long i;
+
+    if (!pix)
+    {
+        fprintf(stderr, "no memory for frame\n");
+        exit(1);
+    }
+    for (i = 0; i < w * h; i++)
+    {
+        seed   = seed * 1103515245 + 12345;
+        pix[i] = 1000 + ((seed >> 16) & 63) + ((seed >> 8) % 997 == 0 ? 30000 : 0);
+    }
+
+    *len = 2880;
+    *buf = malloc(*len);
+    fits_create_memfile(&fptr, buf, len, 2880, realloc, &status);
+    fits_create_img(fptr, USHORT_IMG, 2, naxes, &status);
+    fits_write_img(fptr, TUSHORT, 1, w * h, pix, &status);
+    fits_close_file(fptr, &status);
+    if (status)
+        bail("making frame", status);
+    free(pix);
+}
+
+/* the old way, through temporary files */
+static void packFile(const void *in, size_t inlen, void **out, size_t *outlen)
+{
+    char filename[64], *argv[3];
+    FILE *fp;
+    fpstate fpvar;
+
+    snprintf(filename, sizeof(filename), "/tmp/fpack_bench_%d.fits", (int)getpid());
+    fp = fopen(filename, "w");
+    if (!fp || fwrite(in, 1, inlen, fp) != inlen || fclose(fp))
+    {
+        fprintf(stderr, "%s: write failed\n", filename);
+        exit(1);
+    }
+
+    argv[0] = "fpack";
+    argv[1] = filename;
+    argv[2] = NULL;
+    fp_init(&fpvar);
+    fp_get_param(2, argv, &fpvar);
+    fp_preflight(2, argv, FPACK, &fpvar);
+    fp_loop(2, argv, FPACK, filename, fpvar);
+    remove(filename);
+
+    strcat(filename, ".fz");
+    fp = fopen(filename, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "%s: no output\n", filename);
+        exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    *outlen = ftell(fp);
+    rewind(fp);
+    *out = malloc(*outlen);
+    if (!*out || fread(*out, 1, *outlen, fp) != *outlen)
+    {
+        fprintf(stderr, "%s: read failed\n", filename);
+        exit(1);
+    }
+    fclose(fp);
+    remove(filename);
+}
+
+/* check that the compressed file unpacks to the pixels of the frame */
+static void check(const char *what, void *frame, size_t framelen, void *packed, size_t packedlen, long npix)
+{
+    unsigned short *a = malloc(npix * sizeof(unsigned short));
+    unsigned short *b = malloc(npix * sizeof(unsigned short));
+    fitsfile *fptr;
+    int status = 0, anynul;
+
+    fits_open_memfile(&fptr, "", READONLY, &frame, &framelen, 0, NULL, &status);
+    fits_read_img(fptr, TUSHORT, 1, npix, NULL, a, &anynul, &status);
+    fits_close_file(fptr, &status);
+    fits_open_memfile(&fptr, "", READONLY, &packed, &packedlen, 0, NULL, &status);
+    fits_movabs_hdu(fptr, 2, NULL, &status);
+    fits_read_img(fptr, TUSHORT, 1, npix, NULL, b, &anynul, &status);
+    fits_close_file(fptr, &status);
+    if (status)
+        bail(what, status);
+    if (memcmp(a, b, npix * sizeof(unsigned short)))
+    {
+        fprintf(stderr, "%s: wrong result\n", what);
+        exit(1);
+    }
+    free(a);
+    free(b);
+}
+
+int main(int ac, char *av[])
+{
+    const char *s;
+    int c;
+
+    while ((c = getopt(ac, av, "m:n:t:")) != -1)
+    {
+        switch (c)
+        {
+            case 'm':
+                sizes = optarg;
+                break;
+            case 'n':
+                nruns = atoi(optarg);
+                break;
+            case 't':
+                nthreads = atoi(optarg);
+                break;
+            default:
+                usage(av[0]);
+        }
+    }
+    if (nruns <= 0 || nthreads < 0)
+        usage(av[0]);
+    if (nthreads == 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    printf("%-6s %-8s %10s %10s %8s\n", "MP", "method", "secs", "MB/s", "ratio");
+    for (s = sizes; *s; s += strcspn(s, ","), s += *s == ',')
+    {
+        int mp = atoi(s);
+        long w, h;
+        void *frame;
+        size_t framelen;
+        int m;
+
+        if (mp <= 0)
+            usage(av[0]);
+
+        /* 3:2 sensor */
+        h = 1;
+        while (3 * (h + 1) * (h + 1) / 2 <= mp * 1000000L)
+            h++;
+        w = mp * 1000000L / h;
+        makeFrame(w, h, &frame, &framelen);
+
+        for (m = 0; m < 3; m++)
+        {
+            char name[16];
+            double best = 0;
+            void *packed = NULL;
+            size_t packedlen = 0;
+            int r;
+
+            if (m == 0)
+                snprintf(name, sizeof(name), "file");
+            else
+                snprintf(name, sizeof(name), "mem %d", m == 1 ? 1 : nthreads);
+
+            for (r = 0; r < nruns; r++)
+            {
+                double t;
+                int status = 0;
+
+                free(packed);
+                t = now();
+                if (m == 0)
+                    packFile(frame, framelen, &packed, &packedlen);
+                else if (fp_pack_mem(frame, framelen, &packed, &packedlen, m == 1 ? 1 : nthreads, &status))
+                    bail(name, status);
+                t = now() - t;
+                if (r == 0 || t < best)
+                    best = t;
+            }
+
+            check(name, frame, framelen, packed, packedlen, w * h);
+            printf("%-6d %-8s %10.3f %10.1f %8.2f\n", mp, name, best, framelen / 1e6 / best,
+                   (double)framelen / packedlen);
+            free(packed);
+        }
+
+        free(frame);
+    }
+
+    return (0);
+}
@@ -0,0 +1,290 @@
+/*
+    IDSet*() benchmark
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/* Measure how many messages per second a driver sends with each of
+ * IDSetNumber(), IDSetSwitch(), IDSetText() and IDSetLight().
+ *
+ * Our stdout is a pipe drained by a thread, as a driver's is by indiserver.
+ * Each of -t threads sends its own vector of -e elements, -n messages in all
+ * per property type. Numbers change with every message so each is formatted
+ * anew. With -m every message also carries a message attribute.
+ *
+ * Example:
+ *   idset_bench -n 200000 -e 4 -t 2
+ */
+
+#include "indidevapi.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAXTHREADS 64
+
+static int nmsgs  = 200000; /* messages of each type */
+static int nelem  = 4;      /* elements per vector */
+static int nthr   = 1;      /* sending threads */
+static int nruns  = 3;      /* best of */
+static int withmsg;         /* also send a message attribute */
+
+/* one sender's vectors */
+typedef struct
+{
+    INumberVectorProperty nvp;
+    ISwitchVectorProperty svp;
+    ITextVectorProperty tvp;
+    ILightVectorProperty lvp;
+    int type;  /* which to send */
+    int n;     /* how many */
+} Sender;
+
+/* the driver callbacks, none are called */
+void ISGetProperties(const char *dev)
+{
+    (void)dev;
+}
+
+void ISNewNumber(const char *dev, const char *name, double *values, char *names[], int n)
+{
+    (void)dev, (void)name, (void)values, (void)names, (void)n;
+}
+
+void ISNewSwitch(const char *dev, const char *name, ISState *states, char *names[], int n)
+{
+    (void)dev, (void)name, (void)states, (void)names, (void)n;
+}
+
+void ISNewText(const char *dev, const char *name, char *texts[], char *names[], int n)
+{
+    (void)dev, (void)name, (void)texts, (void)names, (void)n;
+}
+
+void ISNewBLOB(const char *dev, const char *name, int sizes[], int blobsizes[], char *blobs[], char *formats[],
+               char *names[], int n)
+{
+    (void)dev, (void)name, (void)sizes, (void)blobsizes, (void)blobs, (void)formats, (void)names, (void)n;
+}
+
+void ISSnoopDevice(XMLEle *root)
+{
+    (void)root;
+}
+
+static void usage(const char *me)
+{
+    fprintf(stderr, "Usage: %s [options]\n", me);
+    fprintf(stderr, "Purpose: measure IDSet*() messages per second of each property type\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, " -e n     : elements per vector, default %d\n", nelem);
+    fprintf(stderr, " -m       : give each message a message attribute\n");
+    fprintf(stderr, " -n n     : messages of each type, default %d\n", nmsgs);
+    fprintf(stderr, " -r n     : runs of each, best is reported, default %d\n", nruns);
+    fprintf(stderr, " -t n     : sending threads, default %d\n", nthr);
+    exit(2);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+static void *xcalloc(size_t n, size_t size)
+{
+    void *p = calloc(n, size);
+
+    if (!p)
+    {
+        fprintf(stderr, "no memory for %lu bytes\n", (unsigned long)(n * size));
+        exit(1);
+    }
+    return (p);
+}
+
+/* fill the vectors of sender i, elements alike to most drivers' */
+static void fillSender(Sender *sp, int i)
+{
+    INumber *np = xcalloc(nelem, sizeof(INumber));
+    ISwitch *wp = xcalloc(nelem, sizeof(ISwitch));
+    IText *tp   = xcalloc(nelem, sizeof(IText));
+    ILight *lp  = xcalloc(nelem, sizeof(ILight));
+    char dev[MAXINDIDEVICE], name[MAXINDINAME];
+    int j;
+
+    snprintf(dev, sizeof(dev), "Bench Device %d", i);
+    for (j = 0; j < nelem; j++)
+    {
+        snprintf(name, sizeof(name), "ELEMENT_%d", j);
+        IUFillNumber(&np[j], name, name, "%10.6m", -1e6, 1e6, 0, 12.3456789 * (j + 1));
+        IUFillSwitch(&wp[j], name, name, j == 0 ? ISS_ON : ISS_OFF);
+        IUFillText(&tp[j], name, name, "Bench text of <a> sort of usual length");
+        IUFillLight(&lp[j], name, name, IPS_OK);
+    }
+    IUFillNumberVector(&sp->nvp, np, nelem, dev, "BENCH_NUMBER", "Number", "Bench", IP_RO, 60, IPS_OK);
+    IUFillSwitchVector(&sp->svp, wp, nelem, dev, "BENCH_SWITCH", "Switch", "Bench", IP_RW, ISR_1OFMANY, 60, IPS_OK);
+    IUFillTextVector(&sp->tvp, tp, nelem, dev, "BENCH_TEXT", "Text", "Bench", IP_RO, 60, IPS_OK);
+    IUFillLightVector(&sp->lvp, lp, nelem, dev, "BENCH_LIGHT", "Light", "Bench", IPS_OK);
+}
+
+/* send sp->n messages of sp->type */
+static void *sendThread(void *arg)
+{
+    Sender *sp = (Sender *)arg;
+    int i, j;
+
+    for (i = 0; i < sp->n; i++)
+    {
+        switch (sp->type)
+        {
+            case 0:
+                for (j = 0; j < nelem; j++)
+                    sp->nvp.np[j].value += 0.000123;
+                IDSetNumber(&sp->nvp, withmsg ? "Moved to %.3f" : NULL, sp->nvp.np[0].value);
+                break;
+            case 1:
+                sp->svp.sp[i % nelem].s = ISS_ON;
+                sp->svp.sp[(i + nelem - 1) % nelem].s = ISS_OFF;
+                IDSetSwitch(&sp->svp, withmsg ? "Switched %d" : NULL, i % nelem);
+                break;
+            case 2:
+                IDSetText(&sp->tvp, withmsg ? "Text %d" : NULL, i);
+                break;
+            case 3:
+                sp->lvp.lp[i % nelem].s = (i & 1) ? IPS_BUSY : IPS_OK;
+                IDSetLight(&sp->lvp, withmsg ? "Light %d" : NULL, i);
+                break;
+        }
+    }
+    return (NULL);
+}
+
+/* count what arrives on the pipe until EOF */
+static void *drainThread(void *arg)
+{
+    static char buf[65536];
+    int fd = *(int *)arg;
+    unsigned long long *np = xcalloc(1, sizeof(*np));
+    ssize_t nr;
+
+    while ((nr = read(fd, buf, sizeof(buf))) > 0)
+        *np += nr;
+    return (np);
+}
+
+int main(int ac, char *av[])
+{
+    static const char *types[] = { "number", "switch", "text", "light" };
+    static Sender senders[MAXTHREADS];
+    pthread_t thr[MAXTHREADS];
+    FILE *out;
+    int type, i, c, devnull;
+
+    while ((c = getopt(ac, av, "e:mn:r:t:")) != -1)
+    {
+        switch (c)
+        {
+            case 'e':
+                nelem = atoi(optarg);
+                break;
+            case 'm':
+                withmsg = 1;
+                break;
+            case 'n':
+                nmsgs = atoi(optarg);
+                break;
+            case 'r':
+                nruns = atoi(optarg);
+                break;
+            case 't':
+                nthr = atoi(optarg);
+                break;
+            default:
+                usage(av[0]);
+        }
+    }
+    if (nelem <= 0 || nmsgs <= 0 || nruns <= 0 || nthr <= 0 || nthr > MAXTHREADS)
+        usage(av[0]);
+
+    /* the messages go to stdout, the report to what it was */
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!out)
+    {
+        perror("dup stdout");
+        return (1);
+    }
+    devnull = open("/dev/null", O_WRONLY);
+    for (i = 0; i < nthr; i++)
+        fillSender(&senders[i], i);
+
+    fprintf(out, "%d thread(s), %d elements%s\n", nthr, nelem, withmsg ? ", with message" : "");
+    fprintf(out, "%-8s %10s %12s %10s %10s\n", "type", "secs", "msgs/s", "bytes/msg", "MB/s");
+    for (type = 0; type < 4; type++)
+    {
+        double best = 0;
+        unsigned long long nbytes = 0;
+        int run;
+
+        for (run = 0; run < nruns; run++)
+        {
+            unsigned long long *np;
+            pthread_t drainer;
+            int pfd[2];
+            double t0, dt;
+
+            if (pipe(pfd) < 0 || dup2(pfd[1], STDOUT_FILENO) < 0)
+            {
+                perror("pipe");
+                return (1);
+            }
+            close(pfd[1]);
+            pthread_create(&drainer, NULL, drainThread, &pfd[0]);
+
+            t0 = now();
+            for (i = 0; i < nthr; i++)
+            {
+                senders[i].type = type;
+                senders[i].n    = nmsgs / nthr + (i < nmsgs % nthr);
+                pthread_create(&thr[i], NULL, sendThread, &senders[i]);
+            }
+            for (i = 0; i < nthr; i++)
+                pthread_join(thr[i], NULL);
+            fflush(stdout);
+            dup2(devnull, STDOUT_FILENO);
+            pthread_join(drainer, (void **)&np);
+            dt = now() - t0;
+            close(pfd[0]);
+
+            if (run == 0 || dt < best)
+                best = dt;
+            nbytes = *np;
+            free(np);
+        }
+
+        fprintf(out, "%-8s %10.3f %12.0f %10.0f %10.1f\n", types[type], best, nmsgs / best,
+                (double)nbytes / nmsgs, nbytes / best / 1e6);
+    }
+
+    fclose(out);
+    return (0);
+}
@@ -0,0 +1,860 @@
+/*
+    INDI Server routing benchmark
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/* Measure how fast indiserver fans driver traffic out to its clients.
+ *
+ * We start a real indiserver whose drivers are all "remote", ie, it connects
+ * back to sockets we listen on and we play the part of each driver. We then
+ * connect the requested number of clients, have every driver send a burst of
+ * setNumberVector (or setBLOBVector with -b) messages stamped with the send
+ * time and count what arrives at each client. With -B the BLOB content is
+ * sent as rawlen bytes instead of base64, with -R clients ask for it that way
+ * too, else the server must encode it for them. With -U each case is also
+ * run with the clients on the server's unix domain socket (-u) instead of
+ * TCP loopback, to see what local clients gain on large BLOBs.
+ *
+ * Reported per run:
+ *   msgs/s      client deliveries per second of wall time
+ *   cpu us/msg  indiserver user+sys cpu per delivered message
+ *   wakeups     indiserver voluntary context switches, ie, times it blocked
+ *   us/wakeup   indiserver cpu per wakeup
+ *   writes/msg  indiserver write system calls per delivered message
+ *   p50/p99     driver write to client read latency
+ *
+ * Example, sweep clients and drivers:
+ *   indiserver_bench -s ./indiserver -c 1,4,16 -d 1,10,40 -n 2000
+ *
+ * Example, TCP against a unix domain socket for 8 MB BLOBs:
+ *   indiserver_bench -s ./indiserver -c 1,4 -b 8000000 -B -R -n 50 -U
+ *
+ * Options after -- are passed on to indiserver, eg, its socket send buffer:
+ *   indiserver_bench -s ./indiserver -b 4000000 -B -- -w 1024
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define MAXLIST   16      /* max entries in -c and -d lists */
+#define RBUFSIZ   65536   /* read size */
+#define MAXSAMPLE 2000000 /* max latency samples kept */
+#define BATCHMSGS 64      /* number messages formatted per driver write */
+#define IDLESECS  10      /* give up if nothing arrives for this long */
+
+/* one fake driver or client connection */
+typedef struct
+{
+    int fd;
+    /* driver side */
+    int lfd;          /* listen socket the server connects to */
+    int port;         /* port of lfd */
+    long nsent;       /* messages sent */
+    int npending;     /* def replies owed */
+    char *obuf;       /* formatted text to send */
+    size_t nobuf;     /* bytes in obuf */
+    size_t mobuf;     /* malloced size of obuf */
+    size_t nflight;   /* leading bytes of obuf being written via iov[] */
+    struct iovec iov[3];
+    int niov;
+    /* client side */
+    char *ibuf;       /* unparsed input */
+    size_t nibuf;     /* bytes in ibuf */
+    size_t mibuf;     /* malloced size of ibuf */
+    int havets;       /* ts is valid, looking for end of message */
+    double ts;        /* send time of message being read */
+    long ndefs;       /* def*Vector seen during setup */
+    long nrx;         /* set*Vector seen */
+} Peer;
+
+static const char *server = "indiserver";
+static int nmsgs          = 1000;
+static int blobsize       = 0;
+static int binary         = 0;
+static int rawclients     = 0;
+static int rate           = 0;
+static int unixtoo        = 0;
+static int verbose        = 0;
+static char **sargs;     /* more indiserver options, after -- */
+static int nsargs;
+
+static char *payload; /* base64-ish or raw payload for BLOB runs */
+static int npayload;
+
+static double *samples;
+static long nsamples;
+
+static void usage(const char *me)
+{
+    fprintf(stderr, "Usage: %s [options] [-- indiserver options]\n", me);
+    fprintf(stderr, "Purpose: measure indiserver routing throughput and wakeup cost\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, " -s path  : indiserver to run, default indiserver on PATH\n");
+    fprintf(stderr, " -c list  : comma separated number of clients, default 1\n");
+    fprintf(stderr, " -d list  : comma separated number of drivers, default 1\n");
+    fprintf(stderr, " -n n     : messages sent per driver, default %d\n", nmsgs);
+    fprintf(stderr, " -b bytes : send setBLOBVector of this many raw bytes instead of numbers\n");
+    fprintf(stderr, " -B       : with -b, drivers send BLOB content as raw bytes\n");
+    fprintf(stderr, " -R       : with -b, clients ask for raw BLOB content\n");
+    fprintf(stderr, " -r hz    : messages/s per driver, default 0 for as fast as possible\n");
+    fprintf(stderr, " -U       : run each case again with clients on a unix domain socket\n");
+    fprintf(stderr, " -v       : show indiserver -v stderr, -vv for -vvv\n");
+    exit(2);
+}
+
+/* monotonic time in microseconds */
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int parseList(const char *s, int *list)
+{
+    int n = 0;
+    while (*s && n < MAXLIST)
+    {
+        list[n++] = atoi(s);
+        s         = strchr(s, ',');
+        if (!s)
+            break;
+        s++;
+    }
+    return n;
+}
+
+static void die(const char *what)
+{
+    fprintf(stderr, "%s: %s\n", what, strerror(errno));
+    exit(1);
+}
+
+static void setNonBlock(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/* open a listening socket on an ephemeral loopback port, return fd and port */
+static int listenAny(int *port)
+{
+    struct sockaddr_in sa;
+    socklen_t len = sizeof(sa);
+    int fd        = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        die("socket");
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family      = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(fd, 64) < 0)
+        die("bind");
+    getsockname(fd, (struct sockaddr *)&sa, &len);
+    *port = ntohs(sa.sin_port);
+    return fd;
+}
+
+/* find a free port for the server */
+static int freePort(void)
+{
+    int port;
+    close(listenAny(&port));
+    return port;
+}
+
+static int connectLoopback(int port)
+{
+    struct sockaddr_in sa;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+
+    if (fd < 0)
+        die("socket");
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family      = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sa.sin_port        = htons(port);
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+/* connect to the unix domain socket name, @name for the abstract namespace */
+static int connectUnix(const char *name)
+{
+    struct sockaddr_un sa;
+    socklen_t len = sizeof(sa);
+    int fd        = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        die("socket");
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strncpy(sa.sun_path, name, sizeof(sa.sun_path) - 1);
+    if (name[0] == '@')
+    {
+        sa.sun_path[0] = '\0';
+        len            = offsetof(struct sockaddr_un, sun_path) + strlen(name);
+    }
+    if (connect(fd, (struct sockaddr *)&sa, len) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void writeAll(int fd, const char *s)
+{
+    size_t n = strlen(s);
+    while (n > 0)
+    {
+        ssize_t nw = write(fd, s, n);
+        if (nw <= 0)
+            die("write");
+        s += nw;
+        n -= nw;
+    }
+}
+
+static void appendOut(Peer *p, const char *s, int n)
+{
+    if (p->nobuf + n > p->mobuf)
+    {
+        /* a write in progress may point into obuf, keep it there */
+        long off = -1;
+
+        if (p->niov > 0 && (char *)p->iov[0].iov_base >= p->obuf &&
+                (char *)p->iov[0].iov_base <= p->obuf + p->nflight)
+            off = (char *)p->iov[0].iov_base - p->obuf;
+        p->mobuf = (p->nobuf + n) * 2;
+        p->obuf  = realloc(p->obuf, p->mobuf);
+        if (off >= 0)
+            p->iov[0].iov_base = p->obuf + off;
+    }
+    memcpy(p->obuf + p->nobuf, s, n);
+    p->nobuf += n;
+}
+
+static void appendIn(Peer *p, const char *s, size_t n)
+{
+    if (p->nibuf + n > p->mibuf)
+    {
+        p->mibuf = (p->nibuf + n) * 2;
+        p->ibuf  = realloc(p->ibuf, p->mibuf);
+    }
+    memcpy(p->ibuf + p->nibuf, s, n);
+    p->nibuf += n;
+}
+
+/* drop the first n bytes of p->ibuf */
+static void consumeIn(Peer *p, size_t n)
+{
+    memmove(p->ibuf, p->ibuf + n, p->nibuf - n);
+    p->nibuf -= n;
+}
+
+/* count and drop occurrences of tag in p->ibuf, keeping a possible partial */
+static long countTag(Peer *p, const char *tag)
+{
+    size_t tl = strlen(tag);
+    long n    = 0;
+    char *s;
+
+    while ((s = memmem(p->ibuf, p->nibuf, tag, tl)) != NULL)
+    {
+        consumeIn(p, s - p->ibuf + tl);
+        n++;
+    }
+    if (p->nibuf >= tl)
+        consumeIn(p, p->nibuf - tl + 1);
+    return n;
+}
+
+/* queue a def for driver idx so clients see it exists */
+static void queueDef(Peer *p, int idx)
+{
+    char buf[512];
+    int n;
+
+    if (blobsize > 0)
+        n = snprintf(buf, sizeof(buf),
+                     "<defBLOBVector device='Bench%d' name='CCD1' label='Image' group='Bench' state='Idle' perm='ro'>\n"
+                     "    <defBLOB name='CCD1' label='Image'/>\n"
+                     "</defBLOBVector>\n",
+                     idx);
+    else
+        n = snprintf(buf, sizeof(buf),
+                     "<defNumberVector device='Bench%d' name='BENCH' label='Bench' group='Bench' state='Idle' "
+                     "perm='ro' timeout='0'>\n"
+                     "    <defNumber name='T' label='T' format='%%.0f' min='0' max='0' step='0'>\n0\n    </defNumber>\n"
+                     "</defNumberVector>\n",
+                     idx);
+    appendOut(p, buf, n);
+}
+
+/* make sure driver p has something in iov[] to write, if it should.
+ * return 1 if so else 0.
+ */
+static int fillDriver(Peer *p, int idx, double t0)
+{
+    char hdr[512];
+    int i, n;
+
+    if (p->niov > 0)
+        return 1;
+
+    /* pending text first */
+    if (p->nobuf > 0)
+    {
+        p->iov[0].iov_base = p->obuf;
+        p->iov[0].iov_len  = p->nobuf;
+        p->niov            = 1;
+        p->nflight         = p->nobuf;
+        return 1;
+    }
+
+    if (t0 <= 0 || p->nsent >= nmsgs)
+        return 0;
+
+    /* honor rate, if any */
+    if (rate > 0 && p->nsent >= (now_us() - t0) * rate / 1e6)
+        return 0;
+
+    if (blobsize > 0)
+    {
+        static char trailer[] = "\n    </oneBLOB>\n</setBLOBVector>\n";
+        n = snprintf(hdr, sizeof(hdr),
+                     "<setBLOBVector device='Bench%d' name='CCD1' state='Ok' timeout='60' timestamp='%.0f'>\n"
+                     "    <oneBLOB name='CCD1' size='%d' %s='%d' format='.fits'>%s",
+                     idx, now_us(), blobsize, binary ? "rawlen" : "enclen", npayload, binary ? "" : "\n");
+        appendOut(p, hdr, n);
+        p->iov[0].iov_base = p->obuf;
+        p->iov[0].iov_len  = p->nobuf;
+        p->iov[1].iov_base = payload;
+        p->iov[1].iov_len  = npayload;
+        p->iov[2].iov_base = trailer;
+        p->iov[2].iov_len  = sizeof(trailer) - 1;
+        p->niov            = 3;
+        p->nflight         = p->nobuf;
+        p->nsent++;
+        return 1;
+    }
+
+    for (i = 0; i < BATCHMSGS && p->nsent < nmsgs; i++)
+    {
+        n = snprintf(hdr, sizeof(hdr),
+                     "<setNumberVector device='Bench%d' name='BENCH' state='Ok' timeout='60' timestamp='%.0f'>\n"
+                     "    <oneNumber name='T'>\n%ld\n    </oneNumber>\n"
+                     "</setNumberVector>\n",
+                     idx, now_us(), p->nsent);
+        appendOut(p, hdr, n);
+        p->nsent++;
+        if (rate > 0)
+            break;
+    }
+    p->iov[0].iov_base = p->obuf;
+    p->iov[0].iov_len  = p->nobuf;
+    p->niov            = 1;
+    p->nflight         = p->nobuf;
+    return 1;
+}
+
+/* write what we can from driver p. return -1 if trouble */
+static int writeDriver(Peer *p)
+{
+    ssize_t nw = writev(p->fd, p->iov, p->niov);
+    int i;
+
+    if (nw < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+
+    /* advance iov[] */
+    for (i = 0; i < p->niov && nw > 0; i++)
+    {
+        size_t l = p->iov[i].iov_len < (size_t)nw ? p->iov[i].iov_len : (size_t)nw;
+        p->iov[i].iov_base = (char *)p->iov[i].iov_base + l;
+        p->iov[i].iov_len -= l;
+        nw -= l;
+    }
+    while (p->niov > 0 && p->iov[0].iov_len == 0)
+    {
+        memmove(p->iov, p->iov + 1, (p->niov - 1) * sizeof(struct iovec));
+        p->niov--;
+    }
+    /* done, keep anything queued meanwhile */
+    if (p->niov == 0)
+    {
+        memmove(p->obuf, p->obuf + p->nflight, p->nobuf - p->nflight);
+        p->nobuf -= p->nflight;
+        p->nflight = 0;
+    }
+    return 0;
+}
+
+/* parse whatever client p has read so far during the timed run */
+static void scanClient(Peer *p, double tnow)
+{
+    static const char tsat[]  = "timestamp=";
+    static const char endat[] = "</set";
+    const size_t ntsat        = sizeof(tsat) - 1;
+
+    while (1)
+    {
+        if (!p->havets)
+        {
+            char *s = memmem(p->ibuf, p->nibuf, tsat, ntsat);
+            char *q;
+            if (!s)
+            {
+                if (p->nibuf > ntsat)
+                    consumeIn(p, p->nibuf - ntsat);
+                return;
+            }
+            /* need the value and its closing quote, which ever kind it is */
+            q = (p->nibuf - (s - p->ibuf) > ntsat) ?
+                memchr(s + ntsat + 1, s[ntsat], p->nibuf - (s - p->ibuf) - ntsat - 1) : NULL;
+            if (!q)
+            {
+                consumeIn(p, s - p->ibuf);
+                return;
+            }
+            p->ts     = strtod(s + ntsat + 1, NULL);
+            p->havets = 1;
+            consumeIn(p, q - p->ibuf);
+        }
+        else
+        {
+            char *e = memmem(p->ibuf, p->nibuf, endat, sizeof(endat) - 1);
+            if (!e)
+            {
+                if (p->nibuf >= sizeof(endat))
+                    consumeIn(p, p->nibuf - sizeof(endat) + 1);
+                return;
+            }
+            if (nsamples < MAXSAMPLE)
+                samples[nsamples++] = tnow - p->ts;
+            p->nrx++;
+            p->havets = 0;
+            consumeIn(p, e - p->ibuf + sizeof(endat) - 1);
+        }
+    }
+}
+
+static int cmpDouble(const void *a, const void *b)
+{
+    double d = *(const double *)a - *(const double *)b;
+    return d < 0 ? -1 : d > 0;
+}
+
+/* read /proc/pid/status counters, best effort */
+static void procSwitches(int pid, long *vol, long *invol)
+{
+    char fn[64], line[256];
+    FILE *fp;
+
+    *vol = *invol = -1;
+    snprintf(fn, sizeof(fn), "/proc/%d/status", pid);
+    fp = fopen(fn, "r");
+    if (!fp)
+        return;
+    while (fgets(line, sizeof(line), fp))
+    {
+        sscanf(line, "voluntary_ctxt_switches: %ld", vol);
+        sscanf(line, "nonvoluntary_ctxt_switches: %ld", invol);
+    }
+    fclose(fp);
+}
+
+/* read /proc/pid/io count of write system calls, best effort */
+static long procWrites(int pid)
+{
+    char fn[64], line[256];
+    long n = -1;
+    FILE *fp;
+
+    snprintf(fn, sizeof(fn), "/proc/%d/io", pid);
+    fp = fopen(fn, "r");
+    if (!fp)
+        return -1;
+    while (fgets(line, sizeof(line), fp))
+        sscanf(line, "syscw: %ld", &n);
+    fclose(fp);
+    return n;
+}
+
+/* read /proc/pid/stat cpu time in us, best effort */
+static double procCPU(int pid)
+{
+    char fn[64], buf[1024], *s;
+    unsigned long ut, st;
+    FILE *fp;
+
+    snprintf(fn, sizeof(fn), "/proc/%d/stat", pid);
+    fp = fopen(fn, "r");
+    if (!fp)
+        return -1;
+    if (!fgets(buf, sizeof(buf), fp))
+    {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    s = strrchr(buf, ')');
+    if (!s || sscanf(s + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &ut, &st) != 2)
+        return -1;
+    return (ut + st) * 1e6 / sysconf(_SC_CLK_TCK);
+}
+
+static void run(int ncl, int ndv, int viaunix)
+{
+    Peer *dv = calloc(ndv, sizeof(Peer));
+    Peer *cl = calloc(ncl, sizeof(Peer));
+    struct pollfd *pfd = calloc(ndv + ncl, sizeof(struct pollfd));
+    char **args = calloc(ndv + nsargs + 8, sizeof(char *));
+    char portstr[16], upath[64], rbuf[RBUFSIZ];
+    int port = freePort();
+    long expect = (long)ncl * ndv * nmsgs, got = 0;
+    long vol0 = -1, invol0, vol1, invol1, wr0 = -1, wr1;
+    double t0 = 0, tlast, cpu0 = -1, cpu1, elapsed;
+    int i, na = 0, firstdv, ready = 0;
+    pid_t pid;
+
+    /* one listening socket per driver */
+    for (i = 0; i < ndv; i++)
+        dv[i].lfd = listenAny(&dv[i].port);
+
+    /* start server */
+    snprintf(portstr, sizeof(portstr), "%d", port);
+    args[na++] = (char *)server;
+    args[na++] = "-p";
+    args[na++] = portstr;
+    if (verbose)
+        args[na++] = verbose > 1 ? "-vvv" : "-v";
+    if (viaunix)
+    {
+        snprintf(upath, sizeof(upath), "@indiserver_bench.%d", (int)getpid());
+        args[na++] = "-u";
+        args[na++] = upath;
+    }
+    for (i = 0; i < nsargs; i++)
+        args[na++] = sargs[i];
+    firstdv = na;
+    for (i = 0; i < ndv; i++)
+    {
+        args[na] = malloc(64);
+        snprintf(args[na++], 64, "Bench%d@127.0.0.1:%d", i, dv[i].port);
+    }
+    pid = fork();
+    if (pid < 0)
+        die("fork");
+    if (pid == 0)
+    {
+        if (!verbose)
+        {
+            int fd = open("/dev/null", O_WRONLY);
+            dup2(fd, 2);
+        }
+        execvp(server, args);
+        fprintf(stderr, "exec %s: %s\n", server, strerror(errno));
+        _exit(1);
+    }
+
+    /* accept server connecting to each driver */
+    for (i = 0; i < ndv; i++)
+    {
+        struct pollfd lp = { dv[i].lfd, POLLIN, 0 };
+        if (poll(&lp, 1, 5000) <= 0)
+        {
+            fprintf(stderr, "server did not connect to driver %d\n", i);
+            kill(pid, SIGKILL);
+            exit(1);
+        }
+        dv[i].fd = accept(dv[i].lfd, NULL, NULL);
+        setNonBlock(dv[i].fd);
+    }
+
+    /* connect clients, server listens once all drivers are up */
+    for (i = 0; i < ncl; i++)
+    {
+        int tries;
+        for (tries = 0; (cl[i].fd = viaunix ? connectUnix(upath) : connectLoopback(port)) < 0 && tries < 500;
+                tries++)
+            usleep(10000);
+        if (cl[i].fd < 0)
+        {
+            fprintf(stderr, "can not connect client %d to server\n", i);
+            kill(pid, SIGKILL);
+            exit(1);
+        }
+        writeAll(cl[i].fd, rawclients ? "<getProperties version='1.7' binaryBLOB='1'/>\n" :
+                                        "<getProperties version='1.7'/>\n");
+        if (blobsize > 0)
+            writeAll(cl[i].fd, "<enableBLOB>Also</enableBLOB>\n");
+        setNonBlock(cl[i].fd);
+    }
+
+    /* service everyone until all clients have seen everything */
+    tlast = now_us();
+    while (got < expect)
+    {
+        int n = 0, ns;
+        double tnow;
+
+        for (i = 0; i < ndv; i++)
+        {
+            pfd[n].fd     = dv[i].fd;
+            pfd[n].events = POLLIN | (fillDriver(&dv[i], i, t0) ? POLLOUT : 0);
+            n++;
+        }
+        for (i = 0; i < ncl; i++)
+        {
+            pfd[n].fd     = cl[i].fd;
+            pfd[n].events = POLLIN;
+            n++;
+        }
+
+        ns = poll(pfd, n, rate > 0 ? 1 : 100);
+        if (ns < 0 && errno != EINTR)
+            die("poll");
+        tnow = now_us();
+
+        for (i = 0; i < ndv; i++)
+        {
+            Peer *p = &dv[i];
+            if (pfd[i].revents & POLLIN)
+            {
+                ssize_t nr = read(p->fd, rbuf, sizeof(rbuf));
+                if (nr <= 0)
+                {
+                    fprintf(stderr, "driver %d: server closed connection\n", i);
+                    goto done;
+                }
+                appendIn(p, rbuf, nr);
+                p->npending += countTag(p, "<getProperties");
+                while (p->npending > 0)
+                {
+                    queueDef(p, i);
+                    p->npending--;
+                }
+            }
+            if ((pfd[i].revents & POLLOUT) && writeDriver(p) < 0)
+            {
+                fprintf(stderr, "driver %d: write: %s\n", i, strerror(errno));
+                goto done;
+            }
+        }
+
+        for (i = 0; i < ncl; i++)
+        {
+            Peer *p = &cl[i];
+            if (pfd[ndv + i].revents & POLLIN)
+            {
+                ssize_t nr = read(p->fd, rbuf, sizeof(rbuf));
+                if (nr <= 0)
+                {
+                    fprintf(stderr, "client %d: server closed connection\n", i);
+                    goto done;
+                }
+                tlast = tnow;
+                appendIn(p, rbuf, nr);
+                if (t0 > 0)
+                {
+                    long before = p->nrx;
+                    scanClient(p, tnow);
+                    got += p->nrx - before;
+                }
+                else
+                {
+                    int had = p->ndefs >= ndv;
+                    p->ndefs += countTag(p, "<def");
+                    if (!had && p->ndefs >= ndv)
+                        ready++;
+                }
+            }
+        }
+
+        /* start timing once each client has seen every driver */
+        if (t0 <= 0 && ready == ncl)
+        {
+            for (i = 0; i < ncl; i++)
+                cl[i].nibuf = 0;
+            procSwitches(pid, &vol0, &invol0);
+            cpu0 = procCPU(pid);
+            wr0  = procWrites(pid);
+            t0   = now_us();
+        }
+
+        if (tnow - tlast > IDLESECS * 1e6)
+        {
+            fprintf(stderr, "timed out with %ld of %ld messages\n", got, expect);
+            break;
+        }
+    }
+
+done:
+    elapsed = (now_us() - t0) / 1e6;
+    procSwitches(pid, &vol1, &invol1);
+    cpu1 = procCPU(pid);
+    wr1  = procWrites(pid);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    qsort(samples, nsamples, sizeof(double), cmpDouble);
+    {
+        double cpu   = (cpu0 >= 0 && cpu1 >= 0) ? cpu1 - cpu0 : -1;
+        long wakeups = (vol0 >= 0 && vol1 >= 0) ? vol1 - vol0 : -1;
+        long writes  = (wr0 >= 0 && wr1 >= 0) ? wr1 - wr0 : -1;
+        printf("%5s %7d %7d %10ld %9.3f %12.0f %10.0f %10.2f %10ld %10.2f %10.3f %9.0f %9.0f\n", viaunix ? "unix" : "tcp",
+               ncl, ndv, got, elapsed,
+               got / elapsed, blobsize > 0 ? got * (double)blobsize / elapsed / 1e6 : 0, cpu >= 0 ? cpu / got : -1,
+               wakeups, (cpu >= 0 && wakeups > 0) ? cpu / wakeups : -1, (writes >= 0 && got > 0) ? (double)writes / got : -1,
+               nsamples ? samples[nsamples / 2] : 0, nsamples ? samples[nsamples * 99 / 100] : 0);
+        fflush(stdout);
+    }
+
+    for (i = 0; i < ndv; i++)
+    {
+        close(dv[i].fd);
+        close(dv[i].lfd);
+        free(dv[i].obuf);
+        free(dv[i].ibuf);
+    }
+    for (i = 0; i < ncl; i++)
+    {
+        close(cl[i].fd);
+        free(cl[i].ibuf);
+    }
+    for (i = firstdv; i < na; i++)
+        free(args[i]);
+    free(args);
+    free(pfd);
+    free(cl);
+    free(dv);
+    nsamples = 0;
+}
+
+int main(int ac, char *av[])
+{
+    int clients[MAXLIST] = { 1 }, drivers[MAXLIST] = { 1 };
+    int nclients = 1, ndrivers = 1;
+    int c, i, j;
+
+    while ((c = getopt(ac, av, "s:c:d:n:b:BRr:Uv")) != -1)
+    {
+        switch (c)
+        {
+            case 's':
+                server = optarg;
+                break;
+            case 'c':
+                nclients = parseList(optarg, clients);
+                break;
+            case 'd':
+                ndrivers = parseList(optarg, drivers);
+                break;
+            case 'n':
+                nmsgs = atoi(optarg);
+                break;
+            case 'b':
+                blobsize = atoi(optarg);
+                break;
+            case 'B':
+                binary = 1;
+                break;
+            case 'R':
+                rawclients = 1;
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            case 'U':
+                unixtoo = 1;
+                break;
+            case 'v':
+                verbose++;
+                break;
+            default:
+                usage(av[0]);
+        }
+    }
+
+    sargs  = av + optind;
+    nsargs = ac - optind;
+
+    signal(SIGPIPE, SIG_IGN);
+    samples = malloc(MAXSAMPLE * sizeof(double));
+
+    /* raw BLOB payload is every byte value in turn, which never spells out
+     * the markup clients look for but does hold '<', '&' and nul.
+     * base64 payload is 72 column lines of base64 digits.
+     */
+    if (blobsize > 0 && binary)
+    {
+        payload = malloc(blobsize);
+        for (npayload = 0; npayload < blobsize; npayload++)
+            payload[npayload] = (char)npayload;
+    }
+    else if (blobsize > 0)
+    {
+        int enc = 4 * ((blobsize + 2) / 3);
+        payload = malloc(enc + enc / 72 + 1);
+        for (i = 0; i < enc; i++)
+        {
+            payload[npayload++] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[i % 64];
+            if ((i + 1) % 72 == 0 && i + 1 < enc)
+                payload[npayload++] = '\n';
+        }
+    }
+
+    printf("%5s %7s %7s %10s %9s %12s %10s %10s %10s %10s %10s %9s %9s\n", "via", "clients", "drivers", "msgs", "secs",
+           "msgs/s", "MB/s", "cpu us/msg", "wakeups", "us/wakeup", "writes/msg", "p50 us", "p99 us");
+    for (i = 0; i < nclients; i++)
+        for (j = 0; j < ndrivers; j++)
+        {
+            run(clients[i], drivers[j], 0);
+            if (unixtoo)
+                run(clients[i], drivers[j], 1);
+        }
+
+    free(payload);
+    free(samples);
+    return 0;
+}
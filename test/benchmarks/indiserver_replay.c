@@ -0,0 +1,730 @@
+/*
+    INDI Server capture replay
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/* Play back traffic captured with indiserver -L against a real indiserver.
+ *
+ * We start the server with each driver of the capture as a "remote" driver,
+ * ie, it connects back to a socket we listen on and we play the part of the
+ * driver, as indiserver_bench does. Clients connect when they did in the
+ * capture. Then all that drivers and clients sent is sent again, in the same
+ * order and at the same pace, or -x times faster, or as fast as the server
+ * takes it with -x 0. What the server sends back is read and counted.
+ * N.B. drivers' replies are played when they were captured, not when asked
+ * for, so the faster the replay the more of them reach the server before
+ * the client requests they answer and go nowhere. Compare runs at one pace.
+ *
+ * Once all has been sent and clients have heard nothing more for -i secs we
+ * report what clients got and how fast, the server cpu used and the server's
+ * own metrics, which include its fan-out latency from driver read to client
+ * write, asked for with "metrics" on its fifo.
+ *
+ * Example, a night of traffic 10 times as fast:
+ *   indiserver -L night.cap indi_simulator_ccd indi_simulator_telescope
+ *   indiserver_replay -s ./indiserver -x 10 night.cap
+ *
+ * Options after the capture file and -- are passed on to indiserver:
+ *   indiserver_replay -s ./indiserver -x 0 night.cap -- -t 2
+ *
+ * Not played back: shm BLOB content, which is not captured, and compressed
+ * links. Clients that asked for either are played back without.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define CAPHEAD  "# indiserver capture 1\n" /* first line of a capture */
+#define RBUFSIZ  65536                      /* read size */
+#define MAXTAIL  15                         /* longest tag counted less 1 */
+
+/* one record of the capture, see captureIO() in indiserver.c */
+typedef struct
+{
+    double t;   /* us since the server started */
+    char kind;  /* D, d, C or c */
+    int id;     /* driver or client index */
+    char *data; /* into the mapped capture */
+    size_t n;   /* bytes at data */
+} Rec;
+
+/* one fake driver or client connection */
+typedef struct
+{
+    int fd;              /* -1 if not connected */
+    int lfd;             /* drivers: listen socket the server connects to */
+    int port;            /* drivers: port of lfd */
+    int used;            /* drivers: 1 if in the capture */
+    int viaunix;         /* clients: connects to the unix domain socket */
+    long long nrx;       /* bytes read from the server */
+    long nmsgs;          /* clients: messages in them */
+    char tail[MAXTAIL];  /* last bytes read, for tags split between reads */
+    int ntail;           /* n bytes in tail */
+} Peer;
+
+static const char *server = "indiserver";
+static double speed       = 1;
+static double idlesecs    = 1;
+static int verbose        = 0;
+static char **sargs; /* more indiserver options, after -- */
+static int nsargs;
+
+static Rec *recs;
+static int nrecs;
+
+/* what each message to a client ends with, or is */
+static const char *msgtags[] = { "Vector>", "<message ", "<delProperty " };
+#define NMSGTAGS ((int)(sizeof(msgtags) / sizeof(msgtags[0])))
+
+static void usage(const char *me)
+{
+    fprintf(stderr, "Usage: %s [options] capture [-- indiserver options]\n", me);
+    fprintf(stderr, "Purpose: play back traffic captured with indiserver -L\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, " -s path  : indiserver to run, default indiserver on PATH\n");
+    fprintf(stderr, " -x n     : play n times as fast as captured, 0 for as fast as possible, default 1\n");
+    fprintf(stderr, " -i secs  : done when clients heard nothing for this long after the end, default 1\n");
+    fprintf(stderr, " -v       : show indiserver -v stderr, -vv for -vvv\n");
+    exit(2);
+}
+
+/* monotonic time in microseconds */
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void die(const char *what)
+{
+    fprintf(stderr, "%s: %s\n", what, strerror(errno));
+    exit(1);
+}
+
+static void setNonBlock(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/* open a listening socket on an ephemeral loopback port, return fd and port */
+static int listenAny(int *port)
+{
+    struct sockaddr_in sa;
+    socklen_t len = sizeof(sa);
+    int fd        = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        die("socket");
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family      = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(fd, 64) < 0)
+        die("bind");
+    getsockname(fd, (struct sockaddr *)&sa, &len);
+    *port = ntohs(sa.sin_port);
+    return fd;
+}
+
+/* find a free port for the server */
+static int freePort(void)
+{
+    int port;
+    close(listenAny(&port));
+    return port;
+}
+
+static int connectLoopback(int port)
+{
+    struct sockaddr_in sa;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+
+    if (fd < 0)
+        die("socket");
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family      = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sa.sin_port        = htons(port);
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+/* connect to the unix domain socket name, @name for the abstract namespace */
+static int connectUnix(const char *name)
+{
+    struct sockaddr_un sa;
+    socklen_t len = sizeof(sa);
+    int fd        = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        die("socket");
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strncpy(sa.sun_path, name, sizeof(sa.sun_path) - 1);
+    if (name[0] == '@')
+    {
+        sa.sun_path[0] = '\0';
+        len            = offsetof(struct sockaddr_un, sun_path) + strlen(name);
+    }
+    if (connect(fd, (struct sockaddr *)&sa, len) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* blank attribute att, and its value, wherever it is in buf */
+static void blankAtt(char *buf, size_t n, const char *att)
+{
+    size_t al = strlen(att);
+    char *s, *q;
+
+    while ((s = memmem(buf, n, att, al)) != NULL)
+    {
+        q = s + al;
+        if (q + 1 < buf + n && (q = memchr(q + 1, q[0], buf + n - q - 1)) != NULL)
+            memset(s, ' ', q - s + 1);
+        else
+            memset(s, ' ', al);
+    }
+}
+
+/* map the capture in path and split it into recs[]. we may write to the map,
+ * it is private.
+ */
+static void loadCapture(const char *path)
+{
+    struct stat st;
+    char *buf, *s, *end;
+    int fd, mrecs = 0;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0)
+        die(path);
+    if (st.st_size < (off_t)sizeof(CAPHEAD) - 1)
+    {
+        fprintf(stderr, "%s: not an indiserver capture\n", path);
+        exit(1);
+    }
+    buf = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (buf == MAP_FAILED)
+        die("mmap");
+    close(fd);
+    if (memcmp(buf, CAPHEAD, sizeof(CAPHEAD) - 1))
+    {
+        fprintf(stderr, "%s: not an indiserver capture\n", path);
+        exit(1);
+    }
+
+    end = buf + st.st_size;
+    for (s = buf + sizeof(CAPHEAD) - 1; s < end;)
+    {
+        char *nl = memchr(s, '\n', end - s);
+        unsigned long n;
+        Rec *rp;
+
+        if (nrecs == mrecs)
+        {
+            mrecs = mrecs ? 2 * mrecs : 1024;
+            recs  = realloc(recs, mrecs * sizeof(Rec));
+            if (!recs)
+                die("realloc");
+        }
+        rp = &recs[nrecs];
+        if (!nl || sscanf(s, "%lf %c %d %lu", &rp->t, &rp->kind, &rp->id, &n) != 4 || rp->id < 0 ||
+                (size_t)(end - nl - 1) < n)
+        {
+            /* the server may have been killed while writing the last one */
+            fprintf(stderr, "%s: ignoring all from byte %ld on\n", path, (long)(s - buf));
+            break;
+        }
+        rp->data = nl + 1;
+        rp->n    = n;
+        s        = rp->data + n + 1;
+        nrecs++;
+
+        /* we can do neither */
+        if (rp->kind == 'c')
+        {
+            blankAtt(rp->data, rp->n, "compress=");
+            blankAtt(rp->data, rp->n, "shmBLOB=");
+        }
+    }
+}
+
+/* count the client messages in the n bytes at buf read by p */
+static void countMsgs(Peer *p, const char *buf, size_t n)
+{
+    char join[2 * MAXTAIL];
+    size_t nj = n < MAXTAIL ? n : MAXTAIL;
+    int i;
+
+    /* those that straddle the last read and this one */
+    memcpy(join, p->tail, p->ntail);
+    memcpy(join + p->ntail, buf, nj);
+    for (i = 0; i < NMSGTAGS; i++)
+    {
+        size_t tl = strlen(msgtags[i]);
+        size_t k;
+
+        for (k = p->ntail > (int)tl - 1 ? p->ntail - (tl - 1) : 0; k < (size_t)p->ntail && k + tl <= p->ntail + nj; k++)
+            if (!memcmp(join + k, msgtags[i], tl))
+                p->nmsgs++;
+    }
+
+    for (i = 0; i < NMSGTAGS; i++)
+    {
+        size_t tl      = strlen(msgtags[i]);
+        const char *s  = buf;
+        const char *e  = buf + n;
+
+        while ((s = memmem(s, e - s, msgtags[i], tl)) != NULL)
+        {
+            p->nmsgs++;
+            s += tl;
+        }
+    }
+
+    /* keep the last few for next time */
+    if (n >= MAXTAIL)
+    {
+        memcpy(p->tail, buf + n - MAXTAIL, MAXTAIL);
+        p->ntail = MAXTAIL;
+    }
+    else
+    {
+        int keep = p->ntail + (int)n > MAXTAIL ? MAXTAIL - (int)n : p->ntail;
+
+        memmove(p->tail, p->tail + p->ntail - keep, keep);
+        memcpy(p->tail + keep, buf, n);
+        p->ntail = keep + n;
+    }
+}
+
+/* read /proc/pid/stat cpu time in us, best effort */
+static double procCPU(int pid)
+{
+    char fn[64], buf[1024], *s;
+    unsigned long ut, st;
+    FILE *fp;
+
+    snprintf(fn, sizeof(fn), "/proc/%d/stat", pid);
+    fp = fopen(fn, "r");
+    if (!fp)
+        return -1;
+    if (!fgets(buf, sizeof(buf), fp))
+    {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    s = strrchr(buf, ')');
+    if (!s || sscanf(s + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &ut, &st) != 2)
+        return -1;
+    return (ut + st) * 1e6 / sysconf(_SC_CLK_TCK);
+}
+
+/* ask the server for its metrics over fifo and copy them to stdout */
+static void serverMetrics(const char *fifo, const char *mpath)
+{
+    char line[4096];
+    FILE *fp = NULL;
+    int fd, tries;
+
+    fd = open(fifo, O_WRONLY | O_NONBLOCK);
+    if (fd < 0)
+        return;
+    snprintf(line, sizeof(line), "metrics %s\n", mpath);
+    if (write(fd, line, strlen(line)) < 0)
+        fprintf(stderr, "fifo: %s\n", strerror(errno));
+    close(fd);
+
+    for (tries = 0; tries < 200 && !(fp = fopen(mpath, "r")); tries++)
+        usleep(10000);
+    if (!fp)
+    {
+        printf("server metrics: none, is it older than -L?\n");
+        return;
+    }
+    printf("server metrics:\n");
+    while (fgets(line, sizeof(line), fp))
+        fputs(line, stdout);
+    fclose(fp);
+    unlink(mpath);
+}
+
+/* play recs[i] from byte *off on. return 1 when all of it is done, 0 if the
+ * server can not take more just now.
+ */
+static int playRec(Peer *dv, int ndv, Peer *cl, int port, const char *upath, int i, size_t *off)
+{
+    Rec *rp = &recs[i];
+    Peer *p;
+    ssize_t nw;
+    int tries;
+
+    switch (rp->kind)
+    {
+        case 'C':
+            /* the server listens once all drivers are up, allow for that */
+            p = &cl[rp->id];
+            if (p->fd >= 0)
+                close(p->fd);
+            for (tries = 0; (p->fd = p->viaunix ? connectUnix(upath) : connectLoopback(port)) < 0 && tries < 500;
+                    tries++)
+                usleep(10000);
+            p->ntail = 0;
+            if (p->fd < 0)
+                fprintf(stderr, "client %d: can not connect: %s\n", rp->id, strerror(errno));
+            else
+                setNonBlock(p->fd);
+            return 1;
+
+        case 'c':
+            p = &cl[rp->id];
+            break;
+
+        case 'd':
+            p = rp->id < ndv ? &dv[rp->id] : NULL;
+            break;
+
+        default:
+            return 1;
+    }
+
+    /* a driver closing is left to the server, a client just stops sending */
+    if (!p || p->fd < 0 || (rp->n == 0 && rp->kind == 'd'))
+        return 1;
+    if (rp->n == 0)
+    {
+        shutdown(p->fd, SHUT_WR);
+        return 1;
+    }
+
+    nw = write(p->fd, rp->data + *off, rp->n - *off);
+    if (nw < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+    if (nw < 0)
+    {
+        fprintf(stderr, "%s %d: write: %s\n", rp->kind == 'd' ? "driver" : "client", rp->id, strerror(errno));
+        close(p->fd);
+        p->fd = -1;
+        return 1;
+    }
+    *off += nw;
+    return *off == rp->n;
+}
+
+int main(int ac, char *av[])
+{
+    struct pollfd *pfd;
+    Peer *dv, *cl;
+    char **args;
+    char portstr[16], upath[64], fifo[64], mpath[64], rbuf[RBUFSIZ];
+    int ndv = 0, ncl = 0, nconn = 0, unixcl = 0, port, c, i, na = 0, firstdv, next = 0;
+    long long dbytes = 0, cbytes = 0, gotbytes = 0;
+    long gotmsgs = 0;
+    double t0, tlast, tdone = 0, cpu0, cpu1, elapsed, span;
+    size_t off = 0;
+    pid_t pid;
+
+    while ((c = getopt(ac, av, "+s:x:i:v")) != -1)
+    {
+        switch (c)
+        {
+            case 's':
+                server = optarg;
+                break;
+            case 'x':
+                speed = atof(optarg);
+                break;
+            case 'i':
+                idlesecs = atof(optarg);
+                break;
+            case 'v':
+                verbose++;
+                break;
+            default:
+                usage(av[0]);
+        }
+    }
+    if (optind >= ac)
+        usage(av[0]);
+    loadCapture(av[optind++]);
+    if (optind < ac && !strcmp(av[optind], "--"))
+        optind++;
+    sargs  = av + optind;
+    nsargs = ac - optind;
+
+    if (nrecs == 0)
+    {
+        fprintf(stderr, "nothing to play\n");
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    /* who is in it, and what each sent */
+    for (i = 0; i < nrecs; i++)
+    {
+        if (recs[i].kind == 'D' || recs[i].kind == 'd')
+            ndv = recs[i].id + 1 > ndv ? recs[i].id + 1 : ndv;
+        if (recs[i].kind == 'C' || recs[i].kind == 'c')
+            ncl = recs[i].id + 1 > ncl ? recs[i].id + 1 : ncl;
+    }
+    dv = calloc(ndv + 1, sizeof(Peer));
+    cl = calloc(ncl + 1, sizeof(Peer));
+    for (i = 0; i < ndv; i++)
+        dv[i].fd = -1;
+    for (i = 0; i < ncl; i++)
+        cl[i].fd = -1;
+    for (i = 0; i < nrecs; i++)
+    {
+        Rec *rp = &recs[i];
+
+        if (rp->kind == 'D')
+            dv[rp->id].used = 1;
+        else if (rp->kind == 'd')
+            dbytes += rp->n;
+        else if (rp->kind == 'C')
+        {
+            cl[rp->id].viaunix = rp->n == 4 && !memcmp(rp->data, "unix", 4);
+            unixcl |= cl[rp->id].viaunix;
+            nconn++;
+        }
+        else if (rp->kind == 'c')
+            cbytes += rp->n;
+    }
+
+    /* one listening socket per driver, the server connects to each */
+    pfd  = calloc(ndv + ncl + 1, sizeof(struct pollfd));
+    args = calloc(ndv + nsargs + 12, sizeof(char *));
+    port = freePort();
+    snprintf(portstr, sizeof(portstr), "%d", port);
+    snprintf(upath, sizeof(upath), "@indiserver_replay.%d", (int)getpid());
+    snprintf(fifo, sizeof(fifo), "/tmp/indiserver_replay.%d.fifo", (int)getpid());
+    snprintf(mpath, sizeof(mpath), "/tmp/indiserver_replay.%d.metrics", (int)getpid());
+    if (mkfifo(fifo, 0600) < 0)
+        die(fifo);
+
+    args[na++] = (char *)server;
+    args[na++] = "-p";
+    args[na++] = portstr;
+    args[na++] = "-f";
+    args[na++] = fifo;
+    if (verbose)
+        args[na++] = verbose > 1 ? "-vvv" : "-v";
+    if (unixcl)
+    {
+        args[na++] = "-u";
+        args[na++] = upath;
+    }
+    for (i = 0; i < nsargs; i++)
+        args[na++] = sargs[i];
+    firstdv = na;
+    for (i = 0; i < ndv; i++)
+    {
+        if (!dv[i].used)
+            continue;
+        dv[i].lfd = listenAny(&dv[i].port);
+        args[na]  = malloc(64);
+        snprintf(args[na++], 64, "@127.0.0.1:%d", dv[i].port);
+    }
+
+    pid = fork();
+    if (pid < 0)
+        die("fork");
+    if (pid == 0)
+    {
+        if (!verbose)
+        {
+            int fd = open("/dev/null", O_WRONLY);
+            dup2(fd, 2);
+        }
+        execvp(server, args);
+        fprintf(stderr, "exec %s: %s\n", server, strerror(errno));
+        _exit(1);
+    }
+
+    /* accept server connecting to each driver */
+    for (i = 0; i < ndv; i++)
+    {
+        struct pollfd lp = { dv[i].lfd, POLLIN, 0 };
+
+        if (!dv[i].used)
+            continue;
+        if (poll(&lp, 1, 5000) <= 0)
+        {
+            fprintf(stderr, "server did not connect to driver %d\n", i);
+            kill(pid, SIGKILL);
+            unlink(fifo);
+            exit(1);
+        }
+        dv[i].fd = accept(dv[i].lfd, NULL, NULL);
+        setNonBlock(dv[i].fd);
+    }
+
+    /* play each record when due, meanwhile read all the server sends */
+    cpu0  = procCPU(pid);
+    t0    = now_us();
+    tlast = t0;
+    while (1)
+    {
+        double tnow = now_us();
+        double due  = 0;
+        int n = 0, ns, wantfd = -1, timeout;
+
+        while (next < nrecs)
+        {
+            due = speed > 0 ? t0 + (recs[next].t - recs[0].t) / speed : 0;
+            if (due > tnow || !playRec(dv, ndv, cl, port, upath, next, &off))
+                break;
+            next++;
+            off = 0;
+        }
+        if (next == nrecs && tdone == 0)
+            tdone = tnow;
+        if (next == nrecs && tnow - tlast > idlesecs * 1e6 && tnow - tdone > idlesecs * 1e6)
+            break;
+
+        /* the record that could not go yet waits for room */
+        if (next < nrecs && due <= tnow)
+        {
+            Rec *rp = &recs[next];
+            wantfd  = rp->kind == 'd' ? dv[rp->id].fd : cl[rp->id].fd;
+        }
+
+        for (i = 0; i < ndv; i++)
+        {
+            pfd[n].fd     = dv[i].fd;
+            pfd[n].events = POLLIN | (dv[i].fd >= 0 && dv[i].fd == wantfd ? POLLOUT : 0);
+            n++;
+        }
+        for (i = 0; i < ncl; i++)
+        {
+            pfd[n].fd     = cl[i].fd;
+            pfd[n].events = POLLIN | (cl[i].fd >= 0 && cl[i].fd == wantfd ? POLLOUT : 0);
+            n++;
+        }
+
+        if (next < nrecs && wantfd < 0)
+            timeout = due > tnow ? (int)((due - tnow) / 1000) : 0;
+        else
+            timeout = 100;
+        ns = poll(pfd, n, timeout);
+        if (ns < 0 && errno != EINTR)
+            die("poll");
+        tnow = now_us();
+
+        for (i = 0; i < ndv + ncl; i++)
+        {
+            Peer *p = i < ndv ? &dv[i] : &cl[i - ndv];
+            ssize_t nr;
+
+            if (p->fd < 0 || !(pfd[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            nr = read(p->fd, rbuf, sizeof(rbuf));
+            if (nr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                continue;
+            if (nr <= 0)
+            {
+                if (i < ndv)
+                    fprintf(stderr, "driver %d: server closed connection\n", i);
+                close(p->fd);
+                p->fd = -1;
+                continue;
+            }
+            p->nrx += nr;
+            if (i >= ndv)
+            {
+                countMsgs(p, rbuf, nr);
+                tlast = tnow;
+            }
+        }
+    }
+
+    elapsed = ((tlast > tdone ? tlast : tdone) - t0) / 1e6;
+    span    = (recs[nrecs - 1].t - recs[0].t) / 1e6;
+    cpu1    = procCPU(pid);
+    for (i = 0; i < ncl; i++)
+    {
+        gotbytes += cl[i].nrx;
+        gotmsgs += cl[i].nmsgs;
+    }
+
+    printf("capture   %d records over %.3f s: %d drivers sent %.3f MB, %d client connections sent %.3f MB\n", nrecs,
+           span, ndv, dbytes / 1e6, nconn, cbytes / 1e6);
+    if (speed > 0)
+        printf("replay    %.3f s at %g times the captured pace\n", elapsed, speed);
+    else
+        printf("replay    %.3f s as fast as the server takes it\n", elapsed);
+    printf("clients   got %ld msgs, %.3f MB: %.0f msgs/s, %.3f MB/s\n", gotmsgs, gotbytes / 1e6, gotmsgs / elapsed,
+           gotbytes / 1e6 / elapsed);
+    if (cpu0 >= 0 && cpu1 >= 0)
+        printf("server    cpu %.3f s, %.2f us/msg\n", (cpu1 - cpu0) / 1e6,
+               gotmsgs > 0 ? (cpu1 - cpu0) / gotmsgs : 0);
+    serverMetrics(fifo, mpath);
+    fflush(stdout);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    unlink(fifo);
+
+    for (i = 0; i < ndv; i++)
+    {
+        if (dv[i].fd >= 0)
+            close(dv[i].fd);
+        if (dv[i].used)
+            close(dv[i].lfd);
+    }
+    for (i = 0; i < ncl; i++)
+        if (cl[i].fd >= 0)
+            close(cl[i].fd);
+    for (i = firstdv; i < na; i++)
+        free(args[i]);
+    free(args);
+    free(pfd);
+    free(cl);
+    free(dv);
+    free(recs);
+    return 0;
+}
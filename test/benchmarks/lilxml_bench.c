@@ -0,0 +1,194 @@
+/*
+    lilxml parser benchmark
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/* Measure how fast lilxml parses one large setBLOBVector, formatted just as
+ * IDSetBLOB() sends it: base64 in 72 char lines.
+ *
+ * Each run parses the same message in memory with:
+ *   readXMLEle      one char at a time
+ *   parseXMLChunk   in chunks of -c bytes, pcdata collected in the element
+ *   sink            same but the oneBLOB pcdata goes to a callback
+ *
+ * Example:
+ *   lilxml_bench -m 50 -c 49152 -n 3
+ */
+
+#include "lilxml.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int mbytes = 50;    /* raw BLOB MB */
+static int chunk  = 49152; /* parseXMLChunk size, same as indiserver MAXRBUF */
+static int nruns  = 3;     /* best of */
+
+static void usage(const char *me)
+{
+    fprintf(stderr, "Usage: %s [options]\n", me);
+    fprintf(stderr, "Purpose: measure lilxml parse throughput on a large setBLOBVector\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, " -m MB    : raw BLOB size, default %d\n", mbytes);
+    fprintf(stderr, " -c bytes : parseXMLChunk chunk size, default %d\n", chunk);
+    fprintf(stderr, " -n n     : runs of each, best is reported, default %d\n", nruns);
+    exit(2);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+/* build the message, return its length */
+static int buildMsg(char **msgp)
+{
+    static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    int rawlen = mbytes * 1024 * 1024;
+    int enclen = 4 * ((rawlen + 2) / 3);
+    int max    = enclen + enclen / 72 + 1024;
+    char *msg  = malloc(max);
+    int n, i;
+
+    if (!msg)
+    {
+        fprintf(stderr, "no memory for %d byte message\n", max);
+        exit(1);
+    }
+
+    n = sprintf(msg,
+                "<setBLOBVector device='CCD Simulator' name='CCD1' state='Ok' timeout='60' "
+                "timestamp='2020-01-01T00:00:00'>\n"
+                "  <oneBLOB\n    name='CCD1'\n    size='%d'\n    enclen='%d'\n    format='.fits'>\n",
+                rawlen, enclen);
+    for (i = 0; i < enclen; i++)
+    {
+        msg[n++] = b64[(i * 7 + i / 13) & 63];
+        if ((i + 1) % 72 == 0)
+            msg[n++] = '\n';
+    }
+    if (enclen % 72)
+        msg[n++] = '\n';
+    n += sprintf(msg + n, "  </oneBLOB>\n</setBLOBVector>\n");
+
+    *msgp = msg;
+    return (n);
+}
+
+static void sink(XMLEle *ep, const char *data, int len, void *userdata)
+{
+    (void)ep;
+    (void)data;
+    *(long *)userdata += len;
+}
+
+/* parse msg once, return seconds and content length seen */
+static double parseOnce(int mode, char *msg, int len, long *pclen)
+{
+    LilXML *lp   = newLilXML();
+    XMLEle *root = NULL;
+    char err[1024];
+    long sunk = 0;
+    double t0;
+    int i;
+
+    if (mode == 2)
+        setXMLPCDataSink(lp, "oneBLOB", sink, &sunk);
+
+    t0 = now();
+    if (mode == 0)
+    {
+        for (i = 0; i < len && !root; i++)
+            root = readXMLEle(lp, msg[i], err);
+    }
+    else
+    {
+        for (i = 0; i < len; i += chunk)
+        {
+            XMLEle **nodes = parseXMLChunk(lp, msg + i, len - i < chunk ? len - i : chunk, err);
+            if (nodes && nodes[0])
+                root = nodes[0];
+            free(nodes);
+        }
+    }
+    t0 = now() - t0;
+
+    if (!root)
+    {
+        fprintf(stderr, "parse failed: %s\n", err);
+        exit(1);
+    }
+    *pclen = mode == 2 ? sunk : pcdatalenXMLEle(findXMLEle(root, "oneBLOB"));
+    delXMLEle(root);
+    delLilXML(lp);
+
+    return (t0);
+}
+
+int main(int ac, char *av[])
+{
+    static const char *names[] = { "readXMLEle", "parseXMLChunk", "sink" };
+    char *msg;
+    int len, mode, c;
+
+    while ((c = getopt(ac, av, "m:c:n:")) != -1)
+    {
+        switch (c)
+        {
+            case 'm':
+                mbytes = atoi(optarg);
+                break;
+            case 'c':
+                chunk = atoi(optarg);
+                break;
+            case 'n':
+                nruns = atoi(optarg);
+                break;
+            default:
+                usage(av[0]);
+        }
+    }
+    if (mbytes <= 0 || chunk <= 0 || nruns <= 0)
+        usage(av[0]);
+
+    len = buildMsg(&msg);
+
+    printf("%-14s %10s %10s %12s\n", "mode", "msg MB", "secs", "MB/s");
+    for (mode = 0; mode < 3; mode++)
+    {
+        double best = 0;
+        long clen   = 0;
+        int r;
+
+        for (r = 0; r < nruns; r++)
+        {
+            double t = parseOnce(mode, msg, len, &clen);
+            if (r == 0 || t < best)
+                best = t;
+        }
+        printf("%-14s %10.1f %10.3f %12.1f   (%ld content bytes)\n", names[mode], len / 1048576.0, best,
+               len / 1048576.0 / best, clen);
+    }
+
+    free(msg);
+    return (0);
+}
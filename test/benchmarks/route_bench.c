@@ -0,0 +1,256 @@
+/*
+    indiserver routing table benchmark
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/* Measure the cost of finding who gets a message in indiserver.
+ *
+ * Each of -c clients watches -p properties picked at random among the -d
+ * devices with 100 properties each, as chained servers and busy GUIs do. We
+ * then route messages about random properties to the clients interested in
+ * them, with the BLOB policy of each, two ways:
+ *   scan   what indiserver did: every client, every watched property, strcmp
+ *   table  the route.c lookups indiserver does now
+ * Both must find the same number of deliveries.
+ *
+ * Example, sweep watched properties:
+ *   route_bench -c 32 -p 1,10,100,500
+ */
+
+#include "route.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAXLIST  16  /* max entries in -p list */
+#define NAMESIZ  64  /* device and property name size, as MAXINDIDEVICE */
+#define DEVPROPS 100 /* properties per device */
+
+typedef struct
+{
+    char dev[NAMESIZ];
+    char name[NAMESIZ];
+    int blob;
+} Prop;
+
+typedef struct
+{
+    Prop *props;
+    int nprops;
+    unsigned int mark;
+} Client;
+
+static int nclients = 32;     /* clients */
+static int ndevs    = 20;     /* devices */
+static int nmsgs    = 200000; /* messages routed */
+
+static void usage(const char *me)
+{
+    fprintf(stderr, "Usage: %s [options]\n", me);
+    fprintf(stderr, "Purpose: compare indiserver routing by scan and by table\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, " -c n      : clients, default %d\n", nclients);
+    fprintf(stderr, " -d n      : devices, default %d\n", ndevs);
+    fprintf(stderr, " -p n,...  : properties watched by each client, default 100\n");
+    fprintf(stderr, " -n n      : messages routed, default %d\n", nmsgs);
+    exit(2);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+static void propName(char *dev, char *name, int d, int p)
+{
+    snprintf(dev, NAMESIZ, "Device Simulator %d", d);
+    if (p < 0)
+        name[0] = '\0';
+    else
+        snprintf(name, NAMESIZ, "PROPERTY_NUMBER_%d", p);
+}
+
+/* the old indiserver way: findClDevice() then the BLOB policy scan */
+static long routeScan(Client *cl, const char *dev, const char *name)
+{
+    long n = 0;
+    int c, i;
+
+    for (c = 0; c < nclients; c++)
+    {
+        Client *cp = &cl[c];
+        int found  = 0;
+
+        for (i = 0; i < cp->nprops; i++)
+        {
+            Prop *pp = &cp->props[i];
+            if (!strcmp(pp->dev, dev) && (!pp->name[0] || !strcmp(pp->name, name)))
+            {
+                found = 1;
+                break;
+            }
+        }
+        if (!found)
+            continue;
+
+        for (i = 0; i < cp->nprops; i++)
+        {
+            Prop *pp = &cp->props[i];
+            if (!strcmp(pp->dev, dev) && !strcmp(pp->name, name))
+            {
+                n += pp->blob;
+                break;
+            }
+        }
+        n++;
+    }
+
+    return (n);
+}
+
+/* the table way, as q2Clients() */
+static long routeTable(RT *rt, Client *cl, const char *dev, const char *name)
+{
+    static unsigned int mark;
+    Route *rps[2];
+    long n = 0;
+    int i, j;
+
+    mark++;
+    rps[0] = findRoute(rt, dev, name);
+    rps[1] = findRoute(rt, dev, "");
+
+    for (j = 0; j < 2; j++)
+    {
+        RouteList *lp = rps[j] ? &rps[j]->lists[RT_CLIENTS] : NULL;
+        for (i = 0; lp && i < lp->nsubs; i++)
+        {
+            Client *cp = &cl[lp->subs[i].who];
+            if (cp->mark == mark)
+                continue;
+            cp->mark = mark;
+            if (j == 0)
+                n += cp->props[lp->subs[i].prop].blob;
+            n++;
+        }
+    }
+
+    return (n);
+}
+
+static void run(int nprops)
+{
+    Client *cl             = calloc(nclients, sizeof(Client));
+    RT *rt                 = newRT();
+    char (*mdev)[NAMESIZ]  = malloc(nmsgs * NAMESIZ);
+    char (*mname)[NAMESIZ] = malloc(nmsgs * NAMESIZ);
+    long nscan = 0, ntable = 0;
+    double t0, tscan, ttable;
+    int c, i;
+
+    srand(1);
+
+    /* subscribe, one in ten to a whole device, no dups */
+    for (c = 0; c < nclients; c++)
+    {
+        cl[c].props = malloc(nprops * sizeof(Prop));
+        for (i = 0; i < nprops; i++)
+        {
+            Prop *pp = &cl[c].props[cl[c].nprops];
+            Route *rp;
+
+            propName(pp->dev, pp->name, rand() % ndevs, rand() % 10 ? rand() % DEVPROPS : -1);
+            pp->blob = rand() % 2;
+            if ((rp = findRoute(rt, pp->dev, pp->name)) && findRouteSub(rp, RT_CLIENTS, c) >= 0)
+                continue;
+            addRouteSub(rt, pp->dev, pp->name, RT_CLIENTS, c, cl[c].nprops++);
+        }
+    }
+
+    for (i = 0; i < nmsgs; i++)
+        propName(mdev[i], mname[i], rand() % ndevs, rand() % DEVPROPS);
+
+    t0 = now();
+    for (i = 0; i < nmsgs; i++)
+        nscan += routeScan(cl, mdev[i], mname[i]);
+    tscan = now() - t0;
+
+    t0 = now();
+    for (i = 0; i < nmsgs; i++)
+        ntable += routeTable(rt, cl, mdev[i], mname[i]);
+    ttable = now() - t0;
+
+    printf("%7d %7d %7d %10ld %12.3f %12.3f %8.1f%s\n", nclients, ndevs, nprops, nscan, 1e6 * tscan / nmsgs,
+           1e6 * ttable / nmsgs, tscan / ttable, nscan == ntable ? "" : "  MISMATCH");
+
+    for (c = 0; c < nclients; c++)
+        free(cl[c].props);
+    free(cl);
+    free(mdev);
+    free(mname);
+    delRT(rt);
+}
+
+int main(int ac, char *av[])
+{
+    int props[MAXLIST] = { 100 };
+    int nprops         = 1;
+    int c, i;
+
+    while ((c = getopt(ac, av, "c:d:p:n:")) != -1)
+    {
+        switch (c)
+        {
+            case 'c':
+                nclients = atoi(optarg);
+                break;
+            case 'd':
+                ndevs = atoi(optarg);
+                break;
+            case 'p':
+            {
+                char *s = optarg;
+                for (nprops = 0; nprops < MAXLIST && *s; nprops++)
+                {
+                    props[nprops] = strtol(s, &s, 10);
+                    if (*s == ',')
+                        s++;
+                }
+                break;
+            }
+            case 'n':
+                nmsgs = atoi(optarg);
+                break;
+            default:
+                usage(av[0]);
+        }
+    }
+
+    if (nclients < 1 || ndevs < 1 || nmsgs < 1 || nprops < 1)
+        usage(av[0]);
+
+    printf("clients devices   props deliveries  scan us/msg table us/msg  speedup\n");
+    for (i = 0; i < nprops; i++)
+        run(props[i]);
+
+    return (0);
+}
@@ -21,8 +21,11 @@
 #include "config.h"
 #endif
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <string>
+#include <vector>
 
 #include "base64.h"
 
@@ -73,3 +76,59 @@ TEST(CORE_BASE64, Test_from64tobits_fast)
 
     free(p_outbuf);
 }
+
+// Every kernel this CPU runs must give exactly what the scalar code does,
+// for all tail lengths and with or without the newlines IDSetBLOB() adds.
+TEST(CORE_BASE64, Test_kernelsMatchScalar)
+{
+    const char *names[] = { "avx2", "sse4.1", "neon" };
+    std::vector<unsigned char> raw(70000);
+    unsigned int seed = 1;
+
+    for (auto &c : raw)
+        c = (seed = seed * 1103515245 + 12345) >> 16;
+
+    for (const char *name : names)
+    {
+        if (setBase64Kernel(name) < 0)
+            continue;
+
+        for (int len = 0; len <= (int)raw.size(); len += (len < 300 ? 1 : 4999))
+        {
+            size_t sz = 4 * len / 3 + 4;
+            std::vector<unsigned char> ref(sz + 1), enc(sz + 1);
+            int reflen, enclen;
+
+            ASSERT_EQ(0, setBase64Kernel("scalar"));
+            reflen = to64frombits_s(ref.data(), raw.data(), len, sz);
+            ASSERT_EQ(0, setBase64Kernel(name));
+            enclen = to64frombits_s(enc.data(), raw.data(), len, sz);
+            ASSERT_EQ(reflen, enclen) << name << " len " << len;
+            ASSERT_EQ(0, memcmp(ref.data(), enc.data(), enclen + 1)) << name << " len " << len;
+
+            if (len == 0)
+                continue;
+
+            // decode plain and as sent in 72 char lines
+            std::string lines;
+            for (int i = 0; i < enclen; i += 72)
+                lines += "\n" + std::string((const char *)enc.data() + i, std::min(72, enclen - i));
+
+            for (const std::string &b64 : { std::string((const char *)enc.data(), enclen), lines })
+            {
+                std::vector<char> refout(3 * enclen / 4), out(3 * enclen / 4);
+
+                ASSERT_EQ(0, setBase64Kernel("scalar"));
+                int refn = from64tobits_fast(refout.data(), b64.c_str(), enclen);
+                ASSERT_EQ(0, setBase64Kernel(name));
+                int n = from64tobits_fast(out.data(), b64.c_str(), enclen);
+                ASSERT_EQ(len, refn);
+                ASSERT_EQ(refn, n) << name << " len " << len;
+                ASSERT_EQ(0, memcmp(raw.data(), out.data(), n)) << name << " len " << len;
+            }
+        }
+    }
+
+    ASSERT_EQ(-1, setBase64Kernel("nonesuch"));
+    ASSERT_EQ(0, setBase64Kernel(nullptr));
+}
@@ -0,0 +1,197 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "base64.h"
+#include "indidevapi.h"
+#include "indidriver.h"
+#include "lilxml.h"
+
+// what ISNewBLOB() was given
+struct Got
+{
+    std::string name;
+    std::string format;
+    int size;
+    std::string blob;
+};
+
+static std::vector<Got> got;
+
+void ISGetProperties(const char *) {}
+void ISNewSwitch(const char *, const char *, ISState *, char *[], int) {}
+void ISNewText(const char *, const char *, char *[], char *[], int) {}
+void ISNewNumber(const char *, const char *, double[], char *[], int) {}
+void ISSnoopDevice(XMLEle *) {}
+
+void ISNewBLOB(const char *, const char *, int sizes[], int blobsizes[], char *blobs[], char *formats[],
+               char *names[], int n)
+{
+    for (int i = 0; i < n; i++)
+        got.push_back({ names[i], formats[i], sizes[i], std::string(blobs[i], blobsizes[i]) });
+}
+
+static std::string bytes(int n, int seed)
+{
+    std::string s;
+
+    for (int i = 0; i < n; i++)
+        s += (char)((i * 31 + seed * 7) & 0xff);
+    return s;
+}
+
+// a oneBLOB as a client sends it, base64 broken into lines of 72 as IDSetBLOB() does
+static std::string oneBLOB(const char *name, const std::string &blob)
+{
+    std::string b64(4 * blob.size() / 3 + 4, '\0');
+    int n = to64frombits_s((unsigned char *)&b64[0], (const unsigned char *)blob.data(), blob.size(), b64.size());
+    std::string lines;
+
+    b64.resize(n);
+    for (int i = 0; i < n; i += 72)
+        lines += b64.substr(i, 72) + "\n";
+    return std::string("<oneBLOB name='") + name + "' size='" + std::to_string(blob.size()) +
+           "' format='.bin' enclen='" + std::to_string(n) + "'>\n" + lines + "</oneBLOB>\n";
+}
+
+static std::string newBLOBVector(const std::string &members)
+{
+    return "<newBLOBVector device='Dev' name='UPLOAD'>\n" + members + "</newBLOBVector>\n";
+}
+
+// the driver must have defined the property for dispatch() to take it
+static void defineUpload()
+{
+    static IBLOB bp[4];
+    static IBLOBVectorProperty bvp;
+
+    if (bvp.nbp)
+        return;
+    for (int i = 0; i < 4; i++)
+    {
+        const char name[2] = { (char)('A' + i), '\0' };
+        IUFillBLOB(&bp[i], name, name, ".bin");
+    }
+    IUFillBLOBVector(&bvp, bp, 4, "Dev", "UPLOAD", "Upload", "Main", IP_RW, 60, IPS_IDLE);
+
+    // not to our stdout
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO), null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    IDDefBLOB(&bvp, nullptr);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(null);
+}
+
+// parse msg in pieces of n bytes, dispatching each message as indidrivermain does
+static void feed(LilXML *lp, const std::string &msg, int n)
+{
+    std::string buf = msg;
+    char err[2048], dmsg[2048];
+
+    defineUpload();
+
+    for (size_t at = 0; at < buf.size(); at += n)
+    {
+        int len        = std::min((size_t)n, buf.size() - at);
+        XMLEle **nodes = parseXMLChunk(lp, &buf[at], len, err);
+
+        for (int i = 0; nodes && nodes[i]; i++)
+        {
+            dispatch(nodes[i], dmsg);
+            delXMLEle(nodes[i]);
+        }
+        free(nodes);
+        if (err[0])
+            dispatchXMLError();
+    }
+}
+
+TEST(DispatchBLOBTest, Test_decodedAsParsed)
+{
+    const std::string a = bytes(1000, 1), b = bytes(2, 2), c = bytes(0, 3);
+    const std::string msg = newBLOBVector(oneBLOB("A", a) + oneBLOB("B", b) + oneBLOB("C", c)) +
+                            newBLOBVector(oneBLOB("D", bytes(77, 4)));
+
+    for (int n : { 1, 2, 3, 5, 7, 64, 73, 1000, 100000 })
+    {
+        LilXML *lp = newLilXML();
+        dispatchBLOBSink(lp);
+        got.clear();
+
+        feed(lp, msg, n);
+        ASSERT_EQ(got.size(), 4u) << "chunk size " << n;
+        EXPECT_EQ(got[0].name, "A");
+        EXPECT_EQ(got[0].format, ".bin");
+        EXPECT_EQ(got[0].size, 1000);
+        EXPECT_EQ(got[0].blob, a) << "chunk size " << n;
+        EXPECT_EQ(got[1].blob, b) << "chunk size " << n;
+        EXPECT_EQ(got[2].blob, c) << "chunk size " << n;
+        EXPECT_EQ(got[3].blob, bytes(77, 4)) << "chunk size " << n;
+
+        delLilXML(lp);
+    }
+}
+
+TEST(DispatchBLOBTest, Test_sameAsWithoutSink)
+{
+    const std::string msg = newBLOBVector(oneBLOB("A", bytes(5000, 5)) + oneBLOB("B", bytes(1, 6)));
+    std::vector<Got> plain;
+
+    LilXML *lp = newLilXML();
+    got.clear();
+    feed(lp, msg, 4096);
+    plain = got;
+    delLilXML(lp);
+
+    lp = newLilXML();
+    dispatchBLOBSink(lp);
+    got.clear();
+    feed(lp, msg, 4096);
+    delLilXML(lp);
+
+    ASSERT_EQ(got.size(), plain.size());
+    for (size_t i = 0; i < got.size(); i++)
+        EXPECT_EQ(got[i].blob, plain[i].blob);
+}
+
+TEST(DispatchBLOBTest, Test_lostToError)
+{
+    LilXML *lp = newLilXML();
+    dispatchBLOBSink(lp);
+    got.clear();
+
+    // a bad tag in the middle of the first drops it, its content must not show up in the next
+    std::string first = newBLOBVector(oneBLOB("A", bytes(300, 7)));
+    first.insert(first.find("</oneBLOB>") - 20, "<<");
+    const std::string second = newBLOBVector(oneBLOB("A", bytes(300, 8)));
+
+    feed(lp, first + second, 64);
+    ASSERT_EQ(got.size(), 1u);
+    EXPECT_EQ(got[0].blob, bytes(300, 8));
+
+    delLilXML(lp);
+}
@@ -0,0 +1,337 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "eventloop.h"
+#include "indidevapi.h"
+
+// the driver entry points, not called here
+void ISGetProperties(const char *) {}
+void ISNewSwitch(const char *, const char *, ISState *, char *[], int) {}
+void ISNewText(const char *, const char *, char *[], char *[], int) {}
+void ISNewNumber(const char *, const char *, double[], char *[], int) {}
+void ISNewBLOB(const char *, const char *, int[], int[], char *[], char *[], char *[], int) {}
+void ISSnoopDevice(XMLEle *) {}
+
+static std::vector<long> fired;
+
+static void recordTimer(void *ud)
+{
+    fired.push_back((long)ud);
+}
+
+// a work proc runs once per loop with nothing ready, so it marks where the first loop ended
+static int firedInFirstLoop;
+static int loopDone;
+
+static void endLoop(void *)
+{
+    if (!loopDone)
+        firedInFirstLoop = fired.size();
+    loopDone = 1;
+}
+
+static void runOneLoop()
+{
+    loopDone = 0;
+    int wid  = addWorkProc(endLoop, nullptr);
+    deferLoop(1000, &loopDone);
+    rmWorkProc(wid);
+}
+
+static void runUntilFired(size_t n)
+{
+    for (int i = 0; i < 100 && fired.size() < n; i++)
+    {
+        int never = 0;
+        deferLoop(10, &never);
+    }
+}
+
+TEST(EventLoopTest, Test_timersInOrder)
+{
+    fired.clear();
+
+    // due times in no order, several alike, which go in the order added
+    static const int ms[] = { 30, 10, 20, 10, 0, 30, 5, 20, 10, 0 };
+    const int n = sizeof(ms) / sizeof(ms[0]);
+    for (long i = 0; i < n; i++)
+        addTimer(ms[i], recordTimer, (void *)i);
+
+    runUntilFired(n);
+    ASSERT_EQ(fired.size(), (size_t)n);
+    for (int i = 1; i < n; i++)
+    {
+        int a = ms[fired[i - 1]], b = ms[fired[i]];
+        EXPECT_TRUE(a < b || (a == b && fired[i - 1] < fired[i])) << "at " << i;
+    }
+}
+
+TEST(EventLoopTest, Test_rmTimer)
+{
+    fired.clear();
+
+    std::vector<int> ids;
+    for (long i = 0; i < 1000; i++)
+        ids.push_back(addTimer((i * 7) % 13, recordTimer, (void *)i));
+    for (size_t i = 1; i < ids.size(); i += 2)
+        rmTimer(ids[i]);
+
+    // already removed, never given out, or fired: all ignored
+    rmTimer(ids[1]);
+    rmTimer(0);
+    rmTimer(-5);
+
+    runUntilFired(500);
+    int never = 0;
+    deferLoop(20, &never);
+    ASSERT_EQ(fired.size(), 500u);
+    for (long f : fired)
+        EXPECT_EQ(f % 2, 0);
+
+    // an id is not given out again, so a stale one leaves a new timer alone
+    int fresh = addTimer(0, recordTimer, (void *)1);
+    rmTimer(ids[0]);
+    runUntilFired(501);
+    EXPECT_EQ(fired.size(), 501u);
+    EXPECT_NE(fresh, ids[0]);
+}
+
+TEST(EventLoopTest, Test_allDueInOneLoop)
+{
+    fired.clear();
+
+    for (long i = 0; i < 5; i++)
+        addTimer(0, recordTimer, (void *)i);
+    usleep(2000);
+
+    runOneLoop();
+    EXPECT_EQ(firedInFirstLoop, 5);
+}
+
+static void readdTimer(void *ud)
+{
+    recordTimer(ud);
+    addTimer(0, recordTimer, (void *)((long)ud + 1));
+}
+
+TEST(EventLoopTest, Test_addedInTimerWaits)
+{
+    fired.clear();
+
+    addTimer(0, readdTimer, (void *)10);
+    usleep(2000);
+
+    runOneLoop();
+    EXPECT_EQ(firedInFirstLoop, 1);
+    runUntilFired(2);
+    ASSERT_EQ(fired.size(), 2u);
+    EXPECT_EQ(fired[1], 11);
+}
+
+// what a callback does when its fd is ready
+struct Reader
+{
+    int calls { 0 };
+    int *other { nullptr }; // callback id to remove when called
+};
+
+static void readCB(int fd, void *ud)
+{
+    Reader *rp = (Reader *)ud;
+    char buf[64];
+
+    (void)read(fd, buf, sizeof(buf));
+    rp->calls++;
+    if (rp->other)
+        rmCallback(*rp->other);
+}
+
+TEST(EventLoopTest, Test_callbacks)
+{
+    int p1[2], p2[2];
+    ASSERT_EQ(pipe(p1), 0);
+    ASSERT_EQ(pipe(p2), 0);
+
+    // each removes the other, so the second ready may not be called
+    Reader r1, r2;
+    int cid1 = addCallback(p1[0], readCB, &r1);
+    int cid2 = addCallback(p2[0], readCB, &r2);
+    r1.other = &cid2;
+    r2.other = &cid1;
+    ASSERT_EQ(write(p1[1], "x", 1), 1);
+    ASSERT_EQ(write(p2[1], "x", 1), 1);
+
+    int never = 0;
+    deferLoop(50, &never);
+    EXPECT_EQ(r1.calls + r2.calls, 1);
+
+    rmCallback(cid1);
+    rmCallback(cid2);
+    for (int fd : { p1[0], p1[1], p2[0], p2[1] })
+        close(fd);
+}
+
+TEST(EventLoopTest, Test_sameFd)
+{
+    int p[2];
+    ASSERT_EQ(pipe(p), 0);
+
+    // the callback added last is called, then the other once it is gone
+    Reader r1, r2;
+    int cid1 = addCallback(p[0], readCB, &r1);
+    int cid2 = addCallback(p[0], readCB, &r2);
+    ASSERT_EQ(write(p[1], "x", 1), 1);
+    runOneLoop();
+    EXPECT_EQ(r1.calls, 0);
+    EXPECT_EQ(r2.calls, 1);
+
+    rmCallback(cid2);
+    ASSERT_EQ(write(p[1], "x", 1), 1);
+    runOneLoop();
+    EXPECT_EQ(r1.calls, 1);
+
+    rmCallback(cid1);
+    close(p[0]);
+    close(p[1]);
+}
+
+TEST(EventLoopTest, Test_reopenedFd)
+{
+    int p1[2], p2[2];
+    ASSERT_EQ(pipe(p1), 0);
+
+    // closed without removing its callback, then its fd number is used again
+    Reader r1, r2;
+    int cid1 = addCallback(p1[0], readCB, &r1);
+    close(p1[0]);
+    close(p1[1]);
+    ASSERT_EQ(pipe(p2), 0);
+    ASSERT_EQ(p2[0], p1[0]);
+    int cid2 = addCallback(p2[0], readCB, &r2);
+
+    ASSERT_EQ(write(p2[1], "x", 1), 1);
+    runOneLoop();
+    EXPECT_EQ(r2.calls, 1);
+
+    // the stale one going leaves the new one watched
+    rmCallback(cid1);
+    ASSERT_EQ(write(p2[1], "x", 1), 1);
+    runOneLoop();
+    EXPECT_EQ(r2.calls, 2);
+
+    rmCallback(cid2);
+    close(p2[0]);
+    close(p2[1]);
+}
+
+TEST(EventLoopTest, Test_regularFile)
+{
+    // always ready, as select(2) has it
+    FILE *fp = tmpfile();
+    ASSERT_NE(fp, nullptr);
+
+    Reader r;
+    int cid = addCallback(fileno(fp), readCB, &r);
+    int never = 0;
+    deferLoop(20, &never);
+    EXPECT_GT(r.calls, 0);
+
+    rmCallback(cid);
+    fclose(fp);
+}
+
+// what a posted task saw
+struct Posted
+{
+    int thread;
+    int seq;
+};
+
+static std::vector<Posted> posted;
+static pthread_t loopThread;
+static int offThread;
+
+static void postedTask(void *ud)
+{
+    Posted *pp = (Posted *)ud;
+
+    if (!pthread_equal(pthread_self(), loopThread))
+        offThread++;
+    posted.push_back(*pp);
+    delete pp;
+}
+
+TEST(EventLoopTest, Test_postTask)
+{
+    const int nthreads = 4, nposts = 10000;
+
+    posted.clear();
+    offThread  = 0;
+    loopThread = pthread_self();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthreads; t++)
+        threads.emplace_back([t]()
+        {
+            for (int i = 0; i < nposts; i++)
+                ASSERT_EQ(postTask(postedTask, new Posted{t, i}), 0);
+        });
+
+    for (int i = 0; i < 500 && posted.size() < (size_t)(nthreads * nposts); i++)
+    {
+        int never = 0;
+        deferLoop(10, &never);
+    }
+    for (auto &t : threads)
+        t.join();
+
+    // all ran on this thread, each thread's in the order posted
+    ASSERT_EQ(posted.size(), (size_t)(nthreads * nposts));
+    EXPECT_EQ(offThread, 0);
+    std::vector<int> next(nthreads, 0);
+    for (const Posted &p : posted)
+        EXPECT_EQ(p.seq, next[p.thread]++);
+}
+
+static void repostTask(void *ud)
+{
+    int *np = (int *)ud;
+
+    if (++*np < 3)
+        postTask(repostTask, np);
+}
+
+TEST(EventLoopTest, Test_postFromTask)
+{
+    int n = 0;
+
+    postTask(repostTask, &n);
+    for (int i = 0; i < 100 && n < 3; i++)
+    {
+        int never = 0;
+        deferLoop(10, &never);
+    }
+    EXPECT_EQ(n, 3);
+}
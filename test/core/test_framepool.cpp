@@ -0,0 +1,100 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include "libs/indibase/indiframepool.h"
+
+using INDI::FramePool;
+
+TEST(CORE_FRAMEPOOL, Test_sizeClass)
+{
+    for (size_t size : { size_t(1), size_t(100), size_t(65536), size_t(65537), size_t(3000000), size_t(62000000) })
+    {
+        size_t capacity = FramePool::sizeClass(size);
+        EXPECT_GE(capacity, size);
+        // a quarter power of two apart, or a huge page
+        EXPECT_LE(capacity, size + size / 4 + FramePool::HUGE_PAGE_SIZE);
+        if (capacity >= FramePool::HUGE_PAGE_SIZE)
+        {
+            EXPECT_EQ(capacity % FramePool::HUGE_PAGE_SIZE, 0u);
+        }
+    }
+
+    // frames of about the same size share a class
+    EXPECT_EQ(FramePool::sizeClass(40000000), FramePool::sizeClass(40000000 + 2880));
+}
+
+TEST(CORE_FRAMEPOOL, Test_steadyState)
+{
+    auto pool = std::make_shared<FramePool>();
+    const size_t frameSize = 24 * 1024 * 1024 + 12345;
+
+    // what an exposure loop does: a raw copy, an encoded frame and a DSP copy per exposure
+    for (int exposure = 0; exposure < 100; exposure++)
+    {
+        FramePool::Buffer raw = pool->lease(frameSize);
+        ASSERT_NE(raw.get(), nullptr);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(raw.get()) % FramePool::HUGE_PAGE_SIZE, 0u);
+        memset(raw.get(), exposure, frameSize);
+
+        FramePool::Buffer fits = pool->lease(frameSize + 2 * 2880);
+        FramePool::Buffer dsp  = pool->lease(frameSize);
+        ASSERT_NE(fits.get(), nullptr);
+        ASSERT_NE(dsp.get(), nullptr);
+        EXPECT_NE(raw.get(), dsp.get());
+    }
+
+    FramePool::Stats stats = pool->stats();
+    EXPECT_EQ(stats.leases, 300u);
+    EXPECT_EQ(stats.allocations, 3u);
+    EXPECT_EQ(stats.idleBytes, stats.bytes);
+
+    pool->trim();
+    stats = pool->stats();
+    EXPECT_EQ(stats.frees, 3u);
+    EXPECT_EQ(stats.bytes, 0u);
+}
+
+TEST(CORE_FRAMEPOOL, Test_resize)
+{
+    auto pool = std::make_shared<FramePool>();
+
+    // after a change of frame size, the buffers of the old size are let go
+    pool->lease(8 * 1024 * 1024);
+    for (uint64_t i = 0; i <= FramePool::IDLE_LEASES; i++)
+        pool->lease(2 * 1024 * 1024);
+
+    FramePool::Stats stats = pool->stats();
+    EXPECT_EQ(stats.allocations, 2u);
+    EXPECT_EQ(stats.frees, 1u);
+    EXPECT_EQ(stats.bytes, FramePool::sizeClass(2 * 1024 * 1024));
+}
+
+TEST(CORE_FRAMEPOOL, Test_outliveOwner)
+{
+    FramePool::Buffer buffer;
+    {
+        auto pool = std::make_shared<FramePool>();
+        buffer = pool->lease(1000);
+    }
+    ASSERT_NE(buffer.get(), nullptr);
+    buffer[999] = 1;
+    buffer.reset();
+}
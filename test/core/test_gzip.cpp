@@ -0,0 +1,123 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <zlib.h>
+
+#include "libs/indibase/indigzip.h"
+
+// a frame that compresses some, with a tail that is not a whole chunk
+static std::vector<uint8_t> frame(size_t size)
+{
+    std::vector<uint8_t> data(size);
+    unsigned int seed = 1;
+
+    for (size_t i = 0; i < size; i++)
+        data[i] = (i / 7) ^ ((seed = seed * 1103515245 + 12345) >> 28);
+    return data;
+}
+
+// plain single stream gzip, as gzip(1) would write it
+static std::vector<uint8_t> plainGzip(const std::vector<uint8_t> &data)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    EXPECT_EQ(deflateInit2(&zs, 6, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY), Z_OK);
+
+    std::vector<uint8_t> out(deflateBound(&zs, data.size()) + 32);
+    zs.next_in   = const_cast<Bytef *>(data.data());
+    zs.avail_in  = data.size();
+    zs.next_out  = out.data();
+    zs.avail_out = out.size();
+    EXPECT_EQ(deflate(&zs, Z_FINISH), Z_STREAM_END);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+TEST(CORE_GZIP, Test_roundTrip)
+{
+    for (size_t size : { size_t(0), size_t(1), INDI::GZip::CHUNK_SIZE, 5 * INDI::GZip::CHUNK_SIZE + 12345 })
+    {
+        std::vector<uint8_t> data = frame(size);
+        void *packed = nullptr, *unpacked = nullptr;
+        size_t packedSize = 0, unpackedSize = 0;
+
+        ASSERT_EQ(INDI::GZip::compress(data.data(), size, &packed, &packedSize, 6, 3), Z_OK);
+        ASSERT_EQ(INDI::GZip::uncompress(packed, packedSize, &unpacked, &unpackedSize, size, 3), Z_OK);
+        ASSERT_EQ(unpackedSize, size);
+        EXPECT_EQ(memcmp(unpacked, data.data(), size), 0);
+        free(unpacked);
+
+        // more than expected is refused
+        if (size > 0)
+        {
+            EXPECT_NE(INDI::GZip::uncompress(packed, packedSize, &unpacked, &unpackedSize, size - 1), Z_OK);
+        }
+
+        // so is a damaged one
+        if (packedSize > 40)
+        {
+            static_cast<uint8_t *>(packed)[packedSize - 20] ^= 0x55;
+            EXPECT_NE(INDI::GZip::uncompress(packed, packedSize, &unpacked, &unpackedSize, size), Z_OK);
+            EXPECT_NE(INDI::GZip::uncompress(packed, packedSize - 30, &unpacked, &unpackedSize, size), Z_OK);
+        }
+        free(packed);
+    }
+}
+
+TEST(CORE_GZIP, Test_plainGzip)
+{
+    std::vector<uint8_t> data = frame(3 * INDI::GZip::CHUNK_SIZE + 1);
+    void *packed = nullptr, *unpacked = nullptr;
+    size_t packedSize = 0, unpackedSize = 0;
+
+    // what we write is read by zlib as one gzip file
+    ASSERT_EQ(INDI::GZip::compress(data.data(), data.size(), &packed, &packedSize, 1), Z_OK);
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    ASSERT_EQ(inflateInit2(&zs, MAX_WBITS + 16), Z_OK);
+    std::vector<uint8_t> back(data.size());
+    zs.next_in   = static_cast<Bytef *>(packed);
+    zs.avail_in  = packedSize;
+    zs.next_out  = back.data();
+    zs.avail_out = back.size();
+    int r;
+    while ((r = inflate(&zs, Z_NO_FLUSH)) == Z_STREAM_END && zs.avail_in > 0)
+        inflateReset(&zs);
+    EXPECT_EQ(r, Z_STREAM_END);
+    EXPECT_EQ(zs.avail_out, 0u);
+    EXPECT_EQ(back, data);
+    inflateEnd(&zs);
+    free(packed);
+
+    // and we read any gzip, two members back to back here
+    std::vector<uint8_t> gz = plainGzip(data), member = gz;
+    gz.insert(gz.end(), member.begin(), member.end());
+    ASSERT_EQ(INDI::GZip::uncompress(gz.data(), gz.size(), &unpacked, &unpackedSize, 2 * data.size()), Z_OK);
+    ASSERT_EQ(unpackedSize, 2 * data.size());
+    EXPECT_EQ(memcmp(unpacked, data.data(), data.size()), 0);
+    EXPECT_EQ(memcmp(static_cast<uint8_t *>(unpacked) + data.size(), data.data(), data.size()), 0);
+    free(unpacked);
+
+    EXPECT_NE(INDI::GZip::uncompress(gz.data(), gz.size(), &unpacked, &unpackedSize, data.size()), Z_OK);
+    EXPECT_NE(INDI::GZip::uncompress(gz.data(), gz.size() / 2 - 1, &unpacked, &unpackedSize, 2 * data.size()), Z_OK);
+}
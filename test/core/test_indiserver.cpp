@@ -0,0 +1,260 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/* We run the indiserver named by $INDISERVER with one remote driver, ie, it
+ * connects back to a socket we listen on and we play the driver, or the
+ * chained server, at the other end. We also play its clients.
+ */
+class IndiserverTest : public ::testing::Test
+{
+    protected:
+        pid_t pid { -1 };
+        int port { 0 };
+        int dlisten { -1 };
+        int drv { -1 };
+        std::vector<int> clients;
+
+        void TearDown() override
+        {
+            if (pid > 0)
+            {
+                kill(pid, SIGKILL);
+                waitpid(pid, nullptr, 0);
+            }
+            for (int fd : clients)
+                close(fd);
+            if (drv >= 0)
+                close(drv);
+            if (dlisten >= 0)
+                close(dlisten);
+        }
+
+        static int listenAny(int *portp)
+        {
+            struct sockaddr_in sa;
+            socklen_t len = sizeof(sa);
+            int one = 1, fd = socket(AF_INET, SOCK_STREAM, 0);
+
+            memset(&sa, 0, sizeof(sa));
+            sa.sin_family      = AF_INET;
+            sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(fd, 4) < 0 ||
+                    getsockname(fd, (struct sockaddr *)&sa, &len) < 0)
+            {
+                close(fd);
+                return -1;
+            }
+            *portp = ntohs(sa.sin_port);
+            return fd;
+        }
+
+        // start the server with args, accept its driver connection and return what it asks first
+        std::string start(const std::vector<std::string> &args)
+        {
+            const char *server = getenv("INDISERVER") ? getenv("INDISERVER") : "indiserver";
+            int dport, lfd;
+            std::vector<std::string> argv = { server, "-p" };
+            std::vector<char *> cargv;
+
+            dlisten = listenAny(&dport);
+            EXPECT_GE(dlisten, 0);
+
+            // a port nobody has, close enough
+            lfd = listenAny(&port);
+            close(lfd);
+
+            argv.push_back(std::to_string(port));
+            argv.insert(argv.end(), args.begin(), args.end());
+            argv.push_back("Dev@127.0.0.1:" + std::to_string(dport));
+            for (auto &a : argv)
+                cargv.push_back(&a[0]);
+            cargv.push_back(nullptr);
+
+            pid = fork();
+            if (pid == 0)
+            {
+                int fd = open("/dev/null", O_WRONLY);
+                dup2(fd, 2);
+                execvp(cargv[0], cargv.data());
+                _exit(1);
+            }
+
+            struct pollfd pf = { dlisten, POLLIN, 0 };
+            if (poll(&pf, 1, 5000) <= 0)
+            {
+                ADD_FAILURE() << "server did not connect to driver";
+                return "";
+            }
+            drv = accept(dlisten, nullptr, nullptr);
+            return readUntil(drv, ">");
+        }
+
+        // connect a client that says first, return its socket
+        int client(const std::string &first)
+        {
+            struct sockaddr_in sa;
+            int fd = -1;
+
+            memset(&sa, 0, sizeof(sa));
+            sa.sin_family      = AF_INET;
+            sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            sa.sin_port        = htons(port);
+            for (int tries = 0; tries < 500; tries++)
+            {
+                fd = socket(AF_INET, SOCK_STREAM, 0);
+                if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0)
+                    break;
+                close(fd);
+                fd = -1;
+                usleep(10000);
+            }
+            EXPECT_GE(fd, 0) << "can not connect client";
+            if (fd < 0)
+                return -1;
+            clients.push_back(fd);
+            say(fd, first);
+            return fd;
+        }
+
+        static void say(int fd, const std::string &msg)
+        {
+            ASSERT_EQ(write(fd, msg.data(), msg.size()), (ssize_t)msg.size());
+        }
+
+        // read fd until what arrived holds want, or nothing more comes for ms
+        static std::string readUntil(int fd, const std::string &want, int ms = 3000)
+        {
+            std::string got;
+            char buf[65536];
+
+            while (got.find(want) == std::string::npos)
+            {
+                struct pollfd pf = { fd, POLLIN, 0 };
+                if (poll(&pf, 1, ms) <= 0)
+                    break;
+                ssize_t n = read(fd, buf, sizeof(buf));
+                if (n <= 0)
+                    break;
+                got.append(buf, n);
+            }
+            return got;
+        }
+};
+
+static const char setNumber[] = "<setNumberVector device='Dev' name='N'>\n"
+                                "  <oneNumber name='x'>1</oneNumber>\n"
+                                "</setNumberVector>\n";
+
+TEST_F(IndiserverTest, Test_emptySetBLOBVector)
+{
+    start({});
+    int c = client("<getProperties version='1.7'/>\n<enableBLOB>Also</enableBLOB>\n");
+    usleep(200000);
+
+    // nothing after a self-closing setBLOBVector may be held back waiting for its end tag
+    say(drv, std::string("<setBLOBVector device='Dev' name='B' state='Ok' message='a > b'/>\n") + setNumber +
+        "<message device='Dev' message='after'/>\n");
+
+    std::string got = readUntil(c, "after");
+    EXPECT_NE(got.find("<setBLOBVector"), std::string::npos) << got;
+    EXPECT_NE(got.find("<setNumberVector"), std::string::npos) << got;
+    EXPECT_NE(got.find("after"), std::string::npos) << got;
+
+    // also when its start tag comes in pieces
+    say(drv, "<setBLOBVector device='Dev' name='B' sta");
+    usleep(100000);
+    say(drv, "te='Idle'/");
+    usleep(100000);
+    say(drv, std::string(">\n") + "<message device='Dev' message='again'/>\n");
+
+    got = readUntil(c, "again");
+    EXPECT_NE(got.find("Idle"), std::string::npos) << got;
+    EXPECT_NE(got.find("again"), std::string::npos) << got;
+}
+
+TEST_F(IndiserverTest, Test_emptyOneBLOB)
+{
+    start({});
+    int c = client("<getProperties version='1.7'/>\n<enableBLOB>Also</enableBLOB>\n");
+    usleep(200000);
+
+    say(drv, std::string("<setBLOBVector device='Dev' name='B' state='Ok'>\n"
+                         "  <oneBLOB name='a' size='0' format='.bin'/>\n"
+                         "  <oneBLOB name='b' size='3' format='.bin' enclen='4'>YWJj</oneBLOB>\n"
+                         "</setBLOBVector>\n") +
+        setNumber + "<message device='Dev' message='after'/>\n");
+
+    std::string got = readUntil(c, "after");
+    EXPECT_NE(got.find("YWJj"), std::string::npos) << got;
+    EXPECT_NE(got.find("<setNumberVector"), std::string::npos) << got;
+    EXPECT_NE(got.find("after"), std::string::npos) << got;
+}
+
+TEST_F(IndiserverTest, Test_zlinkNoAnswer)
+{
+    // we are a chained server that does not know compress= and says nothing
+    std::string first = start({ "-z" });
+    EXPECT_NE(first.find("compress="), std::string::npos) << first;
+
+    int c = client("<getProperties version='1.7'/>\n");
+
+    // what the client asked must still reach us, plain, once the server gives up waiting
+    std::string got = readUntil(drv, "getProperties", 8000);
+    EXPECT_NE(got.find("<getProperties"), std::string::npos) << got;
+
+    say(drv, setNumber);
+    got = readUntil(c, "setNumberVector");
+    EXPECT_NE(got.find("<setNumberVector"), std::string::npos) << got;
+}
+
+TEST_F(IndiserverTest, Test_mixedBLOBVector)
+{
+    start({});
+    int c = client("<getProperties version='1.7'/>\n<enableBLOB>Also</enableBLOB>\n");
+    usleep(200000);
+
+    // a client that does not take binary BLOBs gets all of them base64, none emptied
+    say(drv, std::string("<setBLOBVector device='Dev' name='B' state='Ok'>\n"
+                         "  <oneBLOB name='a' size='3' format='.bin' enclen='4'>YWJj</oneBLOB>\n"
+                         "  <oneBLOB name='e' size='0' format='.bin'/>\n"
+                         "  <oneBLOB name='b' size='3' format='.bin' rawlen='3'>xyz</oneBLOB>\n"
+                         "  <oneBLOB name='c' size='3' format='.bin'>\nZGVm\n</oneBLOB>\n"
+                         "</setBLOBVector>\n") +
+        "<message device='Dev' message='after'/>\n");
+
+    std::string got = readUntil(c, "after");
+    EXPECT_NE(got.find("YWJj"), std::string::npos) << got;
+    EXPECT_NE(got.find("eHl6"), std::string::npos) << got;
+    EXPECT_NE(got.find("ZGVm"), std::string::npos) << got;
+    EXPECT_EQ(got.find("rawlen"), std::string::npos) << got;
+    EXPECT_NE(got.find("after"), std::string::npos) << got;
+}
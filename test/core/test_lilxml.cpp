@@ -0,0 +1,346 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "lilxml.h"
+
+static const char msg[] = "<?xml version='1.0'?>\n"
+                          "<setBLOBVector device='CCD &amp; Co' name=\"CCD1\" state='Ok'>\n"
+                          "  <oneBLOB name='CCD1' size='9' format='.fits'>\n"
+                          "    Rk9PQkFS\n"
+                          "QkFa &lt;&gt;  \n"
+                          "  </oneBLOB>\n"
+                          "</setBLOBVector>\n"
+                          "<message device='x' message='a &quot;b&quot;'/>\n";
+
+/* parse msg with parseXMLChunk in pieces of n bytes, return the serialized roots */
+static std::string parseInChunks(LilXML *lp, int n)
+{
+    std::string out;
+    char err[1024];
+    int len = sizeof(msg) - 1;
+
+    for (int i = 0; i < len; i += n)
+    {
+        int size       = (len - i < n) ? len - i : n;
+        XMLEle **nodes = parseXMLChunk(lp, (char *)msg + i, size, err);
+
+        EXPECT_TRUE(nodes);
+        EXPECT_STREQ("", err);
+        for (int j = 0; nodes && nodes[j]; j++)
+        {
+            char *s = (char *)malloc(sprlXMLEle(nodes[j], 0) + 1);
+            sprXMLEle(s, nodes[j], 0);
+            out += s;
+            free(s);
+            delXMLEle(nodes[j]);
+        }
+        free(nodes);
+    }
+    return out;
+}
+
+TEST(CORE_LILXML, Test_parseXMLChunkMatchesReadXMLEle)
+{
+    LilXML *lp = newLilXML();
+    std::string expect;
+    char err[1024];
+
+    /* the reference: one char at a time */
+    for (const char *p = msg; *p; p++)
+    {
+        XMLEle *root = readXMLEle(lp, *p, err);
+        ASSERT_STREQ("", err);
+        if (root)
+        {
+            char *s = (char *)malloc(sprlXMLEle(root, 0) + 1);
+            sprXMLEle(s, root, 0);
+            expect += s;
+            free(s);
+            delXMLEle(root);
+        }
+    }
+    ASSERT_NE(std::string::npos, expect.find("QkFa &lt;&gt;\n"));
+    ASSERT_NE(std::string::npos, expect.find("device=\"CCD &amp; Co\""));
+
+    /* any chunking must give the same result */
+    for (int n = 1; n <= (int)sizeof(msg); n++)
+        ASSERT_EQ(expect, parseInChunks(lp, n)) << "chunk size " << n;
+
+    delLilXML(lp);
+}
+
+static void collect(XMLEle *ep, const char *data, int len, void *userdata)
+{
+    ASSERT_STREQ("oneBLOB", tagXMLEle(ep));
+    ASSERT_STREQ("9", findXMLAttValu(ep, "size"));
+    ((std::string *)userdata)->append(data, len);
+}
+
+TEST(CORE_LILXML, Test_pcdataSink)
+{
+    LilXML *lp = newLilXML();
+    std::string sunk;
+
+    setXMLPCDataSink(lp, "oneBLOB", collect, &sunk);
+
+    for (int n = 1; n <= (int)sizeof(msg); n++)
+    {
+        sunk.clear();
+        std::string out = parseInChunks(lp, n);
+
+        /* sink sees what pcdata would have held, element is left empty */
+        ASSERT_EQ("Rk9PQkFS\nQkFa <>", sunk) << "chunk size " << n;
+        ASSERT_NE(std::string::npos, out.find("format=\".fits\"/>")) << "chunk size " << n;
+    }
+
+    /* back to normal */
+    setXMLPCDataSink(lp, "oneBLOB", NULL, NULL);
+    sunk.clear();
+    ASSERT_NE(std::string::npos, parseInChunks(lp, 7).find("Rk9PQkFS"));
+    ASSERT_TRUE(sunk.empty());
+
+    delLilXML(lp);
+}
+
+static void mark(XMLEle *ep, const char *data, int len, void *userdata)
+{
+    std::string *sp = (std::string *)userdata;
+
+    if (len == 0)
+        *sp += std::string("|") + findXMLAttValu(ep, "name") + ":";
+    sp->append(data, len);
+}
+
+TEST(CORE_LILXML, Test_pcdataSinkStart)
+{
+    static const char in[] = "<setBLOBVector device='x' name='y'>\n"
+                             "<oneBLOB name='a'>QUJD</oneBLOB>\n"
+                             "<oneBLOB name='b'/>\n"
+                             "<oneBLOB name='c'></oneBLOB>\n"
+                             "<oneBLOB name='d' rawlen='2'>xy</oneBLOB>\n"
+                             "</setBLOBVector>\n";
+    const int len = sizeof(in) - 1;
+    LilXML *lp    = newLilXML();
+    std::string sunk;
+    char err[1024];
+
+    /* each start marked once before its content, none for one with no end tag */
+    setXMLRawTag(lp, "oneBLOB");
+    setXMLPCDataSink(lp, "oneBLOB", mark, &sunk);
+    for (int n = 1; n <= len; n++)
+    {
+        sunk.clear();
+        for (int i = 0; i < len; i += n)
+        {
+            XMLEle **nodes = parseXMLChunk(lp, (char *)in + i, std::min(n, len - i), err);
+            ASSERT_TRUE(nodes);
+            ASSERT_STREQ("", err);
+            for (int j = 0; nodes[j]; j++)
+                delXMLEle(nodes[j]);
+            free(nodes);
+        }
+        ASSERT_EQ("|a:QUJD|c:|d:xy", sunk) << "chunk size " << n;
+    }
+
+    delLilXML(lp);
+}
+
+TEST(CORE_LILXML, Test_rawContent)
+{
+    /* rawlen content may hold markup, nuls and trailing whitespace */
+    static const char body[] = "<a>&amp;\0</oneBLOB> \n";
+    const int nbody          = sizeof(body) - 1;
+    std::string in = "<setBLOBVector device='x' name='y'>\n<oneBLOB name='y' size='9' rawlen='21' format='.z'>";
+    in.append(body, nbody);
+    in += "</oneBLOB>\n</setBLOBVector>\n<message device='x'/>\n";
+
+    LilXML *lp = newLilXML();
+    char err[1024];
+
+    setXMLRawTag(lp, "oneBLOB");
+
+    /* one char at a time */
+    int nroots = 0;
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        XMLEle *root = readXMLEle(lp, in[i], err);
+        ASSERT_STREQ("", err);
+        if (root && nroots++ == 0)
+        {
+            XMLEle *ep = nextXMLEle(root, 1);
+            ASSERT_EQ(nbody, pcdatalenXMLEle(ep));
+            ASSERT_EQ(0, memcmp(body, pcdataXMLEle(ep), nbody));
+        }
+        delXMLEle(root);
+    }
+    ASSERT_EQ(2, nroots);
+
+    /* in chunks, also through a sink */
+    std::string sunk;
+    for (int sink = 0; sink < 2; sink++)
+    {
+        setXMLPCDataSink(lp, "oneBLOB", sink ? collect : NULL, &sunk);
+        for (size_t n = 1; n <= in.size(); n++)
+        {
+            nroots = 0;
+            sunk.clear();
+            for (size_t i = 0; i < in.size(); i += n)
+            {
+                int size       = (int)std::min(n, in.size() - i);
+                XMLEle **nodes = parseXMLChunk(lp, (char *)in.data() + i, size, err);
+                ASSERT_TRUE(nodes);
+                ASSERT_STREQ("", err);
+                for (int j = 0; nodes[j]; j++)
+                {
+                    if (nroots++ == 0)
+                    {
+                        XMLEle *ep = nextXMLEle(nodes[j], 1);
+                        ASSERT_EQ(sink ? 0 : nbody, pcdatalenXMLEle(ep));
+                        ASSERT_EQ(0, memcmp(body, pcdataXMLEle(ep), sink ? 0 : nbody));
+                    }
+                    delXMLEle(nodes[j]);
+                }
+                free(nodes);
+            }
+            ASSERT_EQ(2, nroots) << "chunk size " << n;
+            ASSERT_EQ(sink ? std::string(body, nbody) : std::string(), sunk) << "chunk size " << n;
+        }
+    }
+
+    delLilXML(lp);
+}
+
+TEST(CORE_LILXML, Test_rawTagOnly)
+{
+    /* rawlen means nothing unless asked for, and then only on that tag */
+    static const char in[] = "<a rawlen='5'><b/>xyz</a>\n<oneBLOB rawlen='4'><b/></oneBLOB>\n";
+    LilXML *lp = newLilXML();
+    char err[1024];
+
+    for (int raw = 0; raw < 2; raw++)
+    {
+        setXMLRawTag(lp, raw ? "oneBLOB" : NULL);
+        XMLEle **nodes = parseXMLChunk(lp, (char *)in, sizeof(in) - 1, err);
+        ASSERT_TRUE(nodes);
+        ASSERT_STREQ("", err);
+        ASSERT_TRUE(nodes[0] && nodes[1] && !nodes[2]);
+
+        ASSERT_EQ(1, nXMLEle(nodes[0]));
+        ASSERT_STREQ("xyz", pcdataXMLEle(nodes[0]));
+        ASSERT_EQ(raw ? 0 : 1, nXMLEle(nodes[1]));
+        ASSERT_STREQ(raw ? "<b/>" : "", pcdataXMLEle(nodes[1]));
+
+        delXMLEle(nodes[0]);
+        delXMLEle(nodes[1]);
+        free(nodes);
+    }
+
+    delLilXML(lp);
+}
+
+TEST(CORE_LILXML, Test_editRaw)
+{
+    /* raw content may hold any bytes, a '\0' included */
+    static const char raw[] = { 'a', '\0', '<', '&', 'z' };
+    XMLEle *ep = addXMLEle(NULL, "oneBLOB");
+
+    editXMLEle(ep, "x&y");
+    editXMLEleRaw(ep, raw, sizeof(raw));
+    ASSERT_EQ((int)sizeof(raw), pcdatalenXMLEle(ep));
+    ASSERT_EQ(0, memcmp(raw, pcdataXMLEle(ep), sizeof(raw)));
+
+    editXMLEleRaw(ep, raw, 0);
+    ASSERT_EQ(0, pcdatalenXMLEle(ep));
+    ASSERT_STREQ("", pcdataXMLEle(ep));
+
+    delXMLEle(ep);
+}
+
+TEST(CORE_LILXML, Test_arena)
+{
+    LilXML *lp = newLilXML();
+    std::string expect;
+
+    expect = parseInChunks(lp, sizeof(msg));
+
+    /* trees in arenas must be just the same, however they are parsed */
+    setXMLArena(lp, 1);
+    for (int n = 1; n <= (int)sizeof(msg); n++)
+        ASSERT_EQ(expect, parseInChunks(lp, n)) << "chunk size " << n;
+
+    /* and can be edited as usual, large content included */
+    char err[1024];
+    XMLEle *root = NULL;
+    for (const char *p = msg; *p && !root; p++)
+        root = readXMLEle(lp, *p, err);
+    ASSERT_TRUE(root);
+
+    std::string big(100000, 'x');
+    XMLEle *ep = nextXMLEle(root, 1);
+    editXMLEle(ep, big.c_str());
+    rmXMLAtt(ep, "size");
+    addXMLAtt(ep, "enclen", "100000");
+    ASSERT_EQ(big, pcdataXMLEle(ep));
+    ASSERT_STREQ("", findXMLAttValu(ep, "size"));
+    ASSERT_STREQ("100000", findXMLAttValu(ep, "enclen"));
+
+    /* children are only unlinked, their memory goes with the root */
+    addXMLAtt(addXMLEle(root, "a"), "b", "c");
+    ASSERT_EQ(2, nXMLEle(root));
+    delXMLEle(ep);
+    ASSERT_EQ(1, nXMLEle(root));
+    ASSERT_STREQ("c", findXMLAttValu(findXMLEle(root, "a"), "b"));
+    delXMLEle(root);
+
+    delLilXML(lp);
+}
+
+TEST(CORE_LILXML, Test_arenaNearBig)
+{
+    /* content just under ARENABIG on a small tree needs a chunk larger than the next doubling */
+    LilXML *lp = newLilXML();
+    char err[1024];
+
+    setXMLArena(lp, 1);
+    for (int n = 8150; n <= 8200; n++)
+    {
+        XMLEle *root = NULL;
+        for (const char *p = msg; *p && !root; p++)
+            root = readXMLEle(lp, *p, err);
+        ASSERT_TRUE(root);
+
+        std::string pcdata(n, 'x');
+        XMLEle *ep = nextXMLEle(root, 1);
+        editXMLEle(ep, pcdata.c_str());
+        addXMLAtt(ep, "enclen", std::to_string(n).c_str());
+        ASSERT_EQ(pcdata, pcdataXMLEle(ep)) << "length " << n;
+        ASSERT_STREQ(std::to_string(n).c_str(), findXMLAttValu(ep, "enclen"));
+        delXMLEle(root);
+    }
+
+    delLilXML(lp);
+}
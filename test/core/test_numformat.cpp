@@ -0,0 +1,170 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "indidevapi.h"
+
+// the driver entry points, not called here
+void ISGetProperties(const char *) {}
+void ISNewSwitch(const char *, const char *, ISState *, char *[], int) {}
+void ISNewText(const char *, const char *, char *[], char *[], int) {}
+void ISNewNumber(const char *, const char *, double[], char *[], int) {}
+void ISNewBLOB(const char *, const char *, int[], int[], char *[], char *[], char *[], int) {}
+void ISSnoopDevice(XMLEle *) {}
+
+// IDSetNumber() formats the timeout with precision 6 and each value with 20,
+// the precisions the driver uses, without snprintf(). both must read exactly
+// as "%.*g" would.
+class NumFormatTest : public ::testing::Test
+{
+    protected:
+        void SetUp() override
+        {
+            fflush(stdout);
+            saved = dup(STDOUT_FILENO);
+            out   = tmpfile();
+            dup2(fileno(out), STDOUT_FILENO);
+
+            IUFillNumber(&n, "x", "x", "%g", 0, 0, 0, 0);
+            IUFillNumberVector(&nvp, &n, 1, "Dev", "N", "N", "Main", IP_RO, 0, IPS_OK);
+        }
+
+        void TearDown() override
+        {
+            fflush(stdout);
+            dup2(saved, STDOUT_FILENO);
+            close(saved);
+            fclose(out);
+        }
+
+        // send v as timeout and value, one message each
+        void send(double v)
+        {
+            nvp.timeout = v;
+            n.value     = v;
+            IDSetNumber(&nvp, nullptr);
+            sent.push_back(v);
+        }
+
+        static std::string g(int prec, double v)
+        {
+            char buf[64];
+
+            snprintf(buf, sizeof(buf), "%.*g", prec, v);
+            return buf;
+        }
+
+        // compare each message sent with snprintf
+        void check()
+        {
+            std::string all;
+            char buf[4096];
+            size_t nr, at = 0;
+
+            fflush(stdout);
+            rewind(out);
+            while ((nr = fread(buf, 1, sizeof(buf), out)) > 0)
+                all.append(buf, nr);
+
+            for (double v : sent)
+            {
+                size_t t = all.find("timeout='", at);
+                size_t o = all.find("<oneNumber", at);
+                ASSERT_NE(t, std::string::npos);
+                ASSERT_NE(o, std::string::npos);
+
+                t += 9;
+                EXPECT_EQ(all.substr(t, all.find('\'', t) - t), g(6, v)) << g(20, v);
+
+                o = all.find('\n', o) + 1;
+                o = all.find_first_not_of(' ', o);
+                EXPECT_EQ(all.substr(o, all.find('\n', o) - o), g(20, v)) << g(20, v);
+                at = o;
+            }
+        }
+
+        INumber n;
+        INumberVectorProperty nvp;
+        std::vector<double> sent;
+        FILE *out { nullptr };
+        int saved { -1 };
+};
+
+TEST_F(NumFormatTest, Test_zeros)
+{
+    send(0.0);
+    send(-0.0);
+    check();
+}
+
+TEST_F(NumFormatTest, Test_extremes)
+{
+    for (double v : { DBL_TRUE_MIN, DBL_MIN, DBL_MIN - DBL_TRUE_MIN, 1e-308, 1e-320, 1e308, 1e-307, DBL_MAX,
+                      (double)NAN, (double)INFINITY, 18446744073709551616.0, 18446744073709549568.0, 9007199254740993.0 })
+    {
+        send(v);
+        send(-v);
+    }
+    check();
+}
+
+TEST_F(NumFormatTest, Test_carries)
+{
+    // rounding up through all the nines at either precision, and ties
+    for (int k = -12; k <= 22; k++)
+    {
+        double p = pow(10, k);
+
+        for (double m : { 9.9999995, 9.99999949, 9.9999994999999, 9.999995, 9.5, 1.0000005, 1.00000049,
+                          9.9999999999999999995, 1.2345625, 1.2345635 })
+            send(m * p);
+        send(nextafter(p, 0));
+        send(nextafter(p, INFINITY));
+        send(p);
+    }
+    for (double v : { 0.5, 2.5, 0.125, 999999.5, 9999995.0, 0.00009999995, 0.0001, 0.00001, 123456.5, 1.0 / 3, 0.1,
+                      60.0 })
+        send(v);
+    check();
+}
+
+TEST_F(NumFormatTest, Test_random)
+{
+    std::mt19937_64 rng(20260917);
+
+    // any bits at all, then some over the range addNum() does itself
+    for (int i = 0; i < 5000; i++)
+    {
+        uint64_t bits = rng();
+        double v;
+
+        memcpy(&v, &bits, sizeof(v));
+        send(v);
+    }
+    for (int i = 0; i < 5000; i++)
+        send(std::ldexp((double)(rng() >> 11), (int)(rng() % 140) - 120));
+    check();
+}
@@ -0,0 +1,261 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "baseclient.h"
+#include "basedevice.h"
+
+// what newBLOB() was given
+struct Got
+{
+    std::string name;
+    std::string format;
+    int size;
+    std::string blob;
+};
+
+class ShmClient : public INDI::BaseClient
+{
+    public:
+        std::vector<Got> got;
+        std::mutex lock;
+        std::condition_variable cv;
+
+        bool waitBLOBs(size_t n)
+        {
+            std::unique_lock<std::mutex> l(lock);
+            return cv.wait_for(l, std::chrono::seconds(5), [&] { return got.size() >= n; });
+        }
+
+    protected:
+        void newDevice(INDI::BaseDevice *) override {}
+        void removeDevice(INDI::BaseDevice *) override {}
+        void newProperty(INDI::Property *) override {}
+        void removeProperty(INDI::Property *) override {}
+        void newSwitch(ISwitchVectorProperty *) override {}
+        void newNumber(INumberVectorProperty *) override {}
+        void newText(ITextVectorProperty *) override {}
+        void newLight(ILightVectorProperty *) override {}
+        void newMessage(INDI::BaseDevice *, int) override {}
+        void serverConnected() override {}
+        void serverDisconnected(int) override {}
+
+        void newBLOB(IBLOB *bp) override
+        {
+            std::lock_guard<std::mutex> l(lock);
+            got.push_back({ bp->name, bp->format, bp->size, std::string((char *)bp->blob, bp->bloblen) });
+            cv.notify_all();
+        }
+};
+
+// we play a local indiserver on its unix domain socket
+class ShmBLOBTest : public ::testing::Test
+{
+    protected:
+        std::string path;
+        int lsock { -1 };
+        int csock { -1 };
+
+        void SetUp() override
+        {
+            char dir[] = "/tmp/shmblobXXXXXX";
+            ASSERT_NE(mkdtemp(dir), nullptr);
+            path = std::string(dir) + "/indi.sock";
+
+            struct sockaddr_un sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sun_family = AF_UNIX;
+            strncpy(sa.sun_path, path.c_str(), sizeof(sa.sun_path) - 1);
+            lsock = socket(AF_UNIX, SOCK_STREAM, 0);
+            ASSERT_GE(lsock, 0);
+            ASSERT_EQ(bind(lsock, (struct sockaddr *)&sa, sizeof(sa)), 0);
+            ASSERT_EQ(listen(lsock, 1), 0);
+        }
+
+        void TearDown() override
+        {
+            if (csock >= 0)
+                close(csock);
+            close(lsock);
+            unlink(path.c_str());
+            rmdir(path.substr(0, path.rfind('/')).c_str());
+        }
+
+        // accept client and return its first message
+        std::string accept(ShmClient &client)
+        {
+            client.setServer(path.c_str(), 0);
+            EXPECT_TRUE(client.connectServer());
+            csock = ::accept(lsock, nullptr, nullptr);
+            EXPECT_GE(csock, 0);
+
+            std::string first;
+            char c;
+            while (first.find('>') == std::string::npos && read(csock, &c, 1) == 1)
+                first += c;
+            return first;
+        }
+
+        // hang up and wait for the client to notice so it may be deleted
+        void hangup(ShmClient &client)
+        {
+            close(csock);
+            csock = -1;
+            for (int i = 0; i < 500 && client.isServerConnected(); i++)
+                usleep(10000);
+        }
+
+        void send(const std::string &msg, const std::vector<int> &fds = {})
+        {
+            union
+            {
+                struct cmsghdr h;
+                char b[CMSG_SPACE(32 * sizeof(int))];
+            } cbuf;
+            struct msghdr mh;
+            struct iovec iov;
+
+            memset(&mh, 0, sizeof(mh));
+            iov.iov_base  = (void *)msg.data();
+            iov.iov_len   = msg.size();
+            mh.msg_iov    = &iov;
+            mh.msg_iovlen = 1;
+            if (!fds.empty())
+            {
+                mh.msg_control    = cbuf.b;
+                mh.msg_controllen = CMSG_SPACE(fds.size() * sizeof(int));
+                struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+                cm->cmsg_level     = SOL_SOCKET;
+                cm->cmsg_type      = SCM_RIGHTS;
+                cm->cmsg_len       = CMSG_LEN(fds.size() * sizeof(int));
+                memcpy(CMSG_DATA(cm), fds.data(), fds.size() * sizeof(int));
+            }
+            ASSERT_EQ(sendmsg(csock, &mh, 0), (ssize_t)msg.size());
+        }
+};
+
+static std::string bytes(int n, int seed)
+{
+    std::string s;
+
+    for (int i = 0; i < n; i++)
+        s += (char)((i * 31 + seed * 7) & 0xff);
+    return s;
+}
+
+// a sealed segment holding blob, as IDSetBLOB() makes them
+static int segment(const std::string &blob)
+{
+    int fd = memfd_create("indiblob", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(write(fd, blob.data(), blob.size()), (ssize_t)blob.size());
+    EXPECT_EQ(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL), 0);
+    return fd;
+}
+
+static const char defCCD[] = "<defBLOBVector device='Cam' name='CCD1' label='Image' group='Main' state='Idle' "
+                             "perm='ro' timeout='60'>\n"
+                             "  <defBLOB name='CCD1' label='Image'/>\n"
+                             "  <defBLOB name='CCD2' label='Guide'/>\n"
+                             "</defBLOBVector>\n";
+
+static std::string shmOneBLOB(const char *name, size_t len)
+{
+    return std::string("  <oneBLOB\n    name='") + name + "'\n    size='" + std::to_string(len) + "'\n    shmlen='" +
+           std::to_string(len) + "'\n    format='.fits'>\n  </oneBLOB>\n";
+}
+
+TEST_F(ShmBLOBTest, Test_frameThroughShm)
+{
+    ShmClient client;
+    client.setSHMBLOB(true);
+
+    std::string first = accept(client);
+    EXPECT_NE(first.find("binaryBLOB='1'"), std::string::npos) << first;
+    EXPECT_NE(first.find("shmBLOB='1'"), std::string::npos) << first;
+
+    // a frame large enough to matter, and a second one in the same message
+    const std::string frame = bytes(4 * 1024 * 1024 + 3, 1), guide = bytes(1000, 2);
+    int fds[2] = { segment(frame), segment(guide) };
+
+    send(defCCD);
+    send("<setBLOBVector device='Cam' name='CCD1' state='Ok' timeout='60' timestamp='2026-10-17T00:00:00'>\n" +
+         shmOneBLOB("CCD1", frame.size()) + shmOneBLOB("CCD2", guide.size()) + "</setBLOBVector>\n",
+         { fds[0], fds[1] });
+    close(fds[0]);
+    close(fds[1]);
+
+    ASSERT_TRUE(client.waitBLOBs(2));
+    EXPECT_EQ(client.got[0].name, "CCD1");
+    EXPECT_EQ(client.got[0].format, ".fits");
+    EXPECT_EQ(client.got[0].size, (int)frame.size());
+    EXPECT_TRUE(client.got[0].blob == frame);
+    EXPECT_EQ(client.got[1].name, "CCD2");
+    EXPECT_TRUE(client.got[1].blob == guide);
+
+    hangup(client);
+}
+
+TEST_F(ShmBLOBTest, Test_notAsked)
+{
+    ShmClient client;
+
+    std::string first = accept(client);
+    EXPECT_NE(first.find("binaryBLOB='1'"), std::string::npos) << first;
+    EXPECT_EQ(first.find("shmBLOB"), std::string::npos) << first;
+
+    hangup(client);
+}
+
+TEST_F(ShmBLOBTest, Test_segmentsLost)
+{
+    ShmClient client;
+    client.setSHMBLOB(true);
+    accept(client);
+
+    // more segments at once than the client takes: the rest would go to the wrong oneBLOBs
+    std::vector<int> fds;
+    std::string msg = "<setBLOBVector device='Cam' name='CCD1' state='Ok'>\n";
+    for (int i = 0; i < 20; i++)
+    {
+        fds.push_back(segment(bytes(10, i)));
+        msg += shmOneBLOB("CCD1", 10);
+    }
+    send(defCCD);
+    send(msg + "</setBLOBVector>\n", fds);
+    for (int fd : fds)
+        close(fd);
+
+    for (int i = 0; i < 500 && client.isServerConnected(); i++)
+        usleep(10000);
+    EXPECT_FALSE(client.isServerConnected());
+    EXPECT_TRUE(client.got.empty());
+}
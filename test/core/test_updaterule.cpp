@@ -0,0 +1,250 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+ .
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+ .
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+#include "libs/indibase/defaultdevice.h"
+#include "eventloop.h"
+
+// the driver entry points, not called here
+void ISGetProperties(const char *) {}
+void ISNewSwitch(const char *, const char *, ISState *, char *[], int) {}
+void ISNewText(const char *, const char *, char *[], char *[], int) {}
+void ISNewNumber(const char *, const char *, double[], char *[], int) {}
+void ISNewBLOB(const char *, const char *, int[], int[], char *[], char *[], char *[], int) {}
+void ISSnoopDevice(XMLEle *) {}
+
+class TestDevice : public INDI::DefaultDevice
+{
+    public:
+        TestDevice()
+        {
+            setDeviceName("Test Device");
+            IUFillNumber(&EqN[0], "RA", "RA", "%g", 0, 24, 0, 1.0);
+            IUFillNumber(&EqN[1], "DEC", "DEC", "%g", -90, 90, 0, 2.0);
+            IUFillNumberVector(&EqNP, EqN, 2, getDeviceName(), "EQ", "Eq", "Main", IP_RO, 60, IPS_OK);
+            IUFillSwitch(&TrackS[0], "ON", "On", ISS_ON);
+            IUFillSwitch(&TrackS[1], "OFF", "Off", ISS_OFF);
+            IUFillSwitchVector(&TrackSP, TrackS, 2, getDeviceName(), "TRACK", "Track", "Main", IP_RW, ISR_1OFMANY, 60,
+                               IPS_OK);
+        }
+
+        const char *getDefaultName() override
+        {
+            return "Test Device";
+        }
+
+        using INDI::DefaultDevice::UpdateStats;
+        using INDI::DefaultDevice::setUpdateRule;
+        using INDI::DefaultDevice::setUpdateEpsilon;
+        using INDI::DefaultDevice::removeUpdateRule;
+        using INDI::DefaultDevice::getUpdateStats;
+        using INDI::DefaultDevice::updateNumber;
+        using INDI::DefaultDevice::updateSwitch;
+
+        INumber EqN[2];
+        INumberVectorProperty EqNP;
+        ISwitch TrackS[2];
+        ISwitchVectorProperty TrackSP;
+};
+
+// our stdout into a file, count what was sent there
+class UpdateRuleTest : public ::testing::Test
+{
+    protected:
+        void SetUp() override
+        {
+            fflush(stdout);
+            saved = dup(STDOUT_FILENO);
+            out   = tmpfile();
+            dup2(fileno(out), STDOUT_FILENO);
+        }
+
+        void TearDown() override
+        {
+            fflush(stdout);
+            dup2(saved, STDOUT_FILENO);
+            close(saved);
+            fclose(out);
+        }
+
+        std::string sent()
+        {
+            std::string all;
+            char buf[4096];
+            size_t n;
+
+            fflush(stdout);
+            rewind(out);
+            while ((n = fread(buf, 1, sizeof(buf), out)) > 0)
+                all.append(buf, n);
+            return all;
+        }
+
+        int count(const char *what)
+        {
+            std::string all = sent();
+            int n = 0;
+
+            for (size_t at = all.find(what); at != std::string::npos; at = all.find(what, at + 1))
+                n++;
+            return n;
+        }
+
+        // run the event loop for ms
+        void runLoop(int ms)
+        {
+            int never = 0;
+            IEDeferLoop(ms, &never);
+        }
+
+        TestDevice device;
+        FILE *out { nullptr };
+        int saved { -1 };
+};
+
+TEST_F(UpdateRuleTest, Test_noRule)
+{
+    for (int i = 0; i < 5; i++)
+        device.updateNumber(&device.EqNP);
+
+    TestDevice::UpdateStats stats;
+    EXPECT_FALSE(device.getUpdateStats("EQ", stats));
+    EXPECT_EQ(count("<setNumberVector"), 5);
+}
+
+TEST_F(UpdateRuleTest, Test_unchanged)
+{
+    device.setUpdateRule("EQ", 0);
+
+    device.updateNumber(&device.EqNP);
+    device.updateNumber(&device.EqNP);
+    device.EqN[0].value = 1.5;
+    device.updateNumber(&device.EqNP);
+    device.updateNumber(&device.EqNP);
+
+    TestDevice::UpdateStats stats;
+    ASSERT_TRUE(device.getUpdateStats("EQ", stats));
+    EXPECT_EQ(stats.requested, 4u);
+    EXPECT_EQ(stats.sent, 2u);
+    EXPECT_EQ(stats.unchanged, 2u);
+    EXPECT_EQ(count("<setNumberVector"), 2);
+}
+
+TEST_F(UpdateRuleTest, Test_epsilon)
+{
+    device.setUpdateRule("EQ", 0, 0.01);
+    device.setUpdateEpsilon("EQ", "DEC", 1);
+
+    device.updateNumber(&device.EqNP);
+    // each change is measured from what was last sent, so small steps add up
+    device.EqN[0].value += 0.006;
+    device.updateNumber(&device.EqNP);
+    device.EqN[0].value += 0.006;
+    device.updateNumber(&device.EqNP);
+    device.EqN[1].value += 0.5;
+    device.updateNumber(&device.EqNP);
+    device.EqN[1].value += 0.5;
+    device.updateNumber(&device.EqNP);
+
+    TestDevice::UpdateStats stats;
+    ASSERT_TRUE(device.getUpdateStats("EQ", stats));
+    EXPECT_EQ(stats.requested, 5u);
+    EXPECT_EQ(stats.sent, 3u);
+    EXPECT_EQ(stats.unchanged, 2u);
+}
+
+TEST_F(UpdateRuleTest, Test_interval)
+{
+    device.setUpdateRule("EQ", 100);
+
+    device.updateNumber(&device.EqNP);
+    for (int i = 1; i <= 10; i++)
+    {
+        device.EqN[0].value = 1 + i;
+        device.updateNumber(&device.EqNP);
+    }
+    EXPECT_EQ(count("<setNumberVector"), 1);
+
+    // the burst goes as its latest value once the interval is over
+    runLoop(300);
+    EXPECT_EQ(count("<setNumberVector"), 2);
+    EXPECT_NE(sent().find("\n      11\n"), std::string::npos);
+
+    TestDevice::UpdateStats stats;
+    ASSERT_TRUE(device.getUpdateStats("EQ", stats));
+    EXPECT_EQ(stats.requested, 11u);
+    EXPECT_EQ(stats.sent, 2u);
+}
+
+TEST_F(UpdateRuleTest, Test_heldBackReverts)
+{
+    device.setUpdateRule("EQ", 100);
+
+    device.updateNumber(&device.EqNP);
+    device.EqN[0].value = 5;
+    device.updateNumber(&device.EqNP);
+    device.EqN[0].value = 1;
+    device.updateNumber(&device.EqNP);
+
+    // the client already has what is held back
+    runLoop(300);
+    EXPECT_EQ(count("<setNumberVector"), 1);
+}
+
+TEST_F(UpdateRuleTest, Test_stateFlushes)
+{
+    device.setUpdateRule("EQ", 10000);
+    device.setUpdateRule("TRACK", 10000);
+
+    device.updateNumber(&device.EqNP);
+    device.EqN[0].value = 3;
+    device.updateNumber(&device.EqNP);
+    device.EqNP.s = IPS_BUSY;
+    device.updateNumber(&device.EqNP);
+    device.EqNP.p = IP_RW;
+    device.updateNumber(&device.EqNP);
+    device.EqN[0].value = 4;
+    device.updateNumber(&device.EqNP, "with a message");
+    EXPECT_EQ(count("<setNumberVector"), 4);
+
+    device.updateSwitch(&device.TrackSP);
+    device.TrackS[0].s = ISS_OFF;
+    device.TrackS[1].s = ISS_ON;
+    device.updateSwitch(&device.TrackSP);
+    device.TrackSP.s = IPS_IDLE;
+    device.updateSwitch(&device.TrackSP);
+    EXPECT_EQ(count("<setSwitchVector"), 2);
+}
+
+TEST_F(UpdateRuleTest, Test_removeSendsHeld)
+{
+    device.setUpdateRule("EQ", 10000);
+
+    device.updateNumber(&device.EqNP);
+    device.EqN[0].value = 7;
+    device.updateNumber(&device.EqNP);
+    EXPECT_EQ(count("<setNumberVector"), 1);
+
+    device.removeUpdateRule("EQ");
+    EXPECT_EQ(count("<setNumberVector"), 2);
+    device.updateNumber(&device.EqNP);
+    EXPECT_EQ(count("<setNumberVector"), 3);
+}
@@ -0,0 +1,293 @@
+/* indiserver compressed links: one deflate stream each way over a socket.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/** \file zlink.c
+    \brief indiserver compressed links.
+
+   A ZL carries the traffic of one nonblocking socket through zlib: what is
+   sent is deflated into one stream that lasts as long as the link, so the
+   markup repeated from one message to the next costs next to nothing, and
+   what is read is inflated from the peer's stream.
+
+   sendZL() compresses all it is given at once, ends it with a sync flush so
+   the peer can act on every message without waiting for the next, and
+   writes what it can. The rest stays pending, and nothing more is taken
+   until it has all been written, so the caller may count whatever it gives
+   as sent and keeps its queue accounting as for a plain socket. Only its
+   write interest must also stay on while pendingZL().
+
+   readZL() reads and inflates like read(2). One read may inflate to more
+   than fits in the caller's buffer, so the caller must call it again while
+   moreZL(): there may be nothing more to read from the socket.
+
+   The output and input sides share nothing, so one thread may send while
+   another reads.
+*/
+
+#include "zlink.h"
+
+#include <zlib.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ZLOUTSIZ 16384 /* initial output buffer, grown as needed */
+#define ZLINSIZ  65536 /* input buffer, grown by feedZL() if need be */
+
+struct _ZL
+{
+    /* output */
+    z_stream zo;   /* deflate stream */
+    char *obuf;    /* malloced compressed bytes not yet written */
+    size_t ohead;  /* obuf[0..ohead) already written */
+    size_t olen;   /* bytes in obuf */
+    size_t omax;   /* n malloced in obuf */
+    int oerr;      /* errno of a write that failed after its bytes were taken */
+
+    /* input */
+    z_stream zi;   /* inflate stream */
+    char *ibuf;    /* malloced compressed bytes read, from zi.next_in on */
+    size_t imax;   /* n malloced in ibuf */
+    int imore;     /* 1 if the last inflate may not have given all it has */
+
+    ZLStats stats;
+};
+
+static void *zlAlloc(void *p, size_t n)
+{
+    p = realloc(p, n);
+    if (!p)
+    {
+        fprintf(stderr, "no memory for compressed link\n");
+        exit(1);
+    }
+    return (p);
+}
+
+/* return a new link, or NULL if zlib can not start its streams */
+ZL *newZL(void)
+{
+    ZL *zp = (ZL *)zlAlloc(NULL, sizeof(ZL));
+
+    memset(zp, 0, sizeof(ZL));
+    if (deflateInit(&zp->zo, Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        free(zp);
+        return (NULL);
+    }
+    if (inflateInit(&zp->zi) != Z_OK)
+    {
+        deflateEnd(&zp->zo);
+        free(zp);
+        return (NULL);
+    }
+    zp->omax = ZLOUTSIZ;
+    zp->obuf = (char *)zlAlloc(NULL, zp->omax);
+    zp->imax = ZLINSIZ;
+    zp->ibuf = (char *)zlAlloc(NULL, zp->imax);
+    return (zp);
+}
+
+/* delete a link no longer needed, the socket is left alone */
+void delZL(ZL *zp)
+{
+    if (!zp)
+        return;
+    deflateEnd(&zp->zo);
+    inflateEnd(&zp->zi);
+    free(zp->obuf);
+    free(zp->ibuf);
+    free(zp);
+}
+
+/* write what is pending to fd.
+ * return 0 if it all went or there was no room, else -1 with errno.
+ */
+static int flushZL(ZL *zp, int fd)
+{
+    while (zp->ohead < zp->olen)
+    {
+        ssize_t nw = write(fd, zp->obuf + zp->ohead, zp->olen - zp->ohead);
+
+        if (nw < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return (0);
+        if (nw < 0 && errno == EINTR)
+            continue;
+        if (nw <= 0)
+        {
+            if (nw == 0)
+                errno = EIO;
+            return (-1);
+        }
+        zp->ohead += nw;
+        zp->stats.written += nw;
+    }
+
+    zp->ohead = 0;
+    zp->olen  = 0;
+    return (0);
+}
+
+/* compress the niov iov[] and write as much as fd takes now, like writev(2).
+ * nothing is taken while bytes from before are pending, then we write those
+ * and fail with EAGAIN if they do not all go.
+ * return n bytes of iov[] taken, all of them or none, else -1 with errno.
+ * N.B. niov may be 0 just to write what is pending, we then return 0.
+ */
+ssize_t sendZL(ZL *zp, int fd, const struct iovec *iov, int niov)
+{
+    ssize_t total = 0;
+    int i;
+
+    /* a write that failed after its bytes were taken */
+    if (zp->oerr)
+    {
+        errno = zp->oerr;
+        return (-1);
+    }
+
+    if (flushZL(zp, fd) < 0)
+        return (-1);
+    if (zp->olen > 0)
+    {
+        errno = EAGAIN;
+        return (-1);
+    }
+
+    for (i = 0; i < niov; i++)
+    {
+        int flush = i == niov - 1 ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+
+        zp->zo.next_in  = (Bytef *)iov[i].iov_base;
+        zp->zo.avail_in = iov[i].iov_len;
+        do
+        {
+            if (zp->olen == zp->omax)
+            {
+                zp->omax *= 2;
+                zp->obuf = (char *)zlAlloc(zp->obuf, zp->omax);
+            }
+            zp->zo.next_out  = (Bytef *)zp->obuf + zp->olen;
+            zp->zo.avail_out = zp->omax - zp->olen;
+            if (deflate(&zp->zo, flush) == Z_STREAM_ERROR)
+            {
+                errno = EIO;
+                return (-1);
+            }
+            zp->olen = zp->omax - zp->zo.avail_out;
+        } while (zp->zo.avail_in > 0 || zp->zo.avail_out == 0);
+        total += iov[i].iov_len;
+    }
+    zp->stats.sent += total;
+
+    /* iov[] is ours now, so trouble writing shows next time */
+    if (flushZL(zp, fd) < 0)
+        zp->oerr = errno;
+
+    return (total);
+}
+
+/* queue n bytes to be written as they are, ahead of anything sent after */
+void putZL(ZL *zp, const char *buf, size_t n)
+{
+    if (zp->olen + n > zp->omax)
+    {
+        zp->omax = zp->olen + n + ZLOUTSIZ;
+        zp->obuf = (char *)zlAlloc(zp->obuf, zp->omax);
+    }
+    memcpy(zp->obuf + zp->olen, buf, n);
+    zp->olen += n;
+}
+
+/* return 1 if there are bytes waiting to be written, else 0 */
+int pendingZL(ZL *zp)
+{
+    return (zp->olen > zp->ohead || zp->oerr);
+}
+
+/* read up to n inflated bytes into buf like read(2), reading fd only if the
+ * stream has nothing more of what was read before. fails with EAGAIN if
+ * what was read inflated to nothing yet, with EPROTO if it is not a deflate
+ * stream.
+ */
+ssize_t readZL(ZL *zp, int fd, char *buf, size_t n)
+{
+    ssize_t nr;
+    int r;
+
+    if (!moreZL(zp))
+    {
+        nr = read(fd, zp->ibuf, zp->imax);
+        if (nr <= 0)
+            return (nr);
+        zp->zi.next_in  = (Bytef *)zp->ibuf;
+        zp->zi.avail_in = nr;
+        zp->stats.read += nr;
+    }
+
+    zp->zi.next_out  = (Bytef *)buf;
+    zp->zi.avail_out = n;
+    r                = inflate(&zp->zi, Z_SYNC_FLUSH);
+    if (r != Z_OK && r != Z_BUF_ERROR)
+    {
+        zp->imore = 0;
+        errno     = EPROTO;
+        return (-1);
+    }
+
+    nr        = n - zp->zi.avail_out;
+    zp->imore = zp->zi.avail_in > 0 || zp->zi.avail_out == 0;
+    zp->stats.got += nr;
+    if (nr == 0)
+    {
+        errno = EAGAIN;
+        return (-1);
+    }
+    return (nr);
+}
+
+/* take n compressed bytes read elsewhere as if readZL() had read them.
+ * N.B. only when !moreZL().
+ */
+void feedZL(ZL *zp, const char *buf, size_t n)
+{
+    if (n > zp->imax)
+    {
+        zp->imax = n;
+        zp->ibuf = (char *)zlAlloc(zp->ibuf, zp->imax);
+    }
+    memcpy(zp->ibuf, buf, n);
+    zp->zi.next_in  = (Bytef *)zp->ibuf;
+    zp->zi.avail_in = n;
+    zp->stats.read += n;
+    zp->imore = n > 0;
+}
+
+/* return 1 if readZL() may have more without reading, else 0 */
+int moreZL(ZL *zp)
+{
+    return (zp->imore);
+}
+
+/* fill *sp with the counters since the link was made */
+void statsZL(ZL *zp, ZLStats *sp)
+{
+    *sp = zp->stats;
+}
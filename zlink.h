@@ -0,0 +1,43 @@
+/* indiserver compressed links: one deflate stream each way over a socket.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* counters since the link was made */
+typedef struct
+{
+    unsigned long long sent;    /* bytes given to sendZL() */
+    unsigned long long written; /* compressed bytes written for them */
+    unsigned long long read;    /* compressed bytes read */
+    unsigned long long got;     /* bytes they inflated to */
+} ZLStats;
+
+typedef struct _ZL ZL;
+
+extern ZL *newZL(void);
+extern void delZL(ZL *zp);
+extern ssize_t sendZL(ZL *zp, int fd, const struct iovec *iov, int niov);
+extern void putZL(ZL *zp, const char *buf, size_t n);
+extern int pendingZL(ZL *zp);
+extern ssize_t readZL(ZL *zp, int fd, char *buf, size_t n);
+extern void feedZL(ZL *zp, const char *buf, size_t n);
+extern int moreZL(ZL *zp);
+extern void statsZL(ZL *zp, ZLStats *sp);